@@ -0,0 +1,22 @@
+#pragma once
+
+// Headless micro benchmarks, run from the command line before any window or GL context exists.
+// Each returns a process exit code.
+
+// BVH build, refit, reinsert and query timings against a brute-force scan at 10k, 100k and 1M objects
+int runBvhBenchmark();
+
+// Software occlusion rasterizer: every compiled kernel and thread count against the single-threaded scalar
+// reference, checking depth buffers and box test results match and timing both
+int runOcclusionBenchmark();
+
+// Job system: checks parallel for, nested parallel for and counters at several thread counts, then times
+// the cost of an empty job and parallel for scaling up to one thread per hardware thread
+int runJobBenchmark();
+
+// Radix sort of 100k draw keys against std::stable_sort, checking both give the same order
+int runDrawSortBenchmark();
+
+// Virtual texture paging driven by software feedback through the same page cache the renderer uses, checking every
+// sampled texel against its reference mip level and that each view converges to the wanted levels. Needs no GPU.
+int runVirtualTextureBenchmark();
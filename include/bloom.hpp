@@ -0,0 +1,44 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "renderGraph.hpp"
+#include "shader.hpp"
+
+// Bloom over a half resolution mip chain of the HDR target, built with compute shaders.
+// The chain is downsampled with a 13-tap filter read from shared memory, the first step thresholding
+// and Karis averaging the scene so lone bright texels do not flicker. It is then walked back up with
+// a tent filter, each level adding onto the one below. Only the part of each level covering the
+// dynamic resolution rectangle is processed. postprocess.frag mixes level 0 into the scene.
+struct Bloom
+{
+	static constexpr int MAX_LEVELS = 6;
+
+	Bloom();
+
+	// Chain texture for a target of this size, independent of the render scale so it is not reallocated
+	static RenderGraphTextureDesc chainDesc(int targetWidth, int targetHeight);
+
+	// renderWidth x renderHeight is the valid corner of hdrTexture
+	void render(GLuint hdrTexture, int renderWidth, int renderHeight, GLuint chainTexture, const RenderGraphTextureDesc& chain);
+
+	// Texture coordinate scale from the rendered rectangle to the valid part of chain level 0
+	glm::vec2 uvScale() const;
+	// Every level is added in on the way up, this brings the sum back to scene brightness
+	float normalization() const { return levels > 0 ? 1.0f / levels : 0.0f; }
+
+	Shader downsampleShader;
+	Shader upsampleShader;
+
+	bool enabled = true;
+	float threshold = 1.0f;
+	float knee = 0.5f; // Width of the soft transition below the threshold
+	float strength = 0.04f;
+	float filterRadius = 1.0f; // Upsample tent radius in texels
+
+private:
+	glm::ivec2 regions[MAX_LEVELS]; // Valid texels per level
+	glm::ivec2 sizes[MAX_LEVELS]; // Texture size per level
+	int levels = 0;
+};
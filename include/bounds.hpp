@@ -0,0 +1,163 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cfloat>
+
+struct AABB
+{
+	glm::vec3 min{ FLT_MAX };
+	glm::vec3 max{ -FLT_MAX };
+
+	bool valid() const { return min.x <= max.x && min.y <= max.y && min.z <= max.z; }
+	glm::vec3 center() const { return (min + max) * 0.5f; }
+	glm::vec3 extents() const { return (max - min) * 0.5f; }
+
+	void expand(const glm::vec3& point)
+	{
+		min = glm::min(min, point);
+		max = glm::max(max, point);
+	}
+
+	void expand(const AABB& other)
+	{
+		min = glm::min(min, other.min);
+		max = glm::max(max, other.max);
+	}
+
+	float surfaceArea() const
+	{
+		const glm::vec3 d = max - min;
+		return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+	}
+
+	bool contains(const AABB& other) const
+	{
+		return min.x <= other.min.x && min.y <= other.min.y && min.z <= other.min.z &&
+			max.x >= other.max.x && max.y >= other.max.y && max.z >= other.max.z;
+	}
+
+	bool overlaps(const AABB& other) const
+	{
+		return min.x <= other.max.x && max.x >= other.min.x &&
+			min.y <= other.max.y && max.y >= other.min.y &&
+			min.z <= other.max.z && max.z >= other.min.z;
+	}
+
+	// Bounds of the transformed box, from the transformed center and the absolute rotated extents
+	AABB transformed(const glm::mat4& m) const
+	{
+		const glm::vec3 c = glm::vec3(m * glm::vec4(center(), 1.0f));
+		const glm::vec3 e = extents();
+		const glm::vec3 r(
+			std::abs(m[0][0]) * e.x + std::abs(m[1][0]) * e.y + std::abs(m[2][0]) * e.z,
+			std::abs(m[0][1]) * e.x + std::abs(m[1][1]) * e.y + std::abs(m[2][1]) * e.z,
+			std::abs(m[0][2]) * e.x + std::abs(m[1][2]) * e.y + std::abs(m[2][2]) * e.z);
+		return { c - r, c + r };
+	}
+};
+
+inline AABB merge(const AABB& a, const AABB& b)
+{
+	return { glm::min(a.min, b.min), glm::max(a.max, b.max) };
+}
+
+struct Sphere
+{
+	glm::vec3 center{ 0.0f };
+	float radius = 0.0f;
+
+	bool overlaps(const AABB& box) const
+	{
+		const glm::vec3 closest = glm::clamp(center, box.min, box.max);
+		const glm::vec3 d = closest - center;
+		return glm::dot(d, d) <= radius * radius;
+	}
+};
+
+struct Ray
+{
+	glm::vec3 origin{ 0.0f };
+	glm::vec3 direction{ 0.0f, 0.0f, -1.0f };
+	glm::vec3 inverseDirection{ 0.0f, 0.0f, -1.0f };
+
+	Ray() = default;
+	Ray(const glm::vec3& origin, const glm::vec3& direction)
+		: origin(origin), direction(direction), inverseDirection(1.0f / direction)
+	{
+	}
+
+	// Slab test, tNear is where the ray enters the box (0 when it starts inside)
+	bool intersects(const AABB& box, float maxDistance, float& tNear) const
+	{
+		const glm::vec3 t0 = (box.min - origin) * inverseDirection;
+		const glm::vec3 t1 = (box.max - origin) * inverseDirection;
+		const glm::vec3 tMin = glm::min(t0, t1);
+		const glm::vec3 tMax = glm::max(t0, t1);
+
+		tNear = std::max(std::max(tMin.x, tMin.y), std::max(tMin.z, 0.0f));
+		const float tFar = std::min(std::min(tMax.x, tMax.y), std::min(tMax.z, maxDistance));
+		return tNear <= tFar;
+	}
+};
+
+// Six inward-facing planes (xyz = normal, w = distance) extracted from a view-projection matrix
+struct Frustum
+{
+	std::array<glm::vec4, 6> planes{};
+
+	static Frustum fromMatrix(const glm::mat4& viewProjection)
+	{
+		const glm::mat4 m = glm::transpose(viewProjection);
+
+		Frustum frustum;
+		frustum.planes[0] = m[3] + m[0]; // left
+		frustum.planes[1] = m[3] - m[0]; // right
+		frustum.planes[2] = m[3] + m[1]; // bottom
+		frustum.planes[3] = m[3] - m[1]; // top
+		frustum.planes[4] = m[3] + m[2]; // near
+		frustum.planes[5] = m[3] - m[2]; // far
+
+		for (glm::vec4& plane : frustum.planes)
+		{
+			plane /= glm::length(glm::vec3(plane));
+		}
+		return frustum;
+	}
+
+	// Conservative: a box outside no single plane counts as visible
+	bool overlaps(const AABB& box) const
+	{
+		const glm::vec3 center = box.center();
+		const glm::vec3 extents = box.extents();
+		for (const glm::vec4& plane : planes)
+		{
+			const glm::vec3 normal(plane);
+			const float radius = glm::dot(extents, glm::abs(normal));
+			if (glm::dot(normal, center) + plane.w < -radius)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// True when the box is inside every plane, so its whole subtree can be accepted without more tests
+	bool contains(const AABB& box) const
+	{
+		const glm::vec3 center = box.center();
+		const glm::vec3 extents = box.extents();
+		for (const glm::vec4& plane : planes)
+		{
+			const glm::vec3 normal(plane);
+			const float radius = glm::dot(extents, glm::abs(normal));
+			if (glm::dot(normal, center) + plane.w < radius)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+};
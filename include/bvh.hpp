@@ -0,0 +1,81 @@
+#pragma once
+
+#include "bounds.hpp"
+
+#include <cstdint>
+#include <vector>
+
+// Dynamic AABB tree over user items (scene entities).
+// Leaves keep their bounds grown by a margin so small moves need no update at all, bigger moves
+// reinsert the leaf using the SAH branch-and-bound sibling search. rebuild() restores quality with a
+// top-down binned SAH build. Leaf ids stay valid across move, refit and rebuild until removed.
+struct BVH
+{
+	static constexpr uint32_t NULL_NODE = UINT32_MAX;
+
+	struct Node
+	{
+		AABB bounds;
+		uint32_t parent = NULL_NODE;
+		uint32_t left = NULL_NODE;
+		uint32_t right = NULL_NODE;
+		uint32_t item = NULL_NODE;
+
+		bool isLeaf() const { return left == NULL_NODE; }
+	};
+
+	float margin = 0.1f;
+
+	// Replaces the tree, leaves[i] is the leaf id of items[i]
+	void build(const std::vector<uint32_t>& items, const std::vector<AABB>& bounds, std::vector<uint32_t>& leaves);
+	void rebuild();
+	void clear();
+
+	uint32_t insert(uint32_t item, const AABB& bounds);
+	void remove(uint32_t leaf);
+
+	// Reinserts the leaf only when the bounds escaped its fattened box, returns true if the tree changed
+	bool move(uint32_t leaf, const AABB& bounds);
+
+	// Overwrites leaf bounds without touching the structure, refit() the ancestors after a batch
+	void setLeafBounds(uint32_t leaf, const AABB& bounds);
+	void refit();
+
+	// Queries append the items of overlapping leaves
+	void queryFrustum(const Frustum& frustum, std::vector<uint32_t>& items) const;
+	// Only the part of the tree under the node, e.g. one of the subtrees from splitFrustum
+	void queryFrustum(const Frustum& frustum, uint32_t subtree, std::vector<uint32_t>& items) const;
+	void querySphere(const Sphere& sphere, std::vector<uint32_t>& items) const;
+	void queryBox(const AABB& box, std::vector<uint32_t>& items) const;
+	void queryRay(const Ray& ray, float maxDistance, std::vector<uint32_t>& items) const;
+
+	// Disjoint subtrees that together hold every leaf overlapping the frustum, at least minSubtrees of them
+	// unless the tree runs out of internal nodes first. Each one can then be queried on its own job.
+	void splitFrustum(const Frustum& frustum, size_t minSubtrees, std::vector<uint32_t>& subtrees) const;
+
+	// Nearest leaf box hit along the ray, NULL_NODE when nothing is hit
+	uint32_t raycast(const Ray& ray, float maxDistance, float& hitDistance) const;
+
+	const AABB& leafBounds(uint32_t leaf) const { return nodes[leaf].bounds; }
+	uint32_t leafItem(uint32_t leaf) const { return nodes[leaf].item; }
+	size_t size() const { return leafCount; }
+
+	// Sum of internal node areas relative to the root, lower is better
+	float sahCost() const;
+	int height() const;
+
+private:
+	uint32_t allocateNode();
+	void freeNode(uint32_t node);
+	void insertLeaf(uint32_t leaf);
+	void removeLeaf(uint32_t leaf);
+	void refitAncestors(uint32_t node);
+	void collectLeaves(uint32_t node, std::vector<uint32_t>& items) const;
+	uint32_t buildRange(uint32_t* leaves, uint32_t count);
+	AABB fatten(const AABB& bounds) const;
+
+	std::vector<Node> nodes;
+	uint32_t root = NULL_NODE;
+	uint32_t freeList = NULL_NODE;
+	size_t leafCount = 0;
+};
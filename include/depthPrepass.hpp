@@ -0,0 +1,71 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <array>
+#include <cstdint>
+
+#include "shader.hpp"
+
+// Optional depth-only pass in front of the main colour pass.
+// Depth is laid down with a position-only shader, the colour pass then tests GL_EQUAL without writing
+// depth, so the lighting shader runs once per visible pixel instead of once per fragment that passes GL_LESS.
+// Overdraw is measured with GL_SAMPLES_PASSED queries: with the pre-pass, its samples are what the colour
+// pass would have shaded without it and the colour samples are the visible ones. In automatic mode the
+// pre-pass stays on while that ratio is above a threshold and is re-probed periodically while off.
+struct DepthPrepass
+{
+	enum Mode { PREPASS_OFF, PREPASS_ON, PREPASS_AUTO };
+
+	static constexpr int QUERY_LATENCY = 4;
+	static constexpr int MAX_QUERIES = 8; // Begin/end pairs per pass and frame
+
+	DepthPrepass();
+	~DepthPrepass();
+
+	// Reads back measurements from earlier frames and decides whether this frame uses the pre-pass
+	void beginFrame(int pixelCount);
+
+	// Binds the depth shader and masks colour writes, the caller then submits the colour pass geometry
+	void beginDepth(const glm::mat4& view, const glm::mat4& projection);
+	void endDepth();
+
+	// Always brackets the colour draws, they are counted for the overdraw estimate even without the pre-pass
+	void beginColour();
+	void endColour();
+
+	Shader shader;
+	int mode = PREPASS_AUTO;
+	float enableOverdraw = 1.5f; // Auto mode turns the pre-pass on above this
+	float disableOverdraw = 1.2f; // and off again below this
+	int probeInterval = 240; // Frames between exact measurements while auto mode has it off
+	bool required = false; // Forces the pre-pass whatever the mode, when something needs depth before shading
+
+	bool active = false;
+	float overdraw = 0.0f; // Shaded fragments per visible fragment of the last measured frame
+	bool overdrawExact = false; // Estimated from an older visible count when measured without the pre-pass
+
+private:
+	struct QueryFrame
+	{
+		std::array<GLuint, MAX_QUERIES> depthQueries{};
+		std::array<GLuint, MAX_QUERIES> colourQueries{};
+		int depthCount = 0;
+		int colourCount = 0;
+		int pixelCount = 0;
+		bool prepass = false;
+		bool pending = false;
+	};
+
+	void collect(QueryFrame& frame);
+	static uint64_t sumQueries(const GLuint* queries, int count);
+
+	std::array<QueryFrame, QUERY_LATENCY> frames;
+	int current = 0;
+	int framesSinceProbe = 0;
+	uint64_t visibleSamples = 0; // From the last frame that ran the pre-pass
+	bool autoActive = true; // Starts on so the first frames measure exactly
+	bool depthQueryOpen = false;
+	bool colourQueryOpen = false;
+};
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <array>
+
+// Picks how much of the full-size HDR target the 3D scene is rendered into, from measured GPU frame time.
+// A GL_TIMESTAMP pair brackets each frame's GPU work and is read back QUERY_LATENCY frames later.
+// Shading cost is taken as proportional to pixel count, so the scale follows the square root of the
+// budget ratio: straight down on a spike, slowly back up while there is headroom.
+// The post-process pass upscales the rendered rectangle to the window.
+struct DynamicResolution
+{
+	static constexpr int QUERY_LATENCY = 4;
+
+	DynamicResolution();
+	~DynamicResolution();
+
+	// Reads back finished frame times, updates the scale and sizes the render rectangle for this frame
+	void beginFrame(int targetWidth, int targetHeight);
+	void endFrame();
+
+	// Fraction of the target's texture coordinates covered by the render rectangle
+	glm::vec2 uvScale() const;
+
+	bool enabled = true;
+	float targetMs = 16.6f;
+	float headroom = 0.9f; // Fraction of the budget the controller aims for
+	float minScale = 0.5f;
+	float maxScale = 1.0f;
+	float scaleStep = 0.05f; // Scale moves in steps so size dependent resources are not rebuilt every frame
+	float raiseRate = 0.05f; // Share of the gap closed per measurement when scaling back up
+
+	float scale = 1.0f;
+	float gpuMs = 0.0f; // Last measured GPU frame time
+	int renderWidth = 1;
+	int renderHeight = 1;
+
+private:
+	struct QueryFrame
+	{
+		GLuint begin = 0;
+		GLuint end = 0;
+		bool pending = false;
+	};
+
+	void collect(QueryFrame& frame);
+
+	std::array<QueryFrame, QUERY_LATENCY> frames;
+	int current = 0;
+	int targetWidth = 1;
+	int targetHeight = 1;
+	float desiredScale = 1.0f; // Unquantized controller output
+};
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <future>
+#include <string>
+#include <vector>
+
+struct IBLBaker;
+
+struct EnvironmentMap
+{
+	std::string name;
+	uint32_t cubemapTexture = 0;
+	uint32_t radianceMap = 0;
+
+	// Diffuse irradiance as 9 SH coefficients, ready to upload to blinnPhong.frag
+	std::array<glm::vec3, 9> irradianceSH{};
+
+	float maxMipLevel;
+	std::string basePath;
+	size_t gpuBytes = 0;
+};
+
+// Face order matches GL_TEXTURE_CUBE_MAP_POSITIVE_X + i
+static constexpr std::array<const char*, 6> cubemapFaceNames{ "px", "nx", "py", "ny", "pz", "nz" };
+
+// CPU-side cubemap in RGB16F, stored mip-major then face-major so each (mip, face) slice is contiguous
+struct CubemapData
+{
+	int faceSize = 0;
+	int mipCount = 0;
+	std::vector<uint16_t> texels;
+
+	static int mipSize(int faceSize, int mip) { return std::max(faceSize >> mip, 1); }
+	size_t sliceOffset(int mip, int face) const;
+	size_t sliceTexelCount(int mip) const;
+	bool empty() const { return texels.empty(); }
+};
+
+// Linear RGB float texels of an equirectangular HDR
+struct EquirectData
+{
+	int width = 0;
+	int height = 0;
+	std::vector<float> texels;
+
+	bool empty() const { return texels.empty(); }
+};
+
+// Decoded data of one environment, produced off the GL thread. An environment either ships a
+// single equirectangular environment.hdr that is baked on the GPU, or pre-split skybox/radiance
+// face directories. Whatever is missing (radiance mips, SH) is baked at upload and cached.
+struct EnvironmentData
+{
+	EquirectData equirect;
+	CubemapData skybox;
+	CubemapData radiance;
+
+	std::array<glm::vec3, 9> irradianceSH{};
+	bool hasIrradianceSH = false;
+};
+
+EnvironmentData loadEnvironmentData(const std::string& basePath);
+EnvironmentMap uploadEnvironmentMap(const std::string& name, const std::string& basePath, const EnvironmentData& data, const IBLBaker& baker);
+void releaseEnvironmentMap(EnvironmentMap& envMap);
+
+// Decodes the six faces of a cubemap directory in parallel or reads its cooked cache.
+// When withMips is set, prefiltered mips (px_1.hdr, px_2.hdr, ...) are kept; missing levels are box-filtered.
+CubemapData loadCubemapData(const std::string& directory, bool withMips);
+// withMipChain allocates and box filters the full chain beyond the levels in data
+uint32_t uploadCubemap(const CubemapData& data, bool withMipChain = false);
+CubemapData readbackCubemap(uint32_t texture, int faceSize, int mipCount);
+
+// Cooked cache: a small header followed by the raw half-float mip chain
+bool readCubemapCache(const std::string& path, CubemapData& data);
+bool writeCubemapCache(const std::string& path, const CubemapData& data);
+bool readIrradianceCache(const std::string& path, std::array<glm::vec3, 9>& coefficients);
+bool writeIrradianceCache(const std::string& path, const std::array<glm::vec3, 9>& coefficients);
+
+// Environments are registered by name and path up front but only decoded when first selected.
+// The previous map stays on screen until the new one is uploaded, and resident maps are
+// evicted least-recently-used once they exceed the VRAM budget.
+struct EnvironmentLibrary
+{
+	enum class State
+	{
+		Unloaded,
+		Loading,
+		Resident
+	};
+
+	struct Entry
+	{
+		std::string name;
+		std::string basePath;
+		State state = State::Unloaded;
+		EnvironmentMap map{};
+		std::future<EnvironmentData> pending;
+		size_t gpuBytes = 0;
+		uint64_t lastUsedFrame = 0;
+	};
+
+	std::vector<Entry> entries;
+	size_t budgetBytes = 512ull * 1024 * 1024;
+	const IBLBaker* baker = nullptr;
+
+	void registerEnvironment(const std::string& name, const std::string& basePath);
+	void select(int index);
+
+	// Call once per frame on the GL thread, uploads finished loads and applies the budget
+	void update();
+
+	// Map to render with, nullptr until the first selection has finished loading
+	const EnvironmentMap* active() const;
+	int selectedIndex() const { return selected; }
+	bool isLoading() const;
+	size_t residentBytes() const;
+
+private:
+	void evict();
+
+	int selected = -1;
+	int displayed = -1;
+	uint64_t frame = 0;
+};
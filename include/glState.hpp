@@ -0,0 +1,76 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <array>
+#include <cstdint>
+
+// Shadow copy of the GL state the renderer changes while drawing, so calls that would not change anything
+// never reach the driver. Each setter returns whether it issued the GL call.
+// Only correct while frame code changes this state through the cache: resources are created with direct
+// state access so setup never disturbs a binding, and code that has to go around the cache calls
+// invalidate() afterwards, which makes every tracked value unknown until it is next set.
+struct GLStateCache
+{
+	static constexpr int TEXTURE_UNITS = 32; // Units above this are never cached
+
+	GLStateCache() { invalidate(); }
+
+	void invalidate();
+
+	bool useProgram(GLuint program);
+	bool bindVertexArray(GLuint vao);
+	// glBindTextureUnit, so the active texture unit is never touched
+	bool bindTexture(GLuint unit, GLuint texture);
+	// GL_FRAMEBUFFER sets both the draw and read binding
+	bool bindFramebuffer(GLenum target, GLuint framebuffer);
+	// The only buffer binding draws depend on, others are bound with glBindBufferBase at dispatch
+	bool bindDrawIndirectBuffer(GLuint buffer);
+
+	// GL_DEPTH_TEST, GL_CULL_FACE and GL_BLEND are cached, other capabilities are always issued
+	bool setEnabled(GLenum capability, bool enabled);
+	bool depthFunc(GLenum func);
+	bool depthMask(bool write);
+	bool colorMask(bool write);
+	bool cullFace(GLenum face);
+	bool polygonMode(GLenum mode);
+
+	// GL drops the bindings of deleted objects, so every delete of something the cache tracks goes through these
+	void deleteTextures(GLsizei count, const GLuint* ids);
+	void deleteVertexArrays(GLsizei count, const GLuint* ids);
+	void deleteFramebuffers(GLsizei count, const GLuint* ids);
+	void deleteBuffers(GLsizei count, const GLuint* ids);
+	void deleteProgram(GLuint id);
+
+	uint64_t skippedCalls = 0; // Since startup, per-pass counts are in RenderStats
+
+private:
+	static constexpr GLuint UNKNOWN = UINT32_MAX;
+
+	enum Capability
+	{
+		DEPTH_TEST,
+		CULL_FACE,
+		BLEND,
+		CAPABILITY_COUNT
+	};
+
+	bool skip();
+
+	// Set by invalidate()
+	GLuint program;
+	GLuint vertexArray;
+	std::array<GLuint, TEXTURE_UNITS> textures;
+	GLuint drawFramebuffer;
+	GLuint readFramebuffer;
+	GLuint drawIndirectBuffer;
+
+	std::array<int, CAPABILITY_COUNT> capabilities; // -1 unknown, 0 disabled, 1 enabled
+	GLenum depthFunction;
+	int depthWrite;
+	int colorWrite;
+	GLenum culledFace;
+	GLenum fillMode;
+};
+
+extern GLStateCache glState;
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct Mesh;
+struct Model;
+
+// A whole file mapped read-only, its pages are only read in as they are touched
+struct MappedFile
+{
+	MappedFile() = default;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	~MappedFile();
+
+	bool open(const std::string& path);
+	void close();
+
+	const uint8_t* data = nullptr;
+	size_t size = 0;
+
+private:
+#ifdef _WIN32
+	void* file = nullptr;
+	void* mapping = nullptr;
+#endif
+};
+
+// One of a glTF primitive's attributes at locations 0-4, as Vertex orders them
+struct GltfAttribute
+{
+	int view = -1; // Index into GltfImport::views, -1 when it is in the primitive's converted bytes
+	size_t offset = 0; // Into the view or the converted bytes
+	GLsizei stride = 0;
+	GLint size = 0; // Components, 0 when the file has nothing for it
+	GLenum type = GL_FLOAT;
+	GLboolean normalized = GL_FALSE;
+};
+
+struct GltfPrimitive
+{
+	std::array<GltfAttribute, 5> attributes;
+	std::vector<uint8_t> converted; // Attributes GL cannot read as the file stores them, tightly packed
+	const uint32_t* indices = nullptr; // Into the mapping, or into convertedIndices
+	std::vector<uint32_t> convertedIndices;
+};
+
+// What LoadGltf leaves for Model::uploadStep: the mapped files, the buffer views the attributes read in place,
+// and per mesh where each attribute is. Dropping it unmaps the files.
+struct GltfImport
+{
+	struct View
+	{
+		const uint8_t* data;
+		size_t size;
+	};
+
+	std::vector<std::unique_ptr<MappedFile>> files;
+	std::vector<View> views;
+	std::vector<GltfPrimitive> primitives; // Parallel to Model::meshes
+};
+
+// Whether the path has a .gltf or .glb extension
+bool IsGltfFile(const std::string& path);
+
+// Reads a glTF 2.0 or GLB file without Assimp or any GL calls. The JSON is parsed in place and the binary
+// buffers are mapped rather than read, positions, normals, UVs and tangents are then uploaded straight from
+// the mapping by UploadGltfMesh. Only what GL cannot draw as stored is converted: 8 and 16 bit indices, the
+// bitangents, and normals or tangents the file leaves out.
+// Returns false with the model untouched for files it leaves to Assimp: required extensions, sparse
+// accessors, non triangle primitives, buffers embedded as data URIs, and images embedded in any way.
+bool LoadGltf(const std::string& path, Model& model);
+
+// Uploads the shared buffer views on the first call, then the mesh's converted attributes and indices,
+// and sets up its vertex array. Returns the bytes sent to GL.
+size_t UploadGltfMesh(Model& model, size_t meshIndex, GLuint instanceVBO);
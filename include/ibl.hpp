@@ -0,0 +1,44 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <array>
+#include <string>
+
+#include "shader.hpp"
+
+struct EquirectData;
+
+// Bakes everything image based lighting needs on the GPU with compute shaders:
+// the skybox cubemap from an equirectangular HDR, GGX-prefiltered radiance mips,
+// 9-coefficient SH irradiance and the split-sum BRDF LUT.
+struct IBLBaker
+{
+	IBLBaker();
+
+	// Returns an RGBA16F cubemap with a full (box filtered) mip chain so it can feed prefiltering
+	uint32_t equirectToCubemap(const EquirectData& equirect, int faceSize) const;
+
+	// Mip i is prefiltered for roughness i / (mipCount - 1)
+	uint32_t prefilterRadiance(uint32_t environment, int environmentSize, int faceSize, int mipCount) const;
+
+	// Coefficients are convolved with the cosine lobe and premultiplied by the basis constants,
+	// so blinnPhong.frag reconstructs irradiance / PI with a handful of MADs
+	std::array<glm::vec3, 9> projectIrradianceSH(uint32_t environment, int environmentSize) const;
+
+	// RG16F split-sum LUT, x = NdotV and y = roughness
+	uint32_t bakeBRDFLUT(int size) const;
+
+	Shader equirectToCubeShader;
+	Shader prefilterShader;
+	Shader shProjectionShader;
+	Shader brdfShader;
+};
+
+// Loads the BRDF LUT from its cooked cache or bakes and caches it
+uint32_t loadBRDFLUT(const IBLBaker& baker, const std::string& cachePath);
+
+constexpr int PREFILTER_FACE_SIZE = 256;
+constexpr int PREFILTER_MIP_COUNT = 6;
+constexpr int BRDF_LUT_SIZE = 256;
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Number of jobs still outstanding, JobSystem::wait returns once it reaches zero
+struct JobCounter
+{
+	std::atomic<int> pending{ 0 };
+
+	bool done() const { return pending.load(std::memory_order_acquire) == 0; }
+};
+
+// Work-stealing job scheduler.
+// Each worker owns a deque, pushing and popping its own jobs at the back while idle workers steal from
+// the front of the others, so recently spawned (cache-warm) work stays local and old, large work moves.
+// The thread that calls init() is worker 0 and runs jobs while it waits on a counter instead of blocking.
+// Jobs must not touch GL: work that needs the context is queued with runOnMainThread and runs when the
+// GL thread calls pumpMainThread.
+struct JobSystem
+{
+	using Job = std::function<void()>;
+
+	JobSystem() = default;
+	~JobSystem();
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	// threadCount 0 picks one per hardware thread, counting the calling thread. Without init jobs run inline.
+	void init(int threadCount = 0);
+	void shutdown();
+
+	void run(JobCounter& counter, Job job);
+	// Runs queued jobs on the calling thread until the counter reaches zero
+	void wait(JobCounter& counter);
+
+	// Calls body(chunkBegin, chunkEnd) over [begin, end) in chunks of at most grainSize, returns when all are done
+	template<typename Body>
+	void parallelFor(size_t begin, size_t end, size_t grainSize, Body&& body);
+
+	// Runs during the next pumpMainThread, e.g. uploading what a job decoded
+	void runOnMainThread(Job job);
+	void pumpMainThread();
+	bool isMainThread() const { return std::this_thread::get_id() == mainThread; }
+
+	int threadCount() const { return std::max(static_cast<int>(workers.size()), 1); }
+
+private:
+	struct Task
+	{
+		Job job;
+		JobCounter* counter;
+	};
+
+	struct Worker
+	{
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	bool popOwn(int worker, Task& task);
+	bool steal(int thief, Task& task);
+	bool runOne(int worker);
+	void execute(Task& task);
+	void workerLoop(int worker);
+	int currentWorker() const;
+
+	std::vector<std::unique_ptr<Worker>> workers;
+	std::vector<std::jthread> threads;
+	std::thread::id mainThread = std::this_thread::get_id();
+
+	std::atomic<int> queued{ 0 };
+	std::atomic<bool> stopping{ false };
+	std::atomic<uint32_t> nextForeignWorker{ 0 };
+	std::mutex sleepMutex;
+	std::condition_variable wake;
+
+	std::mutex mainThreadMutex;
+	std::vector<Job> mainThreadJobs;
+};
+
+template<typename Body>
+void JobSystem::parallelFor(size_t begin, size_t end, size_t grainSize, Body&& body)
+{
+	if (begin >= end)
+	{
+		return;
+	}
+
+	grainSize = std::max(grainSize, size_t(1));
+	if (workers.size() <= 1 || end - begin <= grainSize)
+	{
+		body(begin, end);
+		return;
+	}
+
+	// The calling thread takes the first chunk itself rather than queueing it
+	JobCounter counter;
+	for (size_t chunk = begin + grainSize; chunk < end; chunk += grainSize)
+	{
+		const size_t chunkEnd = std::min(chunk + grainSize, end);
+		run(counter, [&body, chunk, chunkEnd]() { body(chunk, chunkEnd); });
+	}
+	body(begin, std::min(begin + grainSize, end));
+	wait(counter);
+}
+
+extern JobSystem jobSystem;
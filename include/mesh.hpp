@@ -1,9 +1,11 @@
 #pragma once
 
+#include <array>
 #include <vector>
 #include <string>
 #include <glm/glm.hpp>
 
+#include "bounds.hpp"
 #include "shader.hpp"
 
 struct Vertex 
@@ -29,6 +31,36 @@ struct Texture
 	uint32_t id;
 	TextureType type;
 	std::string path;
+	size_t gpuBytes = 0; // Storage with the full mip chain, only set on a model's textures_loaded
+	int virtualId = -1; // Set when id is the indirection texture of a virtual texture, see VirtualTextureSystem
+};
+
+// Per-instance attributes, world at locations 5-8 and previousWorld at 9-12
+struct InstanceData
+{
+	glm::mat4 world;
+	glm::mat4 previousWorld; // Last frame's, for motion vectors
+};
+
+// Where one of the vertex attributes at locations 0-4 is read from when they are not interleaved Vertex structs
+struct VertexStream
+{
+	GLuint buffer = 0;
+	GLintptr offset = 0;
+	GLsizei stride = 0;
+	GLint size = 0; // Components, 0 leaves the attribute disabled so it reads as zero
+	GLenum type = GL_FLOAT;
+	GLboolean normalized = GL_FALSE;
+};
+
+// Layout glDrawElementsIndirect reads from the bound GL_DRAW_INDIRECT_BUFFER
+struct DrawElementsIndirectCommand
+{
+	uint32_t count;
+	uint32_t instanceCount;
+	uint32_t firstIndex;
+	int32_t baseVertex;
+	uint32_t baseInstance;
 };
 
 struct Mesh
@@ -41,13 +73,34 @@ struct Mesh
 	Mesh(const Mesh& other); // Copy constructor
 	Mesh& operator=(const Mesh& other); // Copy assignment operator
 
-	void DrawInstanced(Shader &shader, int instanceCount) const;
+	// Instance attributes start at baseInstance in the model's instance buffer
+	void DrawInstanced(Shader &shader, int instanceCount, uint32_t baseInstance = 0) const;
+	void bindTextures(Shader& shader) const;
+	// Once the texture ids are final, meshes with the same set of maps get the same material id
+	void assignMaterial();
 	void setupMesh(GLuint instanceVBO);
+	// Per attribute buffers instead of the vertices array, EBO must already hold the indices
+	void setupMesh(GLuint instanceVBO, const std::array<VertexStream, 5>& streams);
+	void setupInstanceAttributes(GLuint instanceVBO);
 	void cleanup();
+	// Frees the CPU copy of the geometry, the GL buffers and counts stay
+	void releaseGeometry();
+
+	// Vertex and index buffer bytes
+	size_t gpuBytes() const;
+	// Bytes held by the vertices and indices arrays
+	size_t cpuBytes() const;
 
 	std::vector<Vertex> vertices;
 	std::vector<uint32_t> indices;
 	std::vector<Texture> textures;
+	AABB bounds; // Object space
+	uint32_t materialId = 0;
+	uint32_t textureMask = 0; // Bit per TextureType present
+	uint32_t vertexCount = 0; // Still valid after releaseGeometry()
+	uint32_t indexCount = 0;
+	uint32_t vertexStride = sizeof(Vertex); // Bytes per vertex in VBO, only the converted attributes for streamed meshes
+	float uvDensity = 0.0f; // UV units per object space unit, from UV area over surface area
 
 	uint32_t VAO{ 0 }, VBO{ 0 }, EBO{0};
 };
\ No newline at end of file
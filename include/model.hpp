@@ -1,17 +1,36 @@
 #pragma once
 #include <assimp/scene.h>
 
+#include <cstdint>
+#include <memory>
 #include <unordered_map>
 
+#include "bounds.hpp"
+#include "gltfLoader.hpp"
 #include "mesh.hpp"
 #include "shader.hpp"
 
+// Pixels of a texture file, decoded off the GL thread and uploaded on it
+struct DecodedTexture
+{
+	uint8_t* data = nullptr;
+	int width = 0;
+	int height = 0;
+	int channels = 0;
+};
+
+DecodedTexture DecodeTextureFile(const std::string& path, const std::string& directory);
+// Pixel format and sized internal format for a decoded image with this many channels
+void ChooseTextureFormat(TextureType type, int channels, GLenum& format, GLenum& internalFormat);
+// Creates the GL texture and frees the decoded pixels
+uint32_t UploadTexture(DecodedTexture& decoded, TextureType type);
 uint32_t TextureFromFile(const std::string& path, const std::string& directory, TextureType type);
 
 struct Model
 {
-	// Constructor, expects a filepath to a 3D model and takes optional gamma correction
-	explicit Model(const std::string& path, bool gamma = false, const std::string& modelName = "Model");
+	// Constructor, expects a filepath to a 3D model and takes optional gamma correction.
+	// Without upload it makes no GL calls and can run off the GL thread, uploadStep then finishes the model on it.
+	explicit Model(const std::string& path, bool gamma = false, const std::string& modelName = "Model", bool upload = true);
 	Model(Model&& other) noexcept;
 	Model& operator=(Model&& other) noexcept;
 	Model(const Model& other);
@@ -21,10 +40,30 @@ struct Model
 	// draws the model, and thus all its meshes
 	void Draw(Shader& shader, size_t instanceCount) const;
 
+	// Reads the file and decodes its textures, the GL side is left to uploadStep
 	void loadModel(std::string_view path);
-	void processNode(aiNode* node, const aiScene* scene);
-	Mesh processMesh(aiMesh* mesh, const aiScene* scene);
+	// Lists the meshes under the node depth first, the order they end up in meshes
+	void processNode(const aiNode* node, const aiScene* scene, std::vector<const aiMesh*>& order);
+	// Geometry only and no model state, so meshes are converted in parallel on the job system
+	static Mesh processMesh(const aiMesh* mesh);
+	// Registers the material's maps in textures_loaded, called in mesh order so the result is deterministic
+	std::vector<Texture> processMaterial(aiMaterial* material);
 	std::vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, TextureType typeName);
+	// Decodes every texture the materials referenced on the job system into decodedTextures
+	void decodeTextures();
+	// Uploads textures, then mesh buffers, one at a time until budgetBytes is used up, taking what each one
+	// sends to GL off it. The last one may overshoot. Returns true once the model can be drawn.
+	bool uploadStep(size_t& budgetBytes);
+
+	// Deletes the textures, instance buffer and mesh buffers. Texture ids are not reference counted,
+	// so this is left to whoever owns the model rather than the destructor.
+	void release();
+	// Frees every mesh's CPU geometry, which software occlusion then has to do without
+	void releaseGeometry();
+	// Meshes and textures, the instance buffer is sized by the frame's render lists and not included.
+	// Streamed textures are counted by the TextureStreamer.
+	size_t gpuBytes() const;
+	size_t cpuBytes() const;
 
 	// Global modal properties
 	std::string name;
@@ -34,9 +73,20 @@ struct Model
 	bool gammaCorrection = false;
 	bool hasTextures = false;
 	bool visible = true;
+	AABB bounds; // Object space, over all mesh vertices
 
 	GLuint instanceVBO = 0;
 
+	// uploadStep progress, decoded pixels wait here until their texture is uploaded
+	std::vector<DecodedTexture> decodedTextures;
+	size_t uploadedTextures = 0;
+	size_t uploadedMeshes = 0;
+
+	// glTF files LoadGltf read: the mapped buffers until every mesh is uploaded, then the views the meshes read
+	std::unique_ptr<GltfImport> gltf;
+	std::vector<GLuint> viewBuffers;
+	size_t viewBufferBytes = 0;
+
 	// Static member initialization for model name counting
 	static std::unordered_map<std::string, int> modelNameCount;
 };
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "mesh.hpp"
+
+struct Model;
+struct Scene;
+
+// Loaded models by folder name, shared by every entity that uses them through the scene's registry.
+// Models stay loaded after their last entity is removed so adding them again is free, until the
+// resident models exceed the VRAM budget: then models without entities are evicted least-recently-drawn first.
+struct ModelLibrary
+{
+	static constexpr uint32_t NOT_RESIDENT = UINT32_MAX;
+
+	struct Entry
+	{
+		std::shared_ptr<Model> model;
+		uint32_t modelId = 0; // In the scene's registry
+		size_t gpuBytes = 0;
+		size_t cpuBytes = 0;
+		uint64_t lastDrawnFrame = 0;
+		int pins = 0; // Never evicted while pinned, even without entities
+	};
+
+	std::unordered_map<std::string, Entry> entries;
+	size_t budgetBytes = 1024ull * 1024 * 1024;
+	bool releaseGeometry = false; // Free CPU geometry once uploaded, software occlusion then skips these models
+
+	// Model id of the folder's model, loaded and registered with the scene on a miss
+	uint32_t acquire(Scene& scene, const std::string& folder, const std::string& path);
+	// Registers a model loaded elsewhere under the folder's name, e.g. one the WorldStreamer uploaded
+	uint32_t adopt(Scene& scene, const std::string& folder, std::shared_ptr<Model> model);
+	// Model id of the folder's model, NOT_RESIDENT when it is not loaded
+	uint32_t find(const std::string& folder) const;
+	// Keeps a resident model from eviction until the matching unpin, e.g. while its entities wait on other models
+	void pin(const std::string& folder);
+	void unpin(const std::string& folder);
+
+	// Call once per frame on the GL thread while no job reads the scene's registry.
+	// Models with instances in the last frame's camera lists count as drawn, then the budget is applied.
+	void update(Scene& scene, const std::vector<std::vector<InstanceData>>& instancesPerModel);
+
+	// Frees the CPU geometry of every resident model, for turning releaseGeometry on later
+	void releaseAllGeometry();
+
+	size_t residentBytes() const;
+	size_t residentCPUBytes() const;
+
+private:
+	void evict(Scene& scene);
+
+	uint64_t frame = 0;
+};
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <memory>
+#include <vector>
+
+#include "mesh.hpp"
+#include "renderQueue.hpp"
+
+struct Model;
+
+// GPU occlusion culling of (instance, mesh) pairs against a hierarchical-Z pyramid.
+// Phase 0 tests every candidate against the pyramid built from the previous frame's depth and draws the
+// survivors. The pyramid is then rebuilt from that depth and phase 1 retests only the rejected pairs,
+// so objects that became visible this frame are drawn late instead of popping in a frame later.
+// Survivors are compacted into each model's instance buffer and drawn with glDrawElementsIndirect.
+struct OcclusionCuller
+{
+	OcclusionCuller();
+	~OcclusionCuller();
+
+	// Uploads the frustum-culled candidates, instancesPerModel is indexed by model id like models
+	void prepare(const std::vector<std::vector<InstanceData>>& instancesPerModel, const std::vector<std::shared_ptr<Model>>& models);
+
+	// Tests against the current pyramid, which remembers the view projection it was built with
+	void cull(int phase);
+	// Queues every mesh's indirect draw, phase 0 as RenderPassId::Opaque and phase 1 as OpaqueLate.
+	// Submit each after its cull, depthPerModel is indexed by model id.
+	void enqueue(RenderQueue& queue, const std::vector<std::shared_ptr<Model>>& models, const std::vector<float>& depthPerModel) const;
+
+	// Max-reduces the width x height corner of the depth texture into the pyramid, reallocating it when the size changed
+	void buildPyramid(uint32_t depthTexture, int width, int height, const glm::mat4& viewProjection);
+
+	// The next cull treats everything as visible, e.g. after a camera cut
+	void invalidate() { pyramidValid = false; }
+
+	Shader downsampleShader;
+	Shader cullShader;
+
+	uint32_t pyramidTexture = 0;
+	int pyramidWidth = 0;
+	int pyramidHeight = 0;
+	int pyramidLevels = 0;
+
+private:
+	// One per (model, mesh), matches the std430 layout in occlusionCull.comp
+	struct DrawInfo
+	{
+		uint32_t outputOffset; // First phase 0 instance in the output buffer, phase 1 follows after capacity
+		uint32_t capacity;
+		uint32_t meshBounds;
+		uint32_t padding;
+	};
+
+	// Where a model's instances and commands live this frame
+	struct ModelRange
+	{
+		uint32_t modelId;
+		GLuint instanceVBO;
+		uint32_t outputOffset;
+		uint32_t outputCount;
+		uint32_t firstCommand;
+	};
+
+	void growBuffer(GLuint buffer, size_t& capacity, size_t bytes);
+
+	GLuint instanceBuffer = 0;
+	GLuint meshBoundsBuffer = 0;
+	GLuint itemBuffer = 0;
+	GLuint drawInfoBuffer = 0;
+	GLuint visibilityBuffer = 0;
+	GLuint commandBuffer = 0;
+	GLuint outputBuffer = 0;
+
+	size_t instanceCapacity = 0;
+	size_t meshBoundsCapacity = 0;
+	size_t itemCapacity = 0;
+	size_t drawInfoCapacity = 0;
+	size_t visibilityCapacity = 0;
+	size_t commandCapacity = 0;
+	size_t outputCapacity = 0;
+
+	std::vector<InstanceData> instances;
+	std::vector<glm::vec4> meshBounds;
+	std::vector<glm::uvec2> items;
+	std::vector<DrawInfo> drawInfos;
+	std::vector<DrawElementsIndirectCommand> commands;
+	std::vector<ModelRange> modelRanges;
+
+	uint32_t drawCount = 0;
+	bool pyramidValid = false;
+	glm::mat4 pyramidViewProjection{ 1.0f };
+};
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// One timed zone. Times are microseconds since the profiler started, GPU zones are mapped onto
+// the same clock so both timelines line up in the trace.
+struct ProfileZone
+{
+	const char* name;
+	int depth;
+	uint32_t thread;
+	double startUs;
+	double durationUs;
+};
+
+// Rolling per-frame totals for one zone name, in milliseconds
+struct ZoneStats
+{
+	static constexpr int HISTORY_SIZE = 120;
+
+	std::array<float, HISTORY_SIZE> history{};
+	int next = 0;
+	int count = 0;
+	float last = 0.0f;
+
+	void add(float ms);
+	float average() const;
+	float min() const;
+	float max() const;
+};
+
+// Hierarchical CPU and GPU frame profiler.
+// CPU zones can be opened on any thread, GPU zones only on the GL thread. GPU zones are GL_TIMESTAMP
+// query pairs in a ring of GPU_LATENCY frames, results are only read once available so nothing stalls.
+// Zone names must be string literals, only the pointer is stored.
+struct Profiler
+{
+	static constexpr int GPU_LATENCY = 4;
+	static constexpr int MAX_GPU_ZONES = 64;
+	static constexpr uint32_t GPU_TRACE_THREAD = 1000;
+
+	bool enabled = true;
+
+	// Needs a current GL context
+	void init();
+	void shutdown();
+
+	// Bracket each frame on the GL thread, every other zone nests inside the "Frame" zone
+	void beginFrame();
+	void endFrame();
+
+	void beginCpuZone(const char* name);
+	void endCpuZone();
+	void beginGpuZone(const char* name);
+	void endGpuZone();
+
+	// Opens a CPU and a GPU zone with the same name, for passes that are not a scope of their own
+	void beginZone(const char* name);
+	void endZone();
+
+	void drawUI();
+
+	// Records the next frameCount frames and writes them as Chrome trace_event JSON (chrome://tracing, Perfetto)
+	void captureTrace(const std::string& path, int frameCount);
+	bool writeChromeTrace(const std::string& path) const;
+
+	double nowUs() const;
+
+private:
+	struct GpuZoneRecord
+	{
+		const char* name;
+		int depth;
+	};
+
+	struct GpuFrame
+	{
+		std::array<GLuint, MAX_GPU_ZONES * 2> queries{};
+		std::vector<GpuZoneRecord> zones;
+		GLuint lastQuery = 0;
+		int64_t gpuReference = 0;
+		double cpuReference = 0.0;
+		uint64_t frameNumber = 0;
+		bool pending = false;
+	};
+
+	void collectGpuFrame(GpuFrame& frame);
+	void finishCapture();
+
+	std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+	uint64_t frameNumber = 0;
+	std::atomic<bool> recording{ false }; // Written on the GL thread, read by CPU zones on any thread
+
+	// CPU zones finished this frame, worker threads append under the mutex
+	std::mutex cpuMutex;
+	std::vector<ProfileZone> cpuZones;
+	std::vector<ProfileZone> lastCpuFrame;
+	double lastCpuFrameStart = 0.0;
+	double lastCpuFrameDuration = 0.0;
+
+	std::array<GpuFrame, GPU_LATENCY> gpuFrames;
+	std::vector<int> gpuStack;
+	std::vector<ProfileZone> lastGpuFrame;
+	double lastGpuFrameStart = 0.0;
+	double lastGpuFrameDuration = 0.0;
+	uint64_t droppedGpuFrames = 0;
+
+	std::unordered_map<std::string_view, ZoneStats> cpuStats;
+	std::unordered_map<std::string_view, ZoneStats> gpuStats;
+
+	std::string capturePath;
+	uint64_t captureFirstFrame = 0;
+	uint64_t captureLastFrame = 0;
+	bool capturing = false;
+	std::vector<ProfileZone> capturedZones;
+	std::string lastTraceMessage;
+};
+
+extern Profiler profiler;
+
+struct CpuZoneScope
+{
+	explicit CpuZoneScope(const char* name) { profiler.beginCpuZone(name); }
+	~CpuZoneScope() { profiler.endCpuZone(); }
+};
+
+struct GpuZoneScope
+{
+	explicit GpuZoneScope(const char* name) { profiler.beginGpuZone(name); }
+	~GpuZoneScope() { profiler.endGpuZone(); }
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+// Times the enclosing scope
+#define PROFILE_CPU_ZONE(name) CpuZoneScope PROFILE_CONCAT(cpuZone, __LINE__)(name)
+#define PROFILE_GPU_ZONE(name) GpuZoneScope PROFILE_CONCAT(gpuZone, __LINE__)(name)
+#define PROFILE_ZONE(name) PROFILE_CPU_ZONE(name); PROFILE_GPU_ZONE(name)
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+// Size and format of a graph texture, transient textures with equal descriptions can share storage
+struct RenderGraphTextureDesc
+{
+	int width = 1;
+	int height = 1;
+	GLenum internalFormat = GL_RGBA8;
+	GLenum filter = GL_LINEAR;
+	GLenum wrap = GL_CLAMP_TO_EDGE; // GL_CLAMP_TO_BORDER gets a white border, which is what shadow maps want
+	int levels = 1; // Mip levels, filtering picks the nearest level when there is more than one
+
+	bool operator==(const RenderGraphTextureDesc& other) const = default;
+};
+
+// A texture declared in the current frame's graph
+struct RenderGraphTexture
+{
+	static constexpr uint32_t INVALID = UINT32_MAX;
+
+	uint32_t index = INVALID;
+
+	bool valid() const { return index != INVALID; }
+};
+
+// Frame graph, declared again every frame.
+// Passes declare the textures they create, read and write. compile() culls passes whose output nothing
+// consumes, works out the lifetime of every transient texture and lets transients whose lifetimes do not
+// overlap share one GL texture out of a pool kept across frames. execute() binds a framebuffer made from
+// each pass's written textures and wraps the pass in profiler and render stats zones.
+struct RenderGraph
+{
+	// Handed to a pass's setup function to declare its resources
+	struct Builder
+	{
+		// New transient texture, written first by this pass which is responsible for clearing it
+		RenderGraphTexture create(const char* name, const RenderGraphTextureDesc& desc);
+		// Sampled by this pass
+		RenderGraphTexture read(RenderGraphTexture texture);
+		// Rendered into on top of its earlier contents
+		RenderGraphTexture write(RenderGraphTexture texture);
+		// Run even when nothing reads the pass's output
+		void sideEffect();
+		// Writes go through image stores, no framebuffer is bound
+		void compute();
+
+		RenderGraph& graph;
+		uint32_t pass;
+	};
+
+	// What a pass sees while it executes
+	struct Context
+	{
+		GLuint texture(RenderGraphTexture texture) const;
+
+		const RenderGraph& graph;
+		int width; // Of the bound attachments, 0 for compute passes
+		int height;
+	};
+
+	using SetupFunction = std::function<void(Builder&)>;
+	using ExecuteFunction = std::function<void(const Context&)>;
+
+	~RenderGraph();
+
+	// Drops the previous frame's declarations, the pooled GL textures stay alive
+	void reset();
+
+	// Texture owned outside the graph, id 0 is the default framebuffer. Passes writing it are never culled.
+	RenderGraphTexture import(const char* name, GLuint texture, const RenderGraphTextureDesc& desc);
+	// Call before deleting a texture that was imported: GL reuses the name, and a cached framebuffer
+	// would otherwise keep rendering into the deleted texture
+	void forget(GLuint texture);
+
+	// Name must be a string literal, it becomes the profiler zone name
+	void addPass(const char* name, const SetupFunction& setup, ExecuteFunction execute);
+
+	void compile();
+	void execute();
+
+	// Graphviz description of the last compiled frame, culled passes are dashed
+	std::string toDot() const;
+	bool writeDot(const std::string& path) const;
+
+	void drawUI();
+
+	// Pool textures unused for this many frames are released, e.g. after a resize
+	int poolFrameLimit = 3;
+
+private:
+	struct TextureNode
+	{
+		const char* name;
+		RenderGraphTextureDesc desc;
+		GLuint imported = 0;
+		bool isImported = false;
+		uint32_t producer = UINT32_MAX; // Pass that created it
+		uint32_t firstPass = UINT32_MAX; // Lifetime over live passes
+		uint32_t lastPass = 0;
+		int physical = -1;
+	};
+
+	struct PassNode
+	{
+		const char* name;
+		ExecuteFunction execute;
+		std::vector<uint32_t> creates;
+		std::vector<uint32_t> reads;
+		std::vector<uint32_t> writes; // Includes created textures, in attachment order
+		bool sideEffect = false;
+		bool compute = false;
+		bool culled = false;
+	};
+
+	struct PhysicalTexture
+	{
+		GLuint id = 0;
+		RenderGraphTextureDesc desc;
+		uint32_t busyUntil = 0; // Last pass of the texture that currently owns it, this frame
+		bool usedThisFrame = false;
+		int unusedFrames = 0;
+	};
+
+	GLuint framebufferFor(const PassNode& pass, int& width, int& height);
+	void releaseUnused();
+
+	std::vector<TextureNode> textures;
+	std::vector<PassNode> passes;
+	std::vector<PhysicalTexture> pool;
+	std::map<std::vector<GLuint>, GLuint> framebuffers; // Attachment ids, depth last, to FBO
+	bool compiled = false;
+
+	size_t requestedBytes = 0; // Sum over transient textures
+	size_t allocatedBytes = 0; // Sum over the pool textures they were placed in
+};
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "shader.hpp"
+
+struct Mesh;
+struct Model;
+
+// Passes a render queue can hold, in the order their draws sort
+enum struct RenderPassId : uint8_t
+{
+	Shadow,
+	Opaque,
+	OpaqueLate // Drawn after the occlusion retest, see OcclusionCuller
+};
+
+// 64-bit draw sort key, most significant field first:
+// pass (4 bits) | program variant (8) | material (16) | VAO (16) | depth bucket (20)
+// The variant is the set of material maps present, which picks the ubershader's branches and is what
+// the per-draw has* uniforms encode. Depth is quantized view depth, so opaque draws sort front-to-back
+// within a material and mesh.
+struct DrawKey
+{
+	static constexpr int PASS_SHIFT = 60;
+	static constexpr int VARIANT_SHIFT = 52;
+	static constexpr int MATERIAL_SHIFT = 36;
+	static constexpr int VAO_SHIFT = 20;
+	static constexpr uint32_t DEPTH_BUCKETS = 1u << 20;
+
+	static uint64_t make(RenderPassId pass, uint32_t variant, uint32_t material, uint32_t vao, uint32_t depthBucket)
+	{
+		return (static_cast<uint64_t>(pass) << PASS_SHIFT)
+			| (static_cast<uint64_t>(variant & 0xFF) << VARIANT_SHIFT)
+			| (static_cast<uint64_t>(material & 0xFFFF) << MATERIAL_SHIFT)
+			| (static_cast<uint64_t>(vao & 0xFFFF) << VAO_SHIFT)
+			| (depthBucket & (DEPTH_BUCKETS - 1));
+	}
+
+	static RenderPassId pass(uint64_t key) { return static_cast<RenderPassId>(key >> PASS_SHIFT); }
+};
+
+// Key and the index of the draw it belongs to, what the radix sort moves around
+struct DrawSortEntry
+{
+	uint64_t key;
+	uint32_t item;
+};
+
+// Stable LSD radix sort by key, 8 bits per pass. Bytes that are the same in every key are skipped,
+// which in practice is most of the pass and variant bits. scratch is resized as needed.
+void RadixSortDrawKeys(std::vector<DrawSortEntry>& entries, std::vector<DrawSortEntry>& scratch);
+
+// Instanced draws of single meshes, sorted by key and submitted with a tracker that only rebinds the
+// material, VAO and indirect buffer when they differ from the previous draw
+struct RenderQueue
+{
+	struct Item
+	{
+		const Model* model;
+		const Mesh* mesh;
+		uint32_t instanceCount;
+		uint32_t baseInstance;
+		GLuint indirectBuffer; // Non-zero: the command at indirectOffset supplies the counts
+		GLintptr indirectOffset;
+	};
+
+	void clear();
+
+	// Every mesh of the model with instances [baseInstance, baseInstance + instanceCount) of its instance buffer
+	void addModel(RenderPassId pass, const Model& model, uint32_t instanceCount, float depth, uint32_t baseInstance = 0);
+	void addMesh(RenderPassId pass, const Model& model, const Mesh& mesh, uint32_t instanceCount, uint32_t baseInstance, float depth);
+	void addIndirect(RenderPassId pass, const Model& model, const Mesh& mesh, GLuint commandBuffer, GLintptr commandOffset, float depth);
+
+	void sort();
+	// Draws one pass's items in key order with the bound program
+	void submit(RenderPassId pass, Shader& shader) const;
+
+	size_t size() const { return items.size(); }
+
+	float depthRange = 100.0f; // View depth mapped onto the last depth bucket, the camera's far plane by default
+
+	std::vector<Item> items;
+
+private:
+	uint64_t keyFor(RenderPassId pass, const Model& model, const Mesh& mesh, float depth) const;
+
+	std::vector<DrawSortEntry> entries;
+	std::vector<DrawSortEntry> scratch;
+};
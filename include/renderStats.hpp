@@ -0,0 +1,170 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "glState.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// GL call counters for one pass or one whole frame
+struct RenderCounters
+{
+	uint64_t drawCalls = 0;
+	uint64_t instances = 0;
+	uint64_t triangles = 0;
+	uint64_t programBinds = 0;
+	uint64_t vaoBinds = 0;
+	uint64_t textureBinds = 0;
+	uint64_t uniformUpdates = 0;
+	uint64_t bufferBytesUploaded = 0;
+	uint64_t framebufferBinds = 0;
+	uint64_t redundantCalls = 0; // State changes GLStateCache filtered out
+
+	RenderCounters& operator+=(const RenderCounters& other);
+};
+
+struct PassCounters
+{
+	const char* name;
+	RenderCounters counters;
+};
+
+// Per-pass and per-frame render statistics, recorded through the counted* wrappers below.
+// Only the GL thread records. Calls made outside any pass are accounted to "Other".
+struct RenderStats
+{
+	void beginFrame();
+	void endFrame();
+
+	// Pass names must be string literals, passes do not nest
+	void beginPass(const char* name);
+	void endPass();
+
+	RenderCounters& current() { return passes[currentPass].counters; }
+
+	const std::vector<PassCounters>& lastFramePasses() const { return lastPasses; }
+	const RenderCounters& lastFrameTotals() const { return lastTotals; }
+
+	// Per-frame averages are accumulated from here on, benchmarks reset after warm-up
+	void resetAverages();
+	uint64_t averagedFrames() const { return accumulatedFrames; }
+
+	// Averaged per-frame counters and the per-pass breakdown as a JSON object
+	std::string toJson() const;
+
+	void drawUI();
+
+private:
+	int findPass(const char* name);
+
+	std::vector<PassCounters> passes{ { "Other", {} } };
+	int currentPass = 0;
+
+	std::vector<PassCounters> lastPasses;
+	RenderCounters lastTotals;
+
+	std::vector<PassCounters> accumulatedPasses;
+	RenderCounters accumulatedTotals;
+	uint64_t accumulatedFrames = 0;
+};
+
+extern RenderStats renderStats;
+
+// Counting wrappers around the GL entry points used while rendering a frame.
+// Binds go through glState and only count when they reach GL. One-off setup code keeps calling GL directly.
+inline void countedUseProgram(GLuint program)
+{
+	if (glState.useProgram(program))
+	{
+		++renderStats.current().programBinds;
+	}
+}
+
+inline void countedBindVertexArray(GLuint vao)
+{
+	if (glState.bindVertexArray(vao))
+	{
+		++renderStats.current().vaoBinds;
+	}
+}
+
+inline void countedBindTextureUnit(GLuint unit, GLuint texture)
+{
+	if (glState.bindTexture(unit, texture))
+	{
+		++renderStats.current().textureBinds;
+	}
+}
+
+inline void countedBindFramebuffer(GLenum target, GLuint framebuffer)
+{
+	if (glState.bindFramebuffer(target, framebuffer))
+	{
+		++renderStats.current().framebufferBinds;
+	}
+}
+
+inline void countedBufferData(GLenum target, GLsizeiptr size, const void* data, GLenum usage)
+{
+	renderStats.current().bufferBytesUploaded += static_cast<uint64_t>(size);
+	glBufferData(target, size, data, usage);
+}
+
+inline void countedNamedBufferData(GLuint buffer, GLsizeiptr size, const void* data, GLenum usage)
+{
+	renderStats.current().bufferBytesUploaded += static_cast<uint64_t>(size);
+	glNamedBufferData(buffer, size, data, usage);
+}
+
+inline void countedNamedBufferSubData(GLuint buffer, GLintptr offset, GLsizeiptr size, const void* data)
+{
+	renderStats.current().bufferBytesUploaded += static_cast<uint64_t>(size);
+	glNamedBufferSubData(buffer, offset, size, data);
+}
+
+inline void countUniformUpdate()
+{
+	++renderStats.current().uniformUpdates;
+}
+
+inline void countDraw(GLenum mode, GLsizei count, GLsizei instanceCount)
+{
+	RenderCounters& counters = renderStats.current();
+	++counters.drawCalls;
+	counters.instances += static_cast<uint64_t>(instanceCount);
+	if (mode == GL_TRIANGLES)
+	{
+		counters.triangles += static_cast<uint64_t>(count / 3) * static_cast<uint64_t>(instanceCount);
+	}
+	else if (mode == GL_TRIANGLE_STRIP || mode == GL_TRIANGLE_FAN)
+	{
+		counters.triangles += static_cast<uint64_t>(count > 2 ? count - 2 : 0) * static_cast<uint64_t>(instanceCount);
+	}
+}
+
+inline void countedDrawArrays(GLenum mode, GLint first, GLsizei count)
+{
+	countDraw(mode, count, 1);
+	glDrawArrays(mode, first, count);
+}
+
+inline void countedDrawElementsInstanced(GLenum mode, GLsizei count, GLenum type, const void* indices, GLsizei instanceCount)
+{
+	countDraw(mode, count, instanceCount);
+	glDrawElementsInstanced(mode, count, type, indices, instanceCount);
+}
+
+inline void countedDrawElementsInstancedBaseInstance(GLenum mode, GLsizei count, GLenum type, const void* indices, GLsizei instanceCount, GLuint baseInstance)
+{
+	countDraw(mode, count, instanceCount);
+	glDrawElementsInstancedBaseInstance(mode, count, type, indices, instanceCount, baseInstance);
+}
+
+// The instance count of an indirect draw lives on the GPU, so only the call itself is counted
+inline void countedDrawElementsIndirect(GLenum mode, GLenum type, const void* indirect)
+{
+	++renderStats.current().drawCalls;
+	glDrawElementsIndirect(mode, type, indirect);
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "bvh.hpp"
+#include "mesh.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+struct Model;
+
+// Stable reference to an entity. The generation changes when a slot is reused,
+// so handles to destroyed entities stop validating instead of aliasing a new one.
+struct EntityHandle
+{
+	uint32_t index = UINT32_MAX;
+	uint32_t generation = 0;
+
+	bool operator==(const EntityHandle& other) const = default;
+};
+
+struct Transform
+{
+	glm::vec3 position{ 0.0f };
+	glm::vec3 rotation{ 0.0f }; // Euler angles in degrees, applied X then Y then Z
+	float scale = 1.0f;
+
+	glm::mat4 toMatrix() const;
+};
+
+// Scratch space for one view's render lists, kept by the caller so it keeps its capacity between frames.
+// Views built at the same time each need their own.
+struct RenderListBuckets
+{
+	std::vector<uint32_t> subtrees; // BVH subtree per chunk when culling against a frustum
+	std::vector<std::vector<uint32_t>> entities; // Per chunk, visible dense indices
+	std::vector<uint32_t> offsets; // Per chunk and model, first count and then where the chunk writes
+};
+
+// Entity storage as dense component arrays. Index i of every component array belongs to the same
+// entity, removal swaps the last entity into the hole so the arrays never have gaps.
+// Models are registered once and referenced by id, names are interned in a side table.
+// A BVH over the world bounds, keyed by handle.index, backs culling and spatial queries.
+struct Scene
+{
+	// Component arrays, all sized size()
+	std::vector<Transform> transforms;
+	std::vector<glm::mat4> worldMatrices;
+	std::vector<glm::mat4> previousWorldMatrices; // As of the last updateWorldMatrices, for motion vectors
+	std::vector<uint32_t> modelIds;
+	std::vector<uint8_t> visible;
+	std::vector<uint32_t> nameIds;
+	std::vector<AABB> worldBounds;
+
+	// Model registry, indexed by model id. Released ids hold nullptr until a new model reuses them.
+	std::vector<std::shared_ptr<Model>> models;
+	std::vector<uint32_t> modelInstanceCounts;
+	std::vector<AABB> modelBounds;
+
+	BVH bvh;
+
+	uint32_t registerModel(std::shared_ptr<Model> model);
+	// Drops the registry's reference, only for models without entities
+	void releaseModel(uint32_t modelId);
+
+	EntityHandle create(uint32_t modelId, std::string_view name, const Transform& transform = {});
+	void destroy(EntityHandle handle);
+	void clear();
+
+	bool isValid(EntityHandle handle) const;
+	size_t size() const { return transforms.size(); }
+
+	// Dense index of a valid handle and back
+	uint32_t denseIndex(EntityHandle handle) const { return sparseToDense[handle.index]; }
+	EntityHandle handleAt(uint32_t dense) const { return { denseToSparse[dense], generations[denseToSparse[dense]] }; }
+
+	// Call after editing transforms[dense] so its world matrix is rebuilt
+	void markDirty(uint32_t dense) { dirty[dense] = 1; }
+	// Once per frame, entities that moved last frame catch their previous matrix up.
+	// Matrices and bounds are rebuilt on jobs, the BVH is refitted on the calling thread.
+	void updateWorldMatrices();
+
+	// Visible instances grouped by model id. The outer and inner vectors keep their capacity between frames.
+	// With a frustum only entities whose bounds overlap it are emitted, found through the BVH.
+	// The scene is split into chunks that are culled and gathered on jobs, each into its own bucket, then
+	// scattered into the lists at offsets from a prefix sum over the per-chunk counts.
+	// Read-only on the scene, so lists for different views can be built on different jobs.
+	void buildRenderLists(std::vector<std::vector<InstanceData>>& instancesPerModel, RenderListBuckets& buckets, const Frustum* frustum = nullptr) const;
+
+	// Nearest entity whose bounds the ray hits, an invalid handle when nothing is hit
+	EntityHandle raycast(const Ray& ray, float maxDistance, float& hitDistance) const;
+
+	uint32_t internName(std::string_view name);
+	const std::string& name(uint32_t dense) const { return names[nameIds[dense]]; }
+
+private:
+	std::vector<uint8_t> dirty;
+	std::vector<uint32_t> moved; // Dense indices updated by the last updateWorldMatrices
+	std::vector<uint32_t> denseToSparse;
+	std::vector<uint32_t> bvhLeaves;
+
+	// Indexed by handle.index
+	std::vector<uint32_t> sparseToDense;
+	std::vector<uint32_t> generations;
+	std::vector<uint32_t> freeSlots;
+
+	std::vector<std::string> names;
+	std::unordered_map<std::string, uint32_t> nameLookup;
+};
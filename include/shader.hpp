@@ -2,6 +2,7 @@
 
 #include <string>
 #include <cstdint>
+#include <glm/glm.hpp>
 
 struct Shader 
 {
@@ -9,6 +10,8 @@ struct Shader
 
 	// constructor reads and builds the shader using utility functions
 	Shader(const char* vertexPath, const char* fragmentPath);
+	// compute-only program
+	explicit Shader(const char* computePath);
 	std::string readShaderFile(const std::string& path);
 	uint32_t compileShader(uint32_t shaderType, const char* shaderCode);
 
@@ -19,6 +22,12 @@ struct Shader
 	void setBool(const std::string_view name, bool value) const;
 	void setInt(const std::string_view name, int value) const;
 	void setFloat(const std::string_view name, float value) const;
+	void setVec2(const std::string_view name, const glm::vec2& value) const;
+	void setIVec2(const std::string_view name, const glm::ivec2& value) const;
+	void setVec3(const std::string_view name, const glm::vec3& value) const;
+	void setVec3Array(const std::string_view name, const glm::vec3* values, int count) const;
+	void setVec4(const std::string_view name, const glm::vec4& value) const;
+	void setMat4(const std::string_view name, const glm::mat4& value) const;
 
 	// error checking
 	void checkCompilationErrors(uint32_t shader, const std::string_view type) const;
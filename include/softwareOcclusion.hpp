@@ -0,0 +1,89 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "bounds.hpp"
+
+// Occluder geometry as it already sits in CPU memory, e.g. a Mesh's vertices and indices
+struct OccluderMesh
+{
+	glm::mat4 world{ 1.0f };
+	const void* positions = nullptr; // Three floats per vertex
+	size_t stride = 0; // Bytes between consecutive positions
+	const uint32_t* indices = nullptr;
+	size_t indexCount = 0;
+};
+
+// Projected occluder triangle: pixel coordinates with y up and depth in [0, 1]
+struct ScreenTriangle
+{
+	float x[3];
+	float y[3];
+	float z[3];
+};
+
+// CPU depth rasterizer for occlusion culling on machines without compute shaders.
+// Occluders are rasterized into a small depth buffer on worker threads, each owning a band of tile rows,
+// and every tile keeps its farthest depth so most box tests finish without touching pixels.
+// The span kernels come in scalar, SSE4.1 and AVX2 flavours producing identical results.
+struct SoftwareOcclusion
+{
+	enum class Isa { Scalar, SSE4, AVX2 };
+
+	static constexpr int TILE_WIDTH = 8;
+	static constexpr int TILE_HEIGHT = 4;
+
+	// Widest kernel that was compiled in and that this CPU supports
+	static Isa bestIsa();
+	static bool isSupported(Isa isa);
+	static const char* isaName(Isa isa);
+
+	// Width is rounded up to whole tiles, threadCount 0 picks one per hardware thread
+	explicit SoftwareOcclusion(int width = 320, int height = 180, Isa isa = bestIsa(), int threadCount = 0);
+
+	// Clears the buffer, then transforms, clips and rasterizes every occluder
+	void render(const std::vector<OccluderMesh>& occluders, const glm::mat4& viewProjection);
+
+	// Conservative: anything that cannot be projected or is not fully behind occluders is visible
+	bool isVisible(const glm::mat4& clipFromObject, const AABB& bounds) const;
+
+	const std::vector<float>& depthBuffer() const { return depth; }
+	size_t triangleCount() const { return triangles.size(); }
+
+	int width;
+	int height;
+	Isa isa;
+	int threadCount;
+
+private:
+	void transformOccluders(const OccluderMesh* occluders, size_t count, const glm::mat4& viewProjection, std::vector<ScreenTriangle>& out) const;
+	void rasterizeBand(int rowBegin, int rowEnd);
+
+	std::vector<float> depth;
+	std::vector<float> tileMaxDepth;
+	std::vector<ScreenTriangle> triangles;
+	std::vector<std::vector<ScreenTriangle>> threadTriangles;
+	int tilesX;
+	int tilesY;
+};
+
+// Edge functions and depth plane of one triangle, clipped to a band of rows.
+// Shared by all span kernels so they rasterize the exact same pixels.
+struct TriangleSetup
+{
+	int minX, maxX, minY, maxY;
+	float edgeA[3], edgeB[3], edgeC[3];
+	float depthA, depthB, depthC;
+};
+
+bool setupTriangle(const ScreenTriangle& triangle, int width, int rowBegin, int rowEnd, TriangleSetup& setup);
+
+// Span kernels, the SIMD ones only exist when SOFTWARE_OCCLUSION_SIMD is defined.
+// width must be a multiple of 8.
+void rasterizeScalar(const ScreenTriangle* triangles, size_t count, float* depth, int width, int rowBegin, int rowEnd);
+void rasterizeSSE4(const ScreenTriangle* triangles, size_t count, float* depth, int width, int rowBegin, int rowEnd);
+void rasterizeAVX2(const ScreenTriangle* triangles, size_t count, float* depth, int width, int rowBegin, int rowEnd);
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <array>
+
+#include "shader.hpp"
+
+// Screen-space ambient occlusion computed at half resolution from the scene depth.
+// The depth is reduced to half resolution linear depth, AO is sampled on a view space hemisphere around
+// normals reconstructed from that depth, blurred with a separable bilateral filter and brought back to
+// render resolution with a depth aware upsample. blinnPhong.frag multiplies it into the ambient term.
+// It needs the complete depth before shading, so the main pass forces the depth pre-pass while it is on.
+struct SSAO
+{
+	static constexpr int KERNEL_SIZE = 16;
+
+	SSAO();
+	~SSAO();
+
+	// Reads the width x height corner of depthTexture, reallocating the targets when the size changed
+	void compute(GLuint depthTexture, int width, int height, const glm::mat4& projection);
+
+	Shader depthShader;
+	Shader aoShader;
+	Shader blurShader;
+	Shader upsampleShader;
+
+	bool enabled = true;
+	float radius = 0.5f; // View space, in scene units
+	float bias = 0.025f;
+	float power = 1.5f; // Contrast of the final term
+	float depthSharpness = 30.0f; // How quickly the blur and upsample reject taps at other depths
+
+	GLuint aoTexture = 0; // Render resolution result, R8
+
+private:
+	void allocate(int width, int height);
+
+	std::array<glm::vec3, KERNEL_SIZE> kernel;
+
+	GLuint halfDepthTexture = 0;
+	GLuint halfAOTexture = 0;
+	GLuint blurTexture = 0;
+	int targetWidth = 0;
+	int targetHeight = 0;
+};
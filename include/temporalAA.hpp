@@ -0,0 +1,59 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "renderGraph.hpp"
+#include "shader.hpp"
+
+// Temporal anti-aliasing. The projection is jittered by a sub-pixel Halton offset every frame, the main
+// pass writes per-pixel motion from each instance's current and previous world matrix, and the resolve
+// reprojects last frame's result along that motion. The history is clamped to the current 3x3
+// neighbourhood in YCoCg so disoccluded and changed pixels do not ghost. Pixels without motion vectors
+// (sky, light sources) are reprojected from depth using the camera alone.
+// The resolve output becomes the next frame's history, so the two history textures are swapped each frame.
+struct TemporalAA
+{
+	static constexpr int JITTER_PHASES = 8;
+	static constexpr float NO_VELOCITY = 60000.0f; // Velocity clear value, fits RG16F
+
+	TemporalAA();
+	~TemporalAA();
+
+	// Advances the jitter and drops the history when it cannot be reprojected, viewProjection is unjittered.
+	// The graph the history is imported into forgets the old textures when a resize replaces them.
+	void beginFrame(const glm::mat4& viewProjection, int renderWidth, int renderHeight, int targetWidth, int targetHeight, RenderGraph& graph);
+	void endFrame();
+
+	// Offsets the projection by this frame's jitter
+	glm::mat4 jitterProjection(const glm::mat4& projection) const;
+
+	// Binds the inputs and resolve shader, the caller draws a full screen quad into outputTexture()
+	void bindResolve(GLuint color, GLuint velocity, GLuint depth, const glm::vec2& renderScale);
+
+	GLuint outputTexture() const { return history[current]; }
+	GLuint historyTexture() const { return history[1 - current]; }
+	RenderGraphTextureDesc historyDesc() const { return { width, height, GL_RGBA16F }; }
+
+	Shader resolveShader;
+
+	bool enabled = true;
+	float feedback = 0.9f; // Share of the history kept each frame
+
+	glm::vec2 jitter{ 0.0f }; // This frame's offset in render pixels
+	glm::mat4 viewProjection{ 1.0f }; // Unjittered, the vertex shader derives motion from these two
+	glm::mat4 previousViewProjection{ 1.0f };
+
+private:
+	void allocate(int targetWidth, int targetHeight, RenderGraph& graph);
+
+	GLuint history[2] = { 0, 0 };
+	int current = 0;
+	int width = 0;
+	int height = 0;
+	int renderWidth = 0;
+	int renderHeight = 0;
+	uint32_t frameIndex = 0;
+	bool historyValid = false;
+	bool resolving = false; // enabled as of beginFrame, the UI may change it before the frame executes
+};
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "mesh.hpp"
+
+struct DecodedTexture;
+struct Model;
+
+// Pixels of a run of consecutive mip levels, finest first
+struct MipChain
+{
+	int firstLevel = 0;
+	int channels = 0;
+	std::vector<glm::ivec2> sizes;
+	std::vector<std::vector<uint8_t>> levels;
+};
+
+// Box filters the decoded image down to every level from firstLevel to lastLevel
+MipChain BuildMipChain(const DecodedTexture& decoded, int firstLevel, int lastLevel);
+
+// Material textures with only the mip levels the camera needs resident.
+// A texture starts with the levels no larger than initialSize. Every frame the visible instances give each
+// texture a wanted level from their distance and the mesh's UV density, finer levels are decoded from the
+// file on a background thread and uploaded under budgetBytes, and levels nothing has wanted for a while are freed.
+// Levels are defined one at a time with mutable storage and GL_TEXTURE_BASE_LEVEL marks the finest resident one:
+// immutable storage keeps its whole chain allocated, and keeping the same texture name means materials never change.
+struct TextureStreamer
+{
+	bool enabled = false; // Only affects textures loaded afterwards
+	size_t budgetBytes = 256ull * 1024 * 1024;
+	int initialSize = 128;
+	int maxPendingLoads = 2;
+	uint64_t releaseDelayFrames = 120; // Frames a level must go unwanted before it is freed
+
+	// Creates the texture from its decoded pixels with the initial levels resident, frees the pixels
+	uint32_t upload(DecodedTexture& decoded, TextureType type, const std::string& path, const std::string& directory);
+	// Call before deleting a streamed texture, waits for its pending load
+	void release(uint32_t texture);
+
+	// Call once per frame on the GL thread. Uploads finished loads, then turns the camera's instance lists
+	// into wanted levels and starts loads or frees levels. focalLength is the projection's, in pixels.
+	void update(const std::vector<std::shared_ptr<Model>>& models, const std::vector<std::vector<InstanceData>>& instancesPerModel,
+		const glm::vec3& eye, float focalLength);
+
+	size_t residentBytes() const { return totalBytes; }
+	size_t textureCount() const { return textures.size(); }
+	int pendingLoads() const;
+
+private:
+	struct StreamedTexture
+	{
+		std::string path;
+		std::string directory;
+		GLenum internalFormat;
+		GLenum format;
+		int channels;
+		int width;
+		int height;
+		int levelCount;
+		int initialLevel; // Never freed
+		int residentLevel; // Finest level resident
+		int wantedLevel; // This frame's, levelCount - 1 when nothing visible uses it
+		uint64_t lastWantedFrame = 0; // Last frame every resident level was wanted
+		size_t bytes = 0;
+		std::future<MipChain> pending;
+		size_t pendingBytes = 0; // What the pending load adds once uploaded
+	};
+
+	size_t levelBytes(const StreamedTexture& texture, int level) const;
+	void defineLevel(uint32_t id, const StreamedTexture& texture, int level, int width, int height, const void* pixels);
+	void setResidentLevel(uint32_t id, StreamedTexture& texture, int level);
+	void finishLoads();
+	void computeWantedLevels(const std::vector<std::shared_ptr<Model>>& models, const std::vector<std::vector<InstanceData>>& instancesPerModel,
+		const glm::vec3& eye, float focalLength);
+	void freeLevels();
+	void startLoads();
+
+	std::unordered_map<uint32_t, StreamedTexture> textures; // By GL name
+	std::vector<float> nearestPerModel; // Smallest distance over scale of any instance, per model id
+	size_t totalBytes = 0;
+	uint64_t frame = 0;
+};
+
+extern TextureStreamer textureStreamer;
@@ -0,0 +1,196 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <vector>
+
+#include "textureStreaming.hpp"
+
+class Shader;
+struct DecodedTexture;
+
+// Residency of fixed-size pages of virtual textures in a grid of physical slots, with no GL calls so the
+// software validation drives exactly what the renderer does.
+// Each texture is split into PAGE_SIZE texel pages per mip level, down to the first level that fits a single
+// page; that tail page is pinned once loaded so every texel always has something resident to fall back to.
+// The indirection table has an entry per page of every level: the slot and level of the finest resident page
+// covering it, packed as the RGBA8UI texel (slot x, slot y, level, 1) the shader reads, 0 before the tail loads.
+struct VirtualPageCache
+{
+	static constexpr int PAGE_SIZE = 128;
+	static constexpr uint32_t NO_REQUEST = UINT32_MAX; // Feedback texels nothing wrote to
+	static constexpr int MAX_TEXTURES = 1023; // Texture id 1023 with every other field set is NO_REQUEST
+	static constexpr int MAX_LEVELS = 16;
+	static constexpr int MAX_PAGES = 512; // Per axis, so textures up to 64k texels
+
+	// Feedback word written by blinnPhong.frag, texture in the top 10 bits, level 4, page x 9, page y 9
+	static uint32_t packRequest(uint32_t texture, uint32_t level, uint32_t pageX, uint32_t pageY)
+	{
+		return (texture << 22) | (level << 18) | (pageX << 9) | pageY;
+	}
+	static uint32_t requestTexture(uint32_t request) { return request >> 22; }
+	static uint32_t requestLevel(uint32_t request) { return (request >> 18) & 0xF; }
+	static uint32_t requestPageX(uint32_t request) { return (request >> 9) & 0x1FF; }
+	static uint32_t requestPageY(uint32_t request) { return request & 0x1FF; }
+
+	static uint32_t packEntry(int slotX, int slotY, int level)
+	{
+		return static_cast<uint32_t>(slotX) | (static_cast<uint32_t>(slotY) << 8) | (static_cast<uint32_t>(level) << 16) | (1u << 24);
+	}
+
+	struct Texture
+	{
+		bool live = false;
+		int width = 0;
+		int height = 0;
+		int levelCount = 0; // Finest level to the single page tail
+		int pagesX = 0; // Power of two page grid of level 0, halving per level
+		int pagesY = 0;
+		std::vector<std::vector<int32_t>> pageSlots; // Per level and page, -1 when not resident or loading
+		std::vector<std::vector<uint32_t>> table; // Indirection entries per level, rebuilt by buildTable
+		bool dirty = false; // Residency changed since the last buildTable
+	};
+
+	struct Slot
+	{
+		int32_t texture = -1; // -1 when free
+		uint32_t request = 0; // The page it holds
+		uint32_t generation = 0; // Bumped on every allocate, so a stale load never lands in a reused slot
+		uint64_t lastUsed = 0;
+		bool loaded = false; // False while the page is on its way
+		bool pinned = false;
+	};
+
+	// Discards every texture and page
+	void init(int slotsX, int slotsY);
+
+	// Id of a new texture with nothing resident, -1 when MAX_TEXTURES are live or it is too big
+	int addTexture(int width, int height);
+	// Frees its slots, loads still on their way are dropped when they arrive
+	void removeTexture(int texture);
+
+	static int gridSize(int pages, int level) { return std::max(pages >> level, 1); }
+	static int levelSize(int size, int level) { return std::max(size >> level, 1); }
+	uint32_t tailRequest(int texture) const;
+
+	// Call once per frame before analyse
+	void beginFrame() { ++frame; }
+	// Unique pages the feedback asks for that are neither resident nor loading, coarsest level first.
+	// Resident pages asked for, and the resident pages above them the shader falls back to, count as used this frame.
+	void analyse(const uint32_t* feedback, size_t count, std::vector<uint32_t>& requests);
+	// Reserves a slot for a requested page: a free one, else the least recently used unpinned page not used this
+	// frame is evicted. -1 when every slot is loading, pinned or in use.
+	int allocate(uint32_t request, bool pinned = false);
+	// The slot's page arrived, false when the slot was freed or reused since generation was handed out
+	bool commit(int slot, uint32_t generation);
+
+	// Rebuilds the texture's indirection entries if its residency changed, returns whether it did
+	bool buildTable(int texture);
+
+	int slotsX = 0;
+	int slotsY = 0;
+	std::vector<Texture> textures;
+	std::vector<Slot> slots;
+	uint64_t frame = 0;
+
+private:
+	void release(int slot);
+	// The slot of a page, -1 if neither resident nor loading
+	int32_t& pageSlot(uint32_t request);
+
+	std::vector<uint32_t> sorted; // analyse scratch
+};
+
+// Copies one page of a level to RGBA8, clamping to the level's edge where the page runs past it
+void CutVirtualPage(const MipChain& chain, uint32_t request, uint8_t* rgba);
+
+// Albedo maps paged into one physical texture on demand.
+// The opaque pass writes the (texture, level, page) each sampled texel wants into a low resolution R32UI
+// feedback image, one pixel in FEEDBACK_SCALE squared and jittered every frame. The image is read back through
+// a ring of pixel buffers a few frames later, analysed into missing pages, and the pages are cut from the
+// texture's mip chain on a background thread and uploaded into free slots of the physical cache.
+// blinnPhong.frag finds each texel's page through the texture's indirection texture, which falls back to
+// the coarser resident pages while the wanted one is on its way.
+struct VirtualTextureSystem
+{
+	static constexpr int FEEDBACK_SCALE = 8;
+	static constexpr int READBACK_FRAMES = 3;
+	static constexpr GLuint INDIRECTION_UNIT = 10;
+	static constexpr GLuint PHYSICAL_UNIT = 11;
+	static constexpr GLuint FEEDBACK_IMAGE_UNIT = 7; // Compute passes between begin and endFeedback use the low units
+
+	bool enabled = false; // Only affects albedo maps loaded afterwards
+	int maxUploadsPerFrame = 32;
+
+	// Call once the GL context exists
+	void init(int slotsX = 16, int slotsY = 16);
+	// Waits for the batch in flight, then frees the cache, feedback image and readback buffers
+	void shutdown();
+
+	// Creates the indirection texture, uploads the tail page and frees the pixels. Returns the indirection
+	// texture's name and sets virtualId, or returns 0 and leaves the pixels alone when the image cannot be paged.
+	uint32_t upload(DecodedTexture& decoded, int& virtualId);
+	// Call before deleting the indirection texture
+	void release(int virtualId);
+
+	// Call once per frame on the GL thread. Analyses the oldest finished readback, uploads finished pages
+	// and starts loading the next batch.
+	void update();
+
+	// Around the draws that sample virtual textures, at the render resolution
+	void beginFeedback(Shader& shader, int renderWidth, int renderHeight);
+	void endFeedback();
+	// Per material, what Mesh::bindTextures calls for a virtual albedo map
+	void bindTexture(Shader& shader, uint32_t indirection, int virtualId) const;
+
+	int residentPages() const;
+	int totalPages() const { return static_cast<int>(cache.slots.size()); }
+	size_t lastRequestCount() const { return requestCount; }
+	bool loading() const { return pending.valid(); }
+
+private:
+	struct LoadedPage
+	{
+		int slot;
+		uint32_t generation;
+		std::vector<uint8_t> rgba;
+	};
+
+	struct Readback
+	{
+		GLuint buffer = 0;
+		GLsync fence = nullptr;
+	};
+
+	void uploadPage(int slot, const uint8_t* rgba);
+	void uploadTable(int virtualId);
+	void finishLoads();
+	void readFeedback();
+	void startLoads();
+	void updateTables();
+
+	VirtualPageCache cache;
+	std::vector<std::shared_ptr<const MipChain>> chains; // Per virtual id, pages are cut from these
+	std::vector<GLuint> indirections; // Per virtual id
+
+	GLuint physical = 0;
+	GLuint feedback = 0;
+	int feedbackWidth = 0;
+	int feedbackHeight = 0;
+	std::array<Readback, READBACK_FRAMES> readbacks{};
+	int readbackIndex = 0;
+	bool feedbackActive = false;
+
+	std::vector<uint32_t> feedbackWords;
+	std::vector<uint32_t> requests; // This frame's, dropped if a batch is still loading
+	size_t requestCount = 0; // Missing pages in the last analysed feedback
+	std::future<std::vector<LoadedPage>> pending;
+	uint64_t frame = 0;
+};
+
+extern VirtualTextureSystem virtualTextures;
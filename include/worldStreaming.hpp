@@ -0,0 +1,95 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "scene.hpp"
+
+struct Model;
+struct ModelLibrary;
+
+// The world split into square cells on the XZ plane, each with its own objects and the models they use.
+// Cells whose bounds come within loadRadius of the camera load, and cells further than loadRadius + hysteresis
+// unload, so walking along the edge of the radius does not load and unload the same cell every frame.
+// Models a loading cell needs are imported on background threads and then uploaded a few textures and meshes
+// at a time under uploadBudgetBytes per frame. The cell's entities are created once every one is resident.
+// Models a loading cell already has are pinned in the ModelLibrary, so the budget cannot evict them while the
+// cell waits on the rest. Unloading only destroys the entities: the ModelLibrary evicts their models once it is
+// over its VRAM budget.
+struct WorldStreamer
+{
+	enum struct CellState
+	{
+		UNLOADED,
+		LOADING, // Waiting for its models
+		LOADED
+	};
+
+	struct Object
+	{
+		uint32_t source; // Index into sources
+		Transform transform;
+	};
+
+	struct Cell
+	{
+		glm::ivec2 coord{ 0 };
+		std::vector<Object> objects;
+		std::vector<uint32_t> sources; // Each model the objects use, once
+		CellState state = CellState::UNLOADED;
+		std::vector<EntityHandle> entities; // While loaded
+		std::vector<uint32_t> pinned; // Sources pinned in the library while loading, until the entities hold them
+	};
+
+	// A model file the objects refer to, known to the ModelLibrary by its folder name
+	struct Source
+	{
+		std::string folder;
+		std::string path;
+		std::future<std::shared_ptr<Model>> import; // Valid while the file is read on a background thread
+		std::shared_ptr<Model> uploading; // Imported, uploaded over the next frames
+	};
+
+	bool enabled = true;
+	float cellSize = 50.0f; // Only change while the world is empty
+	float loadRadius = 100.0f;
+	float hysteresis = 25.0f;
+	size_t uploadBudgetBytes = 16ull * 1024 * 1024; // Texture and mesh bytes sent to GL per frame
+	int maxPendingImports = 2;
+
+	// Puts the object in the cell its position falls in, the cell loads it the next time it loads
+	void addObject(const std::string& folder, const std::string& path, const Transform& transform);
+	// Destroys the entities of loaded cells and forgets the world, waiting for imports in flight
+	void clear(Scene& scene, ModelLibrary& library);
+
+	// Call once per frame on the GL thread, after the ModelLibrary's update.
+	// Finishes imports and uploads, then loads and unloads cells around the eye, nearest first.
+	void update(Scene& scene, ModelLibrary& library, const glm::vec3& eye);
+
+	size_t cellCount() const { return cells.size(); }
+	size_t objectCount() const { return objects; }
+	size_t cellsIn(CellState state) const;
+	int pendingImports() const;
+
+private:
+	float distance(const Cell& cell, const glm::vec3& eye) const;
+	void finishImports(Scene& scene, ModelLibrary& library);
+	// True once every model the cell needs is resident, starts imports for the missing ones otherwise
+	bool requestSources(Cell& cell, ModelLibrary& library);
+	void instantiate(Cell& cell, Scene& scene, ModelLibrary& library);
+	void unload(Cell& cell, Scene& scene, ModelLibrary& library);
+	void releasePins(Cell& cell, ModelLibrary& library);
+
+	std::vector<Cell> cells;
+	std::unordered_map<uint64_t, uint32_t> cellLookup; // By packed coord
+	std::vector<Source> sources;
+	std::unordered_map<std::string, uint32_t> sourceLookup; // By folder
+	std::vector<std::pair<float, uint32_t>> loading; // update scratch, distance and cell index
+	size_t objects = 0;
+};
@@ -1,11 +1,16 @@
-#version 330 core
-out vec4 FragColor;
+#version 430 core
+// Keeps early depth testing against the pre-pass, which the feedback image store would otherwise turn off
+layout (early_fragment_tests) in;
+layout (location = 0) out vec4 FragColor;
+layout (location = 1) out vec2 Velocity; // Texture coordinate motion since last frame, for TAA
 
 in vec2 TexCoords;
 in vec3 WorldPos;
 in vec3 Normal;
 in vec4 FragPosLightSpace;
 in mat3 TBN;
+in vec4 CurrentClip;
+in vec4 PreviousClip;
 
 struct PBRMaterial {
     sampler2D albedoMap;
@@ -62,12 +67,28 @@ uniform sampler2D shadowMap;
 uniform float exposure;
 
 // IBL Uniforms
-uniform samplerCube irradianceMap; // Diffuse environment lighting
+uniform vec3 irradianceSH[9]; // Diffuse environment lighting as premultiplied SH coefficients
 uniform samplerCube prefilterMap; // Prefiltered environment map for specular
 uniform sampler2D brdfLUT; // BRDF lookup texture
 uniform float MAX_REFLECTION_LOD; // Max mip level of radiance map calculated from base texture size
 uniform bool useIBL;
 
+uniform sampler2D ssaoTexture; // Screen-space AO at render resolution, see SSAO
+uniform bool useSSAO;
+
+// Virtual albedo, see VirtualTextureSystem
+layout (r32ui, binding = 7) uniform writeonly uimage2D vtFeedback; // Page each sampled texel wants, one pixel per block
+uniform usampler2D vtIndirection; // Per page of each level: physical slot x, y and resident level, alpha 0 when nothing is
+uniform sampler2D vtPhysical;
+uniform bool useVirtualAlbedo;
+uniform int vtTexture;
+uniform vec2 vtSize; // Level 0 texels
+uniform int vtLevels;
+uniform vec2 vtPhysicalSize;
+uniform int vtFeedbackScale; // 0 turns feedback off
+uniform ivec2 vtFeedbackOffset;
+const float VT_PAGE_SIZE = 128.0;
+
 // Constants
 const float PI = 3.14159265359;
 
@@ -78,7 +99,9 @@ float GeometrySchlickGGX(float NdotV, float roughness);
 float GeometrySmith(vec3 N, vec3 V, vec3 L, float roughness);
 vec3 fresnelSchlick(float cosTheta, vec3 F0);
 vec3 fresnelSchlickRougness(float cosTheta, vec3 F0, float roughness);
+vec3 irradianceFromSH(vec3 N);
 float shadowCalculation(vec4 FragPosLightSpace);
+vec3 sampleVirtualAlbedo(vec2 uv);
 vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir, vec3 albedo, float metallic, float roughness, vec3 F0);
 vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 albedo, float metallic, float roughness, vec3 F0);
 vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 albedo, float metallic, float roughness, vec3 F0);
@@ -88,11 +111,15 @@ vec3 getSpecularColor();
 void main()
 {    
     // Simple material properties
-    vec3 albedo = hasAlbedo ? texture(pbrMaterial.albedoMap, TexCoords).rgb : defaultAlbedo;
+    vec3 albedo = hasAlbedo ? (useVirtualAlbedo ? sampleVirtualAlbedo(TexCoords) : texture(pbrMaterial.albedoMap, TexCoords).rgb) : defaultAlbedo;
     vec4 metallicRoughness = hasMetallicRoughness ? texture(pbrMaterial.metallicRoughnessMap, TexCoords) : vec4(0.0, defaultRoughness, defaultMetallic, 1.0);
     float metallic = metallicRoughness.b;
     float roughness = metallicRoughness.g;
     float ao = hasAO ? texture(pbrMaterial.aoMap, TexCoords).r : defaultAO;
+    if (useSSAO)
+    {
+        ao *= texelFetch(ssaoTexture, ivec2(gl_FragCoord.xy), 0).r;
+    }
     vec3 emission = hasEmissive ? texture(pbrMaterial.emissiveMap, TexCoords).rgb : vec3(0.0);
 
     // Get normal
@@ -157,7 +184,7 @@ void main()
         vec3 kD = 1.0 - kS;
         kD *= 1.0 - metallic; 
 
-        vec3 irradiance = texture(irradianceMap, N).rgb;
+        vec3 irradiance = irradianceFromSH(N);
         vec3 diffuse = irradiance * albedo;
 
         // 2. Specular reflectance with environment map
@@ -177,6 +204,53 @@ void main()
     vec3 color = ambient + Lo + emission;
 
     FragColor = vec4(color, 1.0);
+    Velocity = (CurrentClip.xy / CurrentClip.w - PreviousClip.xy / PreviousClip.w) * 0.5;
+}
+
+vec3 sampleVirtualAlbedo(vec2 uv)
+{
+    // The level the hardware would pick from the level 0 footprint, mirrored by the --bench-vt validation
+    vec2 texel = uv * vtSize;
+    vec2 dx = dFdx(texel);
+    vec2 dy = dFdy(texel);
+    float footprint = max(dot(dx, dx), dot(dy, dy));
+    int level = clamp(int(floor(0.5 * log2(max(footprint, 1e-8)))), 0, vtLevels - 1);
+
+    vec2 wrapped = fract(uv);
+    vec2 levelSize = max(floor(vtSize / exp2(float(level))), vec2(1.0));
+    ivec2 page = ivec2(wrapped * levelSize / VT_PAGE_SIZE);
+
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    if (vtFeedbackScale > 0 && all(equal(pixel % vtFeedbackScale, vtFeedbackOffset)))
+    {
+        uint request = (uint(vtTexture) << 22) | (uint(level) << 18) | (uint(page.x) << 9) | uint(page.y);
+        imageStore(vtFeedback, pixel / vtFeedbackScale, uvec4(request));
+    }
+
+    // Finest resident page covering this one, pages have no border so bilinear filtering stays inside it
+    uvec4 entry = texelFetch(vtIndirection, page, level);
+    if (entry.a == 0u)
+    {
+        return defaultAlbedo;
+    }
+    vec2 residentTexel = wrapped * max(floor(vtSize / exp2(float(entry.b))), vec2(1.0));
+    vec2 inPage = clamp(mod(residentTexel, VT_PAGE_SIZE), vec2(0.5), vec2(VT_PAGE_SIZE - 0.5));
+    return textureLod(vtPhysical, (vec2(entry.rg) * VT_PAGE_SIZE + inPage) / vtPhysicalSize, 0.0).rgb;
+}
+
+// Basis constants and the cosine lobe are already folded into the coefficients
+vec3 irradianceFromSH(vec3 N)
+{
+    vec3 result = irradianceSH[0];
+    result += irradianceSH[1] * N.y;
+    result += irradianceSH[2] * N.z;
+    result += irradianceSH[3] * N.x;
+    result += irradianceSH[4] * (N.x * N.y);
+    result += irradianceSH[5] * (N.y * N.z);
+    result += irradianceSH[6] * (3.0 * N.z * N.z - 1.0);
+    result += irradianceSH[7] * (N.x * N.z);
+    result += irradianceSH[8] * (N.x * N.x - N.y * N.y);
+    return max(result, vec3(0.0));
 }
 
 vec3 fresnelSchlickRougness(float cosTheta, vec3 F0, float roughness)
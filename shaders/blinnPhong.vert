@@ -5,16 +5,24 @@ layout (location = 2) in vec2 aTexCoords;
 layout (location = 3) in vec3 aTangent;
 layout (location = 4) in vec3 aBitangent;
 layout (location = 5) in mat4 aInstanceMatrix;
+layout (location = 9) in mat4 aPreviousInstanceMatrix;
 
 out vec2 TexCoords;
 out vec3 WorldPos;
 out vec3 Normal;
 out vec4 FragPosLightSpace;
 out mat3 TBN;
+out vec4 CurrentClip;
+out vec4 PreviousClip;
 
 uniform mat4 projection;
 uniform mat4 view;
 uniform mat4 lightSpaceMatrix;
+uniform mat4 viewProjection; // Unjittered, for motion vectors
+uniform mat4 previousViewProjection;
+
+// Depth pre-pass in depthPrepass.vert computes the same position
+invariant gl_Position;
 
 void main()
 {
@@ -43,6 +51,10 @@ void main()
     // Pass texture co-ordinates
     TexCoords = aTexCoords;
 
+    // Where this vertex is and was on screen without jitter, for TAA
+    CurrentClip = viewProjection * worldPos;
+    PreviousClip = previousViewProjection * aPreviousInstanceMatrix * vec4(aPos, 1.0);
+
     // Output clip space position
     gl_Position = projection * view * worldPos;
 }
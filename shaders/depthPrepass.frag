@@ -0,0 +1,6 @@
+#version 330 core
+
+// Depth only, leaving gl_FragDepth unwritten keeps early depth testing
+void main()
+{
+}
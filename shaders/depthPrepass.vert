@@ -0,0 +1,15 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 5) in mat4 aInstanceMatrix;
+
+uniform mat4 projection;
+uniform mat4 view;
+
+// Must match blinnPhong.vert exactly so the colour pass can test with GL_EQUAL
+invariant gl_Position;
+
+void main()
+{
+    vec4 worldPos = aInstanceMatrix * vec4(aPos, 1.0);
+    gl_Position = projection * view * worldPos;
+}
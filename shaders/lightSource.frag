@@ -1,7 +1,9 @@
 #version 330 core
-out vec4 FragColor;
+layout (location = 0) out vec4 FragColor;
+layout (location = 1) out vec2 Velocity;
 
 void main()
 {
     FragColor = vec4(1.0);
+    Velocity = vec2(60000.0); // TemporalAA::NO_VELOCITY, the resolve reprojects from depth
 }
\ No newline at end of file
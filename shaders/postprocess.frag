@@ -4,19 +4,59 @@ out vec4 FragColor;
 in vec2 TexCoords;
 uniform sampler2D hdrBuffer;
 uniform float exposure;
+uniform vec2 renderScale; // Part of hdrBuffer the scene was rendered into, see DynamicResolution
+uniform float sharpness; // 0 to 1, 0 skips sharpening
+uniform sampler2D bloomTexture; // Level 0 of the bloom chain, see Bloom
+uniform vec2 bloomScale; // Part of bloomTexture covering the rendered rectangle
+uniform float bloomNormalization; // One over the number of levels summed into the chain
+uniform float bloomStrength; // 0 skips bloom
 
-void main()
+vec3 toneMap(vec3 hdrColor)
 {
-    vec3 hdrColor = texture(hdrBuffer, TexCoords).rgb;
-
     // Apply exposure
     hdrColor *= exposure;
 
     // Perform Reinhard tone mapping
-    vec3 mapped = hdrColor / (hdrColor + vec3(1.0));
+    return hdrColor / (hdrColor + vec3(1.0));
+}
+
+// Bilinear fetch that never filters in texels outside the rendered rectangle
+vec3 sampleScene(vec2 uv, vec2 texel)
+{
+    uv = clamp(uv, 0.5 * texel, renderScale - 0.5 * texel);
+    vec3 hdrColor = texture(hdrBuffer, uv).rgb;
+    if (bloomStrength > 0.0)
+    {
+        hdrColor = mix(hdrColor, texture(bloomTexture, uv / renderScale * bloomScale).rgb * bloomNormalization, bloomStrength);
+    }
+    return toneMap(hdrColor);
+}
+
+void main()
+{
+    vec2 texel = 1.0 / vec2(textureSize(hdrBuffer, 0));
+    vec2 uv = TexCoords * renderScale;
+    vec3 mapped = sampleScene(uv, texel);
+
+    if (sharpness > 0.0)
+    {
+        // Contrast adaptive sharpening on the upscaled image: the cross neighbourhood sets how much
+        // detail can be restored, so flat areas get sharpened and strong edges do not ring
+        vec3 north = sampleScene(uv + vec2(0.0, texel.y), texel);
+        vec3 south = sampleScene(uv - vec2(0.0, texel.y), texel);
+        vec3 east = sampleScene(uv + vec2(texel.x, 0.0), texel);
+        vec3 west = sampleScene(uv - vec2(texel.x, 0.0), texel);
+
+        vec3 minColor = min(mapped, min(min(north, south), min(east, west)));
+        vec3 maxColor = max(mapped, max(max(north, south), max(east, west)));
+        vec3 amount = sqrt(clamp(min(minColor, 1.0 - maxColor) / max(maxColor, vec3(1e-4)), 0.0, 1.0));
+        vec3 weight = -amount * mix(0.125, 0.2, sharpness);
+
+        mapped = clamp((mapped + (north + south + east + west) * weight) / (1.0 + 4.0 * weight), 0.0, 1.0);
+    }
 
     // Gamma correction
     mapped = pow(mapped, vec3(1.0 / 2.2));
 
     FragColor = vec4(mapped, 1.0);
-}
\ No newline at end of file
+}
@@ -0,0 +1,89 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D currentColor;
+uniform sampler2D velocityTexture; // Texture coordinate motion since last frame, see blinnPhong.frag
+uniform sampler2D depthTexture;
+uniform sampler2D historyTexture;
+uniform vec2 renderScale; // Part of every input texture the scene was rendered into
+uniform mat4 reprojection; // Last frame's view projection times the inverse of this frame's, both unjittered
+uniform float feedback;
+uniform bool historyValid;
+
+const float NO_VELOCITY = 60000.0; // TemporalAA::NO_VELOCITY
+
+vec3 toYCoCg(vec3 color)
+{
+    return vec3(0.25 * color.r + 0.5 * color.g + 0.25 * color.b,
+                0.5 * color.r - 0.5 * color.b,
+                -0.25 * color.r + 0.5 * color.g - 0.25 * color.b);
+}
+
+vec3 fromYCoCg(vec3 color)
+{
+    return vec3(color.x + color.y - color.z, color.x + color.z, color.x - color.y - color.z);
+}
+
+float luminance(vec3 color)
+{
+    return dot(color, vec3(0.2126, 0.7152, 0.0722));
+}
+
+void main()
+{
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    ivec2 renderSize = ivec2(renderScale * vec2(textureSize(currentColor, 0)) + 0.5);
+    vec3 current = texelFetch(currentColor, texel, 0).rgb;
+
+    // Colour bounds of the neighbourhood, and its nearest texel whose motion is used so that
+    // edges move with the foreground object
+    vec3 minColor = toYCoCg(current);
+    vec3 maxColor = minColor;
+    float closestDepth = 1.0;
+    ivec2 closestTexel = texel;
+    for (int y = -1; y <= 1; ++y)
+    {
+        for (int x = -1; x <= 1; ++x)
+        {
+            ivec2 neighbour = clamp(texel + ivec2(x, y), ivec2(0), renderSize - 1);
+            vec3 color = toYCoCg(texelFetch(currentColor, neighbour, 0).rgb);
+            minColor = min(minColor, color);
+            maxColor = max(maxColor, color);
+
+            float depth = texelFetch(depthTexture, neighbour, 0).r;
+            if (depth < closestDepth)
+            {
+                closestDepth = depth;
+                closestTexel = neighbour;
+            }
+        }
+    }
+
+    vec2 uv = (vec2(texel) + 0.5) / vec2(renderSize);
+    vec2 velocity = texelFetch(velocityTexture, closestTexel, 0).rg;
+    if (velocity.x >= 0.5 * NO_VELOCITY)
+    {
+        // Nothing moved here but the camera
+        vec4 previous = reprojection * vec4(uv * 2.0 - 1.0, closestDepth * 2.0 - 1.0, 1.0);
+        velocity = uv - (previous.xy / previous.w * 0.5 + 0.5);
+    }
+
+    vec2 previousUV = uv - velocity;
+    if (!historyValid || any(lessThan(previousUV, vec2(0.0))) || any(greaterThan(previousUV, vec2(1.0))))
+    {
+        FragColor = vec4(current, 1.0);
+        return;
+    }
+
+    vec2 texelSize = 1.0 / vec2(textureSize(historyTexture, 0));
+    vec2 historyUV = clamp(previousUV * renderScale, 0.5 * texelSize, renderScale - 0.5 * texelSize);
+    vec3 history = texture(historyTexture, historyUV).rgb;
+    history = fromYCoCg(clamp(toYCoCg(history), minColor, maxColor));
+
+    // Weighting by inverse luminance keeps single bright samples from flickering through the HDR blend
+    float currentWeight = (1.0 - feedback) / (1.0 + luminance(current));
+    float historyWeight = feedback / (1.0 + luminance(history));
+    FragColor = vec4((current * currentWeight + history * historyWeight) / (currentWeight + historyWeight), 1.0);
+}
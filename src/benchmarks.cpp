@@ -0,0 +1,811 @@
+#include "benchmarks.hpp"
+#include "bvh.hpp"
+#include "jobSystem.hpp"
+#include "renderQueue.hpp"
+#include "softwareOcclusion.hpp"
+#include "virtualTexture.hpp"
+#include "model.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iomanip>
+#include <algorithm>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	constexpr int QUERY_COUNT = 200;
+
+	double elapsedMs(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// Runs a batch of queries through the tree and through a linear scan of the same leaf boxes
+	struct QueryResult
+	{
+		double bvhMs = 0.0;
+		double bruteMs = 0.0;
+		size_t bvhHits = 0;
+		size_t bruteHits = 0;
+	};
+
+	void printRow(const char* label, const QueryResult& result)
+	{
+		std::cout << "  " << std::left << std::setw(10) << label << std::right
+			<< std::setw(12) << result.bvhMs << " ms" << std::setw(12) << result.bruteMs << " ms"
+			<< std::setw(9) << (result.bvhMs > 0.0 ? result.bruteMs / result.bvhMs : 0.0) << "x"
+			<< (result.bvhHits == result.bruteHits ? "" : "  MISMATCH") << std::endl;
+	}
+
+	bool benchmarkCount(size_t count)
+	{
+		std::mt19937 rng(1234);
+
+		// Constant density: the world grows with the object count
+		const float worldHalfSize = 0.5f * std::cbrt(static_cast<float>(count)) * 4.0f;
+		std::uniform_real_distribution<float> position(-worldHalfSize, worldHalfSize);
+		std::uniform_real_distribution<float> size(0.25f, 1.5f);
+		std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+		std::vector<uint32_t> items(count);
+		std::vector<AABB> bounds(count);
+		for (size_t i = 0; i < count; ++i)
+		{
+			const glm::vec3 center(position(rng), position(rng), position(rng));
+			const glm::vec3 half(size(rng) * 0.5f);
+			items[i] = static_cast<uint32_t>(i);
+			bounds[i] = { center - half, center + half };
+		}
+
+		std::cout << count << " objects" << std::endl;
+
+		BVH bvh;
+		std::vector<uint32_t> leaves;
+		auto start = std::chrono::steady_clock::now();
+		bvh.build(items, bounds, leaves);
+		const double buildMs = elapsedMs(start);
+
+		BVH incremental;
+		start = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < count; ++i)
+		{
+			incremental.insert(items[i], bounds[i]);
+		}
+		const double insertMs = elapsedMs(start);
+
+		std::cout << std::fixed << std::setprecision(3);
+		std::cout << "  SAH build      " << buildMs << " ms (height " << bvh.height() << ", cost " << bvh.sahCost() << ")" << std::endl;
+		std::cout << "  Insert build   " << insertMs << " ms (height " << incremental.height() << ", cost " << incremental.sahCost() << ")" << std::endl;
+
+		// Small jitter on every object stays inside the fat margin or is absorbed by a refit
+		std::uniform_real_distribution<float> jitter(-0.05f, 0.05f);
+		for (size_t i = 0; i < count; ++i)
+		{
+			const glm::vec3 offset(jitter(rng), jitter(rng), jitter(rng));
+			bounds[i].min += offset;
+			bounds[i].max += offset;
+		}
+		start = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < count; ++i)
+		{
+			bvh.setLeafBounds(leaves[i], bounds[i]);
+		}
+		bvh.refit();
+		const double refitMs = elapsedMs(start);
+
+		// One percent of the objects teleport and must be reinserted
+		const size_t movedCount = std::max<size_t>(count / 100, 1);
+		size_t reinserted = 0;
+		start = std::chrono::steady_clock::now();
+		for (size_t n = 0; n < movedCount; ++n)
+		{
+			const size_t i = rng() % count;
+			const glm::vec3 center(position(rng), position(rng), position(rng));
+			const glm::vec3 half = bounds[i].extents();
+			bounds[i] = { center - half, center + half };
+			reinserted += bvh.move(leaves[i], bounds[i]) ? 1 : 0;
+		}
+		const double moveMs = elapsedMs(start);
+
+		std::cout << "  Refit all      " << refitMs << " ms" << std::endl;
+		std::cout << "  Reinsert 1%    " << moveMs << " ms (" << reinserted << " of " << movedCount << " moved)" << std::endl;
+
+		// Brute force scans the exact boxes the tree stores so hit counts must match
+		std::vector<AABB> leafBounds(count);
+		for (size_t i = 0; i < count; ++i)
+		{
+			leafBounds[i] = bvh.leafBounds(leaves[i]);
+		}
+
+		std::cout << "  " << std::left << std::setw(10) << "Query" << std::right
+			<< std::setw(15) << "BVH" << std::setw(15) << "Brute" << std::setw(10) << "Speedup" << std::endl;
+
+		bool matched = true;
+		std::vector<uint32_t> hits;
+		auto runQueries = [&](const char* label, auto&& queryTree, auto&& testBox)
+		{
+			std::mt19937 queryRng(99);
+			QueryResult result;
+			for (int q = 0; q < QUERY_COUNT; ++q)
+			{
+				const uint32_t seed = queryRng();
+
+				hits.clear();
+				auto queryStart = std::chrono::steady_clock::now();
+				queryTree(seed, hits);
+				result.bvhMs += elapsedMs(queryStart);
+				result.bvhHits += hits.size();
+
+				queryStart = std::chrono::steady_clock::now();
+				size_t bruteHits = 0;
+				for (size_t i = 0; i < count; ++i)
+				{
+					bruteHits += testBox(seed, leafBounds[i]) ? 1 : 0;
+				}
+				result.bruteMs += elapsedMs(queryStart);
+				result.bruteHits += bruteHits;
+			}
+			printRow(label, result);
+			matched = matched && result.bvhHits == result.bruteHits;
+		};
+
+		// Query shapes are derived from a per-query seed so both paths see the same one
+		auto frustumFor = [&](uint32_t seed)
+		{
+			std::mt19937 local(seed);
+			const glm::vec3 eye(position(local), position(local), position(local));
+			const glm::vec3 forward = glm::normalize(glm::vec3(unit(local), unit(local) * 0.3f, unit(local)) + glm::vec3(0.001f));
+			const glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 100.0f);
+			return Frustum::fromMatrix(projection * glm::lookAt(eye, eye + forward, glm::vec3(0.0f, 1.0f, 0.0f)));
+		};
+		auto sphereFor = [&](uint32_t seed)
+		{
+			std::mt19937 local(seed);
+			return Sphere{ glm::vec3(position(local), position(local), position(local)), 10.0f };
+		};
+		auto boxFor = [&](uint32_t seed)
+		{
+			std::mt19937 local(seed);
+			const glm::vec3 center(position(local), position(local), position(local));
+			return AABB{ center - glm::vec3(8.0f), center + glm::vec3(8.0f) };
+		};
+		auto rayFor = [&](uint32_t seed)
+		{
+			std::mt19937 local(seed);
+			const glm::vec3 origin(position(local), position(local), position(local));
+			return Ray(origin, glm::normalize(glm::vec3(unit(local), unit(local), unit(local)) + glm::vec3(0.001f)));
+		};
+		const float rayLength = worldHalfSize * 2.0f;
+
+		// Frustum construction is repeated per test on the brute side, so cache it per seed
+		uint32_t cachedSeed = 0;
+		Frustum cachedFrustum;
+		runQueries("Frustum",
+			[&](uint32_t seed, std::vector<uint32_t>& out) { bvh.queryFrustum(frustumFor(seed), out); },
+			[&](uint32_t seed, const AABB& box)
+			{
+				if (seed != cachedSeed)
+				{
+					cachedSeed = seed;
+					cachedFrustum = frustumFor(seed);
+				}
+				return cachedFrustum.overlaps(box);
+			});
+
+		Sphere cachedSphere;
+		cachedSeed = 0;
+		runQueries("Sphere",
+			[&](uint32_t seed, std::vector<uint32_t>& out) { bvh.querySphere(sphereFor(seed), out); },
+			[&](uint32_t seed, const AABB& box)
+			{
+				if (seed != cachedSeed)
+				{
+					cachedSeed = seed;
+					cachedSphere = sphereFor(seed);
+				}
+				return cachedSphere.overlaps(box);
+			});
+
+		AABB cachedBox;
+		cachedSeed = 0;
+		runQueries("Box",
+			[&](uint32_t seed, std::vector<uint32_t>& out) { bvh.queryBox(boxFor(seed), out); },
+			[&](uint32_t seed, const AABB& box)
+			{
+				if (seed != cachedSeed)
+				{
+					cachedSeed = seed;
+					cachedBox = boxFor(seed);
+				}
+				return cachedBox.overlaps(box);
+			});
+
+		Ray cachedRay;
+		cachedSeed = 0;
+		runQueries("Ray",
+			[&](uint32_t seed, std::vector<uint32_t>& out) { bvh.queryRay(rayFor(seed), rayLength, out); },
+			[&](uint32_t seed, const AABB& box)
+			{
+				if (seed != cachedSeed)
+				{
+					cachedSeed = seed;
+					cachedRay = rayFor(seed);
+				}
+				float tNear;
+				return cachedRay.intersects(box, rayLength, tNear);
+			});
+
+		// Nearest hit exits early, compared against a full scan for the closest box
+		QueryResult nearest;
+		std::mt19937 queryRng(99);
+		for (int q = 0; q < QUERY_COUNT; ++q)
+		{
+			const Ray ray = rayFor(queryRng());
+
+			auto queryStart = std::chrono::steady_clock::now();
+			float bvhDistance;
+			const uint32_t bvhHit = bvh.raycast(ray, rayLength, bvhDistance);
+			nearest.bvhMs += elapsedMs(queryStart);
+
+			queryStart = std::chrono::steady_clock::now();
+			float bruteDistance = rayLength;
+			bool bruteHit = false;
+			for (size_t i = 0; i < count; ++i)
+			{
+				float tNear;
+				if (ray.intersects(leafBounds[i], bruteDistance, tNear))
+				{
+					bruteDistance = tNear;
+					bruteHit = true;
+				}
+			}
+			nearest.bruteMs += elapsedMs(queryStart);
+
+			nearest.bvhHits += bvhHit != BVH::NULL_NODE ? 1 : 0;
+			nearest.bruteHits += bruteHit ? 1 : 0;
+			if (bruteHit && bvhHit != BVH::NULL_NODE && std::abs(bvhDistance - bruteDistance) > 1e-4f)
+			{
+				++nearest.bvhHits;
+			}
+		}
+		printRow("Raycast", nearest);
+		matched = matched && nearest.bvhHits == nearest.bruteHits;
+
+		std::cout << std::endl;
+		return matched;
+	}
+
+	// What blinnPhong.frag's sampleVirtualAlbedo does for one pixel, with nearest filtering so texels compare exactly
+	struct VirtualSample
+	{
+		int wantedLevel = 0;
+		uint32_t request = 0;
+		int residentLevel = -1; // -1 when the indirection entry is empty
+		const uint8_t* texel = nullptr;
+		glm::ivec2 levelTexel{ 0 }; // Of the resident level, for the reference
+	};
+
+	VirtualSample SampleVirtualTexture(const VirtualPageCache& cache, int id, glm::vec2 uv, glm::vec2 dx, glm::vec2 dy, const std::vector<uint8_t>& physical)
+	{
+		const VirtualPageCache::Texture& texture = cache.textures[id];
+		const float footprint = std::max(glm::dot(dx, dx), glm::dot(dy, dy));
+		VirtualSample sample;
+		sample.wantedLevel = std::clamp(static_cast<int>(std::floor(0.5f * std::log2(std::max(footprint, 1e-8f)))), 0, texture.levelCount - 1);
+
+		const float wrappedX = uv.x - std::floor(uv.x);
+		const float wrappedY = uv.y - std::floor(uv.y);
+		const int pageX = static_cast<int>(wrappedX * VirtualPageCache::levelSize(texture.width, sample.wantedLevel) / VirtualPageCache::PAGE_SIZE);
+		const int pageY = static_cast<int>(wrappedY * VirtualPageCache::levelSize(texture.height, sample.wantedLevel) / VirtualPageCache::PAGE_SIZE);
+		sample.request = VirtualPageCache::packRequest(id, sample.wantedLevel, pageX, pageY);
+
+		const uint32_t entry = texture.table[sample.wantedLevel][static_cast<size_t>(pageY) * VirtualPageCache::gridSize(texture.pagesX, sample.wantedLevel) + pageX];
+		if ((entry >> 24) == 0)
+		{
+			return sample;
+		}
+		sample.residentLevel = static_cast<int>((entry >> 16) & 0xFF);
+		sample.levelTexel.x = static_cast<int>(wrappedX * VirtualPageCache::levelSize(texture.width, sample.residentLevel));
+		sample.levelTexel.y = static_cast<int>(wrappedY * VirtualPageCache::levelSize(texture.height, sample.residentLevel));
+		const int physicalX = static_cast<int>(entry & 0xFF) * VirtualPageCache::PAGE_SIZE + sample.levelTexel.x % VirtualPageCache::PAGE_SIZE;
+		const int physicalY = static_cast<int>((entry >> 8) & 0xFF) * VirtualPageCache::PAGE_SIZE + sample.levelTexel.y % VirtualPageCache::PAGE_SIZE;
+		sample.texel = physical.data() + (static_cast<size_t>(physicalY) * cache.slotsX * VirtualPageCache::PAGE_SIZE + physicalX) * 4;
+		return sample;
+	}
+}
+
+int runOcclusionBenchmark()
+{
+	constexpr int OCCLUDER_COUNT = 400;
+	constexpr int QUERY_BOXES = 20000;
+	constexpr int RENDER_RUNS = 50;
+	constexpr int WIDTH = 320;
+	constexpr int HEIGHT = 180;
+
+	// Unit cube, each face wound counter-clockwise seen from outside
+	std::vector<glm::vec3> cubePositions;
+	for (int i = 0; i < 8; ++i)
+	{
+		cubePositions.push_back(glm::vec3((i & 1) ? 0.5f : -0.5f, (i & 2) ? 0.5f : -0.5f, (i & 4) ? 0.5f : -0.5f));
+	}
+	const uint32_t faces[6][4] = { { 0, 2, 6, 4 }, { 1, 3, 7, 5 }, { 0, 1, 5, 4 }, { 2, 3, 7, 6 }, { 0, 1, 3, 2 }, { 4, 5, 7, 6 } };
+	std::vector<uint32_t> cubeIndices;
+	for (const auto& face : faces)
+	{
+		const glm::vec3 normal = glm::cross(cubePositions[face[1]] - cubePositions[face[0]], cubePositions[face[2]] - cubePositions[face[0]]);
+		const glm::vec3 faceCenter = (cubePositions[face[0]] + cubePositions[face[2]]) * 0.5f;
+		const bool flip = glm::dot(normal, faceCenter) < 0.0f;
+		const uint32_t quad[4] = { face[0], flip ? face[3] : face[1], face[2], flip ? face[1] : face[3] };
+		cubeIndices.insert(cubeIndices.end(), { quad[0], quad[1], quad[2], quad[0], quad[2], quad[3] });
+	}
+
+	std::mt19937 rng(4321);
+	std::uniform_real_distribution<float> lateral(-30.0f, 30.0f);
+	std::uniform_real_distribution<float> distance(-80.0f, -5.0f);
+	std::uniform_real_distribution<float> size(1.0f, 8.0f);
+
+	std::vector<OccluderMesh> occluders(OCCLUDER_COUNT);
+	for (OccluderMesh& occluder : occluders)
+	{
+		const glm::vec3 center(lateral(rng), lateral(rng) * 0.5f, distance(rng));
+		occluder.world = glm::scale(glm::translate(glm::mat4(1.0f), center), glm::vec3(size(rng), size(rng), size(rng) * 0.25f));
+		occluder.positions = cubePositions.data();
+		occluder.stride = sizeof(glm::vec3);
+		occluder.indices = cubeIndices.data();
+		occluder.indexCount = cubeIndices.size();
+	}
+
+	std::vector<AABB> queries(QUERY_BOXES);
+	std::uniform_real_distribution<float> querySize(0.2f, 2.0f);
+	for (AABB& box : queries)
+	{
+		const glm::vec3 center(lateral(rng), lateral(rng) * 0.5f, distance(rng) - 10.0f);
+		const glm::vec3 half(querySize(rng));
+		box = { center - half, center + half };
+	}
+
+	const glm::mat4 projection = glm::perspective(glm::radians(60.0f), static_cast<float>(WIDTH) / HEIGHT, 0.1f, 200.0f);
+	const glm::mat4 viewProjection = projection * glm::lookAt(glm::vec3(0.0f, 2.0f, 10.0f), glm::vec3(0.0f, 0.0f, -40.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+	SoftwareOcclusion reference(WIDTH, HEIGHT, SoftwareOcclusion::Isa::Scalar, 1);
+	reference.render(occluders, viewProjection);
+	const std::vector<float> referenceDepth = reference.depthBuffer();
+	std::vector<uint8_t> referenceVisible(QUERY_BOXES);
+	size_t occludedCount = 0;
+	for (int i = 0; i < QUERY_BOXES; ++i)
+	{
+		referenceVisible[i] = reference.isVisible(viewProjection, queries[i]) ? 1 : 0;
+		occludedCount += referenceVisible[i] ? 0 : 1;
+	}
+
+	std::cout << "Software occlusion benchmark, " << WIDTH << "x" << HEIGHT << ", " << OCCLUDER_COUNT << " occluders ("
+		<< reference.triangleCount() << " triangles after clipping and culling)" << std::endl;
+	std::cout << QUERY_BOXES << " query boxes, " << occludedCount << " occluded in the reference" << std::endl << std::endl;
+	std::cout << std::fixed << std::setprecision(3);
+	std::cout << "  " << std::left << std::setw(8) << "Kernel" << std::right << std::setw(8) << "Threads"
+		<< std::setw(14) << "Render" << std::setw(14) << "Queries" << std::setw(12) << "Depth diff" << std::setw(12) << "Test diff" << std::endl;
+
+	const int hardwareThreads = std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+	bool matched = true;
+	for (SoftwareOcclusion::Isa isa : { SoftwareOcclusion::Isa::Scalar, SoftwareOcclusion::Isa::SSE4, SoftwareOcclusion::Isa::AVX2 })
+	{
+		if (!SoftwareOcclusion::isSupported(isa))
+		{
+			std::cout << "  " << std::left << std::setw(8) << SoftwareOcclusion::isaName(isa) << std::right << "  not available" << std::endl;
+			continue;
+		}
+
+		for (int threads : { 1, hardwareThreads })
+		{
+			SoftwareOcclusion occlusion(WIDTH, HEIGHT, isa, threads);
+
+			auto start = std::chrono::steady_clock::now();
+			for (int run = 0; run < RENDER_RUNS; ++run)
+			{
+				occlusion.render(occluders, viewProjection);
+			}
+			const double renderMs = elapsedMs(start) / RENDER_RUNS;
+
+			start = std::chrono::steady_clock::now();
+			size_t testMismatches = 0;
+			for (int i = 0; i < QUERY_BOXES; ++i)
+			{
+				const bool visible = occlusion.isVisible(viewProjection, queries[i]);
+				testMismatches += visible != (referenceVisible[i] != 0) ? 1 : 0;
+			}
+			const double queryMs = elapsedMs(start);
+
+			size_t depthMismatches = 0;
+			const std::vector<float>& depth = occlusion.depthBuffer();
+			for (size_t i = 0; i < depth.size(); ++i)
+			{
+				depthMismatches += depth[i] != referenceDepth[i] ? 1 : 0;
+			}
+
+			std::cout << "  " << std::left << std::setw(8) << SoftwareOcclusion::isaName(isa) << std::right << std::setw(8) << occlusion.threadCount
+				<< std::setw(11) << renderMs << " ms" << std::setw(11) << queryMs << " ms"
+				<< std::setw(12) << depthMismatches << std::setw(12) << testMismatches << std::endl;
+			matched = matched && depthMismatches == 0 && testMismatches == 0;
+
+			if (threads == hardwareThreads || hardwareThreads == 1)
+			{
+				break;
+			}
+		}
+	}
+
+	if (!matched)
+	{
+		std::cout << "Software occlusion results differ from the scalar reference" << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+int runBvhBenchmark()
+{
+	std::cout << "BVH benchmark, " << QUERY_COUNT << " queries per shape" << std::endl << std::endl;
+
+	bool matched = true;
+	for (size_t count : { size_t(10000), size_t(100000), size_t(1000000) })
+	{
+		matched = benchmarkCount(count) && matched;
+	}
+
+	if (!matched)
+	{
+		std::cout << "BVH results differ from the brute-force scan" << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+int runJobBenchmark()
+{
+	constexpr int EMPTY_JOBS = 100000;
+	constexpr size_t ITEMS = 1 << 22;
+	constexpr int FOR_RUNS = 20;
+
+	const int hardwareThreads = std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+	std::cout << "Job system benchmark, " << hardwareThreads << " hardware threads" << std::endl << std::endl;
+
+	// Every index visited exactly once, flat and nested, and counters reaching zero
+	bool correct = true;
+	for (int threads : { 1, 2, hardwareThreads })
+	{
+		JobSystem jobs;
+		jobs.init(threads);
+
+		std::vector<std::atomic<int>> hits(100003);
+		jobs.parallelFor(0, hits.size(), 97, [&](size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; ++i)
+				{
+					hits[i].fetch_add(1, std::memory_order_relaxed);
+				}
+			});
+
+		std::vector<std::atomic<int>> nested(64 * 1000);
+		jobs.parallelFor(0, 64, 1, [&](size_t outerBegin, size_t outerEnd)
+			{
+				for (size_t outer = outerBegin; outer < outerEnd; ++outer)
+				{
+					jobs.parallelFor(0, 1000, 10, [&](size_t begin, size_t end)
+						{
+							for (size_t i = begin; i < end; ++i)
+							{
+								nested[outer * 1000 + i].fetch_add(1, std::memory_order_relaxed);
+							}
+						});
+				}
+			});
+
+		JobCounter counter;
+		std::atomic<int> ran{ 0 };
+		for (int i = 0; i < 1000; ++i)
+		{
+			jobs.run(counter, [&]() { ran.fetch_add(1, std::memory_order_relaxed); });
+		}
+		jobs.wait(counter);
+
+		const bool flatOk = std::all_of(hits.begin(), hits.end(), [](const std::atomic<int>& hit) { return hit.load() == 1; });
+		const bool nestedOk = std::all_of(nested.begin(), nested.end(), [](const std::atomic<int>& hit) { return hit.load() == 1; });
+		const bool counterOk = counter.done() && ran.load() == 1000;
+		std::cout << "  " << jobs.threadCount() << " threads: parallel for " << (flatOk ? "ok" : "FAILED")
+			<< ", nested " << (nestedOk ? "ok" : "FAILED") << ", counter " << (counterOk ? "ok" : "FAILED") << std::endl;
+		correct = correct && flatOk && nestedOk && counterOk;
+	}
+	std::cout << std::endl;
+
+	std::vector<float> values(ITEMS);
+	std::iota(values.begin(), values.end(), 0.0f);
+	auto work = [&values](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; ++i)
+			{
+				values[i] = std::sqrt(values[i] * 1.0001f + 1.0f);
+			}
+		};
+
+	std::cout << std::fixed << std::setprecision(3);
+	std::cout << "  " << std::setw(8) << "Threads" << std::setw(16) << "Empty job" << std::setw(16) << "Parallel for" << std::setw(10) << "Speedup" << std::endl;
+
+	double singleMs = 0.0;
+	for (int threads = 1;; threads = std::min(threads * 2, hardwareThreads))
+	{
+		JobSystem jobs;
+		jobs.init(threads);
+
+		// Scheduler overhead: spawn, steal or pop, and retire jobs that do nothing
+		JobCounter counter;
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < EMPTY_JOBS; ++i)
+		{
+			jobs.run(counter, []() {});
+		}
+		jobs.wait(counter);
+		const double emptyNs = elapsedMs(start) * 1.0e6 / EMPTY_JOBS;
+
+		start = std::chrono::steady_clock::now();
+		for (int run = 0; run < FOR_RUNS; ++run)
+		{
+			jobs.parallelFor(0, ITEMS, 16384, work);
+		}
+		const double forMs = elapsedMs(start) / FOR_RUNS;
+		if (threads == 1)
+		{
+			singleMs = forMs;
+		}
+
+		std::cout << "  " << std::setw(8) << jobs.threadCount() << std::setw(13) << emptyNs << " ns"
+			<< std::setw(13) << forMs << " ms" << std::setw(9) << (forMs > 0.0 ? singleMs / forMs : 0.0) << "x" << std::endl;
+
+		if (threads == hardwareThreads)
+		{
+			break;
+		}
+	}
+
+	if (!correct)
+	{
+		std::cout << "Job system results are wrong" << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+int runDrawSortBenchmark()
+{
+	constexpr int DRAW_COUNT = 100000;
+	constexpr int SORT_RUNS = 50;
+
+	// Roughly what a large scene produces: few passes and variants, more materials, many meshes
+	std::mt19937 rng(2468);
+	std::uniform_int_distribution<uint32_t> pass(0, 2);
+	std::uniform_int_distribution<uint32_t> variant(0, 7);
+	std::uniform_int_distribution<uint32_t> material(0, 255);
+	std::uniform_int_distribution<uint32_t> vao(1, 4096);
+	std::uniform_int_distribution<uint32_t> depth(0, DrawKey::DEPTH_BUCKETS - 1);
+
+	std::vector<DrawSortEntry> unsorted(DRAW_COUNT);
+	for (uint32_t i = 0; i < DRAW_COUNT; ++i)
+	{
+		unsorted[i] = { DrawKey::make(static_cast<RenderPassId>(pass(rng)), variant(rng), material(rng), vao(rng), depth(rng)), i };
+	}
+
+	std::vector<DrawSortEntry> radix;
+	std::vector<DrawSortEntry> scratch;
+	auto start = std::chrono::steady_clock::now();
+	for (int run = 0; run < SORT_RUNS; ++run)
+	{
+		radix = unsorted;
+		RadixSortDrawKeys(radix, scratch);
+	}
+	const double radixMs = elapsedMs(start) / SORT_RUNS;
+
+	std::vector<DrawSortEntry> reference;
+	start = std::chrono::steady_clock::now();
+	for (int run = 0; run < SORT_RUNS; ++run)
+	{
+		reference = unsorted;
+		std::stable_sort(reference.begin(), reference.end(), [](const DrawSortEntry& a, const DrawSortEntry& b) { return a.key < b.key; });
+	}
+	const double referenceMs = elapsedMs(start) / SORT_RUNS;
+
+	// Both sorts are stable, so ties keep their submission order and the results must be identical
+	const bool matched = std::equal(radix.begin(), radix.end(), reference.begin(),
+		[](const DrawSortEntry& a, const DrawSortEntry& b) { return a.key == b.key && a.item == b.item; });
+
+	std::cout << "Draw key sort benchmark, " << DRAW_COUNT << " draws" << std::endl << std::endl;
+	std::cout << std::fixed << std::setprecision(3);
+	std::cout << "  Radix sort     " << std::setw(10) << radixMs << " ms" << std::endl;
+	std::cout << "  std::stable_sort" << std::setw(9) << referenceMs << " ms" << std::endl;
+	std::cout << "  Speedup        " << std::setw(10) << (radixMs > 0.0 ? referenceMs / radixMs : 0.0) << "x" << std::endl;
+
+	if (!matched)
+	{
+		std::cout << "Radix sort order differs from std::stable_sort" << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+int runVirtualTextureBenchmark()
+{
+	constexpr int WIDTH = 1000; // Not a power of two, so pages run past the edges
+	constexpr int HEIGHT = 600;
+	constexpr int SCREEN_WIDTH = 256;
+	constexpr int SCREEN_HEIGHT = 160;
+	constexpr int FEEDBACK_SCALE = VirtualTextureSystem::FEEDBACK_SCALE;
+	constexpr int FEEDBACK_LATENCY = VirtualTextureSystem::READBACK_FRAMES;
+	constexpr int FRAMES_PER_VIEW = FEEDBACK_SCALE * FEEDBACK_SCALE + 16; // Every jitter offset, then time to settle
+	constexpr int UPLOADS_PER_FRAME = 4;
+	constexpr int SLOTS = 4; // Per axis, small enough that changing view has to evict
+
+	// Every texel different, so a page in the wrong slot or at the wrong level cannot match by accident
+	std::vector<uint8_t> pixels(static_cast<size_t>(WIDTH) * HEIGHT * 3);
+	std::mt19937 rng(1357);
+	for (uint8_t& value : pixels)
+	{
+		value = static_cast<uint8_t>(rng());
+	}
+	DecodedTexture decoded;
+	decoded.data = pixels.data();
+	decoded.width = WIDTH;
+	decoded.height = HEIGHT;
+	decoded.channels = 3;
+
+	VirtualPageCache cache;
+	cache.init(SLOTS, SLOTS);
+	const int id = cache.addTexture(WIDTH, HEIGHT);
+	const MipChain chain = BuildMipChain(decoded, 0, cache.textures[id].levelCount - 1);
+	std::vector<uint8_t> physical(static_cast<size_t>(SLOTS) * SLOTS * VirtualPageCache::PAGE_SIZE * VirtualPageCache::PAGE_SIZE * 4);
+	auto load = [&](int slot, uint32_t request)
+	{
+		std::vector<uint8_t> page(VirtualPageCache::PAGE_SIZE * VirtualPageCache::PAGE_SIZE * 4);
+		CutVirtualPage(chain, request, page.data());
+		const size_t rowBytes = VirtualPageCache::PAGE_SIZE * 4;
+		for (int y = 0; y < VirtualPageCache::PAGE_SIZE; ++y)
+		{
+			const size_t row = static_cast<size_t>((slot / SLOTS) * VirtualPageCache::PAGE_SIZE + y) * SLOTS * rowBytes + (slot % SLOTS) * rowBytes;
+			std::copy_n(page.data() + y * rowBytes, rowBytes, physical.data() + row);
+		}
+	};
+
+	// What VirtualTextureSystem::upload does before the first frame
+	const int tailSlot = cache.allocate(cache.tailRequest(id), true);
+	load(tailSlot, cache.tailRequest(id));
+	cache.commit(tailSlot, cache.slots[tailSlot].generation);
+	cache.buildTable(id);
+
+	// UV origin and UV per pixel: the whole texture minified, a magnified close-up, a view across the wrap, then back
+	struct View
+	{
+		const char* name;
+		glm::vec2 origin;
+		glm::vec2 uvPerPixel;
+	};
+	const View views[] = {
+		{ "Minified", { 0.0f, 0.0f }, glm::vec2(4.0f / WIDTH, 4.0f / HEIGHT) },
+		{ "Close-up", { 0.55f, 0.3f }, glm::vec2(0.5f / WIDTH, 0.5f / HEIGHT) },
+		{ "Wrapping", { 0.9f, 0.85f }, glm::vec2(1.0f / WIDTH, 1.0f / HEIGHT) },
+		{ "Minified", { 0.0f, 0.0f }, glm::vec2(4.0f / WIDTH, 4.0f / HEIGHT) },
+	};
+
+	std::cout << "Virtual texture benchmark, " << WIDTH << "x" << HEIGHT << " texture, " << SLOTS * SLOTS << " page slots, "
+		<< SCREEN_WIDTH << "x" << SCREEN_HEIGHT << " screen" << std::endl << std::endl;
+	std::cout << "  View        Frames to converge  Pages loaded" << std::endl;
+
+	std::vector<std::vector<uint32_t>> feedbackFrames;
+	std::vector<uint32_t> requests;
+	size_t wrongTexels = 0;
+	size_t finerThanWanted = 0;
+	bool converged = true;
+	double analyseMs = 0.0;
+	int frame = 0;
+	for (const View& view : views)
+	{
+		int convergedFrame = -1;
+		int pagesLoaded = 0;
+		for (int viewFrame = 0; viewFrame < FRAMES_PER_VIEW; ++viewFrame, ++frame)
+		{
+			cache.beginFrame();
+
+			// Feedback rendered FEEDBACK_LATENCY frames ago, as the readback ring hands it over
+			if (static_cast<int>(feedbackFrames.size()) > FEEDBACK_LATENCY)
+			{
+				const std::vector<uint32_t>& feedback = feedbackFrames[feedbackFrames.size() - 1 - FEEDBACK_LATENCY];
+				const auto start = std::chrono::steady_clock::now();
+				cache.analyse(feedback.data(), feedback.size(), requests);
+				analyseMs += elapsedMs(start);
+				for (size_t i = 0; i < requests.size() && i < UPLOADS_PER_FRAME; ++i)
+				{
+					const int slot = cache.allocate(requests[i]);
+					if (slot < 0)
+					{
+						break;
+					}
+					load(slot, requests[i]);
+					cache.commit(slot, cache.slots[slot].generation);
+					++pagesLoaded;
+				}
+				cache.buildTable(id);
+			}
+
+			// Draw the frame: check every pixel against the reference chain and write this frame's feedback pixels
+			std::vector<uint32_t> feedback(static_cast<size_t>(SCREEN_WIDTH / FEEDBACK_SCALE) * (SCREEN_HEIGHT / FEEDBACK_SCALE), VirtualPageCache::NO_REQUEST);
+			const int jitter = (frame * 7) % (FEEDBACK_SCALE * FEEDBACK_SCALE);
+			const glm::ivec2 offset(jitter % FEEDBACK_SCALE, jitter / FEEDBACK_SCALE);
+			const glm::vec2 dx(view.uvPerPixel.x * WIDTH, 0.0f);
+			const glm::vec2 dy(0.0f, view.uvPerPixel.y * HEIGHT);
+			bool exact = true;
+			for (int y = 0; y < SCREEN_HEIGHT; ++y)
+			{
+				for (int x = 0; x < SCREEN_WIDTH; ++x)
+				{
+					const glm::vec2 uv = view.origin + (glm::vec2(x, y) + 0.5f) * view.uvPerPixel;
+					const VirtualSample sample = SampleVirtualTexture(cache, id, uv, dx, dy, physical);
+					if (x % FEEDBACK_SCALE == offset.x && y % FEEDBACK_SCALE == offset.y)
+					{
+						feedback[static_cast<size_t>(y / FEEDBACK_SCALE) * (SCREEN_WIDTH / FEEDBACK_SCALE) + x / FEEDBACK_SCALE] = sample.request;
+					}
+
+					if (sample.residentLevel < 0)
+					{
+						++wrongTexels;
+						continue;
+					}
+					const int level = sample.residentLevel;
+					const uint8_t* reference = chain.levels[level].data() + (static_cast<size_t>(sample.levelTexel.y) * chain.sizes[level].x + sample.levelTexel.x) * 3;
+					if (sample.texel[0] != reference[0] || sample.texel[1] != reference[1] || sample.texel[2] != reference[2] || sample.texel[3] != 255)
+					{
+						++wrongTexels;
+					}
+					finerThanWanted += sample.residentLevel < sample.wantedLevel ? 1 : 0;
+					exact = exact && sample.residentLevel == sample.wantedLevel;
+				}
+			}
+			feedbackFrames.push_back(std::move(feedback));
+
+			if (exact && convergedFrame < 0)
+			{
+				convergedFrame = viewFrame;
+			}
+			else if (!exact)
+			{
+				convergedFrame = -1;
+			}
+		}
+
+		std::cout << "  " << std::left << std::setw(12) << view.name << std::right << std::setw(18);
+		if (convergedFrame >= 0)
+		{
+			std::cout << convergedFrame;
+		}
+		else
+		{
+			std::cout << "never";
+		}
+		std::cout << std::setw(14) << pagesLoaded << std::endl;
+		converged = converged && convergedFrame >= 0;
+	}
+
+	std::cout << std::endl << std::fixed << std::setprecision(3);
+	std::cout << "  Feedback analysis " << analyseMs * 1000.0 / (frame - FEEDBACK_LATENCY) << " us per frame" << std::endl;
+
+	if (wrongTexels > 0 || finerThanWanted > 0 || !converged)
+	{
+		std::cout << "FAILED: " << wrongTexels << " texels differ from the reference, " << finerThanWanted
+			<< " came from a level finer than wanted" << (converged ? "" : ", a view never converged") << std::endl;
+		return 1;
+	}
+	std::cout << "Every sampled texel matched its mip level, every view converged" << std::endl;
+	return 0;
+}
@@ -0,0 +1,105 @@
+#include "bloom.hpp"
+#include "profiler.hpp"
+#include "renderStats.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	// Zone names have to outlive the profiler's history, so every level gets a literal
+	const char* const DOWNSAMPLE_ZONES[Bloom::MAX_LEVELS] = {
+		"Bloom Down 0", "Bloom Down 1", "Bloom Down 2", "Bloom Down 3", "Bloom Down 4", "Bloom Down 5"
+	};
+	const char* const UPSAMPLE_ZONES[Bloom::MAX_LEVELS] = {
+		"Bloom Up 0", "Bloom Up 1", "Bloom Up 2", "Bloom Up 3", "Bloom Up 4", "Bloom Up 5"
+	};
+
+	GLuint groupCount(int size)
+	{
+		return static_cast<GLuint>((size + 7) / 8);
+	}
+
+	glm::ivec2 halve(glm::ivec2 size)
+	{
+		return glm::max((size + 1) / 2, glm::ivec2(1));
+	}
+}
+
+Bloom::Bloom()
+	: downsampleShader("shaders/bloomDownsample.comp"),
+	  upsampleShader("shaders/bloomUpsample.comp")
+{
+}
+
+RenderGraphTextureDesc Bloom::chainDesc(int targetWidth, int targetHeight)
+{
+	const glm::ivec2 size = halve({ targetWidth, targetHeight });
+
+	// Stop while the smallest level is still about 8 texels across, below that it is just a flat glow
+	const int fit = static_cast<int>(std::floor(std::log2(static_cast<float>(std::min(size.x, size.y))))) - 2;
+	const int levels = std::clamp(fit, 1, MAX_LEVELS);
+
+	return { size.x, size.y, GL_R11F_G11F_B10F, GL_LINEAR, GL_CLAMP_TO_EDGE, levels };
+}
+
+void Bloom::render(GLuint hdrTexture, int renderWidth, int renderHeight, GLuint chainTexture, const RenderGraphTextureDesc& chain)
+{
+	levels = chain.levels;
+	glm::ivec2 source{ renderWidth, renderHeight };
+	glm::ivec2 size{ chain.width, chain.height };
+	for (int level = 0; level < levels; ++level)
+	{
+		regions[level] = glm::min(halve(source), size);
+		sizes[level] = size;
+		source = regions[level];
+		size = halve(size);
+	}
+
+	downsampleShader.use();
+	downsampleShader.setInt("source", 0);
+	downsampleShader.setVec4("thresholdCurve", glm::vec4(threshold, threshold - knee, 2.0f * knee, 0.25f / std::max(knee, 1.0e-4f)));
+	for (int level = 0; level < levels; ++level)
+	{
+		profiler.beginGpuZone(DOWNSAMPLE_ZONES[level]);
+
+		const bool fromScene = level == 0;
+		countedBindTextureUnit(0, fromScene ? hdrTexture : chainTexture);
+		downsampleShader.setInt("sourceLod", fromScene ? 0 : level - 1);
+		downsampleShader.setIVec2("sourceSize", fromScene ? glm::ivec2(renderWidth, renderHeight) : regions[level - 1]);
+		downsampleShader.setIVec2("targetSize", regions[level]);
+		downsampleShader.setBool("prefilter", fromScene);
+		glBindImageTexture(0, chainTexture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R11F_G11F_B10F);
+
+		glDispatchCompute(groupCount(regions[level].x), groupCount(regions[level].y), 1);
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+		profiler.endGpuZone();
+	}
+
+	upsampleShader.use();
+	upsampleShader.setInt("source", 0);
+	upsampleShader.setFloat("filterRadius", filterRadius);
+	countedBindTextureUnit(0, chainTexture);
+	for (int level = levels - 2; level >= 0; --level)
+	{
+		profiler.beginGpuZone(UPSAMPLE_ZONES[level]);
+
+		upsampleShader.setInt("sourceLod", level + 1);
+		upsampleShader.setVec2("sourceUvScale", glm::vec2(regions[level + 1]) / glm::vec2(sizes[level + 1]));
+		upsampleShader.setIVec2("targetSize", regions[level]);
+		glBindImageTexture(0, chainTexture, level, GL_FALSE, 0, GL_READ_WRITE, GL_R11F_G11F_B10F);
+
+		glDispatchCompute(groupCount(regions[level].x), groupCount(regions[level].y), 1);
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+		profiler.endGpuZone();
+	}
+
+	glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_READ_ONLY, GL_R11F_G11F_B10F);
+}
+
+glm::vec2 Bloom::uvScale() const
+{
+	return levels > 0 ? glm::vec2(regions[0]) / glm::vec2(sizes[0]) : glm::vec2(1.0f);
+}
@@ -0,0 +1,686 @@
+#include "bvh.hpp"
+
+#include <functional>
+#include <queue>
+
+namespace
+{
+	constexpr int SAH_BINS = 16;
+	constexpr float TRAVERSAL_COST = 1.0f;
+
+	struct Bin
+	{
+		AABB bounds;
+		uint32_t count = 0;
+	};
+}
+
+uint32_t BVH::allocateNode()
+{
+	if (freeList == NULL_NODE)
+	{
+		nodes.emplace_back();
+		return static_cast<uint32_t>(nodes.size() - 1);
+	}
+
+	// Free nodes are chained through their parent index
+	const uint32_t node = freeList;
+	freeList = nodes[node].parent;
+	nodes[node] = Node{};
+	return node;
+}
+
+void BVH::freeNode(uint32_t node)
+{
+	nodes[node] = Node{};
+	nodes[node].parent = freeList;
+	nodes[node].item = NULL_NODE - 1; // marks a free slot
+	freeList = node;
+}
+
+AABB BVH::fatten(const AABB& bounds) const
+{
+	return { bounds.min - glm::vec3(margin), bounds.max + glm::vec3(margin) };
+}
+
+void BVH::clear()
+{
+	nodes.clear();
+	root = NULL_NODE;
+	freeList = NULL_NODE;
+	leafCount = 0;
+}
+
+void BVH::build(const std::vector<uint32_t>& items, const std::vector<AABB>& bounds, std::vector<uint32_t>& leaves)
+{
+	clear();
+	nodes.reserve(items.size() * 2);
+	leaves.resize(items.size());
+
+	for (size_t i = 0; i < items.size(); ++i)
+	{
+		const uint32_t leaf = allocateNode();
+		nodes[leaf].bounds = fatten(bounds[i]);
+		nodes[leaf].item = items[i];
+		leaves[i] = leaf;
+	}
+	leafCount = items.size();
+
+	std::vector<uint32_t> leafIds = leaves;
+	root = buildRange(leafIds.data(), static_cast<uint32_t>(leafIds.size()));
+	if (root != NULL_NODE)
+	{
+		nodes[root].parent = NULL_NODE;
+	}
+}
+
+void BVH::rebuild()
+{
+	if (root == NULL_NODE)
+	{
+		return;
+	}
+
+	// Keep the leaf nodes so outstanding leaf ids survive, only internal nodes are rebuilt
+	std::vector<uint32_t> leaves;
+	leaves.reserve(leafCount);
+	std::vector<uint32_t> stack{ root };
+	while (!stack.empty())
+	{
+		const uint32_t node = stack.back();
+		stack.pop_back();
+		if (nodes[node].isLeaf())
+		{
+			leaves.push_back(node);
+			continue;
+		}
+		stack.push_back(nodes[node].left);
+		stack.push_back(nodes[node].right);
+		freeNode(node);
+	}
+
+	root = buildRange(leaves.data(), static_cast<uint32_t>(leaves.size()));
+	nodes[root].parent = NULL_NODE;
+}
+
+uint32_t BVH::buildRange(uint32_t* leaves, uint32_t count)
+{
+	if (count == 0)
+	{
+		return NULL_NODE;
+	}
+	if (count == 1)
+	{
+		return leaves[0];
+	}
+
+	AABB bounds;
+	AABB centroidBounds;
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		bounds.expand(nodes[leaves[i]].bounds);
+		centroidBounds.expand(nodes[leaves[i]].bounds.center());
+	}
+
+	// Binned SAH over all three axes
+	int bestAxis = -1;
+	int bestSplit = 0;
+	float bestCost = FLT_MAX;
+	const glm::vec3 centroidExtent = centroidBounds.max - centroidBounds.min;
+
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		if (centroidExtent[axis] <= 0.0f)
+		{
+			continue;
+		}
+
+		Bin bins[SAH_BINS];
+		const float scale = SAH_BINS / centroidExtent[axis];
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			const AABB& leafBounds = nodes[leaves[i]].bounds;
+			const int bin = std::min(static_cast<int>((leafBounds.center()[axis] - centroidBounds.min[axis]) * scale), SAH_BINS - 1);
+			bins[bin].bounds.expand(leafBounds);
+			++bins[bin].count;
+		}
+
+		// Sweep from the right to get the cost of every split plane in one pass each way
+		float rightArea[SAH_BINS - 1];
+		uint32_t rightCount[SAH_BINS - 1];
+		AABB accumulated;
+		uint32_t accumulatedCount = 0;
+		for (int i = SAH_BINS - 1; i > 0; --i)
+		{
+			accumulated.expand(bins[i].bounds);
+			accumulatedCount += bins[i].count;
+			rightArea[i - 1] = accumulatedCount > 0 ? accumulated.surfaceArea() : 0.0f;
+			rightCount[i - 1] = accumulatedCount;
+		}
+
+		accumulated = AABB{};
+		accumulatedCount = 0;
+		for (int i = 0; i < SAH_BINS - 1; ++i)
+		{
+			accumulated.expand(bins[i].bounds);
+			accumulatedCount += bins[i].count;
+			if (accumulatedCount == 0 || rightCount[i] == 0)
+			{
+				continue;
+			}
+
+			const float cost = accumulatedCount * accumulated.surfaceArea() + rightCount[i] * rightArea[i];
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = i;
+			}
+		}
+	}
+
+	uint32_t* middle;
+	if (bestAxis >= 0)
+	{
+		const float scale = SAH_BINS / centroidExtent[bestAxis];
+		const float minimum = centroidBounds.min[bestAxis];
+		middle = std::partition(leaves, leaves + count, [&](uint32_t leaf)
+		{
+			const int bin = std::min(static_cast<int>((nodes[leaf].bounds.center()[bestAxis] - minimum) * scale), SAH_BINS - 1);
+			return bin <= bestSplit;
+		});
+	}
+	else
+	{
+		// Every centroid coincides, any split is as good as another
+		middle = leaves + count / 2;
+	}
+
+	const uint32_t leftChild = buildRange(leaves, static_cast<uint32_t>(middle - leaves));
+	const uint32_t rightChild = buildRange(middle, static_cast<uint32_t>(leaves + count - middle));
+
+	const uint32_t node = allocateNode();
+	nodes[node].bounds = bounds;
+	nodes[node].left = leftChild;
+	nodes[node].right = rightChild;
+	nodes[leftChild].parent = node;
+	nodes[rightChild].parent = node;
+	return node;
+}
+
+uint32_t BVH::insert(uint32_t item, const AABB& bounds)
+{
+	const uint32_t leaf = allocateNode();
+	nodes[leaf].bounds = fatten(bounds);
+	nodes[leaf].item = item;
+	insertLeaf(leaf);
+	++leafCount;
+	return leaf;
+}
+
+void BVH::remove(uint32_t leaf)
+{
+	removeLeaf(leaf);
+	freeNode(leaf);
+	--leafCount;
+}
+
+bool BVH::move(uint32_t leaf, const AABB& bounds)
+{
+	if (nodes[leaf].bounds.contains(bounds))
+	{
+		return false;
+	}
+
+	removeLeaf(leaf);
+	nodes[leaf].bounds = fatten(bounds);
+	insertLeaf(leaf);
+	return true;
+}
+
+void BVH::setLeafBounds(uint32_t leaf, const AABB& bounds)
+{
+	nodes[leaf].bounds = fatten(bounds);
+}
+
+void BVH::refit()
+{
+	if (root == NULL_NODE)
+	{
+		return;
+	}
+
+	// Internal nodes in pre-order, walked backwards so children are refit before parents
+	std::vector<uint32_t> order;
+	std::vector<uint32_t> stack{ root };
+	while (!stack.empty())
+	{
+		const uint32_t node = stack.back();
+		stack.pop_back();
+		if (!nodes[node].isLeaf())
+		{
+			order.push_back(node);
+			stack.push_back(nodes[node].left);
+			stack.push_back(nodes[node].right);
+		}
+	}
+
+	for (auto it = order.rbegin(); it != order.rend(); ++it)
+	{
+		Node& node = nodes[*it];
+		node.bounds = merge(nodes[node.left].bounds, nodes[node.right].bounds);
+	}
+}
+
+void BVH::insertLeaf(uint32_t leaf)
+{
+	if (root == NULL_NODE)
+	{
+		root = leaf;
+		nodes[leaf].parent = NULL_NODE;
+		return;
+	}
+
+	// Branch and bound for the sibling that adds the least total area (Catto, GDC 2019).
+	// The inherited cost is the area growth forced on the ancestors of a candidate.
+	const AABB leafBounds = nodes[leaf].bounds; // copy, allocating the new parent may grow nodes
+	const float leafArea = leafBounds.surfaceArea();
+
+	uint32_t bestSibling = root;
+	float bestCost = merge(nodes[root].bounds, leafBounds).surfaceArea();
+
+	using Candidate = std::pair<float, uint32_t>;
+	std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> candidates;
+	candidates.push({ 0.0f, root });
+
+	while (!candidates.empty())
+	{
+		const auto [inheritedCost, index] = candidates.top();
+		candidates.pop();
+
+		const Node& node = nodes[index];
+		const float combinedArea = merge(node.bounds, leafBounds).surfaceArea();
+		const float cost = combinedArea + inheritedCost;
+		if (cost < bestCost)
+		{
+			bestCost = cost;
+			bestSibling = index;
+		}
+
+		const float childInherited = inheritedCost + combinedArea - node.bounds.surfaceArea();
+		if (!node.isLeaf() && leafArea + childInherited < bestCost)
+		{
+			candidates.push({ childInherited, node.left });
+			candidates.push({ childInherited, node.right });
+		}
+	}
+
+	const uint32_t oldParent = nodes[bestSibling].parent;
+	const uint32_t newParent = allocateNode();
+	nodes[newParent].parent = oldParent;
+	nodes[newParent].bounds = merge(nodes[bestSibling].bounds, leafBounds);
+	nodes[newParent].left = bestSibling;
+	nodes[newParent].right = leaf;
+	nodes[bestSibling].parent = newParent;
+	nodes[leaf].parent = newParent;
+
+	if (oldParent == NULL_NODE)
+	{
+		root = newParent;
+	}
+	else if (nodes[oldParent].left == bestSibling)
+	{
+		nodes[oldParent].left = newParent;
+	}
+	else
+	{
+		nodes[oldParent].right = newParent;
+	}
+
+	refitAncestors(oldParent);
+}
+
+void BVH::removeLeaf(uint32_t leaf)
+{
+	if (leaf == root)
+	{
+		root = NULL_NODE;
+		return;
+	}
+
+	// The sibling takes the parent's place
+	const uint32_t parent = nodes[leaf].parent;
+	const uint32_t grandParent = nodes[parent].parent;
+	const uint32_t sibling = nodes[parent].left == leaf ? nodes[parent].right : nodes[parent].left;
+
+	if (grandParent == NULL_NODE)
+	{
+		root = sibling;
+		nodes[sibling].parent = NULL_NODE;
+	}
+	else
+	{
+		if (nodes[grandParent].left == parent)
+		{
+			nodes[grandParent].left = sibling;
+		}
+		else
+		{
+			nodes[grandParent].right = sibling;
+		}
+		nodes[sibling].parent = grandParent;
+		refitAncestors(grandParent);
+	}
+
+	freeNode(parent);
+	nodes[leaf].parent = NULL_NODE;
+}
+
+void BVH::refitAncestors(uint32_t node)
+{
+	while (node != NULL_NODE)
+	{
+		Node& current = nodes[node];
+		current.bounds = merge(nodes[current.left].bounds, nodes[current.right].bounds);
+		node = current.parent;
+	}
+}
+
+void BVH::collectLeaves(uint32_t node, std::vector<uint32_t>& items) const
+{
+	std::vector<uint32_t> stack{ node };
+	while (!stack.empty())
+	{
+		const Node& current = nodes[stack.back()];
+		stack.pop_back();
+		if (current.isLeaf())
+		{
+			items.push_back(current.item);
+		}
+		else
+		{
+			stack.push_back(current.left);
+			stack.push_back(current.right);
+		}
+	}
+}
+
+void BVH::queryFrustum(const Frustum& frustum, std::vector<uint32_t>& items) const
+{
+	if (root != NULL_NODE)
+	{
+		queryFrustum(frustum, root, items);
+	}
+}
+
+void BVH::queryFrustum(const Frustum& frustum, uint32_t subtree, std::vector<uint32_t>& items) const
+{
+	std::vector<uint32_t> stack;
+	stack.reserve(64);
+	stack.push_back(subtree);
+	while (!stack.empty())
+	{
+		const uint32_t index = stack.back();
+		stack.pop_back();
+		const Node& node = nodes[index];
+
+		if (!frustum.overlaps(node.bounds))
+		{
+			continue;
+		}
+		if (node.isLeaf())
+		{
+			items.push_back(node.item);
+		}
+		else if (frustum.contains(node.bounds))
+		{
+			// Fully inside, accept the whole subtree without further plane tests
+			collectLeaves(index, items);
+		}
+		else
+		{
+			stack.push_back(node.left);
+			stack.push_back(node.right);
+		}
+	}
+}
+
+void BVH::splitFrustum(const Frustum& frustum, size_t minSubtrees, std::vector<uint32_t>& subtrees) const
+{
+	subtrees.clear();
+	if (root == NULL_NODE || !frustum.overlaps(nodes[root].bounds))
+	{
+		return;
+	}
+
+	// Open internal nodes, largest first since they sit nearest the front, until there are enough.
+	// Children outside the frustum are dropped here so their jobs are never queued.
+	subtrees.push_back(root);
+	size_t i = 0;
+	while (i < subtrees.size() && subtrees.size() < minSubtrees)
+	{
+		const Node& node = nodes[subtrees[i]];
+		if (node.isLeaf())
+		{
+			++i;
+			continue;
+		}
+
+		const uint32_t left = node.left;
+		const uint32_t right = node.right;
+		subtrees.erase(subtrees.begin() + i);
+		for (uint32_t child : { left, right })
+		{
+			if (frustum.overlaps(nodes[child].bounds))
+			{
+				subtrees.push_back(child);
+			}
+		}
+	}
+}
+
+void BVH::querySphere(const Sphere& sphere, std::vector<uint32_t>& items) const
+{
+	if (root == NULL_NODE)
+	{
+		return;
+	}
+
+	std::vector<uint32_t> stack;
+	stack.reserve(64);
+	stack.push_back(root);
+	while (!stack.empty())
+	{
+		const Node& node = nodes[stack.back()];
+		stack.pop_back();
+
+		if (!sphere.overlaps(node.bounds))
+		{
+			continue;
+		}
+		if (node.isLeaf())
+		{
+			items.push_back(node.item);
+		}
+		else
+		{
+			stack.push_back(node.left);
+			stack.push_back(node.right);
+		}
+	}
+}
+
+void BVH::queryBox(const AABB& box, std::vector<uint32_t>& items) const
+{
+	if (root == NULL_NODE)
+	{
+		return;
+	}
+
+	std::vector<uint32_t> stack;
+	stack.reserve(64);
+	stack.push_back(root);
+	while (!stack.empty())
+	{
+		const Node& node = nodes[stack.back()];
+		stack.pop_back();
+
+		if (!box.overlaps(node.bounds))
+		{
+			continue;
+		}
+		if (node.isLeaf())
+		{
+			items.push_back(node.item);
+		}
+		else
+		{
+			stack.push_back(node.left);
+			stack.push_back(node.right);
+		}
+	}
+}
+
+void BVH::queryRay(const Ray& ray, float maxDistance, std::vector<uint32_t>& items) const
+{
+	if (root == NULL_NODE)
+	{
+		return;
+	}
+
+	std::vector<uint32_t> stack;
+	stack.reserve(64);
+	stack.push_back(root);
+	while (!stack.empty())
+	{
+		const Node& node = nodes[stack.back()];
+		stack.pop_back();
+
+		float tNear;
+		if (!ray.intersects(node.bounds, maxDistance, tNear))
+		{
+			continue;
+		}
+		if (node.isLeaf())
+		{
+			items.push_back(node.item);
+		}
+		else
+		{
+			stack.push_back(node.left);
+			stack.push_back(node.right);
+		}
+	}
+}
+
+uint32_t BVH::raycast(const Ray& ray, float maxDistance, float& hitDistance) const
+{
+	uint32_t hitItem = NULL_NODE;
+	hitDistance = maxDistance;
+	if (root == NULL_NODE)
+	{
+		return hitItem;
+	}
+
+	float tRoot;
+	if (!ray.intersects(nodes[root].bounds, hitDistance, tRoot))
+	{
+		return hitItem;
+	}
+
+	// Entries carry the entry distance so subtrees behind the current hit are skipped
+	std::vector<std::pair<float, uint32_t>> stack;
+	stack.reserve(64);
+	stack.push_back({ tRoot, root });
+	while (!stack.empty())
+	{
+		const auto [tEntry, index] = stack.back();
+		stack.pop_back();
+		if (tEntry > hitDistance)
+		{
+			continue;
+		}
+
+		const Node& node = nodes[index];
+		if (node.isLeaf())
+		{
+			hitDistance = tEntry;
+			hitItem = node.item;
+			continue;
+		}
+
+		float tLeft, tRight;
+		const bool hitLeft = ray.intersects(nodes[node.left].bounds, hitDistance, tLeft);
+		const bool hitRight = ray.intersects(nodes[node.right].bounds, hitDistance, tRight);
+
+		// Push the far child first so the near one is visited next
+		if (hitLeft && hitRight)
+		{
+			if (tLeft < tRight)
+			{
+				stack.push_back({ tRight, node.right });
+				stack.push_back({ tLeft, node.left });
+			}
+			else
+			{
+				stack.push_back({ tLeft, node.left });
+				stack.push_back({ tRight, node.right });
+			}
+		}
+		else if (hitLeft)
+		{
+			stack.push_back({ tLeft, node.left });
+		}
+		else if (hitRight)
+		{
+			stack.push_back({ tRight, node.right });
+		}
+	}
+	return hitItem;
+}
+
+float BVH::sahCost() const
+{
+	if (root == NULL_NODE || nodes[root].isLeaf())
+	{
+		return 0.0f;
+	}
+
+	float area = 0.0f;
+	std::vector<uint32_t> stack{ root };
+	while (!stack.empty())
+	{
+		const Node& node = nodes[stack.back()];
+		stack.pop_back();
+		if (!node.isLeaf())
+		{
+			area += TRAVERSAL_COST * node.bounds.surfaceArea();
+			stack.push_back(node.left);
+			stack.push_back(node.right);
+		}
+	}
+	return area / nodes[root].bounds.surfaceArea();
+}
+
+int BVH::height() const
+{
+	if (root == NULL_NODE)
+	{
+		return 0;
+	}
+
+	int maxDepth = 0;
+	std::vector<std::pair<uint32_t, int>> stack{ { root, 1 } };
+	while (!stack.empty())
+	{
+		const auto [index, depth] = stack.back();
+		stack.pop_back();
+		maxDepth = std::max(maxDepth, depth);
+		if (!nodes[index].isLeaf())
+		{
+			stack.push_back({ nodes[index].left, depth + 1 });
+			stack.push_back({ nodes[index].right, depth + 1 });
+		}
+	}
+	return maxDepth;
+}
@@ -0,0 +1,155 @@
+#include "depthPrepass.hpp"
+#include "glState.hpp"
+
+DepthPrepass::DepthPrepass()
+	: shader("shaders/depthPrepass.vert", "shaders/depthPrepass.frag")
+{
+	for (QueryFrame& frame : frames)
+	{
+		glGenQueries(MAX_QUERIES, frame.depthQueries.data());
+		glGenQueries(MAX_QUERIES, frame.colourQueries.data());
+	}
+}
+
+DepthPrepass::~DepthPrepass()
+{
+	for (QueryFrame& frame : frames)
+	{
+		glDeleteQueries(MAX_QUERIES, frame.depthQueries.data());
+		glDeleteQueries(MAX_QUERIES, frame.colourQueries.data());
+	}
+}
+
+uint64_t DepthPrepass::sumQueries(const GLuint* queries, int count)
+{
+	uint64_t total = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		GLuint64 samples = 0;
+		glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &samples);
+		total += samples;
+	}
+	return total;
+}
+
+void DepthPrepass::collect(QueryFrame& frame)
+{
+	if (frame.colourCount == 0)
+	{
+		return;
+	}
+
+	// Queries finish in order, a frame that is still in flight after QUERY_LATENCY frames is dropped
+	GLint available = 0;
+	glGetQueryObjectiv(frame.colourQueries[frame.colourCount - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available)
+	{
+		return;
+	}
+
+	const uint64_t colourSamples = sumQueries(frame.colourQueries.data(), frame.colourCount);
+	if (frame.prepass)
+	{
+		const uint64_t depthSamples = sumQueries(frame.depthQueries.data(), frame.depthCount);
+		overdraw = colourSamples > 0 ? static_cast<float>(depthSamples) / static_cast<float>(colourSamples) : 0.0f;
+		overdrawExact = true;
+		visibleSamples = colourSamples;
+		framesSinceProbe = 0;
+	}
+	else
+	{
+		// Without the pre-pass only the shaded count is known, the visible count is borrowed from the last probe
+		const uint64_t visible = visibleSamples > 0 ? visibleSamples : static_cast<uint64_t>(frame.pixelCount);
+		overdraw = visible > 0 ? static_cast<float>(colourSamples) / static_cast<float>(visible) : 0.0f;
+		overdrawExact = false;
+	}
+
+	autoActive = overdraw > (autoActive ? disableOverdraw : enableOverdraw);
+}
+
+void DepthPrepass::beginFrame(int pixelCount)
+{
+	current = (current + 1) % QUERY_LATENCY;
+	QueryFrame& frame = frames[current];
+	if (frame.pending)
+	{
+		collect(frame);
+	}
+
+	switch (mode)
+	{
+	case PREPASS_OFF:
+		active = false;
+		break;
+	case PREPASS_ON:
+		active = true;
+		break;
+	default:
+		active = autoActive || ++framesSinceProbe >= probeInterval;
+		break;
+	}
+	active = active || required;
+
+	frame.depthCount = 0;
+	frame.colourCount = 0;
+	frame.pixelCount = pixelCount;
+	frame.prepass = active;
+	frame.pending = true;
+}
+
+void DepthPrepass::beginDepth(const glm::mat4& view, const glm::mat4& projection)
+{
+	shader.use();
+	shader.setMat4("view", view);
+	shader.setMat4("projection", projection);
+
+	glState.colorMask(false);
+
+	QueryFrame& frame = frames[current];
+	depthQueryOpen = frame.depthCount < MAX_QUERIES;
+	if (depthQueryOpen)
+	{
+		glBeginQuery(GL_SAMPLES_PASSED, frame.depthQueries[frame.depthCount++]);
+	}
+}
+
+void DepthPrepass::endDepth()
+{
+	if (depthQueryOpen)
+	{
+		glEndQuery(GL_SAMPLES_PASSED);
+		depthQueryOpen = false;
+	}
+	glState.colorMask(true);
+}
+
+void DepthPrepass::beginColour()
+{
+	if (active)
+	{
+		glState.depthFunc(GL_EQUAL);
+		glState.depthMask(false);
+	}
+
+	QueryFrame& frame = frames[current];
+	colourQueryOpen = frame.colourCount < MAX_QUERIES;
+	if (colourQueryOpen)
+	{
+		glBeginQuery(GL_SAMPLES_PASSED, frame.colourQueries[frame.colourCount++]);
+	}
+}
+
+void DepthPrepass::endColour()
+{
+	if (colourQueryOpen)
+	{
+		glEndQuery(GL_SAMPLES_PASSED);
+		colourQueryOpen = false;
+	}
+
+	if (active)
+	{
+		glState.depthFunc(GL_LESS);
+		glState.depthMask(true);
+	}
+}
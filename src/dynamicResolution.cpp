@@ -0,0 +1,97 @@
+#include "dynamicResolution.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+DynamicResolution::DynamicResolution()
+{
+	for (QueryFrame& frame : frames)
+	{
+		GLuint queries[2];
+		glGenQueries(2, queries);
+		frame.begin = queries[0];
+		frame.end = queries[1];
+	}
+}
+
+DynamicResolution::~DynamicResolution()
+{
+	for (QueryFrame& frame : frames)
+	{
+		const GLuint queries[2] = { frame.begin, frame.end };
+		glDeleteQueries(2, queries);
+	}
+}
+
+void DynamicResolution::collect(QueryFrame& frame)
+{
+	// Still in flight after QUERY_LATENCY frames, skip it rather than stall
+	GLint available = 0;
+	glGetQueryObjectiv(frame.end, GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available)
+	{
+		return;
+	}
+
+	GLuint64 start = 0;
+	GLuint64 end = 0;
+	glGetQueryObjectui64v(frame.begin, GL_QUERY_RESULT, &start);
+	glGetQueryObjectui64v(frame.end, GL_QUERY_RESULT, &end);
+	gpuMs = static_cast<float>(end - start) / 1.0e6f;
+	if (gpuMs <= 0.0f)
+	{
+		return;
+	}
+
+	const float next = std::clamp(desiredScale * std::sqrt(targetMs * headroom / gpuMs), minScale, maxScale);
+	if (next < desiredScale)
+	{
+		desiredScale = next;
+	}
+	else
+	{
+		desiredScale += (next - desiredScale) * raiseRate;
+	}
+}
+
+void DynamicResolution::beginFrame(int width, int height)
+{
+	targetWidth = std::max(width, 1);
+	targetHeight = std::max(height, 1);
+
+	current = (current + 1) % QUERY_LATENCY;
+	QueryFrame& frame = frames[current];
+	if (frame.pending)
+	{
+		collect(frame);
+	}
+
+	if (enabled)
+	{
+		// Round down so a step is only taken once the controller has fully reached it
+		const float steps = std::floor(desiredScale / scaleStep + 1.0e-3f);
+		scale = std::clamp(steps * scaleStep, minScale, maxScale);
+	}
+	else
+	{
+		desiredScale = maxScale;
+		scale = maxScale;
+	}
+
+	renderWidth = std::max(static_cast<int>(targetWidth * scale), 1);
+	renderHeight = std::max(static_cast<int>(targetHeight * scale), 1);
+
+	glQueryCounter(frame.begin, GL_TIMESTAMP);
+}
+
+void DynamicResolution::endFrame()
+{
+	QueryFrame& frame = frames[current];
+	glQueryCounter(frame.end, GL_TIMESTAMP);
+	frame.pending = true;
+}
+
+glm::vec2 DynamicResolution::uvScale() const
+{
+	return glm::vec2(static_cast<float>(renderWidth) / targetWidth, static_cast<float>(renderHeight) / targetHeight);
+}
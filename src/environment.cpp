@@ -0,0 +1,656 @@
+#include "environment.hpp"
+#include "glState.hpp"
+#include "ibl.hpp"
+#include "profiler.hpp"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+#include "stb_image.h"
+
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iostream>
+
+namespace
+{
+	constexpr char ENV_CACHE_MAGIC[4] = { 'O', 'G', 'L', 'E' };
+	constexpr uint32_t ENV_CACHE_VERSION = 1;
+	constexpr char SH_CACHE_MAGIC[4] = { 'O', 'G', 'L', 'S' };
+	constexpr uint32_t SH_CACHE_VERSION = 1;
+
+	struct CubemapCacheHeader
+	{
+		char magic[4];
+		uint32_t version;
+		uint32_t faceSize;
+		uint32_t mipCount;
+	};
+
+	// One face decoded and converted to half floats, one entry per mip level
+	struct FaceChain
+	{
+		int size = 0;
+		std::vector<std::vector<uint16_t>> mips;
+	};
+
+	std::string facePath(const std::string& directory, int face, int mip)
+	{
+		std::string path = directory + "/" + cubemapFaceNames[face];
+		if (mip > 0)
+		{
+			path += "_" + std::to_string(mip);
+		}
+		return path + ".hdr";
+	}
+
+	std::vector<float> downsample(const std::vector<float>& src, int srcSize)
+	{
+		const int dstSize = CubemapData::mipSize(srcSize, 1);
+		std::vector<float> dst(static_cast<size_t>(dstSize) * dstSize * 3);
+
+		for (int y = 0; y < dstSize; ++y)
+		{
+			const int y0 = std::min(2 * y, srcSize - 1);
+			const int y1 = std::min(2 * y + 1, srcSize - 1);
+			for (int x = 0; x < dstSize; ++x)
+			{
+				const int x0 = std::min(2 * x, srcSize - 1);
+				const int x1 = std::min(2 * x + 1, srcSize - 1);
+				for (int c = 0; c < 3; ++c)
+				{
+					float sum = src[(y0 * srcSize + x0) * 3 + c] + src[(y0 * srcSize + x1) * 3 + c] +
+								src[(y1 * srcSize + x0) * 3 + c] + src[(y1 * srcSize + x1) * 3 + c];
+					dst[(y * dstSize + x) * 3 + c] = sum * 0.25f;
+				}
+			}
+		}
+		return dst;
+	}
+
+	std::vector<uint16_t> toHalf(const std::vector<float>& src)
+	{
+		std::vector<uint16_t> dst(src.size());
+		for (size_t i = 0; i < src.size(); ++i)
+		{
+			dst[i] = glm::packHalf1x16(src[i]);
+		}
+		return dst;
+	}
+
+	// Runs on a worker thread: decodes one face plus any prefiltered mips and fills in the rest of the chain
+	FaceChain decodeFace(const std::string& directory, int face, bool withMips)
+	{
+		FaceChain chain;
+
+		int width, height, nrChannels;
+		std::string path = facePath(directory, face, 0);
+		float* data = stbi_loadf(path.c_str(), &width, &height, &nrChannels, 3);
+		if (!data)
+		{
+			std::cout << "HDR Cubemap texture failed to load at path: " << path << std::endl;
+			return chain;
+		}
+
+		chain.size = width;
+		std::vector<float> level(data, data + static_cast<size_t>(width) * height * 3);
+		stbi_image_free(data);
+
+		const int mipCount = withMips ? static_cast<int>(std::log2(width)) + 1 : 1;
+		chain.mips.push_back(toHalf(level));
+
+		bool prefiltered = false;
+		for (int mip = 1; mip < mipCount; ++mip)
+		{
+			const int expectedSize = CubemapData::mipSize(chain.size, mip);
+
+			// Keep the baked prefiltered level if the baker wrote one
+			path = facePath(directory, face, mip);
+			float* mipData = stbi_loadf(path.c_str(), &width, &height, &nrChannels, 3);
+			if (mipData && (width != expectedSize || height != expectedSize))
+			{
+				std::cout << "Prefiltered mip has unexpected size, ignoring: " << path << std::endl;
+				stbi_image_free(mipData);
+				mipData = nullptr;
+			}
+
+			if (mipData)
+			{
+				prefiltered = true;
+				level.assign(mipData, mipData + static_cast<size_t>(expectedSize) * expectedSize * 3);
+				stbi_image_free(mipData);
+			}
+			else if (prefiltered)
+			{
+				// The baker stopped here, so the chain ends at its last prefiltered level
+				break;
+			}
+			else
+			{
+				// No prefiltered levels at all, box filter the previous level
+				level = downsample(level, CubemapData::mipSize(chain.size, mip - 1));
+			}
+			chain.mips.push_back(toHalf(level));
+		}
+
+		return chain;
+	}
+
+	// True when the cache exists and is newer than the source, or the source is gone
+	bool isNewerThan(const std::string& cachePath, const std::string& sourcePath)
+	{
+		namespace fs = std::filesystem;
+
+		std::error_code ec;
+		if (!fs::exists(cachePath, ec))
+		{
+			return false;
+		}
+		if (!fs::exists(sourcePath, ec))
+		{
+			return true;
+		}
+		return fs::last_write_time(cachePath, ec) >= fs::last_write_time(sourcePath, ec);
+	}
+
+	bool cacheIsFresh(const std::string& cachePath, const std::string& directory, bool withMips)
+	{
+		namespace fs = std::filesystem;
+
+		std::error_code ec;
+		if (!fs::exists(cachePath, ec))
+		{
+			return false;
+		}
+
+		// A cache without its sources is still valid, this lets us ship cooked data only
+		const auto cacheTime = fs::last_write_time(cachePath, ec);
+		for (int face = 0; face < 6; ++face)
+		{
+			for (int mip = 0; ; ++mip)
+			{
+				const std::string path = facePath(directory, face, mip);
+				if (!fs::exists(path, ec))
+				{
+					break;
+				}
+				if (fs::last_write_time(path, ec) > cacheTime)
+				{
+					return false;
+				}
+				if (!withMips)
+				{
+					break;
+				}
+			}
+		}
+		return true;
+	}
+}
+
+size_t CubemapData::sliceTexelCount(int mip) const
+{
+	const size_t size = mipSize(faceSize, mip);
+	return size * size * 3;
+}
+
+size_t CubemapData::sliceOffset(int mip, int face) const
+{
+	size_t offset = 0;
+	for (int m = 0; m < mip; ++m)
+	{
+		offset += 6 * sliceTexelCount(m);
+	}
+	return offset + face * sliceTexelCount(mip);
+}
+
+EnvironmentData loadEnvironmentData(const std::string& basePath)
+{
+	PROFILE_CPU_ZONE("Environment Decode");
+	namespace fs = std::filesystem;
+
+	EnvironmentData data;
+	const std::string equirectPath = basePath + "environment.hdr";
+	const std::string skyboxCache = basePath + "skybox.envcache";
+	const std::string radianceCache = basePath + "radiance.envcache";
+	const std::string irradianceCache = basePath + "irradiance.shcache";
+
+	std::error_code ec;
+	if (fs::exists(equirectPath, ec))
+	{
+		// Everything is baked from the equirectangular HDR, reuse the bake until the HDR changes
+		const bool baked = isNewerThan(skyboxCache, equirectPath) && isNewerThan(radianceCache, equirectPath) &&
+			isNewerThan(irradianceCache, equirectPath);
+		if (baked && readCubemapCache(skyboxCache, data.skybox) && readCubemapCache(radianceCache, data.radiance) &&
+			readIrradianceCache(irradianceCache, data.irradianceSH))
+		{
+			data.hasIrradianceSH = true;
+			return data;
+		}
+
+		data = {};
+		int nrChannels;
+		float* texels = stbi_loadf(equirectPath.c_str(), &data.equirect.width, &data.equirect.height, &nrChannels, 3);
+		if (!texels)
+		{
+			std::cout << "Failed to load equirectangular HDR: " << equirectPath << std::endl;
+			return data;
+		}
+		data.equirect.texels.assign(texels, texels + static_cast<size_t>(data.equirect.width) * data.equirect.height * 3);
+		stbi_image_free(texels);
+		return data;
+	}
+
+	// Pre-split faces, radiance is optional and gets prefiltered from the skybox when absent
+	auto skyboxFuture = std::async(std::launch::async, loadCubemapData, basePath + "skybox", false);
+	if (fs::exists(basePath + "radiance", ec))
+	{
+		data.radiance = loadCubemapData(basePath + "radiance", true);
+	}
+	else if (isNewerThan(radianceCache, skyboxCache))
+	{
+		readCubemapCache(radianceCache, data.radiance);
+	}
+	data.skybox = skyboxFuture.get();
+
+	data.hasIrradianceSH = isNewerThan(irradianceCache, skyboxCache) && isNewerThan(irradianceCache, radianceCache) &&
+		readIrradianceCache(irradianceCache, data.irradianceSH);
+
+	return data;
+}
+
+EnvironmentMap uploadEnvironmentMap(const std::string& name, const std::string& basePath, const EnvironmentData& data, const IBLBaker& baker)
+{
+	EnvironmentMap envMap;
+	envMap.name = name;
+	envMap.basePath = basePath;
+
+	// Drivers pad RGB16F to RGBA16F, so count four channels per texel
+	auto cubemapBytes = [](int faceSize, int mipCount)
+	{
+		size_t bytes = 0;
+		for (int mip = 0; mip < mipCount; ++mip)
+		{
+			const size_t size = CubemapData::mipSize(faceSize, mip);
+			bytes += 6 * size * size * 4 * sizeof(uint16_t);
+		}
+		return bytes;
+	};
+
+	int skyboxSize = data.skybox.faceSize;
+	int skyboxMips = data.skybox.mipCount;
+	if (!data.equirect.empty())
+	{
+		skyboxSize = std::clamp(static_cast<int>(std::bit_floor(static_cast<uint32_t>(data.equirect.width / 4))), 64, 2048);
+		skyboxMips = static_cast<int>(std::log2(skyboxSize)) + 1;
+		envMap.cubemapTexture = baker.equirectToCubemap(data.equirect, skyboxSize);
+		writeCubemapCache(basePath + "skybox.envcache", readbackCubemap(envMap.cubemapTexture, skyboxSize, 1));
+	}
+	else
+	{
+		// The skybox only needs a mip chain when it is the source for prefiltering or the SH projection,
+		// which samples a coarse mip and would point sample level 0 without one
+		const bool needsMipChain = data.radiance.empty() || !data.hasIrradianceSH;
+		envMap.cubemapTexture = uploadCubemap(data.skybox, needsMipChain);
+		if (needsMipChain)
+		{
+			skyboxMips = static_cast<int>(std::log2(std::max(skyboxSize, 1))) + 1;
+		}
+	}
+	envMap.gpuBytes += cubemapBytes(skyboxSize, skyboxMips);
+
+	int radianceSize = data.radiance.faceSize;
+	int radianceMips = data.radiance.mipCount;
+	if (!data.radiance.empty())
+	{
+		envMap.radianceMap = uploadCubemap(data.radiance);
+	}
+	else if (envMap.cubemapTexture)
+	{
+		radianceSize = PREFILTER_FACE_SIZE;
+		radianceMips = PREFILTER_MIP_COUNT;
+		envMap.radianceMap = baker.prefilterRadiance(envMap.cubemapTexture, skyboxSize, radianceSize, radianceMips);
+		writeCubemapCache(basePath + "radiance.envcache", readbackCubemap(envMap.radianceMap, radianceSize, radianceMips));
+	}
+	envMap.gpuBytes += cubemapBytes(radianceSize, radianceMips);
+
+	// The mip count comes from the cooked metadata, no need to decode a face again
+	envMap.maxMipLevel = static_cast<float>(std::max(radianceMips - 1, 0));
+
+	if (data.hasIrradianceSH)
+	{
+		envMap.irradianceSH = data.irradianceSH;
+	}
+	else if (envMap.cubemapTexture || envMap.radianceMap)
+	{
+		// Project the sharpest cubemap we have, the radiance mip 0 is unfiltered
+		envMap.irradianceSH = envMap.cubemapTexture ? baker.projectIrradianceSH(envMap.cubemapTexture, skyboxSize)
+			: baker.projectIrradianceSH(envMap.radianceMap, radianceSize);
+		writeIrradianceCache(basePath + "irradiance.shcache", envMap.irradianceSH);
+	}
+
+	return envMap;
+}
+
+void releaseEnvironmentMap(EnvironmentMap& envMap)
+{
+	const uint32_t textures[] = { envMap.cubemapTexture, envMap.radianceMap };
+	glState.deleteTextures(2, textures);
+	envMap.cubemapTexture = envMap.radianceMap = 0;
+}
+
+CubemapData loadCubemapData(const std::string& directory, bool withMips)
+{
+	CubemapData data;
+	const std::string cachePath = directory + ".envcache";
+
+	if (cacheIsFresh(cachePath, directory, withMips) && readCubemapCache(cachePath, data))
+	{
+		return data;
+	}
+
+	std::array<std::future<FaceChain>, 6> faceFutures;
+	for (int face = 0; face < 6; ++face)
+	{
+		faceFutures[face] = std::async(std::launch::async, decodeFace, directory, face, withMips);
+	}
+
+	std::array<FaceChain, 6> faces;
+	for (int face = 0; face < 6; ++face)
+	{
+		faces[face] = faceFutures[face].get();
+	}
+
+	for (const FaceChain& face : faces)
+	{
+		if (face.mips.empty() || face.size != faces[0].size || face.mips.size() != faces[0].mips.size())
+		{
+			std::cout << "Cubemap faces are missing or mismatched in: " << directory << std::endl;
+			return {};
+		}
+	}
+
+	data.faceSize = faces[0].size;
+	data.mipCount = static_cast<int>(faces[0].mips.size());
+	data.texels.resize(data.sliceOffset(data.mipCount, 0));
+
+	for (int mip = 0; mip < data.mipCount; ++mip)
+	{
+		for (int face = 0; face < 6; ++face)
+		{
+			const std::vector<uint16_t>& slice = faces[face].mips[mip];
+			std::memcpy(data.texels.data() + data.sliceOffset(mip, face), slice.data(), slice.size() * sizeof(uint16_t));
+		}
+	}
+
+	if (!writeCubemapCache(cachePath, data))
+	{
+		std::cout << "Failed to write environment cache: " << cachePath << std::endl;
+	}
+
+	return data;
+}
+
+uint32_t uploadCubemap(const CubemapData& data, bool withMipChain)
+{
+	if (data.empty())
+	{
+		return 0;
+	}
+
+	const int levels = withMipChain ? static_cast<int>(std::log2(data.faceSize)) + 1 : data.mipCount;
+
+	uint32_t textureID;
+	glCreateTextures(GL_TEXTURE_CUBE_MAP, 1, &textureID);
+	glTextureStorage2D(textureID, levels, GL_RGB16F, data.faceSize, data.faceSize);
+
+	// RGB16F rows are 6 bytes per texel, so odd widths are only 2-byte aligned
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+	for (int mip = 0; mip < data.mipCount; ++mip)
+	{
+		const int size = CubemapData::mipSize(data.faceSize, mip);
+		for (int face = 0; face < 6; ++face)
+		{
+			// Direct state access addresses cube faces as layers of a 2D array
+			glTextureSubImage3D(textureID, mip, 0, 0, face, size, size, 1, GL_RGB, GL_HALF_FLOAT,
+				data.texels.data() + data.sliceOffset(mip, face));
+		}
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	if (levels > data.mipCount)
+	{
+		glGenerateTextureMipmap(textureID);
+	}
+
+	glTextureParameteri(textureID, GL_TEXTURE_MIN_FILTER, levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+	glTextureParameteri(textureID, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTextureParameteri(textureID, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTextureParameteri(textureID, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTextureParameteri(textureID, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+	return textureID;
+}
+
+CubemapData readbackCubemap(uint32_t texture, int faceSize, int mipCount)
+{
+	CubemapData data;
+	data.faceSize = faceSize;
+	data.mipCount = mipCount;
+	data.texels.resize(data.sliceOffset(mipCount, 0));
+
+	// A cube map level reads back as all six faces in order, which matches our slice layout
+	glPixelStorei(GL_PACK_ALIGNMENT, 2);
+	for (int mip = 0; mip < mipCount; ++mip)
+	{
+		const size_t levelTexels = 6 * data.sliceTexelCount(mip);
+		glGetTextureImage(texture, mip, GL_RGB, GL_HALF_FLOAT, static_cast<GLsizei>(levelTexels * sizeof(uint16_t)),
+			data.texels.data() + data.sliceOffset(mip, 0));
+	}
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+	return data;
+}
+
+bool readCubemapCache(const std::string& path, CubemapData& data)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+	{
+		return false;
+	}
+
+	CubemapCacheHeader header{};
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (!file || std::memcmp(header.magic, ENV_CACHE_MAGIC, 4) != 0 || header.version != ENV_CACHE_VERSION ||
+		header.faceSize == 0 || header.mipCount == 0 || header.mipCount > 16)
+	{
+		std::cout << "Ignoring stale or invalid environment cache: " << path << std::endl;
+		return false;
+	}
+
+	data.faceSize = static_cast<int>(header.faceSize);
+	data.mipCount = static_cast<int>(header.mipCount);
+	data.texels.resize(data.sliceOffset(data.mipCount, 0));
+
+	file.read(reinterpret_cast<char*>(data.texels.data()), data.texels.size() * sizeof(uint16_t));
+	if (!file)
+	{
+		std::cout << "Truncated environment cache: " << path << std::endl;
+		data = {};
+		return false;
+	}
+	return true;
+}
+
+bool writeCubemapCache(const std::string& path, const CubemapData& data)
+{
+	// Write next to the destination and rename so a crash never leaves a half-written cache behind
+	const std::string tempPath = path + ".tmp";
+	{
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+		if (!file)
+		{
+			return false;
+		}
+
+		CubemapCacheHeader header{};
+		std::memcpy(header.magic, ENV_CACHE_MAGIC, 4);
+		header.version = ENV_CACHE_VERSION;
+		header.faceSize = static_cast<uint32_t>(data.faceSize);
+		header.mipCount = static_cast<uint32_t>(data.mipCount);
+
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(data.texels.data()), data.texels.size() * sizeof(uint16_t));
+		if (!file)
+		{
+			return false;
+		}
+	}
+
+	std::error_code ec;
+	std::filesystem::rename(tempPath, path, ec);
+	return !ec;
+}
+
+bool readIrradianceCache(const std::string& path, std::array<glm::vec3, 9>& coefficients)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+	{
+		return false;
+	}
+
+	char magic[4];
+	uint32_t version = 0;
+	file.read(magic, 4);
+	file.read(reinterpret_cast<char*>(&version), sizeof(version));
+	file.read(reinterpret_cast<char*>(coefficients.data()), sizeof(coefficients));
+	return file && std::memcmp(magic, SH_CACHE_MAGIC, 4) == 0 && version == SH_CACHE_VERSION;
+}
+
+bool writeIrradianceCache(const std::string& path, const std::array<glm::vec3, 9>& coefficients)
+{
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	file.write(SH_CACHE_MAGIC, 4);
+	file.write(reinterpret_cast<const char*>(&SH_CACHE_VERSION), sizeof(SH_CACHE_VERSION));
+	file.write(reinterpret_cast<const char*>(coefficients.data()), sizeof(coefficients));
+	return static_cast<bool>(file);
+}
+
+void EnvironmentLibrary::registerEnvironment(const std::string& name, const std::string& basePath)
+{
+	Entry entry;
+	entry.name = name;
+	entry.basePath = basePath;
+	entries.push_back(std::move(entry));
+}
+
+void EnvironmentLibrary::select(int index)
+{
+	if (index < 0 || index >= static_cast<int>(entries.size()))
+	{
+		return;
+	}
+
+	selected = index;
+	Entry& entry = entries[index];
+	if (entry.state == State::Unloaded)
+	{
+		entry.state = State::Loading;
+		entry.pending = std::async(std::launch::async, loadEnvironmentData, entry.basePath);
+	}
+}
+
+void EnvironmentLibrary::update()
+{
+	++frame;
+
+	for (Entry& entry : entries)
+	{
+		if (entry.state != State::Loading ||
+			entry.pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+		{
+			continue;
+		}
+
+		PROFILE_ZONE("Environment Upload");
+		EnvironmentData data = entry.pending.get();
+		entry.map = uploadEnvironmentMap(entry.name, entry.basePath, data, *baker);
+		entry.gpuBytes = entry.map.gpuBytes;
+		entry.state = State::Resident;
+		entry.lastUsedFrame = frame;
+	}
+
+	// Swap only once the selection is resident, until then keep showing the previous map
+	if (selected >= 0 && entries[selected].state == State::Resident)
+	{
+		displayed = selected;
+	}
+	if (displayed >= 0)
+	{
+		entries[displayed].lastUsedFrame = frame;
+	}
+
+	evict();
+}
+
+const EnvironmentMap* EnvironmentLibrary::active() const
+{
+	return displayed >= 0 ? &entries[displayed].map : nullptr;
+}
+
+bool EnvironmentLibrary::isLoading() const
+{
+	return selected >= 0 && entries[selected].state == State::Loading;
+}
+
+size_t EnvironmentLibrary::residentBytes() const
+{
+	size_t total = 0;
+	for (const Entry& entry : entries)
+	{
+		if (entry.state == State::Resident)
+		{
+			total += entry.gpuBytes;
+		}
+	}
+	return total;
+}
+
+void EnvironmentLibrary::evict()
+{
+	size_t total = residentBytes();
+	while (total > budgetBytes)
+	{
+		Entry* victim = nullptr;
+		for (int i = 0; i < static_cast<int>(entries.size()); ++i)
+		{
+			Entry& entry = entries[i];
+			if (entry.state != State::Resident || i == displayed || i == selected)
+			{
+				continue;
+			}
+			if (!victim || entry.lastUsedFrame < victim->lastUsedFrame)
+			{
+				victim = &entry;
+			}
+		}
+
+		// Only the displayed and selected maps are left, they stay even if over budget
+		if (!victim)
+		{
+			break;
+		}
+
+		std::cout << "Evicting environment map: " << victim->name << std::endl;
+		releaseEnvironmentMap(victim->map);
+		total -= victim->gpuBytes;
+		victim->gpuBytes = 0;
+		victim->state = State::Unloaded;
+	}
+}
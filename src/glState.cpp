@@ -0,0 +1,256 @@
+#include "glState.hpp"
+#include "renderStats.hpp"
+
+GLStateCache glState;
+
+void GLStateCache::invalidate()
+{
+	program = UNKNOWN;
+	vertexArray = UNKNOWN;
+	textures.fill(UNKNOWN);
+	drawFramebuffer = UNKNOWN;
+	readFramebuffer = UNKNOWN;
+	drawIndirectBuffer = UNKNOWN;
+
+	capabilities.fill(-1);
+	depthFunction = UNKNOWN;
+	depthWrite = -1;
+	colorWrite = -1;
+	culledFace = UNKNOWN;
+	fillMode = UNKNOWN;
+}
+
+bool GLStateCache::skip()
+{
+	++skippedCalls;
+	++renderStats.current().redundantCalls;
+	return false;
+}
+
+bool GLStateCache::useProgram(GLuint id)
+{
+	if (program == id)
+	{
+		return skip();
+	}
+	program = id;
+	glUseProgram(id);
+	return true;
+}
+
+bool GLStateCache::bindVertexArray(GLuint vao)
+{
+	if (vertexArray == vao)
+	{
+		return skip();
+	}
+	vertexArray = vao;
+	glBindVertexArray(vao);
+	return true;
+}
+
+bool GLStateCache::bindTexture(GLuint unit, GLuint texture)
+{
+	if (unit < TEXTURE_UNITS)
+	{
+		if (textures[unit] == texture)
+		{
+			return skip();
+		}
+		textures[unit] = texture;
+	}
+	glBindTextureUnit(unit, texture);
+	return true;
+}
+
+bool GLStateCache::bindFramebuffer(GLenum target, GLuint framebuffer)
+{
+	const bool draw = target != GL_READ_FRAMEBUFFER;
+	const bool read = target != GL_DRAW_FRAMEBUFFER;
+	if ((!draw || drawFramebuffer == framebuffer) && (!read || readFramebuffer == framebuffer))
+	{
+		return skip();
+	}
+	if (draw)
+	{
+		drawFramebuffer = framebuffer;
+	}
+	if (read)
+	{
+		readFramebuffer = framebuffer;
+	}
+	glBindFramebuffer(target, framebuffer);
+	return true;
+}
+
+bool GLStateCache::bindDrawIndirectBuffer(GLuint buffer)
+{
+	if (drawIndirectBuffer == buffer)
+	{
+		return skip();
+	}
+	drawIndirectBuffer = buffer;
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, buffer);
+	return true;
+}
+
+bool GLStateCache::setEnabled(GLenum capability, bool enabled)
+{
+	int* cached = nullptr;
+	switch (capability)
+	{
+	case GL_DEPTH_TEST:
+		cached = &capabilities[DEPTH_TEST];
+		break;
+	case GL_CULL_FACE:
+		cached = &capabilities[CULL_FACE];
+		break;
+	case GL_BLEND:
+		cached = &capabilities[BLEND];
+		break;
+	}
+
+	if (cached)
+	{
+		if (*cached == static_cast<int>(enabled))
+		{
+			return skip();
+		}
+		*cached = enabled ? 1 : 0;
+	}
+
+	if (enabled)
+	{
+		glEnable(capability);
+	}
+	else
+	{
+		glDisable(capability);
+	}
+	return true;
+}
+
+bool GLStateCache::depthFunc(GLenum func)
+{
+	if (depthFunction == func)
+	{
+		return skip();
+	}
+	depthFunction = func;
+	glDepthFunc(func);
+	return true;
+}
+
+bool GLStateCache::depthMask(bool write)
+{
+	if (depthWrite == static_cast<int>(write))
+	{
+		return skip();
+	}
+	depthWrite = write ? 1 : 0;
+	glDepthMask(write ? GL_TRUE : GL_FALSE);
+	return true;
+}
+
+bool GLStateCache::colorMask(bool write)
+{
+	if (colorWrite == static_cast<int>(write))
+	{
+		return skip();
+	}
+	colorWrite = write ? 1 : 0;
+	const GLboolean mask = write ? GL_TRUE : GL_FALSE;
+	glColorMask(mask, mask, mask, mask);
+	return true;
+}
+
+bool GLStateCache::cullFace(GLenum face)
+{
+	if (culledFace == face)
+	{
+		return skip();
+	}
+	culledFace = face;
+	glCullFace(face);
+	return true;
+}
+
+bool GLStateCache::polygonMode(GLenum mode)
+{
+	if (fillMode == mode)
+	{
+		return skip();
+	}
+	fillMode = mode;
+	glPolygonMode(GL_FRONT_AND_BACK, mode);
+	return true;
+}
+
+void GLStateCache::deleteTextures(GLsizei count, const GLuint* ids)
+{
+	for (GLsizei i = 0; i < count; ++i)
+	{
+		for (GLuint& texture : textures)
+		{
+			if (texture == ids[i] && ids[i] != 0)
+			{
+				texture = 0;
+			}
+		}
+	}
+	glDeleteTextures(count, ids);
+}
+
+void GLStateCache::deleteVertexArrays(GLsizei count, const GLuint* ids)
+{
+	for (GLsizei i = 0; i < count; ++i)
+	{
+		if (vertexArray == ids[i] && ids[i] != 0)
+		{
+			vertexArray = 0;
+		}
+	}
+	glDeleteVertexArrays(count, ids);
+}
+
+void GLStateCache::deleteFramebuffers(GLsizei count, const GLuint* ids)
+{
+	for (GLsizei i = 0; i < count; ++i)
+	{
+		if (ids[i] == 0)
+		{
+			continue;
+		}
+		if (drawFramebuffer == ids[i])
+		{
+			drawFramebuffer = 0;
+		}
+		if (readFramebuffer == ids[i])
+		{
+			readFramebuffer = 0;
+		}
+	}
+	glDeleteFramebuffers(count, ids);
+}
+
+void GLStateCache::deleteBuffers(GLsizei count, const GLuint* ids)
+{
+	for (GLsizei i = 0; i < count; ++i)
+	{
+		if (ids[i] != 0 && drawIndirectBuffer == ids[i])
+		{
+			drawIndirectBuffer = 0;
+		}
+	}
+	glDeleteBuffers(count, ids);
+}
+
+void GLStateCache::deleteProgram(GLuint id)
+{
+	// A program in use is only flagged for deletion, but nothing should be drawn with it any more
+	if (program == id)
+	{
+		program = UNKNOWN;
+	}
+	glDeleteProgram(id);
+}
@@ -0,0 +1,648 @@
+// Before glad, so APIENTRY is only defined once
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <glad/glad.h>
+#define CGLTF_IMPLEMENTATION
+#include "cgltf.h"
+
+#include "gltfLoader.hpp"
+#include "model.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+bool MappedFile::open(const std::string& path)
+{
+	close();
+
+#ifdef _WIN32
+	file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		file = nullptr;
+		return false;
+	}
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+	{
+		close();
+		return false;
+	}
+
+	mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	data = mapping ? static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+	if (!data)
+	{
+		close();
+		return false;
+	}
+	size = static_cast<size_t>(fileSize.QuadPart);
+#else
+	const int descriptor = ::open(path.c_str(), O_RDONLY);
+	if (descriptor < 0)
+	{
+		return false;
+	}
+
+	struct stat info;
+	if (fstat(descriptor, &info) != 0 || info.st_size == 0)
+	{
+		::close(descriptor);
+		return false;
+	}
+
+	// The mapping keeps its own reference to the file
+	void* mapped = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, descriptor, 0);
+	::close(descriptor);
+	if (mapped == MAP_FAILED)
+	{
+		return false;
+	}
+	data = static_cast<const uint8_t*>(mapped);
+	size = static_cast<size_t>(info.st_size);
+#endif
+	return true;
+}
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+	if (data) UnmapViewOfFile(data);
+	if (mapping) CloseHandle(mapping);
+	if (file) CloseHandle(file);
+	file = mapping = nullptr;
+#else
+	if (data) munmap(const_cast<uint8_t*>(data), size);
+#endif
+	data = nullptr;
+	size = 0;
+}
+
+namespace
+{
+	// State of one LoadGltf call, only handed to the model once the whole file loaded
+	struct GltfLoad
+	{
+		GltfLoad(std::string directory, GltfImport& import)
+			: directory(std::move(directory)), import(import)
+		{
+		}
+
+		std::string directory;
+		GltfImport& import;
+		std::unordered_map<const cgltf_buffer_view*, int> viewIndices;
+		std::vector<Mesh> meshes;
+		std::vector<Texture> texturesLoaded;
+		AABB bounds;
+		bool hasTextures = false;
+		std::string error; // Why the file is left to Assimp
+	};
+
+	const uint8_t* AccessorData(const cgltf_accessor* accessor)
+	{
+		const cgltf_buffer_view* view = accessor->buffer_view;
+		return static_cast<const uint8_t*>(view->buffer->data) + view->offset + accessor->offset;
+	}
+
+	glm::vec2 ReadVec2(const cgltf_accessor* accessor, size_t index)
+	{
+		glm::vec2 value(0.0f);
+		cgltf_accessor_read_float(accessor, index, &value.x, 2);
+		return value;
+	}
+
+	glm::vec3 ReadVec3(const cgltf_accessor* accessor, size_t index)
+	{
+		glm::vec3 value(0.0f);
+		cgltf_accessor_read_float(accessor, index, &value.x, 3);
+		return value;
+	}
+
+	glm::vec4 ReadVec4(const cgltf_accessor* accessor, size_t index)
+	{
+		glm::vec4 value(0.0f);
+		cgltf_accessor_read_float(accessor, index, &value.x, 4);
+		return value;
+	}
+
+	const cgltf_accessor* FindAttribute(const cgltf_primitive& primitive, cgltf_attribute_type type)
+	{
+		for (size_t i = 0; i < primitive.attributes_count; ++i)
+		{
+			// Only the first UV set, as with Assimp
+			if (primitive.attributes[i].type == type && primitive.attributes[i].index == 0)
+			{
+				return primitive.attributes[i].data;
+			}
+		}
+		return nullptr;
+	}
+
+	GLenum ComponentType(cgltf_component_type type)
+	{
+		switch (type)
+		{
+		case cgltf_component_type_r_8: return GL_BYTE;
+		case cgltf_component_type_r_8u: return GL_UNSIGNED_BYTE;
+		case cgltf_component_type_r_16: return GL_SHORT;
+		case cgltf_component_type_r_16u: return GL_UNSIGNED_SHORT;
+		case cgltf_component_type_r_32u: return GL_UNSIGNED_INT;
+		default: return GL_FLOAT;
+		}
+	}
+
+	// Every vertex attribute type glTF allows is one GL reads as it is, including quantized ones
+	void InPlace(GltfLoad& load, const cgltf_accessor* accessor, GltfAttribute& attribute, GLint size)
+	{
+		const cgltf_buffer_view* view = accessor->buffer_view;
+		auto [index, added] = load.viewIndices.try_emplace(view, static_cast<int>(load.import.views.size()));
+		if (added)
+		{
+			load.import.views.push_back({ static_cast<const uint8_t*>(view->buffer->data) + view->offset, view->size });
+		}
+
+		attribute.view = index->second;
+		attribute.offset = accessor->offset;
+		attribute.stride = static_cast<GLsizei>(accessor->stride);
+		attribute.size = size;
+		attribute.type = ComponentType(accessor->component_type);
+		attribute.normalized = accessor->normalized ? GL_TRUE : GL_FALSE;
+	}
+
+	void AppendConverted(GltfPrimitive& primitive, GltfAttribute& attribute, const std::vector<glm::vec3>& values)
+	{
+		attribute.view = -1;
+		attribute.offset = primitive.converted.size();
+		attribute.stride = sizeof(glm::vec3);
+		attribute.size = 3;
+		attribute.type = GL_FLOAT;
+		attribute.normalized = GL_FALSE;
+
+		primitive.converted.resize(attribute.offset + values.size() * sizeof(glm::vec3));
+		std::memcpy(primitive.converted.data() + attribute.offset, values.data(), values.size() * sizeof(glm::vec3));
+	}
+
+	// Area weighted, as aiProcess_GenSmoothNormals would have made them
+	std::vector<glm::vec3> SmoothNormals(const cgltf_accessor* positions, const uint32_t* indices, size_t indexCount)
+	{
+		std::vector<glm::vec3> normals(positions->count, glm::vec3(0.0f));
+		for (size_t i = 0; i + 2 < indexCount; i += 3)
+		{
+			const glm::vec3 a = ReadVec3(positions, indices[i]);
+			const glm::vec3 faceNormal = glm::cross(ReadVec3(positions, indices[i + 1]) - a, ReadVec3(positions, indices[i + 2]) - a);
+			for (size_t corner = 0; corner < 3; ++corner)
+			{
+				normals[indices[i + corner]] += faceNormal;
+			}
+		}
+		for (glm::vec3& normal : normals)
+		{
+			const float length = glm::length(normal);
+			normal = length > 0.0f ? normal / length : glm::vec3(0.0f, 1.0f, 0.0f);
+		}
+		return normals;
+	}
+
+	// Per triangle UV gradients summed per vertex and made orthogonal to the normal, as aiProcess_CalcTangentSpace does
+	void TangentSpace(const cgltf_accessor* positions, const cgltf_accessor* uvs, const uint32_t* indices, size_t indexCount,
+		const std::vector<glm::vec3>& normals, std::vector<glm::vec3>& tangents, std::vector<glm::vec3>& bitangents)
+	{
+		tangents.assign(positions->count, glm::vec3(0.0f));
+		bitangents.assign(positions->count, glm::vec3(0.0f));
+		for (size_t i = 0; i + 2 < indexCount; i += 3)
+		{
+			const glm::vec3 p0 = ReadVec3(positions, indices[i]);
+			const glm::vec2 uv0 = ReadVec2(uvs, indices[i]);
+			const glm::vec3 edge0 = ReadVec3(positions, indices[i + 1]) - p0;
+			const glm::vec3 edge1 = ReadVec3(positions, indices[i + 2]) - p0;
+			const glm::vec2 uvEdge0 = ReadVec2(uvs, indices[i + 1]) - uv0;
+			const glm::vec2 uvEdge1 = ReadVec2(uvs, indices[i + 2]) - uv0;
+
+			const float determinant = uvEdge0.x * uvEdge1.y - uvEdge1.x * uvEdge0.y;
+			if (std::abs(determinant) < 1e-12f)
+			{
+				continue;
+			}
+			const glm::vec3 tangent = (edge0 * uvEdge1.y - edge1 * uvEdge0.y) / determinant;
+			const glm::vec3 bitangent = (edge1 * uvEdge0.x - edge0 * uvEdge1.x) / determinant;
+			for (size_t corner = 0; corner < 3; ++corner)
+			{
+				tangents[indices[i + corner]] += tangent;
+				bitangents[indices[i + corner]] += bitangent;
+			}
+		}
+
+		for (size_t v = 0; v < tangents.size(); ++v)
+		{
+			const glm::vec3& normal = normals[v];
+			for (glm::vec3* axis : { &tangents[v], &bitangents[v] })
+			{
+				const glm::vec3 projected = *axis - normal * glm::dot(normal, *axis);
+				const float length = glm::length(projected);
+				*axis = length > 0.0f ? projected / length : glm::vec3(0.0f);
+			}
+		}
+	}
+
+	bool AddTexture(GltfLoad& load, const cgltf_texture_view& view, TextureType type, std::vector<Texture>& textures)
+	{
+		if (!view.texture || !view.texture->image)
+		{
+			return true;
+		}
+
+		// Decoded by path like every other model's maps, and the TextureStreamer reads them again later
+		const cgltf_image* image = view.texture->image;
+		if (!image->uri || std::strncmp(image->uri, "data:", 5) == 0)
+		{
+			load.error = "embedded image";
+			return false;
+		}
+		std::string path = image->uri;
+		path.resize(cgltf_decode_uri(path.data()));
+
+		auto loaded = std::find_if(load.texturesLoaded.begin(), load.texturesLoaded.end(), [&path](const Texture& texture) { return texture.path == path; });
+		if (loaded != load.texturesLoaded.end())
+		{
+			textures.push_back(*loaded);
+			return true;
+		}
+
+		Texture texture;
+		texture.id = 0;
+		texture.type = type;
+		texture.path = path;
+		textures.push_back(texture);
+		load.texturesLoaded.push_back(texture);
+		return true;
+	}
+
+	// The same maps in the same order processMaterial picks from Assimp's glTF materials
+	bool LoadMaterial(GltfLoad& load, const cgltf_material* material, std::vector<Texture>& textures)
+	{
+		if (!material)
+		{
+			return true;
+		}
+
+		const bool pbr = material->has_pbr_metallic_roughness;
+		const bool loaded =
+			(!pbr || AddTexture(load, material->pbr_metallic_roughness.base_color_texture, TextureType::ALBEDO, textures)) &&
+			AddTexture(load, material->normal_texture, TextureType::NORMAL, textures) &&
+			(!pbr || AddTexture(load, material->pbr_metallic_roughness.metallic_roughness_texture, TextureType::METALLIC_ROUGHNESS, textures)) &&
+			AddTexture(load, material->occlusion_texture, TextureType::AO, textures) &&
+			AddTexture(load, material->emissive_texture, TextureType::EMISSIVE, textures);
+
+		if (std::any_of(textures.begin(), textures.end(), [](const Texture& texture) { return texture.type == TextureType::ALBEDO; }))
+		{
+			load.hasTextures = true;
+		}
+		return loaded;
+	}
+
+	bool LoadPrimitive(GltfLoad& load, const cgltf_primitive& primitive)
+	{
+		const cgltf_accessor* positions = FindAttribute(primitive, cgltf_attribute_type_position);
+		const cgltf_accessor* normals = FindAttribute(primitive, cgltf_attribute_type_normal);
+		const cgltf_accessor* uvs = FindAttribute(primitive, cgltf_attribute_type_texcoord);
+		const cgltf_accessor* tangents = FindAttribute(primitive, cgltf_attribute_type_tangent);
+		const cgltf_accessor* indices = primitive.indices;
+
+		if (primitive.type != cgltf_primitive_type_triangles)
+		{
+			load.error = "primitive that is not a triangle list";
+			return false;
+		}
+		if (!positions || positions->type != cgltf_type_vec3)
+		{
+			load.error = "primitive without positions";
+			return false;
+		}
+		for (const cgltf_accessor* accessor : { positions, normals, uvs, tangents, indices })
+		{
+			if (accessor && (accessor->is_sparse || !accessor->buffer_view))
+			{
+				load.error = "sparse accessor";
+				return false;
+			}
+		}
+
+		std::vector<Texture> textures;
+		if (!LoadMaterial(load, primitive.material, textures))
+		{
+			return false;
+		}
+
+		GltfPrimitive& out = load.import.primitives.emplace_back();
+		const size_t vertexCount = positions->count;
+		const size_t indexCount = indices ? indices->count : vertexCount;
+
+		// Every draw takes 32 bit indices, anything narrower is widened
+		if (indices && indices->component_type == cgltf_component_type_r_32u && indices->stride == sizeof(uint32_t))
+		{
+			out.indices = reinterpret_cast<const uint32_t*>(AccessorData(indices));
+		}
+		else
+		{
+			out.convertedIndices.resize(indexCount);
+			for (size_t i = 0; i < indexCount; ++i)
+			{
+				out.convertedIndices[i] = static_cast<uint32_t>(indices ? cgltf_accessor_read_index(indices, i) : i);
+			}
+			out.indices = out.convertedIndices.data();
+		}
+
+		InPlace(load, positions, out.attributes[0], 3);
+		std::vector<glm::vec3> generatedNormals;
+		if (normals)
+		{
+			InPlace(load, normals, out.attributes[1], 3);
+		}
+		else
+		{
+			generatedNormals = SmoothNormals(positions, out.indices, indexCount);
+			AppendConverted(out, out.attributes[1], generatedNormals);
+		}
+
+		// Without UVs there is no tangent space, and the attributes read as zero as Assimp's vertices leave them
+		if (uvs)
+		{
+			InPlace(load, uvs, out.attributes[2], 2);
+
+			std::vector<glm::vec3> bitangents;
+			if (tangents)
+			{
+				// Only xyz of the stored vec4 is read, w is the handedness the bitangent is derived with
+				InPlace(load, tangents, out.attributes[3], 3);
+				bitangents.resize(vertexCount);
+				for (size_t v = 0; v < vertexCount; ++v)
+				{
+					const glm::vec3 normal = normals ? ReadVec3(normals, v) : generatedNormals[v];
+					const glm::vec4 tangent = ReadVec4(tangents, v);
+					bitangents[v] = glm::cross(normal, glm::vec3(tangent)) * tangent.w;
+				}
+			}
+			else
+			{
+				std::vector<glm::vec3> fileNormals;
+				if (normals)
+				{
+					fileNormals.resize(vertexCount);
+					for (size_t v = 0; v < vertexCount; ++v)
+					{
+						fileNormals[v] = ReadVec3(normals, v);
+					}
+				}
+				std::vector<glm::vec3> generatedTangents;
+				TangentSpace(positions, uvs, out.indices, indexCount, normals ? fileNormals : generatedNormals, generatedTangents, bitangents);
+				AppendConverted(out, out.attributes[3], generatedTangents);
+			}
+			AppendConverted(out, out.attributes[4], bitangents);
+		}
+
+		Mesh mesh({}, {}, std::move(textures));
+		mesh.vertexCount = static_cast<uint32_t>(vertexCount);
+		mesh.indexCount = static_cast<uint32_t>(indexCount);
+		mesh.vertexStride = static_cast<uint32_t>(out.converted.size() / std::max(vertexCount, size_t(1)));
+
+		// glTF requires float position bounds in the file, quantized ones are in stored units
+		if (positions->has_min && positions->has_max && positions->component_type == cgltf_component_type_r_32f)
+		{
+			mesh.bounds.expand(glm::vec3(positions->min[0], positions->min[1], positions->min[2]));
+			mesh.bounds.expand(glm::vec3(positions->max[0], positions->max[1], positions->max[2]));
+		}
+		else
+		{
+			for (size_t v = 0; v < vertexCount; ++v)
+			{
+				mesh.bounds.expand(ReadVec3(positions, v));
+			}
+		}
+		load.bounds.expand(mesh.bounds);
+
+		// As the Mesh constructor measures it from Vertex arrays
+		if (uvs)
+		{
+			double surfaceArea = 0.0;
+			double uvArea = 0.0;
+			for (size_t i = 0; i + 2 < indexCount; i += 3)
+			{
+				const glm::vec3 a = ReadVec3(positions, out.indices[i]);
+				surfaceArea += glm::length(glm::cross(ReadVec3(positions, out.indices[i + 1]) - a, ReadVec3(positions, out.indices[i + 2]) - a));
+				const glm::vec2 uv = ReadVec2(uvs, out.indices[i]);
+				const glm::vec2 uvEdge0 = ReadVec2(uvs, out.indices[i + 1]) - uv;
+				const glm::vec2 uvEdge1 = ReadVec2(uvs, out.indices[i + 2]) - uv;
+				uvArea += std::abs(uvEdge0.x * uvEdge1.y - uvEdge0.y * uvEdge1.x);
+			}
+			mesh.uvDensity = surfaceArea > 0.0 ? static_cast<float>(std::sqrt(uvArea / surfaceArea)) : 0.0f;
+		}
+
+		load.meshes.push_back(std::move(mesh));
+		return true;
+	}
+
+	// Node transforms are ignored, as processNode does with Assimp's nodes
+	bool LoadNode(GltfLoad& load, const cgltf_node* node)
+	{
+		if (node->mesh)
+		{
+			for (size_t i = 0; i < node->mesh->primitives_count; ++i)
+			{
+				if (!LoadPrimitive(load, node->mesh->primitives[i]))
+				{
+					return false;
+				}
+			}
+		}
+		for (size_t i = 0; i < node->children_count; ++i)
+		{
+			if (!LoadNode(load, node->children[i]))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Points each buffer at the GLB chunk or maps its .bin file
+	bool MapBuffers(GltfLoad& load, cgltf_data* data)
+	{
+		for (size_t i = 0; i < data->buffers_count; ++i)
+		{
+			cgltf_buffer& buffer = data->buffers[i];
+			if (!buffer.uri)
+			{
+				if (i != 0 || !data->bin || data->bin_size < buffer.size)
+				{
+					load.error = "buffer without data";
+					return false;
+				}
+				buffer.data = const_cast<void*>(data->bin);
+			}
+			else if (std::strncmp(buffer.uri, "data:", 5) == 0)
+			{
+				load.error = "buffer embedded as a data URI";
+				return false;
+			}
+			else
+			{
+				std::string uri = buffer.uri;
+				uri.resize(cgltf_decode_uri(uri.data()));
+				MappedFile& file = *load.import.files.emplace_back(std::make_unique<MappedFile>());
+				if (!file.open(load.directory + '/' + uri) || file.size < buffer.size)
+				{
+					load.error = "missing buffer " + uri;
+					return false;
+				}
+				buffer.data = const_cast<uint8_t*>(file.data);
+			}
+			// Owned by the mappings, cgltf_free leaves them alone
+			buffer.data_free_method = cgltf_data_free_method_none;
+		}
+		return true;
+	}
+}
+
+bool IsGltfFile(const std::string& path)
+{
+	const size_t dot = path.find_last_of('.');
+	if (dot == std::string::npos)
+	{
+		return false;
+	}
+	std::string extension = path.substr(dot);
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+	return extension == ".gltf" || extension == ".glb";
+}
+
+bool LoadGltf(const std::string& path, Model& model)
+{
+	auto import = std::make_unique<GltfImport>();
+	MappedFile& file = *import->files.emplace_back(std::make_unique<MappedFile>());
+	if (!file.open(path))
+	{
+		std::cout << "ERROR::GLTF:: Could not map " << path << std::endl;
+		return false;
+	}
+
+	// Parsed in place, the GLB chunk stays in the mapping
+	cgltf_options options{};
+	cgltf_data* data = nullptr;
+	if (cgltf_parse(&options, file.data, file.size, &data) != cgltf_result_success)
+	{
+		std::cout << "ERROR::GLTF:: Could not parse " << path << std::endl;
+		return false;
+	}
+	std::unique_ptr<cgltf_data, decltype(&cgltf_free)> parsed(data, cgltf_free);
+
+	GltfLoad load(path.substr(0, path.find_last_of('/')), *import);
+	bool loaded = data->extensions_required_count == 0;
+	if (!loaded)
+	{
+		load.error = std::string("required extension ") + data->extensions_required[0];
+	}
+	loaded = loaded && MapBuffers(load, data);
+	// Checks every view and accessor lies within its buffer and every index within its vertices
+	if (loaded && cgltf_validate(data) != cgltf_result_success)
+	{
+		load.error = "invalid file";
+		loaded = false;
+	}
+
+	const cgltf_scene* scene = data->scene ? data->scene : (data->scenes_count > 0 ? data->scenes : nullptr);
+	if (scene)
+	{
+		for (size_t i = 0; loaded && i < scene->nodes_count; ++i)
+		{
+			loaded = LoadNode(load, scene->nodes[i]);
+		}
+	}
+	else
+	{
+		for (size_t i = 0; loaded && i < data->nodes_count; ++i)
+		{
+			loaded = data->nodes[i].parent || LoadNode(load, &data->nodes[i]);
+		}
+	}
+
+	if (!loaded)
+	{
+		std::cout << "Loading " << path << " through Assimp, the glTF loader does not handle its " << load.error << std::endl;
+		return false;
+	}
+
+	model.directory = std::move(load.directory);
+	model.meshes = std::move(load.meshes);
+	model.textures_loaded = std::move(load.texturesLoaded);
+	model.bounds.expand(load.bounds);
+	model.hasTextures = load.hasTextures;
+	model.gltf = std::move(import);
+	return true;
+}
+
+size_t UploadGltfMesh(Model& model, size_t meshIndex, GLuint instanceVBO)
+{
+	const GltfImport& import = *model.gltf;
+	size_t bytes = 0;
+
+	// Every view an attribute reads in place, straight from the mapping: the driver's copy is the only one
+	if (model.viewBuffers.empty() && !import.views.empty())
+	{
+		model.viewBuffers.resize(import.views.size());
+		glCreateBuffers(static_cast<GLsizei>(model.viewBuffers.size()), model.viewBuffers.data());
+		for (size_t i = 0; i < import.views.size(); ++i)
+		{
+			glNamedBufferStorage(model.viewBuffers[i], import.views[i].size, import.views[i].data, 0);
+			bytes += import.views[i].size;
+		}
+		model.viewBufferBytes = bytes;
+	}
+
+	Mesh& mesh = model.meshes[meshIndex];
+	const GltfPrimitive& primitive = import.primitives[meshIndex];
+	glCreateBuffers(1, &mesh.VBO);
+	glCreateBuffers(1, &mesh.EBO);
+	if (!primitive.converted.empty())
+	{
+		glNamedBufferStorage(mesh.VBO, primitive.converted.size(), primitive.converted.data(), 0);
+		bytes += primitive.converted.size();
+	}
+	if (mesh.indexCount > 0)
+	{
+		glNamedBufferStorage(mesh.EBO, mesh.indexCount * sizeof(uint32_t), primitive.indices, 0);
+		bytes += mesh.indexCount * sizeof(uint32_t);
+	}
+
+	std::array<VertexStream, 5> streams;
+	for (size_t i = 0; i < streams.size(); ++i)
+	{
+		const GltfAttribute& attribute = primitive.attributes[i];
+		streams[i].buffer = attribute.view >= 0 ? model.viewBuffers[attribute.view] : mesh.VBO;
+		streams[i].offset = static_cast<GLintptr>(attribute.offset);
+		streams[i].stride = attribute.stride;
+		streams[i].size = attribute.size;
+		streams[i].type = attribute.type;
+		streams[i].normalized = attribute.normalized;
+	}
+	mesh.setupMesh(instanceVBO, streams);
+	return bytes;
+}
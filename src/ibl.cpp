@@ -0,0 +1,221 @@
+#include "ibl.hpp"
+#include "environment.hpp"
+#include "renderStats.hpp"
+
+#include <glm/gtc/constants.hpp>
+
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+	constexpr char LUT_CACHE_MAGIC[4] = { 'O', 'G', 'L', 'B' };
+	constexpr uint32_t LUT_CACHE_VERSION = 1;
+
+	// Work groups are 8x8 in every IBL compute shader
+	GLuint groupCount(int size)
+	{
+		return static_cast<GLuint>((size + 7) / 8);
+	}
+
+	uint32_t createCubemap(int faceSize, int mipCount)
+	{
+		uint32_t textureID;
+		glCreateTextures(GL_TEXTURE_CUBE_MAP, 1, &textureID);
+		glTextureStorage2D(textureID, mipCount, GL_RGBA16F, faceSize, faceSize);
+
+		glTextureParameteri(textureID, GL_TEXTURE_MIN_FILTER, mipCount > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+		glTextureParameteri(textureID, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTextureParameteri(textureID, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTextureParameteri(textureID, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTextureParameteri(textureID, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+		return textureID;
+	}
+}
+
+IBLBaker::IBLBaker()
+	: equirectToCubeShader("shaders/iblEquirectToCube.comp"),
+	  prefilterShader("shaders/iblPrefilter.comp"),
+	  shProjectionShader("shaders/iblSH.comp"),
+	  brdfShader("shaders/iblBRDF.comp")
+{
+}
+
+uint32_t IBLBaker::equirectToCubemap(const EquirectData& equirect, int faceSize) const
+{
+	uint32_t equirectTexture;
+	glCreateTextures(GL_TEXTURE_2D, 1, &equirectTexture);
+	glTextureStorage2D(equirectTexture, 1, GL_RGB16F, equirect.width, equirect.height);
+	glTextureSubImage2D(equirectTexture, 0, 0, 0, equirect.width, equirect.height, GL_RGB, GL_FLOAT, equirect.texels.data());
+	glTextureParameteri(equirectTexture, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTextureParameteri(equirectTexture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTextureParameteri(equirectTexture, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTextureParameteri(equirectTexture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	const int mipCount = static_cast<int>(std::log2(faceSize)) + 1;
+	uint32_t cubemap = createCubemap(faceSize, mipCount);
+
+	equirectToCubeShader.use();
+	equirectToCubeShader.setInt("equirectangularMap", 0);
+	equirectToCubeShader.setInt("faceSize", faceSize);
+	countedBindTextureUnit(0, equirectTexture);
+	glBindImageTexture(0, cubemap, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+
+	glDispatchCompute(groupCount(faceSize), groupCount(faceSize), 6);
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+
+	// Box filtered mips are what filtered importance sampling expects from its source
+	glGenerateTextureMipmap(cubemap);
+
+	glState.deleteTextures(1, &equirectTexture);
+	return cubemap;
+}
+
+uint32_t IBLBaker::prefilterRadiance(uint32_t environment, int environmentSize, int faceSize, int mipCount) const
+{
+	uint32_t radiance = createCubemap(faceSize, mipCount);
+
+	prefilterShader.use();
+	prefilterShader.setInt("environmentMap", 0);
+	prefilterShader.setFloat("environmentResolution", static_cast<float>(environmentSize));
+	countedBindTextureUnit(0, environment);
+
+	for (int mip = 0; mip < mipCount; ++mip)
+	{
+		const int size = CubemapData::mipSize(faceSize, mip);
+		prefilterShader.setFloat("roughness", static_cast<float>(mip) / static_cast<float>(std::max(mipCount - 1, 1)));
+		prefilterShader.setInt("faceSize", size);
+		glBindImageTexture(0, radiance, mip, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+		glDispatchCompute(groupCount(size), groupCount(size), 6);
+	}
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+
+	return radiance;
+}
+
+std::array<glm::vec3, 9> IBLBaker::projectIrradianceSH(uint32_t environment, int environmentSize) const
+{
+	// Projecting a 64x64 mip per face is plenty for the three low frequency bands
+	const int sampleSize = std::min(environmentSize, 64);
+	const GLuint groups = groupCount(sampleSize);
+	const size_t partialCount = static_cast<size_t>(groups) * groups * 6 * 9;
+
+	uint32_t partialBuffer;
+	glCreateBuffers(1, &partialBuffer);
+	glNamedBufferData(partialBuffer, partialCount * sizeof(glm::vec4), nullptr, GL_STREAM_READ);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, partialBuffer);
+
+	shProjectionShader.use();
+	shProjectionShader.setInt("environmentMap", 0);
+	shProjectionShader.setInt("sampleSize", sampleSize);
+	shProjectionShader.setFloat("sourceLod", std::log2(static_cast<float>(environmentSize) / sampleSize));
+	countedBindTextureUnit(0, environment);
+
+	glDispatchCompute(groups, groups, 6);
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+	std::vector<glm::vec4> partials(partialCount);
+	glGetNamedBufferSubData(partialBuffer, 0, partialCount * sizeof(glm::vec4), partials.data());
+	glDeleteBuffers(1, &partialBuffer);
+
+	std::array<glm::vec3, 9> coefficients{};
+	float solidAngle = 0.0f;
+	for (size_t i = 0; i < partialCount; ++i)
+	{
+		coefficients[i % 9] += glm::vec3(partials[i]);
+		if (i % 9 == 0)
+		{
+			solidAngle += partials[i].w;
+		}
+	}
+
+	// Normalise the texel solid angles to exactly 4 PI, then apply the cosine lobe convolution
+	// (PI, 2PI/3, PI/4 per band, divided by PI) and the basis constants used for reconstruction
+	const float normalisation = 4.0f * glm::pi<float>() / std::max(solidAngle, 1e-6f);
+	const float bandScale[9] = { 1.0f, 2.0f / 3.0f, 2.0f / 3.0f, 2.0f / 3.0f, 0.25f, 0.25f, 0.25f, 0.25f, 0.25f };
+	const float basis[9] = { 0.282095f, 0.488603f, 0.488603f, 0.488603f, 1.092548f, 1.092548f, 0.315392f, 1.092548f, 0.546274f };
+
+	for (int i = 0; i < 9; ++i)
+	{
+		coefficients[i] *= normalisation * bandScale[i] * basis[i];
+	}
+	return coefficients;
+}
+
+uint32_t IBLBaker::bakeBRDFLUT(int size) const
+{
+	uint32_t lut;
+	glCreateTextures(GL_TEXTURE_2D, 1, &lut);
+	glTextureStorage2D(lut, 1, GL_RG16F, size, size);
+	glTextureParameteri(lut, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTextureParameteri(lut, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTextureParameteri(lut, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTextureParameteri(lut, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	brdfShader.use();
+	brdfShader.setInt("lutSize", size);
+	glBindImageTexture(0, lut, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG16F);
+	glDispatchCompute(groupCount(size), groupCount(size), 1);
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+
+	return lut;
+}
+
+uint32_t loadBRDFLUT(const IBLBaker& baker, const std::string& cachePath)
+{
+	struct LUTCacheHeader
+	{
+		char magic[4];
+		uint32_t version;
+		uint32_t size;
+	};
+
+	std::ifstream cache(cachePath, std::ios::binary);
+	if (cache)
+	{
+		LUTCacheHeader header{};
+		cache.read(reinterpret_cast<char*>(&header), sizeof(header));
+		if (cache && std::memcmp(header.magic, LUT_CACHE_MAGIC, 4) == 0 && header.version == LUT_CACHE_VERSION && header.size > 0 && header.size <= 4096)
+		{
+			std::vector<uint16_t> texels(static_cast<size_t>(header.size) * header.size * 2);
+			cache.read(reinterpret_cast<char*>(texels.data()), texels.size() * sizeof(uint16_t));
+			if (cache)
+			{
+				uint32_t lut;
+				glCreateTextures(GL_TEXTURE_2D, 1, &lut);
+				glTextureStorage2D(lut, 1, GL_RG16F, header.size, header.size);
+				glTextureSubImage2D(lut, 0, 0, 0, header.size, header.size, GL_RG, GL_HALF_FLOAT, texels.data());
+				glTextureParameteri(lut, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+				glTextureParameteri(lut, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+				glTextureParameteri(lut, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+				glTextureParameteri(lut, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+				return lut;
+			}
+		}
+		std::cout << "Ignoring stale or invalid BRDF LUT cache: " << cachePath << std::endl;
+	}
+
+	uint32_t lut = baker.bakeBRDFLUT(BRDF_LUT_SIZE);
+
+	std::vector<uint16_t> texels(static_cast<size_t>(BRDF_LUT_SIZE) * BRDF_LUT_SIZE * 2);
+	glGetTextureImage(lut, 0, GL_RG, GL_HALF_FLOAT, static_cast<GLsizei>(texels.size() * sizeof(uint16_t)), texels.data());
+
+	std::ofstream file(cachePath, std::ios::binary | std::ios::trunc);
+	LUTCacheHeader header{};
+	std::memcpy(header.magic, LUT_CACHE_MAGIC, 4);
+	header.version = LUT_CACHE_VERSION;
+	header.size = BRDF_LUT_SIZE;
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(texels.data()), texels.size() * sizeof(uint16_t));
+	if (!file)
+	{
+		std::cout << "Failed to write BRDF LUT cache: " << cachePath << std::endl;
+	}
+
+	return lut;
+}
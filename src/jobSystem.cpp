@@ -0,0 +1,208 @@
+#include "jobSystem.hpp"
+
+JobSystem jobSystem;
+
+namespace
+{
+	// Worker index of a spawned thread and the system it belongs to, benchmarks run several systems
+	thread_local const JobSystem* currentSystem = nullptr;
+	thread_local int currentIndex = -1;
+}
+
+JobSystem::~JobSystem()
+{
+	shutdown();
+}
+
+void JobSystem::init(int threadCount)
+{
+	shutdown();
+
+	if (threadCount <= 0)
+	{
+		threadCount = std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+	}
+
+	mainThread = std::this_thread::get_id();
+	stopping = false;
+	workers.clear();
+	for (int i = 0; i < threadCount; ++i)
+	{
+		workers.push_back(std::make_unique<Worker>());
+	}
+
+	for (int i = 1; i < threadCount; ++i)
+	{
+		threads.emplace_back([this, i]() { workerLoop(i); });
+	}
+}
+
+void JobSystem::shutdown()
+{
+	if (threads.empty())
+	{
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	threads.clear();
+}
+
+int JobSystem::currentWorker() const
+{
+	if (currentSystem == this)
+	{
+		return currentIndex;
+	}
+	return isMainThread() && !workers.empty() ? 0 : -1;
+}
+
+void JobSystem::run(JobCounter& counter, Job job)
+{
+	counter.pending.fetch_add(1, std::memory_order_relaxed);
+	if (workers.empty())
+	{
+		Task task{ std::move(job), &counter };
+		execute(task);
+		return;
+	}
+
+	// Threads outside the system hand their jobs out round robin
+	int worker = currentWorker();
+	if (worker < 0)
+	{
+		worker = static_cast<int>(nextForeignWorker.fetch_add(1, std::memory_order_relaxed) % workers.size());
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(workers[worker]->mutex);
+		workers[worker]->tasks.push_back({ std::move(job), &counter });
+	}
+
+	// Taking the sleep lock orders the increment against a worker about to sleep, so the wake is not lost
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		queued.fetch_add(1, std::memory_order_release);
+	}
+	wake.notify_one();
+}
+
+bool JobSystem::popOwn(int worker, Task& task)
+{
+	Worker& own = *workers[worker];
+	std::lock_guard<std::mutex> lock(own.mutex);
+	if (own.tasks.empty())
+	{
+		return false;
+	}
+	task = std::move(own.tasks.back());
+	own.tasks.pop_back();
+	return true;
+}
+
+bool JobSystem::steal(int thief, Task& task)
+{
+	const int count = static_cast<int>(workers.size());
+	const int start = thief < 0 ? 0 : thief + 1;
+	for (int i = 0; i < count; ++i)
+	{
+		const int victim = (start + i) % count;
+		if (victim == thief)
+		{
+			continue;
+		}
+
+		Worker& other = *workers[victim];
+		std::unique_lock<std::mutex> lock(other.mutex, std::try_to_lock);
+		if (!lock.owns_lock() || other.tasks.empty())
+		{
+			continue;
+		}
+		task = std::move(other.tasks.front());
+		other.tasks.pop_front();
+		return true;
+	}
+	return false;
+}
+
+void JobSystem::execute(Task& task)
+{
+	task.job();
+	task.counter->pending.fetch_sub(1, std::memory_order_release);
+}
+
+bool JobSystem::runOne(int worker)
+{
+	Task task;
+	if ((worker >= 0 && popOwn(worker, task)) || steal(worker, task))
+	{
+		queued.fetch_sub(1, std::memory_order_relaxed);
+		execute(task);
+		return true;
+	}
+	return false;
+}
+
+void JobSystem::wait(JobCounter& counter)
+{
+	const int worker = currentWorker();
+	while (!counter.done())
+	{
+		// The last jobs may be running elsewhere, nothing left to help with
+		if (!runOne(worker))
+		{
+			std::this_thread::yield();
+		}
+	}
+}
+
+void JobSystem::workerLoop(int worker)
+{
+	currentSystem = this;
+	currentIndex = worker;
+
+	while (true)
+	{
+		if (runOne(worker))
+		{
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		wake.wait(lock, [this]() { return stopping.load() || queued.load(std::memory_order_acquire) > 0; });
+		if (stopping)
+		{
+			return;
+		}
+	}
+}
+
+void JobSystem::runOnMainThread(Job job)
+{
+	if (isMainThread())
+	{
+		job();
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(mainThreadMutex);
+	mainThreadJobs.push_back(std::move(job));
+}
+
+void JobSystem::pumpMainThread()
+{
+	std::vector<Job> jobs;
+	{
+		std::lock_guard<std::mutex> lock(mainThreadMutex);
+		jobs.swap(mainThreadJobs);
+	}
+
+	for (Job& job : jobs)
+	{
+		job();
+	}
+}
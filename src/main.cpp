@@ -14,10 +14,35 @@
 #include "shader.hpp"
 #include "camera.hpp"
 #include "model.hpp"
+#include "modelLibrary.hpp"
+#include "environment.hpp"
+#include "ibl.hpp"
+#include "profiler.hpp"
+#include "renderStats.hpp"
+#include "scene.hpp"
+#include "benchmarks.hpp"
+#include "occlusion.hpp"
+#include "softwareOcclusion.hpp"
+#include "depthPrepass.hpp"
+#include "dynamicResolution.hpp"
+#include "renderGraph.hpp"
+#include "bloom.hpp"
+#include "ssao.hpp"
+#include "temporalAA.hpp"
+#include "textureStreaming.hpp"
+#include "virtualTexture.hpp"
+#include "worldStreaming.hpp"
+#include "jobSystem.hpp"
+#include "renderQueue.hpp"
 
 #include <iostream>
+#include <algorithm>
 #include <array>
 #include <filesystem>
+#include <functional>
+#include <fstream>
+#include <limits>
+#include <random>
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
@@ -26,52 +51,22 @@ void processInput(GLFWwindow* window);
 void processControllerInput();
 void renderQuad();
 void LoadModelFolders();
-
-class GameObject {
-public:
-	std::shared_ptr<Model> model;  // Using shared_ptr for better memory management
-	glm::vec3 position = { 0, 0, 0 };
-	glm::vec3 rotation = { 0, 0, 0 };
-	float scale = 1.0f;
-	bool visible = true;
-	std::string name;
-
-	GameObject(std::shared_ptr<Model> model, const std::string& name) : model(model), name(name) {}
-
-	glm::mat4 getTransformMatrix() const {
-		glm::mat4 transform(1.0f);
-		transform = glm::translate(transform, position);
-		transform = glm::rotate(transform, glm::radians(rotation.x), glm::vec3(1, 0, 0));
-		transform = glm::rotate(transform, glm::radians(rotation.y), glm::vec3(0, 1, 0));
-		transform = glm::rotate(transform, glm::radians(rotation.z), glm::vec3(0, 0, 1));
-		transform = glm::scale(transform, glm::vec3(scale));
-		return transform;
-	}
-};
-
-struct EnvironmentMap
-{
-	std::string name;
-	uint32_t cubemapTexture;
-	uint32_t irradianceMap;
-	uint32_t radianceMap;
-
-	float maxMipLevel;
-	std::string basePath;
-};
+struct ModelEntry;
+void AddModelInstances(const ModelEntry& entry, int instanceCount);
+void ScatterStreamedWorld(const ModelEntry& entry, int cellsPerSide, int objectsPerCell);
+void SelectOccluders(const std::vector<std::vector<InstanceData>>& instancesPerModel, size_t triangleBudget, std::vector<OccluderMesh>& occluders);
+struct MeshInstanceRanges;
+void UploadInstanceLists(const std::vector<std::vector<InstanceData>>& instancesPerModel);
+void NearestInstanceDepths(const std::vector<std::vector<InstanceData>>& instancesPerModel, const glm::vec3& eye, const glm::vec3& forward, std::vector<float>& depthPerModel);
+void EnqueueInstanceLists(RenderQueue& queue, RenderPassId pass, const std::vector<std::vector<InstanceData>>& instancesPerModel, const std::vector<float>& depthPerModel);
+void UploadOcclusionTested(const std::vector<std::vector<InstanceData>>& instancesPerModel, const SoftwareOcclusion& occlusion, const glm::mat4& viewProjection, std::vector<MeshInstanceRanges>& rangesPerModel);
+void EnqueueMeshInstanceRanges(RenderQueue& queue, const std::vector<MeshInstanceRanges>& rangesPerModel, const std::vector<float>& depthPerModel);
 
 void initEnvironmentMaps();
-EnvironmentMap loadEnvironmentMap(const std::string& name, const std::string& basePath);
-uint32_t loadHDRCubemap(std::vector<std::string> faces);
-uint32_t loadBRDF(const std::string& path);
 
-std::vector<EnvironmentMap> environmentMaps;
-int currentEnvironmentIndex = 0;
+EnvironmentLibrary environmentLibrary;
 
-// Framebuffers
-uint32_t g_hdrFBO;
-uint32_t g_colorBuffer;
-uint32_t g_rboDepth;
+// Framebuffers are transients of the render graph, sized from SCR_WIDTH x SCR_HEIGHT every frame
 int g_SCR_WIDTH = 2560;
 int g_SCR_HEIGHT = 1440;
 
@@ -179,9 +174,38 @@ const std::unordered_set<std::string> supportedFormats = {
 	".obj", ".gltf", ".glb", ".fbx", ".dae", ".blend", ".3ds", ".ply", ".stl"
 };
 
-// Game object container
-std::vector<GameObject> gameObjects;
-std::unordered_map<std::string, std::shared_ptr<Model>> modelCache;
+// Per-mesh runs of instances in a model's instance buffer, see UploadOcclusionTested
+struct MeshInstanceRanges
+{
+	std::vector<uint32_t> firstInstances;
+	std::vector<uint32_t> instanceCounts;
+};
+
+// Scene entities, models are shared between entities through the scene's model registry
+Scene scene;
+ModelLibrary modelLibrary;
+// Cells of the world around the camera, their entities are added to and removed from the scene as it moves
+WorldStreamer worldStreamer;
+
+// Benchmark mode: renders a fixed scene from a fixed camera, then writes the averaged stats and exits
+struct BenchmarkSettings
+{
+	bool enabled = false;
+	bool bvhOnly = false; // --bench-bvh runs the BVH micro benchmark without opening a window
+	bool occlusionOnly = false; // --bench-occlusion compares the software occlusion kernels without opening a window
+	bool jobsOnly = false; // --bench-jobs checks and times the job system without opening a window
+	bool sortOnly = false; // --bench-sort times the draw key radix sort without opening a window
+	bool virtualTextureOnly = false; // --bench-vt validates virtual texture paging in software without opening a window
+	int warmupFrames = 60;
+	int frames = 600;
+	int instances = 100;
+	std::string modelFolder;
+	std::string outputPath = "benchmark_stats.json";
+};
+BenchmarkSettings benchmark;
+
+bool parseBenchmarkArgs(int argc, char** argv);
+void writeBenchmarkResults(const std::vector<float>& frameTimes);
 
 GLenum glCheckError_(const char* file, int line)
 {
@@ -252,7 +276,35 @@ void APIENTRY glDebugOutput(GLenum source,
 	std::cout << std::endl;
 }
 
-int main() {
+int main(int argc, char** argv) {
+	if (!parseBenchmarkArgs(argc, argv))
+	{
+		return -1;
+	}
+
+	// This thread becomes worker 0 and the only one allowed to touch GL
+	jobSystem.init();
+	if (benchmark.jobsOnly)
+	{
+		return runJobBenchmark();
+	}
+	if (benchmark.sortOnly)
+	{
+		return runDrawSortBenchmark();
+	}
+	if (benchmark.virtualTextureOnly)
+	{
+		return runVirtualTextureBenchmark();
+	}
+	if (benchmark.bvhOnly)
+	{
+		return runBvhBenchmark();
+	}
+	if (benchmark.occlusionOnly)
+	{
+		return runOcclusionBenchmark();
+	}
+
 	glfwInit();
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
@@ -319,7 +371,7 @@ int main() {
 	printf("Max supported Vertex Attribs: %d\n", nrAttributes);
 
 	// configure global state
-	glEnable(GL_DEPTH_TEST);
+	glState.setEnabled(GL_DEPTH_TEST, true);
 
 	// More work to implement with framebuffers, not compatible with Clustered Forward or Deferred anway 
 	//glEnable(GL_MULTISAMPLE);
@@ -329,10 +381,13 @@ int main() {
 
 	bool wireframe = false;
 
-	glEnable(GL_CULL_FACE);
-	glCullFace(GL_BACK);
+	glState.setEnabled(GL_CULL_FACE, true);
+	glState.cullFace(GL_BACK);
 	glFrontFace(GL_CCW);
 
+	// Filter across cubemap face edges, the low radiance mips are only a few texels wide
+	glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+
 	Shader blinnPhongShading("shaders/blinnPhong.vert", "shaders/blinnPhong.frag");
 	Shader lightSource("shaders/lightSource.vert", "shaders/lightSource.frag");
 	Shader skyboxShader("shaders/skybox.vert", "shaders/skybox.frag");
@@ -387,87 +442,73 @@ int main() {
 	};
 
 	uint32_t skyboxVAO, skyboxVBO;
-	glGenVertexArrays(1, &skyboxVAO);
-	glGenBuffers(1, &skyboxVBO);
-	glBindVertexArray(skyboxVAO);
-	glBindBuffer(GL_ARRAY_BUFFER, skyboxVBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), &skyboxVertices, GL_STATIC_DRAW);
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+	glCreateVertexArrays(1, &skyboxVAO);
+	glCreateBuffers(1, &skyboxVBO);
+	glNamedBufferStorage(skyboxVBO, sizeof(skyboxVertices), &skyboxVertices, 0);
+	glVertexArrayVertexBuffer(skyboxVAO, 0, skyboxVBO, 0, 3 * sizeof(float));
+	glEnableVertexArrayAttrib(skyboxVAO, 0);
+	glVertexArrayAttribFormat(skyboxVAO, 0, 3, GL_FLOAT, GL_FALSE, 0);
+	glVertexArrayAttribBinding(skyboxVAO, 0, 0);
+
+	// Compiles the IBL compute shaders, environments and the BRDF LUT are baked on the GPU when missing
+	IBLBaker iblBaker;
+	profiler.init();
+	environmentLibrary.baker = &iblBaker;
 
 	initEnvironmentMaps();
-	uint32_t brdfLUTTexture = loadBRDF("assets/textures/brdf.png");
+	uint32_t brdfLUTTexture = loadBRDFLUT(iblBaker, "assets/textures/brdf.lutcache");
+
+	// Physical page cache of the virtual albedo maps, pages are requested by the opaque pass's feedback
+	virtualTextures.init();
+
+	// Hi-Z pyramid and GPU culling of the main pass against last frame's depth
+	OcclusionCuller occlusionCuller;
+
+	// CPU depth rasterizer of the largest meshes, for when the GPU path is turned off
+	SoftwareOcclusion softwareOcclusion;
+	std::vector<OccluderMesh> occluders;
+	size_t occluderTriangleBudget = 100000;
+	std::vector<MeshInstanceRanges> occlusionTestedRanges;
+
+	// Depth-only pass in front of the main pass, on when the measured overdraw makes it pay off
+	DepthPrepass depthPrepass;
+
+	// Scene render scale driven by GPU frame time, fixed in benchmark runs so results stay comparable
+	DynamicResolution dynamicResolution;
+	dynamicResolution.enabled = !benchmark.enabled;
+	float sharpness = 0.5f;
+
+	// Compute bloom on a half resolution chain, composited in the post-process pass
+	Bloom bloom;
+
+	// Half resolution ambient occlusion from the pre-pass depth, applied to the ambient term
+	SSAO ssao;
+
+	// Jittered rendering resolved against reprojected history, in place of MSAA on the HDR target
+	TemporalAA taa;
+
+	// Declares and runs the frame's passes, owns their framebuffers and transient textures
+	RenderGraph renderGraph;
 
 	blinnPhongShading.use();
-	blinnPhongShading.setInt("irradianceMap", 6);
 	blinnPhongShading.setInt("prefilterMap", 7);
 	blinnPhongShading.setInt("brdfLUT", 8);
+	blinnPhongShading.setInt("ssaoTexture", 9);
+	blinnPhongShading.setInt("vtIndirection", VirtualTextureSystem::INDIRECTION_UNIT);
+	blinnPhongShading.setInt("vtPhysical", VirtualTextureSystem::PHYSICAL_UNIT);
 
 	bool useIBL = true;
 
-	// Configure depth map FBO
+	// Shadow map size, the texture itself is a transient of the render graph
 	const uint32_t SHADOW_WIDTH = 2048, SHADOW_HEIGHT = 2048;
-	uint32_t depthMapFBO;
-	glGenFramebuffers(1, &depthMapFBO);
-
-	// Create depth texture
-	uint32_t depthMap;
-	glGenTextures(1, &depthMap);
-	glBindTexture(GL_TEXTURE_2D, depthMap);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-
-	float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
-	glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
-
-	// Attach depth texture as FBO's depth buffer
-	glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthMap, 0);
-	glDrawBuffer(GL_NONE);
-	glReadBuffer(GL_NONE);
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
 	skyboxShader.use();
-	glUniform1i(glGetUniformLocation(skyboxShader.ID, "skybox"), 0);
+	skyboxShader.setInt("skybox", 0);
 
 	debugDepthQuad.use();
-	glUniform1i(glGetUniformLocation(debugDepthQuad.ID, "depthMap"), 0);
-
-	// HDR Framebuffer for Post-Processing
-	uint32_t hdrFBO;
-	glGenFramebuffers(1, &hdrFBO);
-	glBindFramebuffer(GL_FRAMEBUFFER, hdrFBO);
-
-	// Create color buffer texture (HDR)
-	uint32_t colorBuffer;
-	glGenTextures(1, &colorBuffer);
-	glBindTexture(GL_TEXTURE_2D, colorBuffer);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_FLOAT, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorBuffer, 0);
-
-	// Create and attach depth buffer (renderbuffer)
-	uint32_t rboDepth;
-	glGenRenderbuffers(1, &rboDepth);
-	glBindRenderbuffer(GL_RENDERBUFFER, rboDepth);
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, SCR_WIDTH, SCR_HEIGHT);
-	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rboDepth);
-
-	// Check FBO validity
-	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-	{
-		std::cout << "Framebuffer incomplete!" << std::endl;
-	}
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	debugDepthQuad.setInt("depthMap", 0);
 
-	// Assign to global variables for use in callback
-	g_hdrFBO = hdrFBO;
-	g_colorBuffer = colorBuffer;
-	g_rboDepth = rboDepth;
+	// Size the projection's aspect ratio is taken from
 	g_SCR_WIDTH = SCR_WIDTH;
 	g_SCR_HEIGHT = SCR_HEIGHT;
 
@@ -491,26 +532,75 @@ int main() {
 
 	bool drawModel = true;
 	bool useNormalMaps = true;
+	bool frustumCulling = true;
+	enum OcclusionMode { OCCLUSION_OFF, OCCLUSION_GPU, OCCLUSION_SOFTWARE };
+	int occlusionMode = OCCLUSION_GPU;
 	float exposure = 1.0f;
 	LoadModelFolders();
 
+	// Per-model instance matrices for each pass, rebuilt every frame but keep their allocations
+	std::vector<std::vector<InstanceData>> instancesPerModel;
+	std::vector<std::vector<InstanceData>> shadowInstancesPerModel;
+	RenderListBuckets cameraBuckets;
+	RenderListBuckets shadowBuckets;
+
+	// Sorted draws for each pass, also rebuilt every frame
+	RenderQueue shadowQueue;
+	RenderQueue opaqueQueue;
+	std::vector<float> depthPerModel;
+
+	int benchmarkFrame = 0;
+	std::vector<float> benchmarkFrameTimes;
+	if (benchmark.enabled)
+	{
+		// Uncapped so the numbers measure the renderer rather than the display
+		glfwSwapInterval(0);
+
+		auto entry = std::find_if(modelFolders.begin(), modelFolders.end(), [](const ModelEntry& folder)
+		{
+			return benchmark.modelFolder.empty() || folder.folderName == benchmark.modelFolder;
+		});
+		if (entry != modelFolders.end())
+		{
+			AddModelInstances(*entry, benchmark.instances);
+		}
+		else
+		{
+			std::cout << "Benchmark model folder not found: " << benchmark.modelFolder << std::endl;
+		}
+		benchmarkFrameTimes.reserve(benchmark.frames);
+	}
+
 	while (!glfwWindowShouldClose(window))
 	{
+		profiler.beginFrame();
+		renderStats.beginFrame();
+		dynamicResolution.beginFrame(SCR_WIDTH, SCR_HEIGHT);
+
+		// GL work that jobs handed back since the last frame
+		jobSystem.pumpMainThread();
+
 		float currentFrame = static_cast<float>(glfwGetTime());
 		deltaTime = currentFrame - lastFrame;
 		lastFrame = currentFrame;
 
-		if (wireframe)
-		{
-			glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-		}
-		else
+		glState.polygonMode(wireframe ? GL_LINE : GL_FILL);
+
+		if (!benchmark.enabled)
 		{
-			glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+			processControllerInput();
+			processInput(window);
 		}
 
-		processControllerInput();
-		processInput(window);
+		// Upload any environment map that finished decoding in the background
+		environmentLibrary.update();
+		const EnvironmentMap* currentEnv = environmentLibrary.active();
+		// Before this frame's render lists are built, they hold pointers into the registry
+		modelLibrary.update(scene, instancesPerModel);
+		worldStreamer.update(scene, modelLibrary, camera.Position);
+		textureStreamer.update(scene.models, instancesPerModel, camera.Position,
+			dynamicResolution.renderHeight / (2.0f * std::tan(glm::radians(camera.Zoom) * 0.5f)));
+		virtualTextures.update();
 
 		// Physics update
 		if (isJumping)
@@ -558,189 +648,405 @@ int main() {
 
 		ImGui::End();
 
-		// 1.) Render depth of scene to texture (from light's perspective)
+		// Light and camera transformations shared by the passes
 		glm::mat4 lightProjection;
 		glm::mat4 lightView;
 		glm::mat4 lightSpaceMatrix;
 		glm::vec3 lightPos = -direction * 10.0f;
-	
+
 		float near_plane = 1.0f, far_plane = 50.0f;
 		lightProjection = glm::ortho(-10.0f, 10.0f, -10.0f, 10.0f, near_plane, far_plane);
 		lightView = glm::lookAt(lightPos, glm::vec3(0.0f), glm::vec3(0.0, 1.0, 0.0));
 		lightSpaceMatrix = lightProjection * lightView;
 
-		// Render scene from lights POV
-		shadowMap.use();
-		glUniformMatrix4fv(glGetUniformLocation(shadowMap.ID, "lightSpaceMatrix"), 1, GL_FALSE, glm::value_ptr(lightSpaceMatrix));
+		glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)g_SCR_WIDTH / (float)g_SCR_HEIGHT, 0.1f, 100.0f);
+		glm::mat4 view = camera.GetViewMatrix();
 
-		glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
-		glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-		glClear(GL_DEPTH_BUFFER_BIT);
+		// The scene only covers the bottom-left renderWidth x renderHeight of the HDR target
+		const int renderWidth = dynamicResolution.renderWidth;
+		const int renderHeight = dynamicResolution.renderHeight;
 
-		// Group transforms by model for shadow pass
-		std::unordered_map<std::shared_ptr<Model>, std::vector<glm::mat4>> batchedInstanceData;
+		// Motion vectors come from the unjittered matrices, everything rasterized uses the jittered projection
+		taa.beginFrame(projection * view, renderWidth, renderHeight, SCR_WIDTH, SCR_HEIGHT, renderGraph);
+		projection = taa.jitterProjection(projection);
 
-		// Group transforms by model
-		for (const auto& obj : gameObjects) 
-		{
-			if (obj.visible) {
-				batchedInstanceData[obj.model].push_back(obj.getTransformMatrix());
-			}
-		}
+		// Render lists are built on jobs once the UI has settled the scene, see below
+		const Frustum lightFrustum = Frustum::fromMatrix(lightSpaceMatrix);
+		const Frustum cameraFrustum = Frustum::fromMatrix(projection * view);
+		JobCounter shadowLists;
+		JobCounter cameraLists;
 
-		// Render each model with all its instances for shadow mapping
-		for (auto& [modelPtr, transforms] : batchedInstanceData) 
-		{
-			// Skip if no visible instances
-			if (transforms.empty()) continue;
-
-			// Update model's instance buffer
-			glBindBuffer(GL_ARRAY_BUFFER, modelPtr->instanceVBO);
-			glBufferData(GL_ARRAY_BUFFER,
-				transforms.size() * sizeof(glm::mat4),
-				transforms.data(),
-				GL_DYNAMIC_DRAW);
-
-			// Draw the model with instancing for shadows
-			modelPtr->Draw(shadowMap, transforms.size());
-		}
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		// Declare this frame's passes, they execute once the UI has been built
+		renderGraph.reset();
+		const RenderGraphTexture backbuffer = renderGraph.import("Backbuffer", 0, { SCR_WIDTH, SCR_HEIGHT });
+		RenderGraphTexture shadowDepth;
+		RenderGraphTexture hdrColor;
+		RenderGraphTexture velocity;
+		RenderGraphTexture sceneDepth;
 
-		// Reset viewport
-		glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		// 1.) Render depth of scene to texture (from light's perspective)
+		renderGraph.addPass("Shadow Pass",
+			[&](RenderGraph::Builder& builder)
+			{
+				shadowDepth = builder.create("Shadow Map", { static_cast<int>(SHADOW_WIDTH), static_cast<int>(SHADOW_HEIGHT), GL_DEPTH_COMPONENT24, GL_NEAREST, GL_CLAMP_TO_BORDER });
+			},
+			[&](const RenderGraph::Context&)
+			{
+				// Render scene from lights POV
+				shadowMap.use();
+				shadowMap.setMat4("lightSpaceMatrix", lightSpaceMatrix);
+
+				glClear(GL_DEPTH_BUFFER_BIT);
+
+				jobSystem.wait(shadowLists);
+
+				// Render each model with all its instances for shadow mapping, depth order does not matter here
+				UploadInstanceLists(shadowInstancesPerModel);
+				shadowQueue.clear();
+				EnqueueInstanceLists(shadowQueue, RenderPassId::Shadow, shadowInstancesPerModel, {});
+				shadowQueue.sort();
+				shadowQueue.submit(RenderPassId::Shadow, shadowMap);
+			});
 
 		//2.) Render Scene as normal using the generated depth / shadow map
-		glBindFramebuffer(GL_FRAMEBUFFER, hdrFBO);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		renderGraph.addPass("Main Pass",
+			[&](RenderGraph::Builder& builder)
+			{
+				builder.read(shadowDepth);
+				hdrColor = builder.create("HDR Color", { SCR_WIDTH, SCR_HEIGHT, GL_RGBA16F });
+				if (taa.enabled)
+				{
+					velocity = builder.create("Velocity", { SCR_WIDTH, SCR_HEIGHT, GL_RG16F, GL_NEAREST });
+				}
+				sceneDepth = builder.create("Scene Depth", { SCR_WIDTH, SCR_HEIGHT, GL_DEPTH_COMPONENT32F, GL_NEAREST });
+			},
+			[&](const RenderGraph::Context& context)
+			{
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				if (velocity.valid())
+				{
+					const GLfloat noVelocity[4] = { TemporalAA::NO_VELOCITY, TemporalAA::NO_VELOCITY, 0.0f, 0.0f };
+					glClearBufferfv(GL_COLOR, 1, noVelocity);
+				}
+				glViewport(0, 0, renderWidth, renderHeight);
 
-		Shader* activeShader;
-		switch(currentShadingMode) 
-		{
-			case BLINNPHONG:
-				activeShader = &blinnPhongShading;
-				break;
-			default:
-				activeShader = &blinnPhongShading;
-				break;
-		}
+				// Hi-Z pyramid source
+				const GLuint depthTexture = context.texture(sceneDepth);
 
-		activeShader->use();
-		glUniform3fv(glGetUniformLocation(activeShader->ID, "camPos"), 1, glm::value_ptr(camera.Position));
-		glUniformMatrix4fv(glGetUniformLocation(activeShader->ID, "lightSpaceMatrix"), 1, GL_FALSE, glm::value_ptr(lightSpaceMatrix));
+				Shader* activeShader;
+				switch(currentShadingMode) 
+				{
+					case BLINNPHONG:
+						activeShader = &blinnPhongShading;
+						break;
+					default:
+						activeShader = &blinnPhongShading;
+						break;
+				}
 
-		// Set Material Properties
-		activeShader->setBool("useNormalMaps", useNormalMaps);
-		activeShader->setBool("useIBL", useIBL);
+				activeShader->use();
+				activeShader->setVec3("camPos", camera.Position);
+				activeShader->setMat4("lightSpaceMatrix", lightSpaceMatrix);
 
-		// Directional Light
-		glUniform1i(glGetUniformLocation(activeShader->ID, "enableDirLight"), useDirLight ? 1 : 0);
-		glUniform3fv(glGetUniformLocation(activeShader->ID, "dirLight.direction"), 1, glm::value_ptr(direction));
-		glUniform3fv(glGetUniformLocation(activeShader->ID, "dirLight.color"), 1, glm::value_ptr(sunLightColor));
+				// Set Material Properties
+				activeShader->setBool("useNormalMaps", useNormalMaps);
+				activeShader->setBool("useIBL", useIBL && currentEnv);
+				activeShader->setBool("useSSAO", ssao.enabled);
 
-		// Point Lights
-		glUniform1i(glGetUniformLocation(activeShader->ID, "NR_POINT_LIGHTS"), pointLightPositions.size());
-		for (uint32_t i = 0; i < pointLightPositions.size(); ++i)
-		{
-			std::string number = std::to_string(i);
+				// Directional Light
+				activeShader->setInt("enableDirLight", useDirLight ? 1 : 0);
+				activeShader->setVec3("dirLight.direction", direction);
+				activeShader->setVec3("dirLight.color", sunLightColor);
 
-			glUniform3fv(glGetUniformLocation(activeShader->ID, ("pointLights[" + number + "].position").c_str()), 1, glm::value_ptr(pointLightPositions[i]));
-			glUniform3fv(glGetUniformLocation(activeShader->ID, ("pointLights[" + number + "].color").c_str()), 1, glm::value_ptr(pointLightColor));
-		}
+				// Point Lights
+				activeShader->setInt("NR_POINT_LIGHTS", static_cast<int>(pointLightPositions.size()));
+				for (uint32_t i = 0; i < pointLightPositions.size(); ++i)
+				{
+					std::string number = std::to_string(i);
 
-		// Spot light
-		glUniform1i(glGetUniformLocation(activeShader->ID, "enableSpotLight"), useFlashlight ? 1 : 0);
-		glUniform3fv(glGetUniformLocation(activeShader->ID, "spotLight.position"), 1, glm::value_ptr(camera.Position));
-		glUniform3fv(glGetUniformLocation(activeShader->ID, "spotLight.direction"), 1, glm::value_ptr(camera.Front));
-		glUniform3fv(glGetUniformLocation(activeShader->ID, "spotLight.color"), 1, glm::value_ptr(spotlightColor));
-		glUniform1f(glGetUniformLocation(activeShader->ID, "spotLight.cutOff"), glm::cos(glm::radians(12.5f)));
-		glUniform1f(glGetUniformLocation(activeShader->ID, "spotLight.outerCutOff"), glm::cos(glm::radians(15.0f)));
+					activeShader->setVec3("pointLights[" + number + "].position", pointLightPositions[i]);
+					activeShader->setVec3("pointLights[" + number + "].color", pointLightColor);
+				}
 
-		// View / Projection transformations
-		glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)g_SCR_WIDTH / (float)g_SCR_HEIGHT, 0.1f, 100.0f);
-		glm::mat4 view = camera.GetViewMatrix();
-		glUniformMatrix4fv(glGetUniformLocation(activeShader->ID, "view"), 1, GL_FALSE, glm::value_ptr(view));
-		glUniformMatrix4fv(glGetUniformLocation(activeShader->ID, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
-
-		// Default PBR values
-		glm::vec3 defaultAlbedo = glm::vec3(0.8f);
-		float defaultMetallic = 0.0f;
-		float defaultRoughness = 0.5;
-		float defaultAO = 1.0f;
-
-		glUniform3fv(glGetUniformLocation(activeShader->ID, "defaultAlbedo"), 1, glm::value_ptr(defaultAlbedo));
-		activeShader->setFloat("defaultMetallic", defaultMetallic);
-		activeShader->setFloat("defaultRoughness", defaultRoughness);
-		activeShader->setFloat("defaultAO", defaultAO);
-
-		// Use texture unit 5 for shadow map to allow room for albedo/normals/metallic/roughness/ao
-		glUniform1i(glGetUniformLocation(activeShader->ID, "shadowMap"), 5);
-		glActiveTexture(GL_TEXTURE5);
-		glBindTexture(GL_TEXTURE_2D, depthMap);
-
-		// Bind IBL textures
-		const EnvironmentMap& currentEnv = environmentMaps[currentEnvironmentIndex];
-
-		activeShader->setFloat("MAX_REFLECTION_LOD", currentEnv.maxMipLevel);
-		activeShader->setFloat("exposure", exposure);
-
-		glActiveTexture(GL_TEXTURE6);
-		glBindTexture(GL_TEXTURE_CUBE_MAP, currentEnv.irradianceMap);
-		glActiveTexture(GL_TEXTURE7);
-		glBindTexture(GL_TEXTURE_CUBE_MAP, currentEnv.radianceMap);
-		glActiveTexture(GL_TEXTURE8);
-		glBindTexture(GL_TEXTURE_2D, brdfLUTTexture);
-
-		// Render each model with all its instances
-		for (auto& [modelPtr, transforms] : batchedInstanceData) { 
-			// Skip if no visible instances or null model
-			if (!modelPtr || transforms.empty()) {
-				std::cout << "Skipping model - null or no transforms" << std::endl;
-				continue;
-			}
+				// Spot light
+				activeShader->setInt("enableSpotLight", useFlashlight ? 1 : 0);
+				activeShader->setVec3("spotLight.position", camera.Position);
+				activeShader->setVec3("spotLight.direction", camera.Front);
+				activeShader->setVec3("spotLight.color", spotlightColor);
+				activeShader->setFloat("spotLight.cutOff", glm::cos(glm::radians(12.5f)));
+				activeShader->setFloat("spotLight.outerCutOff", glm::cos(glm::radians(15.0f)));
+
+				// View / Projection transformations
+				activeShader->setMat4("view", view);
+				activeShader->setMat4("projection", projection);
+				activeShader->setMat4("viewProjection", taa.viewProjection);
+				activeShader->setMat4("previousViewProjection", taa.previousViewProjection);
+
+				// Default PBR values
+				glm::vec3 defaultAlbedo = glm::vec3(0.8f);
+				float defaultMetallic = 0.0f;
+				float defaultRoughness = 0.5;
+				float defaultAO = 1.0f;
+
+				activeShader->setVec3("defaultAlbedo", defaultAlbedo);
+				activeShader->setFloat("defaultMetallic", defaultMetallic);
+				activeShader->setFloat("defaultRoughness", defaultRoughness);
+				activeShader->setFloat("defaultAO", defaultAO);
+
+				// Use texture unit 5 for shadow map to allow room for albedo/normals/metallic/roughness/ao
+				activeShader->setInt("shadowMap", 5);
+				countedBindTextureUnit(5, context.texture(shadowDepth));
+
+				// Bind IBL textures, nothing is bound until the first environment has finished loading
+				activeShader->setFloat("MAX_REFLECTION_LOD", currentEnv ? currentEnv->maxMipLevel : 0.0f);
+				activeShader->setFloat("exposure", exposure);
+
+				if (currentEnv)
+				{
+					activeShader->setVec3Array("irradianceSH", currentEnv->irradianceSH.data(), 9);
+				}
 
-			// No need to set model matrix uniform when instancing
-			modelPtr->Draw(*activeShader, transforms.size());
-		}
+				countedBindTextureUnit(7, currentEnv ? currentEnv->radianceMap : 0);
+				countedBindTextureUnit(8, brdfLUTTexture);
+				virtualTextures.beginFeedback(*activeShader, renderWidth, renderHeight);
+
+				jobSystem.wait(cameraLists);
+
+				// Opaque draws sort front-to-back by their model's nearest visible instance
+				NearestInstanceDepths(instancesPerModel, camera.Position, camera.Front, depthPerModel);
+				opaqueQueue.clear();
+
+				// Submits the same geometry to the depth pre-pass, when it runs, and then to the colour pass.
+				// SSAO needs all of the depth first, so while it is on the colour draws are held back until then.
+				depthPrepass.required = ssao.enabled;
+				depthPrepass.beginFrame(renderWidth * renderHeight);
+				std::vector<std::function<void(Shader&)>> deferredColour;
+				auto drawWithPrepass = [&](std::function<void(Shader&)> drawGeometry)
+				{
+					if (depthPrepass.active)
+					{
+						profiler.beginGpuZone("Depth Pre-Pass");
+						depthPrepass.beginDepth(view, projection);
+						drawGeometry(depthPrepass.shader);
+						depthPrepass.endDepth();
+						profiler.endGpuZone();
+						activeShader->use();
+					}
+
+					if (ssao.enabled)
+					{
+						deferredColour.push_back(std::move(drawGeometry));
+						return;
+					}
+
+					depthPrepass.beginColour();
+					drawGeometry(*activeShader);
+					depthPrepass.endColour();
+				};
+
+				if (occlusionMode == OCCLUSION_GPU)
+				{
+					// Draw what last frame's depth does not hide, then retest the rest against this frame's depth
+					const glm::mat4 viewProjection = projection * view;
+					occlusionCuller.prepare(instancesPerModel, scene.models);
+					occlusionCuller.enqueue(opaqueQueue, scene.models, depthPerModel);
+					opaqueQueue.sort();
+
+					// cull() and buildPyramid() switch programs in between draws
+					occlusionCuller.cull(0);
+					drawWithPrepass([&](Shader& shader) { shader.use(); opaqueQueue.submit(RenderPassId::Opaque, shader); });
+					occlusionCuller.buildPyramid(depthTexture, renderWidth, renderHeight, viewProjection);
+					occlusionCuller.cull(1);
+					drawWithPrepass([&](Shader& shader) { shader.use(); opaqueQueue.submit(RenderPassId::OpaqueLate, shader); });
+
+					// Complete depth of this frame is what the next frame tests against
+					occlusionCuller.buildPyramid(depthTexture, renderWidth, renderHeight, viewProjection);
+				}
+				else if (occlusionMode == OCCLUSION_SOFTWARE)
+				{
+					// Rasterize the biggest meshes on the CPU, then only draw meshes that are not fully behind them
+					const glm::mat4 viewProjection = projection * view;
+					profiler.beginCpuZone("Software Occlusion");
+					SelectOccluders(instancesPerModel, occluderTriangleBudget, occluders);
+					softwareOcclusion.render(occluders, viewProjection);
+					profiler.endCpuZone();
+
+					UploadOcclusionTested(instancesPerModel, softwareOcclusion, viewProjection, occlusionTestedRanges);
+					EnqueueMeshInstanceRanges(opaqueQueue, occlusionTestedRanges, depthPerModel);
+					opaqueQueue.sort();
+					drawWithPrepass([&](Shader& shader) { opaqueQueue.submit(RenderPassId::Opaque, shader); });
+				}
+				else
+				{
+					// Render each model with all its instances
+					UploadInstanceLists(instancesPerModel);
+					EnqueueInstanceLists(opaqueQueue, RenderPassId::Opaque, instancesPerModel, depthPerModel);
+					opaqueQueue.sort();
+					drawWithPrepass([&](Shader& shader) { opaqueQueue.submit(RenderPassId::Opaque, shader); });
+				}
+
+				if (ssao.enabled)
+				{
+					ssao.compute(depthTexture, renderWidth, renderHeight, projection);
+
+					activeShader->use();
+					countedBindTextureUnit(9, ssao.aoTexture);
+					for (const std::function<void(Shader&)>& drawGeometry : deferredColour)
+					{
+						depthPrepass.beginColour();
+						drawGeometry(*activeShader);
+						depthPrepass.endColour();
+					}
+				}
+
+				// Pages the opaque draws sampled, read back a few frames from now
+				virtualTextures.endFeedback();
+			});
+
+		renderGraph.addPass("Light Sources",
+			[&](RenderGraph::Builder& builder)
+			{
+				builder.write(hdrColor);
+				if (velocity.valid())
+				{
+					builder.write(velocity);
+				}
+				builder.write(sceneDepth);
+			},
+			[&](const RenderGraph::Context&)
+			{
+				glViewport(0, 0, renderWidth, renderHeight);
+				lightSource.use();
+				lightSource.setMat4("projection", projection);
+				lightSource.setMat4("view", view);
+
+				for (uint32_t i = 0; i < pointLightPositions.size(); i++)
+				{
+					glm::mat4 model = glm::mat4(1.0f);
+					model = glm::translate(model, pointLightPositions[i]);
+					model = glm::scale(model, glm::vec3(0.2f));
+					lightSource.setMat4("model", model);
+
+					lightSourceSphere.Draw(lightSource, 1);
+				}
+			});
 
-		lightSource.use();
-		glUniformMatrix4fv(glGetUniformLocation(lightSource.ID, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
-		glUniformMatrix4fv(glGetUniformLocation(lightSource.ID, "view"), 1, GL_FALSE, glm::value_ptr(view));
+		// Draw skybox last in the scene
+		renderGraph.addPass("Skybox",
+			[&](RenderGraph::Builder& builder)
+			{
+				builder.write(hdrColor);
+				builder.write(sceneDepth);
+			},
+			[&](const RenderGraph::Context&)
+			{
+				glViewport(0, 0, renderWidth, renderHeight);
+				glState.depthFunc(GL_LEQUAL);
+				skyboxShader.use();
+				const glm::mat4 skyboxView = glm::mat4(glm::mat3(view)); // Remove translation from the view matrix
+				skyboxShader.setMat4("projection", projection);
+				skyboxShader.setMat4("view", skyboxView);
+
+				if (currentEnv)
+				{
+					countedBindVertexArray(skyboxVAO);
+					countedBindTextureUnit(0, currentEnv->cubemapTexture);
+					countedDrawArrays(GL_TRIANGLES, 0, 36);
+				}
+				glState.depthFunc(GL_LESS); // Reset depth function
+			});
 
-		for (uint32_t i = 0; i < pointLightPositions.size(); i++)
+		// Resolves into this frame's history texture, which the passes below read in place of the HDR colour
+		RenderGraphTexture sceneColor = hdrColor;
+		if (taa.enabled)
 		{
-			glm::mat4 model = glm::mat4(1.0f);
-			model = glm::translate(model, pointLightPositions[i]);
-			model = glm::scale(model, glm::vec3(0.2f));
-			glUniformMatrix4fv(glGetUniformLocation(lightSource.ID, "model"), 1, GL_FALSE, glm::value_ptr(model));
+			const RenderGraphTexture history = renderGraph.import("TAA History", taa.historyTexture(), taa.historyDesc());
+			const RenderGraphTexture resolved = renderGraph.import("TAA Output", taa.outputTexture(), taa.historyDesc());
+			renderGraph.addPass("TAA Resolve",
+				[&](RenderGraph::Builder& builder)
+				{
+					builder.read(hdrColor);
+					builder.read(velocity);
+					builder.read(sceneDepth);
+					builder.read(history);
+					builder.write(resolved);
+				},
+				[&](const RenderGraph::Context& context)
+				{
+					glViewport(0, 0, renderWidth, renderHeight);
+					taa.bindResolve(context.texture(hdrColor), context.texture(velocity), context.texture(sceneDepth), dynamicResolution.uvScale());
+					renderQuad();
+				});
+			sceneColor = resolved;
+		}
 
-			lightSourceSphere.Draw(lightSource, 1);
+		RenderGraphTexture bloomChain;
+		const RenderGraphTextureDesc bloomDesc = Bloom::chainDesc(SCR_WIDTH, SCR_HEIGHT);
+		if (bloom.enabled)
+		{
+			renderGraph.addPass("Bloom",
+				[&](RenderGraph::Builder& builder)
+				{
+					builder.compute();
+					builder.read(sceneColor);
+					bloomChain = builder.create("Bloom Chain", bloomDesc);
+				},
+				[&](const RenderGraph::Context& context)
+				{
+					bloom.render(context.texture(sceneColor), renderWidth, renderHeight, context.texture(bloomChain), bloomDesc);
+				});
 		}
 
-		// Draw skybox last in the scene
-		glDepthFunc(GL_LEQUAL);
-		skyboxShader.use();
-		view = glm::mat4(glm::mat3(camera.GetViewMatrix())); // Remove translation from the view matrix
-		glUniformMatrix4fv(glGetUniformLocation(skyboxShader.ID, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
-		glUniformMatrix4fv(glGetUniformLocation(skyboxShader.ID, "view"), 1, GL_FALSE, glm::value_ptr(view));
-
-		glBindVertexArray(skyboxVAO);
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_CUBE_MAP, currentEnv.cubemapTexture);
-		glDrawArrays(GL_TRIANGLES, 0, 36);
-		glBindVertexArray(0);
-		glDepthFunc(GL_LESS); // Reset depth function
-
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-		postShader.use();
-		postShader.setFloat("exposure", exposure);
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, colorBuffer);
-		postShader.setInt("hdrBuffer", 0);
-
-		// Full post-process ready quad
-		renderQuad();
+		// Upscales the rendered rectangle to the window
+		renderGraph.addPass("Post Process",
+			[&](RenderGraph::Builder& builder)
+			{
+				builder.read(sceneColor);
+				if (bloomChain.valid())
+				{
+					builder.read(bloomChain);
+				}
+				builder.write(backbuffer);
+			},
+			[&](const RenderGraph::Context& context)
+			{
+				postShader.use();
+				postShader.setFloat("exposure", exposure);
+				postShader.setVec2("renderScale", dynamicResolution.uvScale());
+				postShader.setFloat("sharpness", sharpness);
+				countedBindTextureUnit(0, context.texture(sceneColor));
+				postShader.setInt("hdrBuffer", 0);
+				if (bloomChain.valid())
+				{
+					countedBindTextureUnit(1, context.texture(bloomChain));
+					postShader.setInt("bloomTexture", 1);
+					postShader.setVec2("bloomScale", bloom.uvScale());
+					postShader.setFloat("bloomNormalization", bloom.normalization());
+					postShader.setFloat("bloomStrength", bloom.strength);
+				}
+				else
+				{
+					postShader.setFloat("bloomStrength", 0.0f);
+				}
+
+				// Full post-process ready quad
+				renderQuad();
+			});
+
+		renderGraph.addPass("ImGui Render",
+			[&](RenderGraph::Builder& builder)
+			{
+				builder.write(backbuffer);
+			},
+			[&](const RenderGraph::Context&)
+			{
+				ImGui::Render();
+				ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+				// The backend binds and enables whatever it needs directly
+				glState.invalidate();
+			});
+
+		renderGraph.compile();
 
 		// Render depth map to quad for visual debugging
 		// debugDepthQuad.use();
@@ -750,18 +1056,23 @@ int main() {
 		// glBindTexture(GL_TEXTURE_2D, depthMap);
 		// renderQuad();
 
+		profiler.beginCpuZone("ImGui Build");
 		ImGui::Begin("OGLRenderer Interface");
 		ImGui::Text("Scene Construction");
 		ImGui::Separator();
 
-		if (ImGui::BeginCombo("Environment", environmentMaps[currentEnvironmentIndex].name.c_str()))
+		const int selectedEnvironment = environmentLibrary.selectedIndex();
+		const bool hasSelection = selectedEnvironment >= 0 && selectedEnvironment < static_cast<int>(environmentLibrary.entries.size());
+		const char* environmentPreview = hasSelection ? environmentLibrary.entries[selectedEnvironment].name.c_str() : "None";
+		if (ImGui::BeginCombo("Environment", environmentPreview))
 		{
-			for (size_t i = 0; i < environmentMaps.size(); ++i)
+			const int environmentCount = static_cast<int>(environmentLibrary.entries.size());
+			for (int i = 0; i < environmentCount; ++i)
 			{
-				bool isSelected = (currentEnvironmentIndex == i);
-				if (ImGui::Selectable(environmentMaps[i].name.c_str(), isSelected))
+				bool isSelected = (selectedEnvironment == i);
+				if (ImGui::Selectable(environmentLibrary.entries[i].name.c_str(), isSelected))
 				{
-					currentEnvironmentIndex = i;
+					environmentLibrary.select(i);
 				}
 				if (isSelected)
 				{
@@ -771,6 +1082,43 @@ int main() {
 			ImGui::EndCombo();
 		}
 
+		if (environmentLibrary.isLoading())
+		{
+			ImGui::Text("Loading environment...");
+		}
+
+		static int environmentBudgetMB = static_cast<int>(environmentLibrary.budgetBytes / (1024 * 1024));
+		if (ImGui::SliderInt("Environment Budget (MB)", &environmentBudgetMB, 64, 4096))
+		{
+			environmentLibrary.budgetBytes = static_cast<size_t>(environmentBudgetMB) * 1024 * 1024;
+		}
+		ImGui::Text("Resident Environments: %.1f MB", environmentLibrary.residentBytes() / (1024.0f * 1024.0f));
+
+		static int modelBudgetMB = static_cast<int>(modelLibrary.budgetBytes / (1024 * 1024));
+		if (ImGui::SliderInt("Model Budget (MB)", &modelBudgetMB, 64, 8192))
+		{
+			modelLibrary.budgetBytes = static_cast<size_t>(modelBudgetMB) * 1024 * 1024;
+		}
+		if (ImGui::Checkbox("Release CPU Geometry", &modelLibrary.releaseGeometry) && modelLibrary.releaseGeometry)
+		{
+			modelLibrary.releaseAllGeometry();
+		}
+		ImGui::Text("Resident Models: %zu, %.1f MB GPU, %.1f MB CPU", modelLibrary.entries.size(),
+			modelLibrary.residentBytes() / (1024.0f * 1024.0f), modelLibrary.residentCPUBytes() / (1024.0f * 1024.0f));
+
+		ImGui::Checkbox("Stream Textures (new models)", &textureStreamer.enabled);
+		static int textureBudgetMB = static_cast<int>(textureStreamer.budgetBytes / (1024 * 1024));
+		if (ImGui::SliderInt("Texture Budget (MB)", &textureBudgetMB, 16, 4096))
+		{
+			textureStreamer.budgetBytes = static_cast<size_t>(textureBudgetMB) * 1024 * 1024;
+		}
+		ImGui::Text("Streamed Textures: %zu, %.1f MB, %d loading", textureStreamer.textureCount(),
+			textureStreamer.residentBytes() / (1024.0f * 1024.0f), textureStreamer.pendingLoads());
+
+		ImGui::Checkbox("Virtual Albedo (new models)", &virtualTextures.enabled);
+		ImGui::Text("Virtual Pages: %d / %d resident, %zu requested%s", virtualTextures.residentPages(), virtualTextures.totalPages(),
+			virtualTextures.lastRequestCount(), virtualTextures.loading() ? ", loading" : "");
+
 		ImGui::Separator();
 
 		if (ImGui::BeginCombo("Select Model", modelFolders[selectedModelIdx].folderName.c_str())) 
@@ -796,42 +1144,32 @@ int main() {
 			instanceCount = 1;
 		}
 
-		// Update your "Add Model" button handler
 		if (ImGui::Button("Add Model")) {
-			ModelEntry& selectedModel = modelFolders[selectedModelIdx];
-			std::string selectedFolder = selectedModel.folderName;
-			std::string modelPath = selectedModel.modelFilePath;
-			std::replace(modelPath.begin(), modelPath.end(), '\\', '/');
-
-			std::cout << selectedFolder << " " << modelPath << std::endl;
-
-			// Check if we already have this model in cache
-			std::shared_ptr<Model> modelPtr;
-			if (modelCache.find(selectedFolder) == modelCache.end()) {
-				// Create new model and add to cache
-				modelPtr = std::make_shared<Model>(modelPath, false, selectedFolder);
-				modelCache[selectedFolder] = modelPtr;
-				std::cout << "Created new model: " << selectedFolder << std::endl;
-			}
-			else {
-				// Use existing model from cache
-				modelPtr = modelCache[selectedFolder];
-				std::cout << "Using cached model: " << selectedFolder << std::endl;
+			AddModelInstances(modelFolders[selectedModelIdx], instanceCount);
+		}
+
+		if (ImGui::CollapsingHeader("World Streaming"))
+		{
+			ImGui::Checkbox("Stream Cells", &worldStreamer.enabled);
+			ImGui::SliderFloat("Load Radius", &worldStreamer.loadRadius, 10.0f, 1000.0f);
+			ImGui::SliderFloat("Unload Hysteresis", &worldStreamer.hysteresis, 0.0f, 200.0f);
+			static int uploadBudgetMB = static_cast<int>(worldStreamer.uploadBudgetBytes / (1024 * 1024));
+			if (ImGui::SliderInt("Upload Budget (MB/frame)", &uploadBudgetMB, 1, 256))
+			{
+				worldStreamer.uploadBudgetBytes = static_cast<size_t>(uploadBudgetMB) * 1024 * 1024;
 			}
 
-			// Add multiple GameObjects
-			int gridSize = static_cast<int>(std::sqrt(instanceCount));
-			float spacing = 2.5f; 
-
-			for (int i = 0; i < instanceCount; ++i) {
-				std::string objName = selectedFolder + "_" + std::to_string(gameObjects.size());
-				GameObject obj(modelPtr, objName);
-				int row = i / gridSize;
-				int col = i % gridSize;
-				obj.position = glm::vec3(col * spacing, 0.0f, row * spacing);
-				gameObjects.push_back(std::move(obj));
+			static int cellsPerSide = 20;
+			static int objectsPerCell = 25;
+			ImGui::SliderInt("Cells Per Side", &cellsPerSide, 1, 200);
+			ImGui::SliderInt("Objects Per Cell", &objectsPerCell, 1, 500);
+			if (ImGui::Button("Scatter Selected Model Over World"))
+			{
+				ScatterStreamedWorld(modelFolders[selectedModelIdx], cellsPerSide, objectsPerCell);
 			}
-			std::cout << "Added " << instanceCount << " instances of " << selectedFolder << std::endl;
+			ImGui::Text("Cells: %zu, %zu loaded, %zu loading, %zu objects, %d importing", worldStreamer.cellCount(),
+				worldStreamer.cellsIn(WorldStreamer::CellState::LOADED), worldStreamer.cellsIn(WorldStreamer::CellState::LOADING),
+				worldStreamer.objectCount(), worldStreamer.pendingImports());
 		}
 
 		ImGui::Separator();
@@ -839,23 +1177,34 @@ int main() {
 
 		if (ImGui::CollapsingHeader("GameObjects"))
 		{
-			for (int i = 0; i < gameObjects.size(); ++i)
+			for (int i = 0; i < static_cast<int>(scene.size()); ++i)
 			{
-				GameObject& obj = gameObjects[i];
-				ImGui::PushID(i);
-				if (ImGui::TreeNode(obj.name.c_str()))
+				const EntityHandle handle = scene.handleAt(i);
+				Transform& transform = scene.transforms[i];
+				ImGui::PushID(static_cast<int>(handle.index));
+				const std::string label = scene.name(i) + "_" + std::to_string(handle.index);
+				if (ImGui::TreeNode(label.c_str()))
 				{
-					ImGui::Checkbox("Visible", &obj.visible);
-					ImGui::SliderFloat("Scale", &obj.scale, 0.01f, 2.0f);
-					ImGui::DragFloat3("Position", glm::value_ptr(obj.position), 0.1f);
-					ImGui::SliderFloat("Rotation X", &obj.rotation.x, 0.0f, 360.0f);
-					ImGui::SliderFloat("Rotation Y", &obj.rotation.y, 0.0f, 360.0f);
-					ImGui::SliderFloat("Rotation Z", &obj.rotation.z, 0.0f, 360.0f);
-
-					// Remove Button for each GameObject
+					bool visible = scene.visible[i] != 0;
+					if (ImGui::Checkbox("Visible", &visible))
+					{
+						scene.visible[i] = visible;
+					}
+
+					bool changed = ImGui::SliderFloat("Scale", &transform.scale, 0.01f, 2.0f);
+					changed |= ImGui::DragFloat3("Position", glm::value_ptr(transform.position), 0.1f);
+					changed |= ImGui::SliderFloat("Rotation X", &transform.rotation.x, 0.0f, 360.0f);
+					changed |= ImGui::SliderFloat("Rotation Y", &transform.rotation.y, 0.0f, 360.0f);
+					changed |= ImGui::SliderFloat("Rotation Z", &transform.rotation.z, 0.0f, 360.0f);
+					if (changed)
+					{
+						scene.markDirty(i);
+					}
+
+					// Swap-remove moves the last entity into this slot, so visit index i again
 					if (ImGui::Button("Remove GameObject")) {
-						gameObjects.erase(gameObjects.begin() + i);
-						i--; // Adjust index since we removed an element
+						scene.destroy(handle);
+						i--;
 					}
 					ImGui::TreePop();
 				}
@@ -868,6 +1217,42 @@ int main() {
 
 		ImGui::Separator();
 		ImGui::Checkbox("Enable IBL", &useIBL);
+		ImGui::Checkbox("Frustum Culling", &frustumCulling);
+		if (ImGui::Combo("Occlusion Culling", &occlusionMode, "Off\0GPU Hi-Z\0Software\0"))
+		{
+			occlusionCuller.invalidate();
+		}
+		if (occlusionMode == OCCLUSION_SOFTWARE)
+		{
+			ImGui::Text("Kernel: %s, %d threads", SoftwareOcclusion::isaName(softwareOcclusion.isa), softwareOcclusion.threadCount);
+			ImGui::Text("Occluders: %zu meshes, %zu triangles", occluders.size(), softwareOcclusion.triangleCount());
+		}
+		ImGui::Combo("Depth Pre-Pass", &depthPrepass.mode, "Off\0On\0Auto\0");
+		ImGui::Text("Overdraw: %.2fx%s, pre-pass %s", depthPrepass.overdraw, depthPrepass.overdrawExact ? "" : " (estimate)", depthPrepass.active ? "on" : "off");
+
+		ImGui::Separator();
+		ImGui::Checkbox("Dynamic Resolution", &dynamicResolution.enabled);
+		ImGui::SliderFloat("GPU Budget (ms)", &dynamicResolution.targetMs, 4.0f, 50.0f);
+		ImGui::SliderFloat("Min Render Scale", &dynamicResolution.minScale, 0.25f, 1.0f);
+		ImGui::SliderFloat("Sharpness", &sharpness, 0.0f, 1.0f);
+		ImGui::Text("Render scale: %.0f%% (%dx%d), GPU %.2f ms", dynamicResolution.scale * 100.0f, dynamicResolution.renderWidth, dynamicResolution.renderHeight, dynamicResolution.gpuMs);
+
+		ImGui::Separator();
+		ImGui::Checkbox("TAA", &taa.enabled);
+		ImGui::SliderFloat("TAA Feedback", &taa.feedback, 0.5f, 0.98f);
+
+		ImGui::Separator();
+		ImGui::Checkbox("SSAO", &ssao.enabled);
+		ImGui::SliderFloat("SSAO Radius", &ssao.radius, 0.05f, 2.0f);
+		ImGui::SliderFloat("SSAO Bias", &ssao.bias, 0.0f, 0.1f);
+		ImGui::SliderFloat("SSAO Power", &ssao.power, 0.5f, 4.0f);
+
+		ImGui::Separator();
+		ImGui::Checkbox("Bloom", &bloom.enabled);
+		ImGui::SliderFloat("Bloom Threshold", &bloom.threshold, 0.0f, 5.0f);
+		ImGui::SliderFloat("Bloom Knee", &bloom.knee, 0.0f, 2.0f);
+		ImGui::SliderFloat("Bloom Strength", &bloom.strength, 0.0f, 0.3f);
+		ImGui::SliderFloat("Bloom Radius", &bloom.filterRadius, 0.5f, 3.0f);
 
 		ImGui::Separator();
 		ImGui::Text("Active Point Lights: %zu/%d", pointLightPositions.size(), MAX_POINT_LIGHTS);
@@ -957,13 +1342,58 @@ int main() {
 		}
 		ImGui::End();
 
-		ImGui::Render();
-		ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+		profiler.drawUI();
+		renderStats.drawUI();
+		renderGraph.drawUI();
+		profiler.endCpuZone();
+
+		// The UI may have added or moved entities
+		scene.updateWorldMatrices();
 
+		// Group transforms inside the light volume and the camera frustum by model. Both lists are built on
+		// jobs while this thread starts submitting, each pass waits only for the list it draws.
+		jobSystem.run(shadowLists, [&]() { scene.buildRenderLists(shadowInstancesPerModel, shadowBuckets, frustumCulling ? &lightFrustum : nullptr); });
+		jobSystem.run(cameraLists, [&]() { scene.buildRenderLists(instancesPerModel, cameraBuckets, frustumCulling ? &cameraFrustum : nullptr); });
+
+		renderGraph.execute();
+		jobSystem.wait(shadowLists);
+		jobSystem.wait(cameraLists);
+		taa.endFrame();
+		dynamicResolution.endFrame();
+
+		profiler.beginCpuZone("Swap Buffers");
 		glfwSwapBuffers(window);
+		profiler.endCpuZone();
 		glfwPollEvents();
+
+		renderStats.endFrame();
+		profiler.endFrame();
+
+		if (benchmark.enabled)
+		{
+			++benchmarkFrame;
+			if (benchmarkFrame == benchmark.warmupFrames)
+			{
+				renderStats.resetAverages();
+			}
+			else if (benchmarkFrame > benchmark.warmupFrames)
+			{
+				benchmarkFrameTimes.push_back(deltaTime * 1000.0f);
+			}
+
+			if (benchmarkFrame >= benchmark.warmupFrames + benchmark.frames)
+			{
+				writeBenchmarkResults(benchmarkFrameTimes);
+				glfwSetWindowShouldClose(window, true);
+			}
+		}
 	}
 
+	worldStreamer.clear(scene, modelLibrary);
+	virtualTextures.shutdown();
+	profiler.shutdown();
+	jobSystem.shutdown();
+
 	ImGui_ImplOpenGL3_Shutdown();
 	ImGui_ImplGlfw_Shutdown();
 	ImGui::DestroyContext();
@@ -1058,23 +1488,6 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 	SCR_WIDTH = width;
 	SCR_HEIGHT = height;
 	glViewport(0, 0, width, height);
-
-	// Resize HDR framebuffer textures
-	glBindTexture(GL_TEXTURE_2D, g_colorBuffer);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
-
-	// Resize depth renderbuffer
-	glBindRenderbuffer(GL_RENDERBUFFER, g_rboDepth);
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, width, height);
-
-	// Check FBO status after resize
-	glBindFramebuffer(GL_FRAMEBUFFER, g_hdrFBO);
-	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-	{
-		std::cout << "Framebuffer incomplete after resize!" << std::endl;
-	}
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
 }
 
 void SetDisplayMode(GLFWwindow* window, DisplayMode mode)
@@ -1120,7 +1533,7 @@ void mouse_callback(GLFWwindow* window, double xPosIn, double yPosIn)
 {
 	ImGuiIO& io = ImGui::GetIO();
 
-	if (!io.WantCaptureMouse) {
+	if (!io.WantCaptureMouse && !benchmark.enabled) {
 		float xPos = static_cast<float>(xPosIn);
 		float yPos = static_cast<float>(yPosIn);
 
@@ -1193,199 +1606,394 @@ void processControllerInput()
 
 void initEnvironmentMaps()
 {
-	environmentMaps.push_back(loadEnvironmentMap("Snow Field", "assets/textures/snowfield/"));	
-	environmentMaps.push_back(loadEnvironmentMap("Warm Bar", "assets/textures/warmbar/"));	
+	// Only registers the environments, each one is decoded the first time it is selected
+	environmentLibrary.registerEnvironment("Snow Field", "assets/textures/snowfield/");
+	environmentLibrary.registerEnvironment("Warm Bar", "assets/textures/warmbar/");
+	environmentLibrary.select(0);
 }
 
-EnvironmentMap loadEnvironmentMap(const std::string& name, const std::string& basePath)
+// renderQuad() renders a 1x1 XY quad in NDC
+// -----------------------------------------
+unsigned int quadVAO = 0;
+unsigned int quadVBO;
+void renderQuad()
 {
-	EnvironmentMap envMap;
-	envMap.name = name;
-	envMap.basePath = basePath;
+	if (quadVAO == 0)
+	{
+		float quadVertices[] = {
+			// positions        // texture Coords
+			-1.0f,  1.0f, 0.0f, 0.0f, 1.0f,
+			-1.0f, -1.0f, 0.0f, 0.0f, 0.0f,
+			 1.0f,  1.0f, 0.0f, 1.0f, 1.0f,
+			 1.0f, -1.0f, 0.0f, 1.0f, 0.0f,
+		};
+		// setup plane VAO
+		glCreateVertexArrays(1, &quadVAO);
+		glCreateBuffers(1, &quadVBO);
+		glNamedBufferStorage(quadVBO, sizeof(quadVertices), &quadVertices, 0);
+		glVertexArrayVertexBuffer(quadVAO, 0, quadVBO, 0, 5 * sizeof(float));
+		glEnableVertexArrayAttrib(quadVAO, 0);
+		glVertexArrayAttribFormat(quadVAO, 0, 3, GL_FLOAT, GL_FALSE, 0);
+		glVertexArrayAttribBinding(quadVAO, 0, 0);
+		glEnableVertexArrayAttrib(quadVAO, 1);
+		glVertexArrayAttribFormat(quadVAO, 1, 2, GL_FLOAT, GL_FALSE, 3 * sizeof(float));
+		glVertexArrayAttribBinding(quadVAO, 1, 0);
+	}
+	countedBindVertexArray(quadVAO);
+	countedDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+}
 
-	// Load HDR Skybox for background
-	std::vector<std::string> faces
+void LoadModelFolders()
+{
+	modelFolders.clear();
+	for (const auto& entry : std::filesystem::directory_iterator("assets/models"))
 	{
-		basePath + "skybox/px.hdr",
-		basePath + "skybox/nx.hdr",
-		basePath + "skybox/py.hdr",
-		basePath + "skybox/ny.hdr",
-		basePath + "skybox/pz.hdr",
-		basePath + "skybox/nz.hdr",
-	};
-	envMap.cubemapTexture = loadHDRCubemap(faces);
-
-	// Load cubemaps for IBL 
-	std::vector<std::string> irradianceFaces = {
-		basePath + "/irradiance/px.hdr",
-		basePath + "/irradiance/nx.hdr",
-		basePath + "/irradiance/py.hdr",
-		basePath + "/irradiance/ny.hdr",
-		basePath + "/irradiance/pz.hdr",
-		basePath + "/irradiance/nz.hdr"
-	};
-	envMap.irradianceMap = loadHDRCubemap(irradianceFaces);
-
-	std::vector<std::string> radianceFaces = {
-		basePath + "/radiance/px.hdr",
-		basePath + "/radiance/nx.hdr",
-		basePath + "/radiance/py.hdr",
-		basePath + "/radiance/ny.hdr",
-		basePath + "/radiance/pz.hdr",
-		basePath + "/radiance/nz.hdr"
-	};
-	envMap.radianceMap = loadHDRCubemap(radianceFaces);
-
-	// Calculate max mip levels for this prefilter map
-	int width, height, nrChannels;
-	float* tempData = stbi_loadf(radianceFaces[0].c_str(), &width, &height, &nrChannels, 0);
-	if (tempData) {
-		envMap.maxMipLevel = static_cast<int>(std::log2(std::max(width, height)));
-		stbi_image_free(tempData);
+		if (entry.is_directory())
+		{
+			for (const auto& file : std::filesystem::directory_iterator(entry.path()))
+			{
+				std::string ext = file.path().extension().string();
+				if (supportedFormats.contains(ext))
+				{
+					modelFolders.push_back({
+						entry.path().filename().string(), // Folder name
+						file.path().string()			  // Full model file path
+					});
+					break;
+				}
+			}
+		}
 	}
-	else {
-		envMap.maxMipLevel = 5; // Default fallback
+}
+
+void AddModelInstances(const ModelEntry& entry, int instanceCount)
+{
+	std::string selectedFolder = entry.folderName;
+	std::string modelPath = entry.modelFilePath;
+	std::replace(modelPath.begin(), modelPath.end(), '\\', '/');
+
+	std::cout << selectedFolder << " " << modelPath << std::endl;
+
+	// Loads the model unless the library still has it
+	const uint32_t modelId = modelLibrary.acquire(scene, selectedFolder, modelPath);
+
+	// Add multiple entities
+	int gridSize = std::max(static_cast<int>(std::sqrt(instanceCount)), 1);
+	float spacing = 2.5f; 
+
+	for (int i = 0; i < instanceCount; ++i) {
+		Transform transform;
+		int row = i / gridSize;
+		int col = i % gridSize;
+		transform.position = glm::vec3(col * spacing, 0.0f, row * spacing);
+		scene.create(modelId, selectedFolder, transform);
 	}
-	return envMap;
+	std::cout << "Added " << instanceCount << " instances of " << selectedFolder << std::endl;
 }
 
-uint32_t loadHDRCubemap(std::vector<std::string> faces)
+// Replaces the streamed world with the model scattered over a square of cells centred on the origin,
+// none of it is loaded until the camera comes near
+void ScatterStreamedWorld(const ModelEntry& entry, int cellsPerSide, int objectsPerCell)
 {
-	uint32_t textureID;
-	glGenTextures(1, &textureID);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+	std::string modelPath = entry.modelFilePath;
+	std::replace(modelPath.begin(), modelPath.end(), '\\', '/');
 
-	int width, height, nrChannels;
-	for (uint32_t i = 0; i < faces.size(); ++i)
+	worldStreamer.clear(scene, modelLibrary);
+	const float extent = cellsPerSide * worldStreamer.cellSize;
+	std::mt19937 rng(12345);
+	std::uniform_real_distribution<float> position(-0.5f * extent, 0.5f * extent);
+	std::uniform_real_distribution<float> rotation(0.0f, 360.0f);
+
+	const int objectCount = cellsPerSide * cellsPerSide * objectsPerCell;
+	for (int i = 0; i < objectCount; ++i)
 	{
-		float* data = stbi_loadf(faces[i].c_str(), &width, &height, &nrChannels, 0);
-		if (data)
-		{
-			// Use appropriate format based on channels
-			GLenum format = nrChannels == 3 ? GL_RGB : GL_RGBA;
+		Transform transform;
+		transform.position = glm::vec3(position(rng), 0.0f, position(rng));
+		transform.rotation.y = rotation(rng);
+		worldStreamer.addObject(entry.folderName, modelPath, transform);
+	}
+	std::cout << "Scattered " << objectCount << " instances of " << entry.folderName << " over " << worldStreamer.cellCount() << " cells" << std::endl;
+}
+
+// Occluders are the meshes with the largest world bounds, picked until the triangle budget is used up
+void SelectOccluders(const std::vector<std::vector<InstanceData>>& instancesPerModel, size_t triangleBudget, std::vector<OccluderMesh>& occluders)
+{
+	struct Candidate
+	{
+		float area;
+		const Mesh* mesh;
+		const glm::mat4* world;
+	};
+
+	// Small meshes cover too few pixels of the low resolution buffer to hide anything
+	const float minArea = 4.0f;
 
-			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB16F, width, height, 0, format, GL_FLOAT, data);
-			stbi_image_free(data);
+	std::vector<Candidate> candidates;
+	for (uint32_t modelId = 0; modelId < instancesPerModel.size(); ++modelId)
+	{
+		const std::shared_ptr<Model>& modelPtr = scene.models[modelId];
+		if (!modelPtr)
+		{
+			continue;
 		}
-		else
+
+		for (const InstanceData& instance : instancesPerModel[modelId])
 		{
-			std::cout << "HDR Cubemap texture failed to load at path: " << faces[i] << std::endl;
+			for (const Mesh& mesh : modelPtr->meshes)
+			{
+				// Models whose CPU geometry was released cannot be rasterized
+				const float area = mesh.bounds.transformed(instance.world).surfaceArea();
+				if (area >= minArea && !mesh.vertices.empty())
+				{
+					candidates.push_back({ area, &mesh, &instance.world });
+				}
+			}
 		}
 	}
 
-	// For prefiltered environment map, enable mipmapping
-	if (faces[0].find("radiance") != std::string::npos)
+	std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) { return a.area > b.area; });
+
+	occluders.clear();
+	size_t triangles = 0;
+	for (const Candidate& candidate : candidates)
 	{
-		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+		const size_t meshTriangles = candidate.mesh->indices.size() / 3;
+		if (triangles + meshTriangles > triangleBudget)
+		{
+			continue;
+		}
+		triangles += meshTriangles;
+
+		OccluderMesh occluder;
+		occluder.world = *candidate.world;
+		occluder.positions = &candidate.mesh->vertices[0].Position;
+		occluder.stride = sizeof(Vertex);
+		occluder.indices = candidate.mesh->indices.data();
+		occluder.indexCount = candidate.mesh->indices.size();
+		occluders.push_back(occluder);
 	}
-	else 
+}
+
+// The shadow pass left its own instance lists in the buffers
+void UploadInstanceLists(const std::vector<std::vector<InstanceData>>& instancesPerModel)
+{
+	for (uint32_t modelId = 0; modelId < instancesPerModel.size(); ++modelId)
 	{
-		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		const std::vector<InstanceData>& transforms = instancesPerModel[modelId];
+		const std::shared_ptr<Model>& modelPtr = scene.models[modelId];
+		if (!modelPtr || transforms.empty())
+		{
+			continue;
+		}
+
+		countedNamedBufferData(modelPtr->instanceVBO,
+			transforms.size() * sizeof(InstanceData),
+			transforms.data(),
+			GL_DYNAMIC_DRAW);
 	}
+}
 
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+// View depth of each model's nearest instance origin, 0 for models without instances
+void NearestInstanceDepths(const std::vector<std::vector<InstanceData>>& instancesPerModel, const glm::vec3& eye, const glm::vec3& forward, std::vector<float>& depthPerModel)
+{
+	depthPerModel.assign(instancesPerModel.size(), 0.0f);
+	jobSystem.parallelFor(0, instancesPerModel.size(), 1, [&](size_t begin, size_t end)
+		{
+			for (size_t modelId = begin; modelId < end; ++modelId)
+			{
+				const std::vector<InstanceData>& transforms = instancesPerModel[modelId];
+				if (transforms.empty())
+				{
+					continue;
+				}
 
-	return textureID;
+				float nearest = std::numeric_limits<float>::max();
+				for (const InstanceData& instance : transforms)
+				{
+					nearest = std::min(nearest, glm::dot(glm::vec3(instance.world[3]) - eye, forward));
+				}
+				depthPerModel[modelId] = std::max(nearest, 0.0f);
+			}
+		});
 }
 
-// For standard 2D textures (BRDF LUT)
-uint32_t loadBRDF(const std::string& path)
+// Every mesh of every model with instances, drawing the whole list uploaded by UploadInstanceLists.
+// An empty depthPerModel puts every draw in the nearest depth bucket.
+void EnqueueInstanceLists(RenderQueue& queue, RenderPassId pass, const std::vector<std::vector<InstanceData>>& instancesPerModel, const std::vector<float>& depthPerModel)
 {
-	uint32_t textureID;
-	glGenTextures(1, &textureID);
-
-	int width, height, nrChannels;
-	unsigned char* data = stbi_load(path.c_str(), &width, &height, &nrChannels, 0);
-	if (data)
+	for (uint32_t modelId = 0; modelId < instancesPerModel.size(); ++modelId)
 	{
-		GLenum format {};
-		GLenum internalFormat {};
-		if (nrChannels == 1) {
-			format = GL_RED;
-			internalFormat = GL_RED;
-		}
-		else if (nrChannels == 3) {
-			format = GL_RGB;
-			internalFormat = GL_RGB;
-		}
-		else if (nrChannels == 4) {
-			format = GL_RGBA;
-			internalFormat = GL_RGBA;
+		const std::shared_ptr<Model>& modelPtr = scene.models[modelId];
+		if (modelPtr && !instancesPerModel[modelId].empty())
+		{
+			const float depth = depthPerModel.empty() ? 0.0f : depthPerModel[modelId];
+			queue.addModel(pass, *modelPtr, static_cast<uint32_t>(instancesPerModel[modelId].size()), depth);
 		}
+	}
+}
+
+// Each mesh gets its own contiguous run of visible instances in the model's instance buffer.
+// Models are tested on jobs, the uploads stay on this thread.
+void UploadOcclusionTested(const std::vector<std::vector<InstanceData>>& instancesPerModel, const SoftwareOcclusion& occlusion, const glm::mat4& viewProjection, std::vector<MeshInstanceRanges>& rangesPerModel)
+{
+	static std::vector<std::vector<InstanceData>> visiblePerModel;
+	visiblePerModel.resize(instancesPerModel.size());
+	rangesPerModel.resize(instancesPerModel.size());
+
+	jobSystem.parallelFor(0, instancesPerModel.size(), 1, [&](size_t begin, size_t end)
+		{
+			for (size_t modelId = begin; modelId < end; ++modelId)
+			{
+				const std::vector<InstanceData>& transforms = instancesPerModel[modelId];
+				const std::shared_ptr<Model>& modelPtr = scene.models[modelId];
+				std::vector<InstanceData>& visible = visiblePerModel[modelId];
+				MeshInstanceRanges& ranges = rangesPerModel[modelId];
+				visible.clear();
+				ranges.firstInstances.clear();
+				ranges.instanceCounts.clear();
+				if (!modelPtr || transforms.empty())
+				{
+					continue;
+				}
 
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
+				ranges.firstInstances.assign(modelPtr->meshes.size(), 0);
+				ranges.instanceCounts.assign(modelPtr->meshes.size(), 0);
+				for (size_t i = 0; i < modelPtr->meshes.size(); ++i)
+				{
+					ranges.firstInstances[i] = static_cast<uint32_t>(visible.size());
+					for (const InstanceData& instance : transforms)
+					{
+						if (occlusion.isVisible(viewProjection * instance.world, modelPtr->meshes[i].bounds))
+						{
+							visible.push_back(instance);
+						}
+					}
+					ranges.instanceCounts[i] = static_cast<uint32_t>(visible.size()) - ranges.firstInstances[i];
+				}
 
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+				if (visible.empty())
+				{
+					ranges.firstInstances.clear();
+					ranges.instanceCounts.clear();
+				}
+			}
+		});
 
-		stbi_image_free(data);
-	}
-	else
+	for (uint32_t modelId = 0; modelId < instancesPerModel.size(); ++modelId)
 	{
-		std::cout << "BRDF LUT failed to load at path: " << path << std::endl;
+		const std::vector<InstanceData>& visible = visiblePerModel[modelId];
+		if (!visible.empty())
+		{
+			countedNamedBufferData(scene.models[modelId]->instanceVBO, visible.size() * sizeof(InstanceData), visible.data(), GL_DYNAMIC_DRAW);
+		}
 	}
-
-	return textureID;
 }
 
-// renderQuad() renders a 1x1 XY quad in NDC
-// -----------------------------------------
-unsigned int quadVAO = 0;
-unsigned int quadVBO;
-void renderQuad()
+void EnqueueMeshInstanceRanges(RenderQueue& queue, const std::vector<MeshInstanceRanges>& rangesPerModel, const std::vector<float>& depthPerModel)
 {
-	if (quadVAO == 0)
+	for (uint32_t modelId = 0; modelId < rangesPerModel.size(); ++modelId)
 	{
-		float quadVertices[] = {
-			// positions        // texture Coords
-			-1.0f,  1.0f, 0.0f, 0.0f, 1.0f,
-			-1.0f, -1.0f, 0.0f, 0.0f, 0.0f,
-			 1.0f,  1.0f, 0.0f, 1.0f, 1.0f,
-			 1.0f, -1.0f, 0.0f, 1.0f, 0.0f,
-		};
-		// setup plane VAO
-		glGenVertexArrays(1, &quadVAO);
-		glGenBuffers(1, &quadVBO);
-		glBindVertexArray(quadVAO);
-		glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
-		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
+		const MeshInstanceRanges& ranges = rangesPerModel[modelId];
+		const Model& model = *scene.models[modelId];
+		for (size_t i = 0; i < ranges.instanceCounts.size(); ++i)
+		{
+			queue.addMesh(RenderPassId::Opaque, model, model.meshes[i], ranges.instanceCounts[i], ranges.firstInstances[i], depthPerModel[modelId]);
+		}
 	}
-	glBindVertexArray(quadVAO);
-	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-	glBindVertexArray(0);
 }
 
-void LoadModelFolders()
+// --benchmark [--frames N] [--warmup N] [--model <folder>] [--instances N] [--stats-out <path>]
+// --bench-bvh
+// --bench-occlusion
+// --bench-jobs
+// --bench-sort
+// --bench-vt
+bool parseBenchmarkArgs(int argc, char** argv)
 {
-	modelFolders.clear();
-	for (const auto& entry : std::filesystem::directory_iterator("assets/models"))
+	for (int i = 1; i < argc; ++i)
 	{
-		if (entry.is_directory())
+		const std::string arg = argv[i];
+		const bool hasValue = i + 1 < argc;
+
+		if (arg == "--benchmark")
 		{
-			for (const auto& file : std::filesystem::directory_iterator(entry.path()))
-			{
-				std::string ext = file.path().extension().string();
-				if (supportedFormats.contains(ext))
-				{
-					modelFolders.push_back({
-						entry.path().filename().string(), // Folder name
-						file.path().string()			  // Full model file path
-					});
-					break;
-				}
-			}
+			benchmark.enabled = true;
+		}
+		else if (arg == "--bench-bvh")
+		{
+			benchmark.bvhOnly = true;
+		}
+		else if (arg == "--bench-occlusion")
+		{
+			benchmark.occlusionOnly = true;
+		}
+		else if (arg == "--bench-jobs")
+		{
+			benchmark.jobsOnly = true;
+		}
+		else if (arg == "--bench-sort")
+		{
+			benchmark.sortOnly = true;
+		}
+		else if (arg == "--bench-vt")
+		{
+			benchmark.virtualTextureOnly = true;
+		}
+		else if (arg == "--frames" && hasValue)
+		{
+			benchmark.frames = std::max(std::atoi(argv[++i]), 1);
+		}
+		else if (arg == "--warmup" && hasValue)
+		{
+			benchmark.warmupFrames = std::max(std::atoi(argv[++i]), 1);
+		}
+		else if (arg == "--instances" && hasValue)
+		{
+			benchmark.instances = std::max(std::atoi(argv[++i]), 1);
+		}
+		else if (arg == "--model" && hasValue)
+		{
+			benchmark.modelFolder = argv[++i];
+		}
+		else if (arg == "--stats-out" && hasValue)
+		{
+			benchmark.outputPath = argv[++i];
+		}
+		else
+		{
+			std::cout << "Unknown or incomplete argument: " << arg << std::endl;
+			std::cout << "Usage: OGLRenderer [--benchmark [--frames N] [--warmup N] [--model <folder>] [--instances N] [--stats-out <path>]] [--bench-bvh] [--bench-occlusion] [--bench-jobs] [--bench-sort] [--bench-vt]" << std::endl;
+			return false;
 		}
 	}
-}
\ No newline at end of file
+	return true;
+}
+
+void writeBenchmarkResults(const std::vector<float>& frameTimes)
+{
+	float total = 0.0f;
+	float minMs = frameTimes.empty() ? 0.0f : frameTimes[0];
+	float maxMs = minMs;
+	for (float ms : frameTimes)
+	{
+		total += ms;
+		minMs = std::min(minMs, ms);
+		maxMs = std::max(maxMs, ms);
+	}
+	const float averageMs = frameTimes.empty() ? 0.0f : total / frameTimes.size();
+
+	std::ofstream file(benchmark.outputPath, std::ios::trunc);
+	file << "{\"benchmark\":{\"model\":\"" << benchmark.modelFolder << "\",\"instances\":" << benchmark.instances
+		<< ",\"frames\":" << frameTimes.size() << ",\"averageFrameMs\":" << averageMs
+		<< ",\"minFrameMs\":" << minMs << ",\"maxFrameMs\":" << maxMs << "},"
+		<< "\"renderStats\":" << renderStats.toJson() << "}\n";
+
+	if (file)
+	{
+		std::cout << "Benchmark: " << averageMs << " ms average over " << frameTimes.size() << " frames, stats written to " << benchmark.outputPath << std::endl;
+	}
+	else
+	{
+		std::cout << "Failed to write benchmark stats: " << benchmark.outputPath << std::endl;
+	}
+}
@@ -1,18 +1,51 @@
 #include <glad/glad.h>
 
 #include "mesh.hpp"
+#include "renderStats.hpp"
+#include "virtualTexture.hpp"
 
+#include <array>
+#include <cmath>
 #include <iostream>
+#include <map>
 
 Mesh::Mesh(std::vector<Vertex> vertices, std::vector<uint32_t> indices, std::vector<Texture> textures)
 	: vertices(std::move(vertices)), indices(std::move(indices)), textures(std::move(textures))
 {
+	vertexCount = static_cast<uint32_t>(this->vertices.size());
+	indexCount = static_cast<uint32_t>(this->indices.size());
+
+	// Both areas are doubled triangle areas, only their ratio matters
+	double surfaceArea = 0.0;
+	double uvArea = 0.0;
+	for (size_t i = 0; i + 2 < this->indices.size(); i += 3)
+	{
+		const Vertex& a = this->vertices[this->indices[i]];
+		const Vertex& b = this->vertices[this->indices[i + 1]];
+		const Vertex& c = this->vertices[this->indices[i + 2]];
+		surfaceArea += glm::length(glm::cross(b.Position - a.Position, c.Position - a.Position));
+		const glm::vec2 uvEdge0 = b.TexCoords - a.TexCoords;
+		const glm::vec2 uvEdge1 = c.TexCoords - a.TexCoords;
+		uvArea += std::abs(uvEdge0.x * uvEdge1.y - uvEdge0.y * uvEdge1.x);
+	}
+	uvDensity = surfaceArea > 0.0 ? static_cast<float>(std::sqrt(uvArea / surfaceArea)) : 0.0f;
+	for (const Vertex& vertex : this->vertices)
+	{
+		bounds.expand(vertex.Position);
+	}
 }
 
 Mesh::Mesh(const Mesh& other)
 	: vertices(other.vertices),
 	  indices(other.indices),
 	  textures(other.textures),
+	  bounds(other.bounds),
+	  materialId(other.materialId),
+	  textureMask(other.textureMask),
+	  vertexCount(other.vertexCount),
+	  indexCount(other.indexCount),
+	  vertexStride(other.vertexStride),
+	  uvDensity(other.uvDensity),
 	  VAO(0), VBO(0), EBO(0)
 {
 }
@@ -21,6 +54,13 @@ Mesh::Mesh(Mesh&& other) noexcept
 	: vertices(std::move(other.vertices)),
 	  indices(std::move(other.indices)),
 	  textures(std::move(other.textures)),
+	  bounds(other.bounds),
+	  materialId(other.materialId),
+	  textureMask(other.textureMask),
+	  vertexCount(other.vertexCount),
+	  indexCount(other.indexCount),
+	  vertexStride(other.vertexStride),
+	  uvDensity(other.uvDensity),
 	  VAO(other.VAO),
 	  VBO(other.VBO),
 	  EBO(other.EBO)
@@ -37,6 +77,13 @@ Mesh& Mesh::operator=(const Mesh& other)
 		vertices = other.vertices;
 		indices = other.indices;
 		textures = other.textures;
+		bounds = other.bounds;
+		materialId = other.materialId;
+		textureMask = other.textureMask;
+		vertexCount = other.vertexCount;
+		indexCount = other.indexCount;
+		vertexStride = other.vertexStride;
+		uvDensity = other.uvDensity;
 	}
 	return *this;
 }
@@ -49,6 +96,13 @@ Mesh& Mesh::operator=(Mesh&& other) noexcept
 		vertices = std::move(other.vertices);
 		indices = std::move(other.indices);
 		textures = std::move(other.textures);
+		bounds = other.bounds;
+		materialId = other.materialId;
+		textureMask = other.textureMask;
+		vertexCount = other.vertexCount;
+		indexCount = other.indexCount;
+		vertexStride = other.vertexStride;
+		uvDensity = other.uvDensity;
 		VAO = other.VAO;
 		VBO = other.VBO;
 		EBO = other.EBO;
@@ -62,7 +116,23 @@ Mesh::~Mesh()
 	cleanup();
 }
 
-void Mesh::DrawInstanced(Shader& shader, int instanceCount) const
+void Mesh::DrawInstanced(Shader& shader, int instanceCount, uint32_t baseInstance) const
+{
+	bindTextures(shader);
+
+	// draw mesh
+	countedBindVertexArray(VAO);
+	if (baseInstance == 0)
+	{
+		countedDrawElementsInstanced(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0, instanceCount);
+	}
+	else
+	{
+		countedDrawElementsInstancedBaseInstance(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0, instanceCount, baseInstance);
+	}
+}
+
+void Mesh::bindTextures(Shader& shader) const
 {
 	// Define fixed texture units for each type
 	const uint32_t ALBEDO_UNIT = 0;
@@ -84,34 +154,38 @@ void Mesh::DrawInstanced(Shader& shader, int instanceCount) const
 	bool hasMetallicRoughness = false;
 	bool hasAO = false;
 	bool hasEmissive = false;
+	bool virtualAlbedo = false;
 
 	for (const Texture& texture : textures)
 	{
 		switch (texture.type)
 		{
 		case TextureType::ALBEDO:
-			glActiveTexture(GL_TEXTURE0 + ALBEDO_UNIT);
-			glBindTexture(GL_TEXTURE_2D, texture.id);
+			if (texture.virtualId >= 0)
+			{
+				virtualTextures.bindTexture(shader, texture.id, texture.virtualId);
+				virtualAlbedo = true;
+			}
+			else
+			{
+				countedBindTextureUnit(ALBEDO_UNIT, texture.id);
+			}
 			hasAlbedo = true;
 			break;
 		case TextureType::NORMAL:
-			glActiveTexture(GL_TEXTURE0 + NORMAL_UNIT);
-			glBindTexture(GL_TEXTURE_2D, texture.id);
+			countedBindTextureUnit(NORMAL_UNIT, texture.id);
 			hasNormal = true;
 			break;
 		case TextureType::METALLIC_ROUGHNESS:
-			glActiveTexture(GL_TEXTURE0 + METALLIC_ROUGHNESS_UNIT);
-			glBindTexture(GL_TEXTURE_2D, texture.id);
+			countedBindTextureUnit(METALLIC_ROUGHNESS_UNIT, texture.id);
 			hasMetallicRoughness = true;
 			break;
 		case TextureType::AO:
-			glActiveTexture(GL_TEXTURE0 + AO_UNIT);
-			glBindTexture(GL_TEXTURE_2D, texture.id);
+			countedBindTextureUnit(AO_UNIT, texture.id);
 			hasAO = true;
 			break;
 		case TextureType::EMISSIVE:
-			glActiveTexture(GL_TEXTURE0 + EMISSIVE_UNIT);
-			glBindTexture(GL_TEXTURE_2D, texture.id);
+			countedBindTextureUnit(EMISSIVE_UNIT, texture.id);
 			hasEmissive = true;
 			break;
 		}
@@ -122,61 +196,124 @@ void Mesh::DrawInstanced(Shader& shader, int instanceCount) const
 	shader.setBool("hasMetallicRoughness", hasMetallicRoughness);
 	shader.setBool("hasAO", hasAO);
 	shader.setBool("hasEmissive", hasEmissive);
+	shader.setBool("useVirtualAlbedo", virtualAlbedo);
+}
 
-	// draw mesh
-	glBindVertexArray(VAO);
-	glDrawElementsInstanced(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0, instanceCount);
-	glBindVertexArray(0);
+void Mesh::assignMaterial()
+{
+	// Texture id per type, 0 where the mesh has no map of that type
+	std::array<uint32_t, 5> maps{};
+	textureMask = 0;
+	for (const Texture& texture : textures)
+	{
+		maps[static_cast<size_t>(texture.type)] = texture.id;
+		textureMask |= 1u << static_cast<uint32_t>(texture.type);
+	}
+
+	// Shared by every model, only ever touched on the GL thread
+	static std::map<std::array<uint32_t, 5>, uint32_t> materials;
+	materialId = materials.try_emplace(maps, static_cast<uint32_t>(materials.size())).first->second;
 }
 
 void Mesh::setupMesh(GLuint instanceVBO)
 {
-	glGenVertexArrays(1, &VAO);
-	glGenBuffers(1, &VBO);
-	glGenBuffers(1, &EBO);
-
-	glBindVertexArray(VAO);
-
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
-
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint32_t), indices.data(), GL_STATIC_DRAW);
-
-	// Vertex positions
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-	// Vertex normals
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-	// Texture Co-ordinates
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-	// Tangents
-	glEnableVertexAttribArray(3);
-	glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-	// Bitangents
-	glEnableVertexAttribArray(4);
-	glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
-
-	//Instance Matrix Attributes (mat4 = 4 vec4s)
-	glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
-
-	for (int i = 0; i < 4; ++i)
+	// Direct state access throughout, nothing here changes what is bound
+	glCreateVertexArrays(1, &VAO);
+	glCreateBuffers(1, &VBO);
+	glCreateBuffers(1, &EBO);
+
+	// Immutable storage, empty meshes keep a buffer without any
+	if (!vertices.empty())
+	{
+		glNamedBufferStorage(VBO, vertices.size() * sizeof(Vertex), vertices.data(), 0);
+	}
+	if (!indices.empty())
 	{
-		glEnableVertexAttribArray(5 + i); // <--- start from 5, since 04 are taken
-		glVertexAttribPointer(5 + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(sizeof(glm::vec4) * i));
-		glVertexAttribDivisor(5 + i, 1); // advance per-instance
+		glNamedBufferStorage(EBO, indices.size() * sizeof(uint32_t), indices.data(), 0);
 	}
 
-	glBindVertexArray(0);
+	// Binding 0 streams vertices, binding 1 instances
+	glVertexArrayVertexBuffer(VAO, 0, VBO, 0, sizeof(Vertex));
+	glVertexArrayElementBuffer(VAO, EBO);
+
+	auto vertexAttribute = [this](GLuint location, GLint size, GLuint offset)
+	{
+		glEnableVertexArrayAttrib(VAO, location);
+		glVertexArrayAttribFormat(VAO, location, size, GL_FLOAT, GL_FALSE, offset);
+		glVertexArrayAttribBinding(VAO, location, 0);
+	};
+	vertexAttribute(0, 3, offsetof(Vertex, Position));
+	vertexAttribute(1, 3, offsetof(Vertex, Normal));
+	vertexAttribute(2, 2, offsetof(Vertex, TexCoords));
+	vertexAttribute(3, 3, offsetof(Vertex, Tangent));
+	vertexAttribute(4, 3, offsetof(Vertex, Bitangent));
+
+	setupInstanceAttributes(instanceVBO);
+}
+
+void Mesh::setupMesh(GLuint instanceVBO, const std::array<VertexStream, 5>& streams)
+{
+	glCreateVertexArrays(1, &VAO);
+	glVertexArrayElementBuffer(VAO, EBO);
+
+	// Each attribute gets its own binding, skipping binding 1 which the instances keep
+	for (GLuint location = 0; location < streams.size(); ++location)
+	{
+		const VertexStream& stream = streams[location];
+		if (stream.size == 0)
+		{
+			continue;
+		}
+
+		const GLuint binding = location == 0 ? 0 : location + 1;
+		glVertexArrayVertexBuffer(VAO, binding, stream.buffer, stream.offset, stream.stride);
+		glEnableVertexArrayAttrib(VAO, location);
+		glVertexArrayAttribFormat(VAO, location, stream.size, stream.type, stream.normalized, 0);
+		glVertexArrayAttribBinding(VAO, location, binding);
+	}
+
+	setupInstanceAttributes(instanceVBO);
+}
+
+void Mesh::setupInstanceAttributes(GLuint instanceVBO)
+{
+	// Instance matrices (mat4 = 4 vec4s) at 5-8, the previous frame's for motion vectors at 9-12
+	glVertexArrayVertexBuffer(VAO, 1, instanceVBO, 0, sizeof(InstanceData));
+	glVertexArrayBindingDivisor(VAO, 1, 1);
+	for (GLuint i = 0; i < 4; ++i)
+	{
+		for (GLuint location : { 5 + i, 9 + i })
+		{
+			const GLuint matrixOffset = location < 9 ? offsetof(InstanceData, world) : offsetof(InstanceData, previousWorld);
+			glEnableVertexArrayAttrib(VAO, location);
+			glVertexArrayAttribFormat(VAO, location, 4, GL_FLOAT, GL_FALSE, matrixOffset + sizeof(glm::vec4) * i);
+			glVertexArrayAttribBinding(VAO, location, 1);
+		}
+	}
 }
 
 void Mesh::cleanup()
 {
-	if (VAO) glDeleteVertexArrays(1, &VAO);
+	if (VAO) glState.deleteVertexArrays(1, &VAO);
 	if (VBO) glDeleteBuffers(1, &VBO);
 	if (EBO) glDeleteBuffers(1, &EBO);
 
 	VAO = VBO = EBO = 0;
+}
+
+void Mesh::releaseGeometry()
+{
+	// shrink_to_fit is only a request, swapping with empty vectors always frees
+	std::vector<Vertex>().swap(vertices);
+	std::vector<uint32_t>().swap(indices);
+}
+
+size_t Mesh::gpuBytes() const
+{
+	return static_cast<size_t>(vertexCount) * vertexStride + static_cast<size_t>(indexCount) * sizeof(uint32_t);
+}
+
+size_t Mesh::cpuBytes() const
+{
+	return vertices.capacity() * sizeof(Vertex) + indices.capacity() * sizeof(uint32_t);
 }
\ No newline at end of file
@@ -2,18 +2,66 @@
 #include "stb_image.h"
 #include <assimp/Importer.hpp>
 #include <assimp/postprocess.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <iostream>
+#include <mutex>
+#include <optional>
 
 #include "mesh.hpp"
 #include "model.hpp"
+#include "jobSystem.hpp"
+#include "renderStats.hpp"
+#include "textureStreaming.hpp"
+#include "virtualTexture.hpp"
 
 std::unordered_map<std::string, int> Model::modelNameCount;
 
-Model::Model(const std::string& path, bool gamma, const std::string& modelName)
+namespace
+{
+	// Models are also constructed on background threads, see WorldStreamer
+	std::mutex modelNameMutex;
+
+	// What UploadTexture allocates for the decoded image, drivers pad three channel texels to four bytes
+	size_t TextureStorageBytes(const DecodedTexture& decoded)
+	{
+		if (!decoded.data)
+		{
+			return 0;
+		}
+
+		const size_t texelBytes = decoded.channels == 3 ? 4 : static_cast<size_t>(decoded.channels);
+		size_t bytes = 0;
+		int width = decoded.width;
+		int height = decoded.height;
+		while (true)
+		{
+			bytes += static_cast<size_t>(width) * height * texelBytes;
+			if (width == 1 && height == 1)
+			{
+				break;
+			}
+			width = std::max(width / 2, 1);
+			height = std::max(height / 2, 1);
+		}
+		return bytes;
+	}
+}
+
+Model::Model(const std::string& path, bool gamma, const std::string& modelName, bool upload)
 	: gammaCorrection(gamma)
 {
-	name = modelName + std::to_string(++modelNameCount[modelName]);
+	{
+		std::lock_guard<std::mutex> lock(modelNameMutex);
+		name = modelName + std::to_string(++modelNameCount[modelName]);
+	}
 	loadModel(path);
+	if (upload)
+	{
+		size_t unlimited = SIZE_MAX;
+		uploadStep(unlimited);
+	}
 }
 
 Model::Model(const Model& other)
@@ -23,6 +71,7 @@ Model::Model(const Model& other)
 	  gammaCorrection(other.gammaCorrection),
 	  hasTextures(other.hasTextures),
 	  visible(other.visible),
+	  bounds(other.bounds),
 	  name(other.name + std::to_string(++modelNameCount[other.name]))
 {
 	std::cout << "Copying model with name: " << other.name << " to " << name << std::endl;
@@ -37,6 +86,7 @@ Model& Model::operator=(const Model& other)
 		gammaCorrection = other.gammaCorrection;
 		hasTextures = other.hasTextures;
 		visible = other.visible;
+		bounds = other.bounds;
 		name = other.name + std::to_string(++modelNameCount[other.name]);
 	}
 	return *this;
@@ -49,8 +99,17 @@ Model::Model(Model&& other) noexcept
 	  gammaCorrection(other.gammaCorrection),
 	  hasTextures(other.hasTextures),
 	  visible(other.visible),
+	  bounds(other.bounds),
+	  instanceVBO(other.instanceVBO),
+	  decodedTextures(std::move(other.decodedTextures)),
+	  uploadedTextures(other.uploadedTextures),
+	  uploadedMeshes(other.uploadedMeshes),
+	  gltf(std::move(other.gltf)),
+	  viewBuffers(std::move(other.viewBuffers)),
+	  viewBufferBytes(other.viewBufferBytes),
 	  name(std::move(other.name))
 {
+	other.instanceVBO = 0;
 }
 
 Model& Model::operator=(Model&& other) noexcept
@@ -62,6 +121,15 @@ Model& Model::operator=(Model&& other) noexcept
 		gammaCorrection = other.gammaCorrection;
 		hasTextures = other.hasTextures;
 		visible = other.visible;
+		bounds = other.bounds;
+		instanceVBO = other.instanceVBO;
+		other.instanceVBO = 0;
+		decodedTextures = std::move(other.decodedTextures);
+		uploadedTextures = other.uploadedTextures;
+		uploadedMeshes = other.uploadedMeshes;
+		gltf = std::move(other.gltf);
+		viewBuffers = std::move(other.viewBuffers);
+		viewBufferBytes = other.viewBufferBytes;
 		name = std::move(other.name);
 	}
 	return *this;
@@ -70,7 +138,7 @@ Model& Model::operator=(Model&& other) noexcept
 void Model::Draw(Shader& shader, size_t instanceCount) const
 {
 	// Set uniform before drawing meshes
-	glUniform1i(glGetUniformLocation(shader.ID, "hasTextures"), hasTextures);
+	shader.setBool("hasTextures", hasTextures);
 
 	for (const auto& mesh : meshes)
 	{
@@ -80,6 +148,13 @@ void Model::Draw(Shader& shader, size_t instanceCount) const
 
 void Model::loadModel(std::string_view path)
 {
+	// glTF buffers go from the file to GL without passing through Assimp's arrays or Vertex structs
+	if (IsGltfFile(std::string(path)) && LoadGltf(std::string(path), *this))
+	{
+		decodeTextures();
+		return;
+	}
+
 	// Read file via ASSIMP
 	Assimp::Importer importer;
 	const aiScene* scene = importer.ReadFile(
@@ -106,118 +181,104 @@ void Model::loadModel(std::string_view path)
 	std::string pathStr(path);
 	directory = pathStr.substr(0, path.find_last_of('/'));
 
-	// Process Assimp's root node recursively
-	processNode(scene->mRootNode, scene);
+	// Meshes are converted in parallel, then their materials resolved in order on this thread
+	std::vector<const aiMesh*> order;
+	processNode(scene->mRootNode, scene, order);
 
-	// Create and upload instance VBO
-	glGenBuffers(1, &instanceVBO);
-	glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
-	glm::mat4 identity(1.0f);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(glm::mat4), &identity, GL_DYNAMIC_DRAW);
+	std::vector<std::optional<Mesh>> converted(order.size());
+	jobSystem.parallelFor(0, order.size(), 1, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; ++i)
+		{
+			converted[i].emplace(processMesh(order[i]));
+		}
+	});
 
-	for (Mesh& mesh : meshes)
+	meshes.reserve(meshes.size() + order.size());
+	for (size_t i = 0; i < order.size(); ++i)
 	{
-		mesh.setupMesh(instanceVBO);
+		Mesh& mesh = meshes.emplace_back(std::move(*converted[i]));
+		mesh.textures = processMaterial(scene->mMaterials[order[i]->mMaterialIndex]);
+		bounds.expand(mesh.bounds);
 	}
+	decodeTextures();
 }
 
-void Model::processNode(aiNode* node, const aiScene *scene)
+void Model::processNode(const aiNode* node, const aiScene* scene, std::vector<const aiMesh*>& order)
 {
-	// Process each mesh located at the current node
-	meshes.reserve(meshes.size() + node->mNumMeshes);
+	// The node object only contains indices to index the actual objects in the scene.
+	// The scene object contains all the data, node is just to keep stuff organized (like relations between nodes)
 	for (uint32_t i = 0; i < node->mNumMeshes; ++i)
 	{
-		// The node object only contains indices to index the actual objects in the scene.
-		// The scene object contains all the data, node is just to keep stuff organized (like relations between nodes)
-		aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-		meshes.push_back(processMesh(mesh, scene));
+		order.push_back(scene->mMeshes[node->mMeshes[i]]);
 	}
-	// After we've processed all of the meshes (if any) we then recursively proecss each of the children nodes
+	// After we've listed all of the meshes (if any) we then recursively process each of the children nodes
 	for (uint32_t i = 0; i < node->mNumChildren; ++i)
 	{
-		processNode(node->mChildren[i], scene);
+		processNode(node->mChildren[i], scene, order);
 	}
 }
 
-Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene)
+Mesh Model::processMesh(const aiMesh* mesh)
 {
-	// Data to fill
-	std::vector<Vertex> vertices;
-	std::vector<uint32_t> indices;
-	std::vector<Texture> textures;
+	// Sized up front and filled one attribute at a time: each loop is a plain strided copy the compiler
+	// vectorizes, and attributes the mesh lacks stay zero
+	std::vector<Vertex> vertices(mesh->mNumVertices);
+	const size_t vertexCount = vertices.size();
+	auto toVec3 = [](const aiVector3D& v) { return glm::vec3(v.x, v.y, v.z); };
 
-	vertices.reserve(mesh->mNumVertices);
-
-	// Walk through each of the mesh's vertices
-	for (unsigned int i = 0; i < mesh->mNumVertices; ++i) {
-		Vertex vertex;
-
-		// Position
-		vertex.Position = {
-			mesh->mVertices[i].x,
-			mesh->mVertices[i].y,
-			mesh->mVertices[i].z
-		};
-
-		// Normals
-		if (mesh->HasNormals()) {
-			vertex.Normal = {
-				mesh->mNormals[i].x,
-				mesh->mNormals[i].y,
-				mesh->mNormals[i].z
-			};
+	for (size_t i = 0; i < vertexCount; ++i)
+	{
+		vertices[i].Position = toVec3(mesh->mVertices[i]);
+	}
+	if (mesh->HasNormals())
+	{
+		for (size_t i = 0; i < vertexCount; ++i)
+		{
+			vertices[i].Normal = toVec3(mesh->mNormals[i]);
 		}
-
-		// Texture Coordinates
-		if (mesh->mTextureCoords[0]) {
-			vertex.TexCoords = {
-				mesh->mTextureCoords[0][i].x,
-				mesh->mTextureCoords[0][i].y
-			};
-
-			// Tangent
-			vertex.Tangent = {
-				mesh->mTangents[i].x,
-				mesh->mTangents[i].y,
-				mesh->mTangents[i].z
-			};
-
-			// Bitangent
-			vertex.Bitangent = {
-				mesh->mBitangents[i].x,
-				mesh->mBitangents[i].y,
-				mesh->mBitangents[i].z
-			};
+	}
+	if (mesh->mTextureCoords[0])
+	{
+		for (size_t i = 0; i < vertexCount; ++i)
+		{
+			vertices[i].TexCoords = glm::vec2(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y);
+		}
+	}
+	if (mesh->mTextureCoords[0] && mesh->HasTangentsAndBitangents())
+	{
+		for (size_t i = 0; i < vertexCount; ++i)
+		{
+			vertices[i].Tangent = toVec3(mesh->mTangents[i]);
 		}
-		else {
-			vertex.TexCoords = { 0.0f, 0.0f };
+		for (size_t i = 0; i < vertexCount; ++i)
+		{
+			vertices[i].Bitangent = toVec3(mesh->mBitangents[i]);
 		}
-
-		vertices.push_back(vertex);
 	}
 
-	// Reserve memory for indices
-	uint32_t totalIndices = 0;
+	// Faces are triangles after aiProcess_Triangulate, apart from the point and line meshes SortByPType splits off
+	size_t totalIndices = 0;
 	for (uint32_t i = 0; i < mesh->mNumFaces; ++i)
 	{
 		totalIndices += mesh->mFaces[i].mNumIndices;
 	}
-	indices.reserve(totalIndices);
-
-	// Process indices
-	for (uint32_t i = 0; i < mesh->mNumFaces; ++i) 
+	std::vector<uint32_t> indices(totalIndices);
+	uint32_t* index = indices.data();
+	for (uint32_t i = 0; i < mesh->mNumFaces; ++i)
 	{
-		aiFace face = mesh->mFaces[i];
-
-		// Retrieve all indices of the face and store them in the indicies vector
-		for (uint32_t j = 0; j < face.mNumIndices; ++j) 
-		{
-			indices.push_back(face.mIndices[j]);
-		}
+		const aiFace& face = mesh->mFaces[i];
+		std::memcpy(index, face.mIndices, face.mNumIndices * sizeof(uint32_t));
+		index += face.mNumIndices;
 	}
-	
-	// Process materials
-	aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
+
+	// The constructor measures bounds and UV density, still on the worker
+	return Mesh(std::move(vertices), std::move(indices), {});
+}
+
+std::vector<Texture> Model::processMaterial(aiMaterial* material)
+{
+	std::vector<Texture> textures;
 
 	std::vector<Texture> albedoMap = loadMaterialTextures(material, aiTextureType_BASE_COLOR, TextureType::ALBEDO);
 	// If no BASE_COLOR, try DIFFUSE as fallback
@@ -256,7 +317,7 @@ Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene)
 		hasTextures = true;
 	}
 
-	return Mesh(std::move(vertices), std::move(indices), std::move(textures));
+	return textures;
 }
 
 std::vector<Texture> Model::loadMaterialTextures(aiMaterial* mat, aiTextureType type, TextureType typeName)
@@ -284,8 +345,9 @@ std::vector<Texture> Model::loadMaterialTextures(aiMaterial* mat, aiTextureType
 
 		if (!skip)
 		{
+			// Decoded together with the others in decodeTextures, uploaded in uploadStep
 			Texture texture;
-			texture.id = TextureFromFile(str.C_Str(), directory, typeName);
+			texture.id = 0;
 			texture.type = typeName;
 			texture.path = str.C_Str();
 			textures.push_back(texture);
@@ -296,46 +358,237 @@ std::vector<Texture> Model::loadMaterialTextures(aiMaterial* mat, aiTextureType
 	return textures;
 }
 
-uint32_t TextureFromFile(const std::string& path, const std::string& directory, TextureType type)
+void Model::decodeTextures()
 {
-	uint32_t textureID;
-	glGenTextures(1, &textureID);
-	std::string fullPath = directory + '/' + path;
+	decodedTextures.resize(textures_loaded.size());
+	jobSystem.parallelFor(0, textures_loaded.size(), 1, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; ++i)
+		{
+			decodedTextures[i] = DecodeTextureFile(textures_loaded[i].path, directory);
+		}
+	});
+}
 
-	int width, height, nrChannels;
-	uint8_t* data = stbi_load(fullPath.c_str(), &width, &height, &nrChannels, 0);
+bool Model::uploadStep(size_t& budgetBytes)
+{
+	while (uploadedTextures < textures_loaded.size())
+	{
+		if (budgetBytes == 0)
+		{
+			return false;
+		}
 
-	if (data)
+		Texture& texture = textures_loaded[uploadedTextures];
+		DecodedTexture& decoded = decodedTextures[uploadedTextures];
+		budgetBytes -= std::min(std::max(static_cast<size_t>(decoded.width) * decoded.height * decoded.channels, size_t(1)), budgetBytes);
+		if (virtualTextures.enabled && texture.type == TextureType::ALBEDO)
+		{
+			// Pages share the physical cache, only the small indirection texture is this model's
+			texture.id = virtualTextures.upload(decoded, texture.virtualId);
+		}
+		if (texture.virtualId < 0 && textureStreamer.enabled)
+		{
+			// Resident levels change over time, the streamer keeps count of them
+			texture.id = textureStreamer.upload(decoded, texture.type, texture.path, directory);
+		}
+		else if (texture.virtualId < 0)
+		{
+			texture.gpuBytes = TextureStorageBytes(decoded);
+			texture.id = UploadTexture(decoded, texture.type);
+		}
+		++uploadedTextures;
+	}
+	decodedTextures.clear();
+
+	// Every texture id is known, so the meshes' materials can be resolved
+	if (!instanceVBO && !meshes.empty())
+	{
+		std::unordered_map<std::string, const Texture*> loaded;
+		for (const Texture& texture : textures_loaded)
+		{
+			loaded[texture.path] = &texture;
+		}
+		for (Mesh& mesh : meshes)
+		{
+			for (Texture& texture : mesh.textures)
+			{
+				texture.id = loaded[texture.path]->id;
+				texture.virtualId = loaded[texture.path]->virtualId;
+			}
+			mesh.assignMaterial();
+		}
+
+		// Create and upload instance VBO
+		glCreateBuffers(1, &instanceVBO);
+		const InstanceData identity{ glm::mat4(1.0f), glm::mat4(1.0f) };
+		glNamedBufferData(instanceVBO, sizeof(InstanceData), &identity, GL_DYNAMIC_DRAW);
+	}
+
+	while (uploadedMeshes < meshes.size())
 	{
-		GLenum format {};
-		GLenum internalFormat {};
+		if (budgetBytes == 0)
+		{
+			return false;
+		}
 
-		if (nrChannels == 1) {
-			format = GL_RED;
-			internalFormat = GL_RED;
+		Mesh& mesh = meshes[uploadedMeshes];
+		if (gltf)
+		{
+			budgetBytes -= std::min(std::max(UploadGltfMesh(*this, uploadedMeshes, instanceVBO), size_t(1)), budgetBytes);
 		}
-		else if (nrChannels == 3) {
-			format = GL_RGB;
-			// Use SRGB only for albedo textures or emissive
-			internalFormat = (type == TextureType::ALBEDO || type == TextureType::EMISSIVE) ? GL_SRGB : GL_RGB;
+		else
+		{
+			budgetBytes -= std::min(std::max(mesh.gpuBytes(), size_t(1)), budgetBytes);
+			mesh.setupMesh(instanceVBO);
+		}
+		++uploadedMeshes;
+	}
+	// Unmaps the files, GL has its own copy of everything
+	gltf.reset();
+	return true;
+}
+
+void Model::release()
+{
+	for (DecodedTexture& decoded : decodedTextures)
+	{
+		stbi_image_free(decoded.data);
+	}
+	decodedTextures.clear();
+	for (Texture& texture : textures_loaded)
+	{
+		if (texture.virtualId >= 0)
+		{
+			virtualTextures.release(texture.virtualId);
+			texture.virtualId = -1;
 		}
-		else if (nrChannels == 4) {
-			format = GL_RGBA;
-			// Use SRGB_ALPHA only for albedo textures or emissive
-			internalFormat = (type == TextureType::ALBEDO || type == TextureType::EMISSIVE) ? GL_SRGB_ALPHA : GL_RGBA;
+		if (texture.id)
+		{
+			textureStreamer.release(texture.id);
+			glState.deleteTextures(1, &texture.id);
 		}
+		texture.id = 0;
+		texture.gpuBytes = 0;
+	}
+	if (instanceVBO)
+	{
+		glDeleteBuffers(1, &instanceVBO);
+		instanceVBO = 0;
+	}
+	for (Mesh& mesh : meshes)
+	{
+		mesh.cleanup();
+	}
+	if (!viewBuffers.empty())
+	{
+		glDeleteBuffers(static_cast<GLsizei>(viewBuffers.size()), viewBuffers.data());
+		viewBuffers.clear();
+		viewBufferBytes = 0;
+	}
+	gltf.reset();
+}
+
+void Model::releaseGeometry()
+{
+	for (Mesh& mesh : meshes)
+	{
+		mesh.releaseGeometry();
+	}
+}
+
+size_t Model::gpuBytes() const
+{
+	size_t bytes = viewBufferBytes;
+	for (const Mesh& mesh : meshes)
+	{
+		bytes += mesh.VAO ? mesh.gpuBytes() : 0;
+	}
+	for (const Texture& texture : textures_loaded)
+	{
+		bytes += texture.gpuBytes;
+	}
+	return bytes;
+}
+
+size_t Model::cpuBytes() const
+{
+	size_t bytes = 0;
+	for (const Mesh& mesh : meshes)
+	{
+		bytes += mesh.cpuBytes();
+	}
+	return bytes;
+}
+
+DecodedTexture DecodeTextureFile(const std::string& path, const std::string& directory)
+{
+	DecodedTexture decoded;
+	std::string fullPath = directory + '/' + path;
+	decoded.data = stbi_load(fullPath.c_str(), &decoded.width, &decoded.height, &decoded.channels, 0);
+	return decoded;
+}
+
+uint32_t TextureFromFile(const std::string& path, const std::string& directory, TextureType type)
+{
+	DecodedTexture decoded = DecodeTextureFile(path, directory);
+	return UploadTexture(decoded, type);
+}
+
+void ChooseTextureFormat(TextureType type, int channels, GLenum& format, GLenum& internalFormat)
+{
+	// Use sRGB only for albedo and emissive textures
+	const bool srgb = type == TextureType::ALBEDO || type == TextureType::EMISSIVE;
+	format = GL_RED;
+	internalFormat = GL_R8;
+
+	if (channels == 2) {
+		format = GL_RG;
+		internalFormat = GL_RG8;
+	}
+	else if (channels == 3) {
+		format = GL_RGB;
+		internalFormat = srgb ? GL_SRGB8 : GL_RGB8;
+	}
+	else if (channels == 4) {
+		format = GL_RGBA;
+		internalFormat = srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+	}
+}
 
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
+uint32_t UploadTexture(DecodedTexture& decoded, TextureType type)
+{
+	uint32_t textureID;
+	glCreateTextures(GL_TEXTURE_2D, 1, &textureID);
+
+	uint8_t* data = decoded.data;
+	const int width = decoded.width;
+	const int height = decoded.height;
+	const int nrChannels = decoded.channels;
+
+	if (data)
+	{
+		GLenum format;
+		GLenum internalFormat;
+		ChooseTextureFormat(type, nrChannels, format, internalFormat);
+
+		// Immutable storage with the full mip chain, filled without binding the texture
+		const int levels = static_cast<int>(std::floor(std::log2(std::max(width, height)))) + 1;
+		glTextureStorage2D(textureID, levels, internalFormat, width, height);
+		// stb rows are tightly packed, which one and three channel widths often are not to 4 bytes
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTextureSubImage2D(textureID, 0, 0, 0, width, height, format, GL_UNSIGNED_BYTE, data);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glGenerateTextureMipmap(textureID);
 
 		// Texture wrapping/filtering options
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTextureParameteri(textureID, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTextureParameteri(textureID, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTextureParameteri(textureID, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTextureParameteri(textureID, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
 		stbi_image_free(data);
+		decoded.data = nullptr;
 	}
 	else
 	{
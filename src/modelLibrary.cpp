@@ -0,0 +1,141 @@
+#include <glad/glad.h>
+
+#include "modelLibrary.hpp"
+#include "model.hpp"
+#include "profiler.hpp"
+#include "scene.hpp"
+
+#include <iostream>
+
+uint32_t ModelLibrary::acquire(Scene& scene, const std::string& folder, const std::string& path)
+{
+	auto found = entries.find(folder);
+	if (found != entries.end())
+	{
+		std::cout << "Using cached model: " << folder << std::endl;
+		found->second.lastDrawnFrame = frame;
+		return found->second.modelId;
+	}
+
+	PROFILE_ZONE("Model Load");
+	return adopt(scene, folder, std::make_shared<Model>(path, false, folder));
+}
+
+uint32_t ModelLibrary::adopt(Scene& scene, const std::string& folder, std::shared_ptr<Model> model)
+{
+	Entry entry;
+	entry.model = std::move(model);
+	if (releaseGeometry)
+	{
+		entry.model->releaseGeometry();
+	}
+	entry.modelId = scene.registerModel(entry.model);
+	entry.gpuBytes = entry.model->gpuBytes();
+	entry.cpuBytes = entry.model->cpuBytes();
+	entry.lastDrawnFrame = frame;
+	std::cout << "Created new model: " << folder << " (" << entry.gpuBytes / 1024 << " KB GPU, " << entry.cpuBytes / 1024 << " KB CPU)" << std::endl;
+
+	const uint32_t modelId = entry.modelId;
+	entries.emplace(folder, std::move(entry));
+	return modelId;
+}
+
+uint32_t ModelLibrary::find(const std::string& folder) const
+{
+	auto found = entries.find(folder);
+	return found != entries.end() ? found->second.modelId : NOT_RESIDENT;
+}
+
+void ModelLibrary::pin(const std::string& folder)
+{
+	auto found = entries.find(folder);
+	if (found != entries.end())
+	{
+		++found->second.pins;
+	}
+}
+
+void ModelLibrary::unpin(const std::string& folder)
+{
+	auto found = entries.find(folder);
+	if (found != entries.end() && found->second.pins > 0)
+	{
+		--found->second.pins;
+	}
+}
+
+void ModelLibrary::update(Scene& scene, const std::vector<std::vector<InstanceData>>& instancesPerModel)
+{
+	++frame;
+
+	for (auto& [folder, entry] : entries)
+	{
+		if (entry.modelId < instancesPerModel.size() && !instancesPerModel[entry.modelId].empty())
+		{
+			entry.lastDrawnFrame = frame;
+		}
+	}
+
+	evict(scene);
+}
+
+void ModelLibrary::releaseAllGeometry()
+{
+	for (auto& [folder, entry] : entries)
+	{
+		entry.model->releaseGeometry();
+		entry.cpuBytes = entry.model->cpuBytes();
+	}
+}
+
+size_t ModelLibrary::residentBytes() const
+{
+	size_t total = 0;
+	for (const auto& [folder, entry] : entries)
+	{
+		total += entry.gpuBytes;
+	}
+	return total;
+}
+
+size_t ModelLibrary::residentCPUBytes() const
+{
+	size_t total = 0;
+	for (const auto& [folder, entry] : entries)
+	{
+		total += entry.cpuBytes;
+	}
+	return total;
+}
+
+void ModelLibrary::evict(Scene& scene)
+{
+	size_t total = residentBytes();
+	while (total > budgetBytes)
+	{
+		auto victim = entries.end();
+		for (auto it = entries.begin(); it != entries.end(); ++it)
+		{
+			if (scene.modelInstanceCounts[it->second.modelId] > 0 || it->second.pins > 0)
+			{
+				continue;
+			}
+			if (victim == entries.end() || it->second.lastDrawnFrame < victim->second.lastDrawnFrame)
+			{
+				victim = it;
+			}
+		}
+
+		// Every model left has entities or is pinned, they stay even if over budget
+		if (victim == entries.end())
+		{
+			break;
+		}
+
+		std::cout << "Evicting model: " << victim->first << std::endl;
+		victim->second.model->release();
+		scene.releaseModel(victim->second.modelId);
+		total -= victim->second.gpuBytes;
+		entries.erase(victim);
+	}
+}
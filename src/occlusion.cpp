@@ -0,0 +1,233 @@
+#include "occlusion.hpp"
+#include "model.hpp"
+#include "renderStats.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	// Cull work groups are 64 wide, downsample work groups 8x8
+	GLuint groupCount(size_t size, size_t groupSize)
+	{
+		return static_cast<GLuint>((size + groupSize - 1) / groupSize);
+	}
+}
+
+OcclusionCuller::OcclusionCuller()
+	: downsampleShader("shaders/hiZDownsample.comp"),
+	  cullShader("shaders/occlusionCull.comp")
+{
+	GLuint buffers[7];
+	glCreateBuffers(7, buffers);
+	instanceBuffer = buffers[0];
+	meshBoundsBuffer = buffers[1];
+	itemBuffer = buffers[2];
+	drawInfoBuffer = buffers[3];
+	visibilityBuffer = buffers[4];
+	commandBuffer = buffers[5];
+	outputBuffer = buffers[6];
+}
+
+OcclusionCuller::~OcclusionCuller()
+{
+	const GLuint buffers[7] = { instanceBuffer, meshBoundsBuffer, itemBuffer, drawInfoBuffer, visibilityBuffer, commandBuffer, outputBuffer };
+	glState.deleteBuffers(7, buffers);
+	if (pyramidTexture)
+	{
+		glState.deleteTextures(1, &pyramidTexture);
+	}
+}
+
+void OcclusionCuller::growBuffer(GLuint buffer, size_t& capacity, size_t bytes)
+{
+	if (bytes <= capacity)
+	{
+		return;
+	}
+
+	// Grow geometrically so a slowly growing scene does not reallocate every frame
+	capacity = std::max(bytes, capacity * 2);
+	glNamedBufferData(buffer, capacity, nullptr, GL_DYNAMIC_DRAW);
+}
+
+void OcclusionCuller::prepare(const std::vector<std::vector<InstanceData>>& instancesPerModel, const std::vector<std::shared_ptr<Model>>& models)
+{
+	instances.clear();
+	meshBounds.clear();
+	items.clear();
+	drawInfos.clear();
+	commands.clear();
+	modelRanges.clear();
+
+	// Every mesh of a model gets a phase 0 and a phase 1 region sized for all of the model's instances
+	uint32_t outputOffset = 0;
+	for (uint32_t modelId = 0; modelId < instancesPerModel.size(); ++modelId)
+	{
+		const std::vector<InstanceData>& transforms = instancesPerModel[modelId];
+		const std::shared_ptr<Model>& model = models[modelId];
+		if (!model || transforms.empty() || model->meshes.empty())
+		{
+			continue;
+		}
+
+		const uint32_t firstInstance = static_cast<uint32_t>(instances.size());
+		const uint32_t count = static_cast<uint32_t>(transforms.size());
+		instances.insert(instances.end(), transforms.begin(), transforms.end());
+
+		ModelRange range{ modelId, model->instanceVBO, outputOffset, 0, static_cast<uint32_t>(drawInfos.size()) };
+		for (const Mesh& mesh : model->meshes)
+		{
+			const uint32_t draw = static_cast<uint32_t>(drawInfos.size());
+			const uint32_t boundsIndex = static_cast<uint32_t>(meshBounds.size() / 2);
+			meshBounds.push_back(glm::vec4(mesh.bounds.min, 0.0f));
+			meshBounds.push_back(glm::vec4(mesh.bounds.max, 0.0f));
+
+			drawInfos.push_back({ outputOffset, count, boundsIndex, 0 });
+			commands.push_back({ mesh.indexCount, 0, 0, 0, outputOffset - range.outputOffset });
+
+			for (uint32_t i = 0; i < count; ++i)
+			{
+				items.push_back({ firstInstance + i, draw });
+			}
+			outputOffset += 2 * count;
+		}
+		range.outputCount = outputOffset - range.outputOffset;
+		modelRanges.push_back(range);
+
+		// The culled instances are copied here, the shadow pass may have left a smaller buffer behind
+		glNamedBufferData(model->instanceVBO, range.outputCount * sizeof(InstanceData), nullptr, GL_DYNAMIC_DRAW);
+	}
+
+	// Phase 1 commands mirror phase 0 and point past the phase 0 region of each mesh
+	drawCount = static_cast<uint32_t>(drawInfos.size());
+	for (uint32_t draw = 0; draw < drawCount; ++draw)
+	{
+		DrawElementsIndirectCommand command = commands[draw];
+		command.baseInstance += drawInfos[draw].capacity;
+		commands.push_back(command);
+	}
+
+	if (items.empty())
+	{
+		return;
+	}
+
+	growBuffer(instanceBuffer, instanceCapacity, instances.size() * sizeof(InstanceData));
+	growBuffer(meshBoundsBuffer, meshBoundsCapacity, meshBounds.size() * sizeof(glm::vec4));
+	growBuffer(itemBuffer, itemCapacity, items.size() * sizeof(glm::uvec2));
+	growBuffer(drawInfoBuffer, drawInfoCapacity, drawInfos.size() * sizeof(DrawInfo));
+	growBuffer(visibilityBuffer, visibilityCapacity, items.size() * sizeof(uint32_t));
+	growBuffer(commandBuffer, commandCapacity, commands.size() * sizeof(DrawElementsIndirectCommand));
+	growBuffer(outputBuffer, outputCapacity, outputOffset * sizeof(InstanceData));
+
+	countedNamedBufferSubData(instanceBuffer, 0, instances.size() * sizeof(InstanceData), instances.data());
+	countedNamedBufferSubData(meshBoundsBuffer, 0, meshBounds.size() * sizeof(glm::vec4), meshBounds.data());
+	countedNamedBufferSubData(itemBuffer, 0, items.size() * sizeof(glm::uvec2), items.data());
+	countedNamedBufferSubData(drawInfoBuffer, 0, drawInfos.size() * sizeof(DrawInfo), drawInfos.data());
+	countedNamedBufferSubData(commandBuffer, 0, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data());
+}
+
+void OcclusionCuller::cull(int phase)
+{
+	if (items.empty())
+	{
+		return;
+	}
+
+	cullShader.use();
+	cullShader.setInt("pyramid", 0);
+	cullShader.setInt("pyramidLevels", pyramidLevels);
+	cullShader.setBool("usePyramid", pyramidValid);
+	cullShader.setMat4("viewProjection", pyramidViewProjection);
+	cullShader.setInt("phase", phase);
+	cullShader.setInt("drawCount", static_cast<int>(drawCount));
+	cullShader.setInt("itemCount", static_cast<int>(items.size()));
+
+	countedBindTextureUnit(0, pyramidTexture);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, instanceBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, meshBoundsBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, itemBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, drawInfoBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, visibilityBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, commandBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, outputBuffer);
+
+	glDispatchCompute(groupCount(items.size(), 64), 1, 1);
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+
+	// Mesh VAOs read instance matrices from their model's buffer, so hand each model its compacted range
+	for (const ModelRange& range : modelRanges)
+	{
+		glCopyNamedBufferSubData(outputBuffer, range.instanceVBO,
+			range.outputOffset * sizeof(InstanceData), 0, range.outputCount * sizeof(InstanceData));
+	}
+}
+
+void OcclusionCuller::enqueue(RenderQueue& queue, const std::vector<std::shared_ptr<Model>>& models, const std::vector<float>& depthPerModel) const
+{
+	if (items.empty())
+	{
+		return;
+	}
+
+	for (int phase = 0; phase < 2; ++phase)
+	{
+		const RenderPassId pass = phase == 0 ? RenderPassId::Opaque : RenderPassId::OpaqueLate;
+		for (const ModelRange& range : modelRanges)
+		{
+			const Model& model = *models[range.modelId];
+			for (size_t i = 0; i < model.meshes.size(); ++i)
+			{
+				const size_t command = phase * drawCount + range.firstCommand + i;
+				queue.addIndirect(pass, model, model.meshes[i], commandBuffer, static_cast<GLintptr>(command * sizeof(DrawElementsIndirectCommand)), depthPerModel[range.modelId]);
+			}
+		}
+	}
+}
+
+void OcclusionCuller::buildPyramid(uint32_t depthTexture, int width, int height, const glm::mat4& viewProjection)
+{
+	// Level 0 is half the depth buffer resolution, the finest level a 2x2 footprint test needs
+	const int levelWidth = std::max(width / 2, 1);
+	const int levelHeight = std::max(height / 2, 1);
+	if (levelWidth != pyramidWidth || levelHeight != pyramidHeight)
+	{
+		if (pyramidTexture)
+		{
+			glState.deleteTextures(1, &pyramidTexture);
+		}
+
+		pyramidWidth = levelWidth;
+		pyramidHeight = levelHeight;
+		pyramidLevels = static_cast<int>(std::floor(std::log2(std::max(levelWidth, levelHeight)))) + 1;
+
+		glCreateTextures(GL_TEXTURE_2D, 1, &pyramidTexture);
+		glTextureStorage2D(pyramidTexture, pyramidLevels, GL_R32F, pyramidWidth, pyramidHeight);
+		glTextureParameteri(pyramidTexture, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+		glTextureParameteri(pyramidTexture, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTextureParameteri(pyramidTexture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTextureParameteri(pyramidTexture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	}
+
+	downsampleShader.use();
+	downsampleShader.setInt("depthTexture", 0);
+	downsampleShader.setIVec2("depthSize", glm::ivec2(width, height));
+	countedBindTextureUnit(0, depthTexture);
+
+	for (int level = 0; level < pyramidLevels; ++level)
+	{
+		// Level 0 never reads the source image, it is bound only so the unit is not empty
+		downsampleShader.setBool("fromDepth", level == 0);
+		glBindImageTexture(0, pyramidTexture, std::max(level - 1, 0), GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+		glBindImageTexture(1, pyramidTexture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+
+		glDispatchCompute(groupCount(std::max(pyramidWidth >> level, 1), 8), groupCount(std::max(pyramidHeight >> level, 1), 8), 1);
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+	}
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+	pyramidValid = true;
+	pyramidViewProjection = viewProjection;
+}
@@ -0,0 +1,508 @@
+#include "profiler.hpp"
+
+#include "imgui.h"
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <unordered_set>
+
+Profiler profiler;
+
+namespace
+{
+	struct OpenCpuZone
+	{
+		const char* name;
+		double startUs;
+		bool recording;
+	};
+
+	std::atomic<uint32_t> nextThreadIndex{ 0 };
+
+	// The GL thread calls init() first, so it is always thread 0
+	thread_local uint32_t threadIndex = nextThreadIndex++;
+	thread_local std::vector<OpenCpuZone> cpuStack;
+
+	ImU32 zoneColor(std::string_view name)
+	{
+		const size_t hash = std::hash<std::string_view>{}(name);
+		return IM_COL32(90 + (hash & 0x7F), 90 + ((hash >> 8) & 0x7F), 90 + ((hash >> 16) & 0x7F), 255);
+	}
+
+	// Sums repeated zones so a name called several times per frame is one sample
+	void addFrameTotals(const std::vector<ProfileZone>& zones, std::unordered_map<std::string_view, ZoneStats>& stats)
+	{
+		std::unordered_map<std::string_view, float> totals;
+		for (const ProfileZone& zone : zones)
+		{
+			totals[zone.name] += static_cast<float>(zone.durationUs / 1000.0);
+		}
+		for (const auto& [name, ms] : totals)
+		{
+			stats[name].add(ms);
+		}
+	}
+
+	void writeJsonString(std::ofstream& file, const char* text)
+	{
+		file << '"';
+		for (const char* c = text; *c; ++c)
+		{
+			if (*c == '"' || *c == '\\')
+			{
+				file << '\\';
+			}
+			file << *c;
+		}
+		file << '"';
+	}
+
+	// Draws one row per nesting depth, zones are scaled to the width of the frame
+	void drawTimeline(const char* label, const std::vector<ProfileZone>& zones, double frameStartUs, double frameDurationUs)
+	{
+		int maxDepth = 0;
+		for (const ProfileZone& zone : zones)
+		{
+			if (zone.thread == 0 || zone.thread == Profiler::GPU_TRACE_THREAD)
+			{
+				maxDepth = std::max(maxDepth, zone.depth);
+			}
+		}
+
+		const float rowHeight = ImGui::GetTextLineHeightWithSpacing();
+		const float width = ImGui::GetContentRegionAvail().x;
+		const ImVec2 origin = ImGui::GetCursorScreenPos();
+		const ImVec2 size(width, rowHeight * (maxDepth + 1));
+
+		ImGui::InvisibleButton(label, size);
+		ImDrawList* drawList = ImGui::GetWindowDrawList();
+		drawList->AddRect(origin, ImVec2(origin.x + size.x, origin.y + size.y), IM_COL32(80, 80, 80, 255));
+		drawList->PushClipRect(origin, ImVec2(origin.x + size.x, origin.y + size.y), true);
+
+		const double scale = frameDurationUs > 0.0 ? width / frameDurationUs : 0.0;
+		for (const ProfileZone& zone : zones)
+		{
+			// Worker threads only show up in the stats table and the trace
+			if (zone.thread != 0 && zone.thread != Profiler::GPU_TRACE_THREAD)
+			{
+				continue;
+			}
+
+			const ImVec2 min(origin.x + static_cast<float>((zone.startUs - frameStartUs) * scale), origin.y + zone.depth * rowHeight);
+			const ImVec2 max(std::max(min.x + 1.0f, min.x + static_cast<float>(zone.durationUs * scale)), min.y + rowHeight - 1.0f);
+			drawList->AddRectFilled(min, max, zoneColor(zone.name));
+
+			if (max.x - min.x > ImGui::CalcTextSize(zone.name).x + 4.0f)
+			{
+				drawList->AddText(ImVec2(min.x + 2.0f, min.y), IM_COL32(0, 0, 0, 255), zone.name);
+			}
+			if (ImGui::IsMouseHoveringRect(min, max))
+			{
+				ImGui::SetTooltip("%s: %.3f ms", zone.name, zone.durationUs / 1000.0);
+			}
+		}
+		drawList->PopClipRect();
+	}
+
+	void drawStatsTable(const char* id, const std::vector<ProfileZone>& zones, const std::unordered_map<std::string_view, ZoneStats>& stats)
+	{
+		// Parents before children, in the order the frame ran them
+		std::vector<ProfileZone> ordered = zones;
+		std::stable_sort(ordered.begin(), ordered.end(), [](const ProfileZone& a, const ProfileZone& b)
+		{
+			return a.thread != b.thread ? a.thread < b.thread : a.startUs < b.startUs;
+		});
+
+		if (!ImGui::BeginTable(id, 5, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingFixedFit))
+		{
+			return;
+		}
+		ImGui::TableSetupColumn("Zone");
+		ImGui::TableSetupColumn("Last ms");
+		ImGui::TableSetupColumn("Avg ms");
+		ImGui::TableSetupColumn("Min ms");
+		ImGui::TableSetupColumn("Max ms");
+		ImGui::TableHeadersRow();
+
+		std::unordered_set<std::string_view> listed;
+		for (const ProfileZone& zone : ordered)
+		{
+			auto it = stats.find(zone.name);
+			if (it == stats.end() || !listed.insert(zone.name).second)
+			{
+				continue;
+			}
+
+			const ZoneStats& zoneStats = it->second;
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn();
+			ImGui::Indent(zone.depth * 10.0f + 1.0f);
+			ImGui::TextUnformatted(zone.name);
+			ImGui::Unindent(zone.depth * 10.0f + 1.0f);
+			ImGui::TableNextColumn();
+			ImGui::Text("%.3f", zoneStats.last);
+			ImGui::TableNextColumn();
+			ImGui::Text("%.3f", zoneStats.average());
+			ImGui::TableNextColumn();
+			ImGui::Text("%.3f", zoneStats.min());
+			ImGui::TableNextColumn();
+			ImGui::Text("%.3f", zoneStats.max());
+		}
+		ImGui::EndTable();
+	}
+}
+
+void ZoneStats::add(float ms)
+{
+	last = ms;
+	history[next] = ms;
+	next = (next + 1) % HISTORY_SIZE;
+	count = std::min(count + 1, HISTORY_SIZE);
+}
+
+float ZoneStats::average() const
+{
+	float sum = 0.0f;
+	for (int i = 0; i < count; ++i)
+	{
+		sum += history[i];
+	}
+	return count > 0 ? sum / count : 0.0f;
+}
+
+float ZoneStats::min() const
+{
+	return count > 0 ? *std::min_element(history.begin(), history.begin() + count) : 0.0f;
+}
+
+float ZoneStats::max() const
+{
+	return count > 0 ? *std::max_element(history.begin(), history.begin() + count) : 0.0f;
+}
+
+void Profiler::init()
+{
+	(void)threadIndex;
+	for (GpuFrame& frame : gpuFrames)
+	{
+		glGenQueries(static_cast<GLsizei>(frame.queries.size()), frame.queries.data());
+	}
+}
+
+void Profiler::shutdown()
+{
+	for (GpuFrame& frame : gpuFrames)
+	{
+		glDeleteQueries(static_cast<GLsizei>(frame.queries.size()), frame.queries.data());
+		frame.queries.fill(0);
+		frame.pending = false;
+	}
+}
+
+double Profiler::nowUs() const
+{
+	return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+void Profiler::beginFrame()
+{
+	++frameNumber;
+	recording.store(enabled, std::memory_order_relaxed);
+
+	// Collect every older frame whose timestamps have landed, oldest first
+	for (uint64_t offset = GPU_LATENCY - 1; offset > 0; --offset)
+	{
+		if (frameNumber <= offset)
+		{
+			continue;
+		}
+		GpuFrame& frame = gpuFrames[(frameNumber - offset) % GPU_LATENCY];
+		if (frame.pending)
+		{
+			collectGpuFrame(frame);
+		}
+	}
+
+	// Still waiting after GPU_LATENCY frames, drop it rather than block on the results
+	GpuFrame& frame = gpuFrames[frameNumber % GPU_LATENCY];
+	if (frame.pending)
+	{
+		++droppedGpuFrames;
+	}
+	frame.zones.clear();
+	frame.pending = false;
+	frame.frameNumber = frameNumber;
+	gpuStack.clear();
+
+	if (recording)
+	{
+		// Reference point that maps GPU timestamps onto the CPU clock
+		frame.cpuReference = nowUs();
+		glGetInteger64v(GL_TIMESTAMP, &frame.gpuReference);
+	}
+
+	beginZone("Frame");
+}
+
+void Profiler::endFrame()
+{
+	endZone();
+
+	GpuFrame& frame = gpuFrames[frameNumber % GPU_LATENCY];
+	frame.pending = !frame.zones.empty();
+
+	{
+		std::lock_guard<std::mutex> lock(cpuMutex);
+		lastCpuFrame.swap(cpuZones);
+		cpuZones.clear();
+	}
+
+	if (recording)
+	{
+		for (const ProfileZone& zone : lastCpuFrame)
+		{
+			if (zone.thread == 0 && zone.depth == 0)
+			{
+				lastCpuFrameStart = zone.startUs;
+				lastCpuFrameDuration = zone.durationUs;
+			}
+		}
+		addFrameTotals(lastCpuFrame, cpuStats);
+
+		if (capturing && frameNumber >= captureFirstFrame && frameNumber <= captureLastFrame)
+		{
+			capturedZones.insert(capturedZones.end(), lastCpuFrame.begin(), lastCpuFrame.end());
+		}
+	}
+
+	// GPU results trail behind, stop once the last captured frame has been read or dropped
+	if (capturing && frameNumber >= captureLastFrame + GPU_LATENCY)
+	{
+		finishCapture();
+	}
+}
+
+void Profiler::beginCpuZone(const char* name)
+{
+	const bool record = recording.load(std::memory_order_relaxed);
+	cpuStack.push_back({ name, record ? nowUs() : 0.0, record });
+}
+
+void Profiler::endCpuZone()
+{
+	if (cpuStack.empty())
+	{
+		return;
+	}
+
+	const OpenCpuZone open = cpuStack.back();
+	cpuStack.pop_back();
+	if (!open.recording)
+	{
+		return;
+	}
+
+	ProfileZone zone{ open.name, static_cast<int>(cpuStack.size()), threadIndex, open.startUs, nowUs() - open.startUs };
+	std::lock_guard<std::mutex> lock(cpuMutex);
+	cpuZones.push_back(zone);
+}
+
+void Profiler::beginGpuZone(const char* name)
+{
+	GpuFrame& frame = gpuFrames[frameNumber % GPU_LATENCY];
+	if (!recording || frame.queries[0] == 0 || frame.zones.size() >= MAX_GPU_ZONES)
+	{
+		gpuStack.push_back(-1);
+		return;
+	}
+
+	const int index = static_cast<int>(frame.zones.size());
+	frame.zones.push_back({ name, static_cast<int>(gpuStack.size()) });
+	glQueryCounter(frame.queries[index * 2], GL_TIMESTAMP);
+	frame.lastQuery = frame.queries[index * 2];
+	gpuStack.push_back(index);
+}
+
+void Profiler::endGpuZone()
+{
+	if (gpuStack.empty())
+	{
+		return;
+	}
+
+	const int index = gpuStack.back();
+	gpuStack.pop_back();
+	if (index < 0)
+	{
+		return;
+	}
+
+	GpuFrame& frame = gpuFrames[frameNumber % GPU_LATENCY];
+	glQueryCounter(frame.queries[index * 2 + 1], GL_TIMESTAMP);
+	frame.lastQuery = frame.queries[index * 2 + 1];
+}
+
+void Profiler::beginZone(const char* name)
+{
+	beginCpuZone(name);
+	beginGpuZone(name);
+}
+
+void Profiler::endZone()
+{
+	endGpuZone();
+	endCpuZone();
+}
+
+void Profiler::collectGpuFrame(GpuFrame& frame)
+{
+	// Timestamps retire in order, so the last one issued being ready means the whole frame is
+	GLint available = 0;
+	glGetQueryObjectiv(frame.lastQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available)
+	{
+		return;
+	}
+
+	lastGpuFrame.clear();
+	for (size_t i = 0; i < frame.zones.size(); ++i)
+	{
+		GLuint64 start = 0;
+		GLuint64 end = 0;
+		glGetQueryObjectui64v(frame.queries[i * 2], GL_QUERY_RESULT, &start);
+		glGetQueryObjectui64v(frame.queries[i * 2 + 1], GL_QUERY_RESULT, &end);
+
+		const double startUs = frame.cpuReference + (static_cast<double>(start) - static_cast<double>(frame.gpuReference)) / 1000.0;
+		const double durationUs = end > start ? static_cast<double>(end - start) / 1000.0 : 0.0;
+		lastGpuFrame.push_back({ frame.zones[i].name, frame.zones[i].depth, GPU_TRACE_THREAD, startUs, durationUs });
+	}
+	frame.pending = false;
+
+	if (!lastGpuFrame.empty())
+	{
+		lastGpuFrameStart = lastGpuFrame[0].startUs;
+		lastGpuFrameDuration = lastGpuFrame[0].durationUs;
+	}
+	addFrameTotals(lastGpuFrame, gpuStats);
+
+	if (capturing && frame.frameNumber >= captureFirstFrame && frame.frameNumber <= captureLastFrame)
+	{
+		capturedZones.insert(capturedZones.end(), lastGpuFrame.begin(), lastGpuFrame.end());
+	}
+}
+
+void Profiler::captureTrace(const std::string& path, int frameCount)
+{
+	capturePath = path;
+	captureFirstFrame = frameNumber + 1;
+	captureLastFrame = frameNumber + std::max(frameCount, 1);
+	capturedZones.clear();
+	capturing = true;
+	lastTraceMessage.clear();
+}
+
+void Profiler::finishCapture()
+{
+	capturing = false;
+	if (writeChromeTrace(capturePath))
+	{
+		lastTraceMessage = "Wrote " + std::to_string(captureLastFrame - captureFirstFrame + 1) + " frames to " + capturePath;
+	}
+	else
+	{
+		lastTraceMessage = "Failed to write " + capturePath;
+	}
+	std::cout << lastTraceMessage << std::endl;
+	capturedZones.clear();
+}
+
+bool Profiler::writeChromeTrace(const std::string& path) const
+{
+	std::ofstream file(path, std::ios::trunc);
+	if (!file)
+	{
+		return false;
+	}
+
+	file << "{\"traceEvents\":[\n";
+	file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"Main\"}},\n";
+	file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << GPU_TRACE_THREAD << ",\"args\":{\"name\":\"GPU\"}}";
+
+	for (const ProfileZone& zone : capturedZones)
+	{
+		file << ",\n{\"name\":";
+		writeJsonString(file, zone.name);
+		file << ",\"cat\":\"" << (zone.thread == GPU_TRACE_THREAD ? "gpu" : "cpu") << "\",\"ph\":\"X\",\"ts\":" << zone.startUs
+			<< ",\"dur\":" << zone.durationUs << ",\"pid\":1,\"tid\":" << zone.thread << "}";
+	}
+	file << "\n],\"displayTimeUnit\":\"ms\"}\n";
+
+	return static_cast<bool>(file);
+}
+
+void Profiler::drawUI()
+{
+	if (!ImGui::Begin("Profiler"))
+	{
+		ImGui::End();
+		return;
+	}
+
+	ImGui::Checkbox("Enabled", &enabled);
+	ImGui::SameLine();
+	ImGui::BeginDisabled(capturing || !enabled);
+	if (ImGui::Button("Capture Chrome Trace"))
+	{
+		captureTrace("profile_trace.json", 120);
+	}
+	ImGui::EndDisabled();
+
+	if (capturing)
+	{
+		ImGui::Text("Capturing frames %llu-%llu...", static_cast<unsigned long long>(captureFirstFrame), static_cast<unsigned long long>(captureLastFrame));
+	}
+	else if (!lastTraceMessage.empty())
+	{
+		ImGui::TextUnformatted(lastTraceMessage.c_str());
+	}
+
+	auto cpuFrame = cpuStats.find("Frame");
+	auto gpuFrame = gpuStats.find("Frame");
+	if (cpuFrame != cpuStats.end())
+	{
+		const ZoneStats& stats = cpuFrame->second;
+		ImGui::Text("CPU frame: %.2f ms (avg %.2f, max %.2f)", stats.last, stats.average(), stats.max());
+
+		// Oldest sample first
+		std::array<float, ZoneStats::HISTORY_SIZE> history;
+		for (int i = 0; i < stats.count; ++i)
+		{
+			history[i] = stats.history[(stats.next - stats.count + i + ZoneStats::HISTORY_SIZE) % ZoneStats::HISTORY_SIZE];
+		}
+		ImGui::PlotLines("##cpuFrameHistory", history.data(), stats.count, 0, nullptr, 0.0f, 33.3f, ImVec2(ImGui::GetContentRegionAvail().x, 40.0f));
+	}
+	if (gpuFrame != gpuStats.end())
+	{
+		const ZoneStats& stats = gpuFrame->second;
+		ImGui::Text("GPU frame: %.2f ms (avg %.2f, max %.2f)", stats.last, stats.average(), stats.max());
+	}
+	if (droppedGpuFrames > 0)
+	{
+		ImGui::Text("Dropped GPU frames: %llu", static_cast<unsigned long long>(droppedGpuFrames));
+	}
+
+	if (ImGui::CollapsingHeader("CPU", ImGuiTreeNodeFlags_DefaultOpen))
+	{
+		drawTimeline("##cpuTimeline", lastCpuFrame, lastCpuFrameStart, lastCpuFrameDuration);
+		drawStatsTable("##cpuStats", lastCpuFrame, cpuStats);
+	}
+	if (ImGui::CollapsingHeader("GPU", ImGuiTreeNodeFlags_DefaultOpen))
+	{
+		drawTimeline("##gpuTimeline", lastGpuFrame, lastGpuFrameStart, lastGpuFrameDuration);
+		drawStatsTable("##gpuStats", lastGpuFrame, gpuStats);
+	}
+
+	ImGui::End();
+}
@@ -0,0 +1,540 @@
+#include "renderGraph.hpp"
+#include "profiler.hpp"
+#include "renderStats.hpp"
+
+#include "imgui.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace
+{
+	bool isDepthFormat(GLenum format)
+	{
+		switch (format)
+		{
+		case GL_DEPTH_COMPONENT16:
+		case GL_DEPTH_COMPONENT24:
+		case GL_DEPTH_COMPONENT32:
+		case GL_DEPTH_COMPONENT32F:
+		case GL_DEPTH24_STENCIL8:
+		case GL_DEPTH32F_STENCIL8:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	size_t bytesPerPixel(GLenum format)
+	{
+		switch (format)
+		{
+		case GL_R8: return 1;
+		case GL_RG8: case GL_R16F: case GL_DEPTH_COMPONENT16: return 2;
+		case GL_RGBA8: case GL_SRGB8_ALPHA8: case GL_RG16F: case GL_R32F: case GL_R11F_G11F_B10F:
+		case GL_DEPTH_COMPONENT24: case GL_DEPTH_COMPONENT32: case GL_DEPTH_COMPONENT32F: case GL_DEPTH24_STENCIL8: return 4;
+		case GL_RGBA16F: case GL_RG32F: case GL_DEPTH32F_STENCIL8: return 8;
+		case GL_RGBA32F: return 16;
+		default: return 4;
+		}
+	}
+
+	const char* formatName(GLenum format)
+	{
+		switch (format)
+		{
+		case GL_R8: return "R8";
+		case GL_RG8: return "RG8";
+		case GL_R16F: return "R16F";
+		case GL_RGBA8: return "RGBA8";
+		case GL_SRGB8_ALPHA8: return "SRGB8_A8";
+		case GL_RG16F: return "RG16F";
+		case GL_R32F: return "R32F";
+		case GL_R11F_G11F_B10F: return "R11G11B10F";
+		case GL_RGBA16F: return "RGBA16F";
+		case GL_RG32F: return "RG32F";
+		case GL_RGBA32F: return "RGBA32F";
+		case GL_DEPTH_COMPONENT16: return "D16";
+		case GL_DEPTH_COMPONENT24: return "D24";
+		case GL_DEPTH_COMPONENT32: return "D32";
+		case GL_DEPTH_COMPONENT32F: return "D32F";
+		case GL_DEPTH24_STENCIL8: return "D24S8";
+		case GL_DEPTH32F_STENCIL8: return "D32FS8";
+		default: return "?";
+		}
+	}
+
+	size_t textureBytes(const RenderGraphTextureDesc& desc)
+	{
+		size_t bytes = 0;
+		for (int level = 0; level < desc.levels; ++level)
+		{
+			bytes += static_cast<size_t>(std::max(desc.width >> level, 1)) * std::max(desc.height >> level, 1) * bytesPerPixel(desc.internalFormat);
+		}
+		return bytes;
+	}
+
+	GLuint createTexture(const RenderGraphTextureDesc& desc)
+	{
+		GLuint texture;
+		glCreateTextures(GL_TEXTURE_2D, 1, &texture);
+		glTextureStorage2D(texture, desc.levels, desc.internalFormat, desc.width, desc.height);
+		const GLenum minFilter = desc.levels == 1 ? desc.filter : (desc.filter == GL_LINEAR ? GL_LINEAR_MIPMAP_NEAREST : GL_NEAREST_MIPMAP_NEAREST);
+		glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, minFilter);
+		glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, desc.filter);
+		glTextureParameteri(texture, GL_TEXTURE_WRAP_S, desc.wrap);
+		glTextureParameteri(texture, GL_TEXTURE_WRAP_T, desc.wrap);
+		if (desc.wrap == GL_CLAMP_TO_BORDER)
+		{
+			const float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+			glTextureParameterfv(texture, GL_TEXTURE_BORDER_COLOR, borderColor);
+		}
+		return texture;
+	}
+}
+
+RenderGraphTexture RenderGraph::Builder::create(const char* name, const RenderGraphTextureDesc& desc)
+{
+	const uint32_t index = static_cast<uint32_t>(graph.textures.size());
+	TextureNode node;
+	node.name = name;
+	node.desc = desc;
+	node.producer = pass;
+	graph.textures.push_back(node);
+
+	graph.passes[pass].creates.push_back(index);
+	graph.passes[pass].writes.push_back(index);
+	return { index };
+}
+
+RenderGraphTexture RenderGraph::Builder::read(RenderGraphTexture texture)
+{
+	graph.passes[pass].reads.push_back(texture.index);
+	return texture;
+}
+
+RenderGraphTexture RenderGraph::Builder::write(RenderGraphTexture texture)
+{
+	graph.passes[pass].writes.push_back(texture.index);
+	return texture;
+}
+
+void RenderGraph::Builder::sideEffect()
+{
+	graph.passes[pass].sideEffect = true;
+}
+
+void RenderGraph::Builder::compute()
+{
+	graph.passes[pass].compute = true;
+}
+
+GLuint RenderGraph::Context::texture(RenderGraphTexture texture) const
+{
+	const TextureNode& node = graph.textures[texture.index];
+	return node.isImported ? node.imported : graph.pool[node.physical].id;
+}
+
+RenderGraph::~RenderGraph()
+{
+	for (const PhysicalTexture& texture : pool)
+	{
+		glState.deleteTextures(1, &texture.id);
+	}
+	for (const auto& [attachments, framebuffer] : framebuffers)
+	{
+		glState.deleteFramebuffers(1, &framebuffer);
+	}
+}
+
+void RenderGraph::reset()
+{
+	textures.clear();
+	passes.clear();
+	compiled = false;
+}
+
+RenderGraphTexture RenderGraph::import(const char* name, GLuint texture, const RenderGraphTextureDesc& desc)
+{
+	TextureNode node;
+	node.name = name;
+	node.desc = desc;
+	node.imported = texture;
+	node.isImported = true;
+	textures.push_back(node);
+	return { static_cast<uint32_t>(textures.size() - 1) };
+}
+
+void RenderGraph::addPass(const char* name, const SetupFunction& setup, ExecuteFunction execute)
+{
+	PassNode node;
+	node.name = name;
+	node.execute = std::move(execute);
+	passes.push_back(std::move(node));
+
+	Builder builder{ *this, static_cast<uint32_t>(passes.size() - 1) };
+	setup(builder);
+}
+
+void RenderGraph::compile()
+{
+	// Walk backwards keeping the set of textures a later live pass still needs. Imported textures are
+	// always needed, and drawing on top of a texture needs whatever earlier passes put there.
+	std::vector<bool> needed(textures.size());
+	for (size_t i = 0; i < textures.size(); ++i)
+	{
+		needed[i] = textures[i].isImported;
+	}
+
+	for (size_t p = passes.size(); p-- > 0;)
+	{
+		PassNode& pass = passes[p];
+		pass.culled = !pass.sideEffect && std::none_of(pass.writes.begin(), pass.writes.end(), [&](uint32_t t) { return needed[t]; });
+		if (pass.culled)
+		{
+			continue;
+		}
+
+		for (uint32_t t : pass.reads)
+		{
+			needed[t] = true;
+		}
+		for (uint32_t t : pass.writes)
+		{
+			if (std::find(pass.creates.begin(), pass.creates.end(), t) == pass.creates.end())
+			{
+				needed[t] = true;
+			}
+		}
+	}
+
+	// Lifetimes only span live passes
+	for (uint32_t p = 0; p < passes.size(); ++p)
+	{
+		if (passes[p].culled)
+		{
+			continue;
+		}
+
+		auto touch = [&](uint32_t t)
+		{
+			textures[t].firstPass = std::min(textures[t].firstPass, p);
+			textures[t].lastPass = std::max(textures[t].lastPass, p);
+		};
+		std::for_each(passes[p].reads.begin(), passes[p].reads.end(), touch);
+		std::for_each(passes[p].writes.begin(), passes[p].writes.end(), touch);
+	}
+
+	// Flags still describe the previous frame here
+	releaseUnused();
+	for (PhysicalTexture& texture : pool)
+	{
+		texture.usedThisFrame = false;
+		texture.busyUntil = 0;
+	}
+
+	// Place transients in creation order, a pooled texture is free once the last pass of its current owner ran
+	requestedBytes = 0;
+	allocatedBytes = 0;
+	for (uint32_t p = 0; p < passes.size(); ++p)
+	{
+		if (passes[p].culled)
+		{
+			continue;
+		}
+
+		for (uint32_t t : passes[p].creates)
+		{
+			TextureNode& node = textures[t];
+			requestedBytes += textureBytes(node.desc);
+
+			auto free = std::find_if(pool.begin(), pool.end(), [&](const PhysicalTexture& texture)
+			{
+				return texture.desc == node.desc && (!texture.usedThisFrame || texture.busyUntil < p);
+			});
+			if (free == pool.end())
+			{
+				PhysicalTexture texture;
+				texture.id = createTexture(node.desc);
+				texture.desc = node.desc;
+				pool.push_back(texture);
+				free = pool.end() - 1;
+			}
+
+			if (!free->usedThisFrame)
+			{
+				allocatedBytes += textureBytes(free->desc);
+			}
+			free->usedThisFrame = true;
+			free->unusedFrames = 0;
+			free->busyUntil = node.lastPass;
+			node.physical = static_cast<int>(free - pool.begin());
+		}
+	}
+
+	compiled = true;
+}
+
+GLuint RenderGraph::framebufferFor(const PassNode& pass, int& width, int& height)
+{
+	width = 0;
+	height = 0;
+	if (pass.compute)
+	{
+		return 0;
+	}
+
+	std::vector<GLuint> colors;
+	GLuint depth = 0;
+	for (uint32_t t : pass.writes)
+	{
+		const TextureNode& node = textures[t];
+		if (node.isImported && node.imported == 0)
+		{
+			// Default framebuffer, cannot be combined with textures
+			width = node.desc.width;
+			height = node.desc.height;
+			return 0;
+		}
+
+		const GLuint id = node.isImported ? node.imported : pool[node.physical].id;
+		if (isDepthFormat(node.desc.internalFormat))
+		{
+			depth = id;
+		}
+		else
+		{
+			colors.push_back(id);
+		}
+
+		if (width == 0)
+		{
+			width = node.desc.width;
+			height = node.desc.height;
+		}
+	}
+
+	if (colors.empty() && depth == 0)
+	{
+		return 0;
+	}
+
+	std::vector<GLuint> key = colors;
+	key.push_back(depth);
+	auto found = framebuffers.find(key);
+	if (found != framebuffers.end())
+	{
+		return found->second;
+	}
+
+	GLuint framebuffer;
+	glCreateFramebuffers(1, &framebuffer);
+
+	std::vector<GLenum> drawBuffers;
+	for (size_t i = 0; i < colors.size(); ++i)
+	{
+		glNamedFramebufferTexture(framebuffer, static_cast<GLenum>(GL_COLOR_ATTACHMENT0 + i), colors[i], 0);
+		drawBuffers.push_back(static_cast<GLenum>(GL_COLOR_ATTACHMENT0 + i));
+	}
+	if (depth)
+	{
+		glNamedFramebufferTexture(framebuffer, GL_DEPTH_ATTACHMENT, depth, 0);
+	}
+
+	if (drawBuffers.empty())
+	{
+		glNamedFramebufferDrawBuffer(framebuffer, GL_NONE);
+		glNamedFramebufferReadBuffer(framebuffer, GL_NONE);
+	}
+	else
+	{
+		glNamedFramebufferDrawBuffers(framebuffer, static_cast<GLsizei>(drawBuffers.size()), drawBuffers.data());
+	}
+
+	if (glCheckNamedFramebufferStatus(framebuffer, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	{
+		std::cout << "Render graph framebuffer for " << pass.name << " incomplete!" << std::endl;
+	}
+
+	framebuffers[key] = framebuffer;
+	return framebuffer;
+}
+
+void RenderGraph::execute()
+{
+	if (!compiled)
+	{
+		compile();
+	}
+
+	for (PassNode& pass : passes)
+	{
+		if (pass.culled)
+		{
+			continue;
+		}
+
+		profiler.beginZone(pass.name);
+		renderStats.beginPass(pass.name);
+
+		int width;
+		int height;
+		const GLuint framebuffer = framebufferFor(pass, width, height);
+		if (!pass.compute)
+		{
+			countedBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		}
+		if (width > 0)
+		{
+			glViewport(0, 0, width, height);
+		}
+
+		pass.execute(Context{ *this, width, height });
+
+		renderStats.endPass();
+		profiler.endZone();
+	}
+	countedBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void RenderGraph::releaseUnused()
+{
+	for (size_t i = 0; i < pool.size();)
+	{
+		PhysicalTexture& texture = pool[i];
+		if (!texture.usedThisFrame && ++texture.unusedFrames > poolFrameLimit)
+		{
+			forget(texture.id);
+			glState.deleteTextures(1, &texture.id);
+			pool.erase(pool.begin() + i);
+		}
+		else
+		{
+			++i;
+		}
+	}
+
+}
+
+void RenderGraph::forget(GLuint texture)
+{
+	if (texture == 0)
+	{
+		return;
+	}
+
+	for (auto it = framebuffers.begin(); it != framebuffers.end();)
+	{
+		if (std::find(it->first.begin(), it->first.end(), texture) != it->first.end())
+		{
+			glState.deleteFramebuffers(1, &it->second);
+			it = framebuffers.erase(it);
+		}
+		else
+		{
+			++it;
+		}
+	}
+}
+
+std::string RenderGraph::toDot() const
+{
+	std::ostringstream dot;
+	dot << "digraph RenderGraph {\n";
+	dot << "\trankdir=LR;\n";
+	dot << "\tnode [fontname=\"Helvetica\"];\n";
+
+	for (size_t p = 0; p < passes.size(); ++p)
+	{
+		const PassNode& pass = passes[p];
+		dot << "\tpass" << p << " [shape=box, label=\"" << pass.name << (pass.culled ? "\\n(culled)" : "") << "\"";
+		dot << (pass.culled ? ", style=dashed" : ", style=filled, fillcolor=lightblue") << "];\n";
+	}
+
+	for (size_t t = 0; t < textures.size(); ++t)
+	{
+		const TextureNode& node = textures[t];
+		dot << "\ttex" << t << " [shape=ellipse, label=\"" << node.name << "\\n" << node.desc.width << "x" << node.desc.height << " " << formatName(node.desc.internalFormat);
+		if (node.isImported)
+		{
+			dot << "\\nimported";
+		}
+		else if (node.physical >= 0)
+		{
+			dot << "\\npool slot " << node.physical;
+		}
+		dot << "\"];\n";
+	}
+
+	for (size_t p = 0; p < passes.size(); ++p)
+	{
+		for (uint32_t t : passes[p].reads)
+		{
+			dot << "\ttex" << t << " -> pass" << p << ";\n";
+		}
+		for (uint32_t t : passes[p].writes)
+		{
+			dot << "\tpass" << p << " -> tex" << t << " [color=red];\n";
+		}
+	}
+
+	dot << "}\n";
+	return dot.str();
+}
+
+bool RenderGraph::writeDot(const std::string& path) const
+{
+	std::ofstream file(path);
+	if (!file)
+	{
+		std::cout << "Failed to write render graph to " << path << std::endl;
+		return false;
+	}
+	file << toDot();
+	std::cout << "Render graph written to " << path << std::endl;
+	return true;
+}
+
+void RenderGraph::drawUI()
+{
+	if (!ImGui::Begin("Render Graph"))
+	{
+		ImGui::End();
+		return;
+	}
+
+	if (ImGui::Button("Write render_graph.dot"))
+	{
+		writeDot("render_graph.dot");
+	}
+
+	const size_t culled = std::count_if(passes.begin(), passes.end(), [](const PassNode& pass) { return pass.culled; });
+	ImGui::Text("Passes: %zu (%zu culled)", passes.size(), culled);
+	ImGui::Text("Transient textures: %.1f MB requested, %.1f MB allocated", requestedBytes / (1024.0f * 1024.0f), allocatedBytes / (1024.0f * 1024.0f));
+	ImGui::Text("Pool: %zu textures", pool.size());
+
+	ImGui::Separator();
+	for (const PassNode& pass : passes)
+	{
+		ImGui::BeginDisabled(pass.culled);
+		ImGui::BulletText("%s%s", pass.name, pass.culled ? " (culled)" : "");
+		ImGui::EndDisabled();
+	}
+
+	ImGui::Separator();
+	for (const TextureNode& node : textures)
+	{
+		if (node.isImported)
+		{
+			ImGui::BulletText("%s: %dx%d imported", node.name, node.desc.width, node.desc.height);
+		}
+		else
+		{
+			ImGui::BulletText("%s: %dx%d %s, slot %d", node.name, node.desc.width, node.desc.height, formatName(node.desc.internalFormat), node.physical);
+		}
+	}
+
+	ImGui::End();
+}
@@ -0,0 +1,156 @@
+#include "renderQueue.hpp"
+#include "mesh.hpp"
+#include "model.hpp"
+#include "renderStats.hpp"
+
+#include <algorithm>
+#include <array>
+
+void RadixSortDrawKeys(std::vector<DrawSortEntry>& entries, std::vector<DrawSortEntry>& scratch)
+{
+	const size_t count = entries.size();
+	if (count < 2)
+	{
+		return;
+	}
+
+	// One histogram per key byte, all filled in a single read of the keys
+	std::array<std::array<uint32_t, 256>, 8> histograms{};
+	for (const DrawSortEntry& entry : entries)
+	{
+		for (int byte = 0; byte < 8; ++byte)
+		{
+			++histograms[byte][(entry.key >> (byte * 8)) & 0xFF];
+		}
+	}
+
+	scratch.resize(count);
+	DrawSortEntry* source = entries.data();
+	DrawSortEntry* destination = scratch.data();
+	for (int byte = 0; byte < 8; ++byte)
+	{
+		std::array<uint32_t, 256>& histogram = histograms[byte];
+		const int shift = byte * 8;
+		if (histogram[(source[0].key >> shift) & 0xFF] == count)
+		{
+			continue;
+		}
+
+		uint32_t offset = 0;
+		for (uint32_t& bucket : histogram)
+		{
+			const uint32_t bucketCount = bucket;
+			bucket = offset;
+			offset += bucketCount;
+		}
+
+		for (size_t i = 0; i < count; ++i)
+		{
+			destination[histogram[(source[i].key >> shift) & 0xFF]++] = source[i];
+		}
+		std::swap(source, destination);
+	}
+
+	if (source != entries.data())
+	{
+		std::copy(source, source + count, entries.data());
+	}
+}
+
+void RenderQueue::clear()
+{
+	items.clear();
+	entries.clear();
+}
+
+uint64_t RenderQueue::keyFor(RenderPassId pass, const Model& model, const Mesh& mesh, float depth) const
+{
+	const uint32_t variant = mesh.textureMask | (model.hasTextures ? 1u << 7 : 0u);
+	const float normalizedDepth = std::clamp(depth / depthRange, 0.0f, 1.0f);
+	const uint32_t depthBucket = static_cast<uint32_t>(normalizedDepth * (DrawKey::DEPTH_BUCKETS - 1));
+	return DrawKey::make(pass, variant, mesh.materialId, mesh.VAO, depthBucket);
+}
+
+void RenderQueue::addModel(RenderPassId pass, const Model& model, uint32_t instanceCount, float depth, uint32_t baseInstance)
+{
+	for (const Mesh& mesh : model.meshes)
+	{
+		addMesh(pass, model, mesh, instanceCount, baseInstance, depth);
+	}
+}
+
+void RenderQueue::addMesh(RenderPassId pass, const Model& model, const Mesh& mesh, uint32_t instanceCount, uint32_t baseInstance, float depth)
+{
+	if (instanceCount == 0)
+	{
+		return;
+	}
+
+	entries.push_back({ keyFor(pass, model, mesh, depth), static_cast<uint32_t>(items.size()) });
+	items.push_back({ &model, &mesh, instanceCount, baseInstance, 0, 0 });
+}
+
+void RenderQueue::addIndirect(RenderPassId pass, const Model& model, const Mesh& mesh, GLuint commandBuffer, GLintptr commandOffset, float depth)
+{
+	entries.push_back({ keyFor(pass, model, mesh, depth), static_cast<uint32_t>(items.size()) });
+	items.push_back({ &model, &mesh, 0, 0, commandBuffer, commandOffset });
+}
+
+void RenderQueue::sort()
+{
+	RadixSortDrawKeys(entries, scratch);
+}
+
+void RenderQueue::submit(RenderPassId pass, Shader& shader) const
+{
+	// Entries are sorted with the pass in the top bits, so a pass is one contiguous run
+	const auto first = std::lower_bound(entries.begin(), entries.end(), pass,
+		[](const DrawSortEntry& entry, RenderPassId value) { return DrawKey::pass(entry.key) < value; });
+	const auto last = std::upper_bound(first, entries.end(), pass,
+		[](RenderPassId value, const DrawSortEntry& entry) { return value < DrawKey::pass(entry.key); });
+	if (first == last)
+	{
+		return;
+	}
+
+	// What the previous draw left bound, nothing is assumed about the state before the first one
+	int boundHasTextures = -1;
+	uint32_t boundMaterial = UINT32_MAX;
+	GLuint boundVAO = UINT32_MAX;
+
+	for (auto it = first; it != last; ++it)
+	{
+		const Item& item = items[it->item];
+		const Mesh& mesh = *item.mesh;
+
+		if (static_cast<int>(item.model->hasTextures) != boundHasTextures)
+		{
+			boundHasTextures = item.model->hasTextures ? 1 : 0;
+			shader.setBool("hasTextures", item.model->hasTextures);
+		}
+		if (mesh.materialId != boundMaterial)
+		{
+			boundMaterial = mesh.materialId;
+			mesh.bindTextures(shader);
+		}
+		if (mesh.VAO != boundVAO)
+		{
+			boundVAO = mesh.VAO;
+			countedBindVertexArray(mesh.VAO);
+		}
+
+		if (item.indirectBuffer)
+		{
+			glState.bindDrawIndirectBuffer(item.indirectBuffer);
+			countedDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, reinterpret_cast<const void*>(item.indirectOffset));
+		}
+		else if (item.baseInstance == 0)
+		{
+			countedDrawElementsInstanced(GL_TRIANGLES, static_cast<GLsizei>(mesh.indexCount), GL_UNSIGNED_INT, 0, static_cast<GLsizei>(item.instanceCount));
+		}
+		else
+		{
+			countedDrawElementsInstancedBaseInstance(GL_TRIANGLES, static_cast<GLsizei>(mesh.indexCount), GL_UNSIGNED_INT, 0, static_cast<GLsizei>(item.instanceCount), item.baseInstance);
+		}
+	}
+}
@@ -0,0 +1,179 @@
+#include "renderStats.hpp"
+
+#include "imgui.h"
+
+#include <cstring>
+#include <sstream>
+
+RenderStats renderStats;
+
+namespace
+{
+	void writeCounters(std::ostringstream& out, const RenderCounters& counters, double frames)
+	{
+		const double scale = frames > 0.0 ? 1.0 / frames : 0.0;
+		out << "\"drawCalls\":" << counters.drawCalls * scale
+			<< ",\"instances\":" << counters.instances * scale
+			<< ",\"triangles\":" << counters.triangles * scale
+			<< ",\"programBinds\":" << counters.programBinds * scale
+			<< ",\"vaoBinds\":" << counters.vaoBinds * scale
+			<< ",\"textureBinds\":" << counters.textureBinds * scale
+			<< ",\"uniformUpdates\":" << counters.uniformUpdates * scale
+			<< ",\"bufferBytesUploaded\":" << counters.bufferBytesUploaded * scale
+			<< ",\"framebufferBinds\":" << counters.framebufferBinds * scale
+			<< ",\"redundantCalls\":" << counters.redundantCalls * scale;
+	}
+
+	void counterRow(const char* name, const RenderCounters& counters)
+	{
+		ImGui::TableNextRow();
+		ImGui::TableNextColumn();
+		ImGui::TextUnformatted(name);
+		const uint64_t values[] = { counters.drawCalls, counters.instances, counters.triangles, counters.programBinds,
+			counters.vaoBinds, counters.textureBinds, counters.uniformUpdates, counters.framebufferBinds, counters.redundantCalls };
+		for (uint64_t value : values)
+		{
+			ImGui::TableNextColumn();
+			ImGui::Text("%llu", static_cast<unsigned long long>(value));
+		}
+		ImGui::TableNextColumn();
+		ImGui::Text("%.1f", counters.bufferBytesUploaded / 1024.0);
+	}
+}
+
+RenderCounters& RenderCounters::operator+=(const RenderCounters& other)
+{
+	drawCalls += other.drawCalls;
+	instances += other.instances;
+	triangles += other.triangles;
+	programBinds += other.programBinds;
+	vaoBinds += other.vaoBinds;
+	textureBinds += other.textureBinds;
+	uniformUpdates += other.uniformUpdates;
+	bufferBytesUploaded += other.bufferBytesUploaded;
+	framebufferBinds += other.framebufferBinds;
+	redundantCalls += other.redundantCalls;
+	return *this;
+}
+
+int RenderStats::findPass(const char* name)
+{
+	for (int i = 0; i < static_cast<int>(passes.size()); ++i)
+	{
+		if (passes[i].name == name || std::strcmp(passes[i].name, name) == 0)
+		{
+			return i;
+		}
+	}
+	passes.push_back({ name, {} });
+	return static_cast<int>(passes.size()) - 1;
+}
+
+void RenderStats::beginFrame()
+{
+	// Keep the pass list so the table order is stable from frame to frame
+	for (PassCounters& pass : passes)
+	{
+		pass.counters = {};
+	}
+	currentPass = 0;
+}
+
+void RenderStats::endFrame()
+{
+	lastPasses = passes;
+	lastTotals = {};
+	for (const PassCounters& pass : passes)
+	{
+		lastTotals += pass.counters;
+	}
+
+	for (const PassCounters& pass : passes)
+	{
+		bool found = false;
+		for (PassCounters& accumulated : accumulatedPasses)
+		{
+			if (std::strcmp(accumulated.name, pass.name) == 0)
+			{
+				accumulated.counters += pass.counters;
+				found = true;
+				break;
+			}
+		}
+		if (!found)
+		{
+			accumulatedPasses.push_back(pass);
+		}
+	}
+	accumulatedTotals += lastTotals;
+	++accumulatedFrames;
+}
+
+void RenderStats::beginPass(const char* name)
+{
+	currentPass = findPass(name);
+}
+
+void RenderStats::endPass()
+{
+	currentPass = 0;
+}
+
+void RenderStats::resetAverages()
+{
+	accumulatedPasses.clear();
+	accumulatedTotals = {};
+	accumulatedFrames = 0;
+}
+
+std::string RenderStats::toJson() const
+{
+	const double frames = static_cast<double>(accumulatedFrames);
+
+	std::ostringstream out;
+	out << "{\"frames\":" << accumulatedFrames << ",\"perFrame\":{";
+	writeCounters(out, accumulatedTotals, frames);
+	out << "},\"passes\":[";
+	for (size_t i = 0; i < accumulatedPasses.size(); ++i)
+	{
+		out << (i > 0 ? "," : "") << "{\"name\":\"" << accumulatedPasses[i].name << "\",";
+		writeCounters(out, accumulatedPasses[i].counters, frames);
+		out << "}";
+	}
+	out << "]}";
+	return out.str();
+}
+
+void RenderStats::drawUI()
+{
+	if (!ImGui::Begin("Render Stats"))
+	{
+		ImGui::End();
+		return;
+	}
+
+	if (ImGui::BeginTable("##renderStats", 11, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingFixedFit))
+	{
+		ImGui::TableSetupColumn("Pass");
+		ImGui::TableSetupColumn("Draws");
+		ImGui::TableSetupColumn("Instances");
+		ImGui::TableSetupColumn("Triangles");
+		ImGui::TableSetupColumn("Programs");
+		ImGui::TableSetupColumn("VAOs");
+		ImGui::TableSetupColumn("Textures");
+		ImGui::TableSetupColumn("Uniforms");
+		ImGui::TableSetupColumn("FBOs");
+		ImGui::TableSetupColumn("Skipped");
+		ImGui::TableSetupColumn("Upload KB");
+		ImGui::TableHeadersRow();
+
+		for (const PassCounters& pass : lastPasses)
+		{
+			counterRow(pass.name, pass.counters);
+		}
+		counterRow("Frame", lastTotals);
+		ImGui::EndTable();
+	}
+
+	ImGui::End();
+}
@@ -0,0 +1,318 @@
+#include <glad/glad.h>
+
+#include "scene.hpp"
+#include "model.hpp"
+#include "jobSystem.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+
+glm::mat4 Transform::toMatrix() const
+{
+	glm::mat4 transform(1.0f);
+	transform = glm::translate(transform, position);
+	transform = glm::rotate(transform, glm::radians(rotation.x), glm::vec3(1, 0, 0));
+	transform = glm::rotate(transform, glm::radians(rotation.y), glm::vec3(0, 1, 0));
+	transform = glm::rotate(transform, glm::radians(rotation.z), glm::vec3(0, 0, 1));
+	transform = glm::scale(transform, glm::vec3(scale));
+	return transform;
+}
+
+uint32_t Scene::registerModel(std::shared_ptr<Model> model)
+{
+	for (uint32_t i = 0; i < models.size(); ++i)
+	{
+		if (models[i] == model)
+		{
+			return i;
+		}
+	}
+
+	// A model that failed to load has no vertices, give it a point so it still has usable bounds
+	const AABB bounds = model->bounds.valid() ? model->bounds : AABB{ glm::vec3(0.0f), glm::vec3(0.0f) };
+	for (uint32_t i = 0; i < models.size(); ++i)
+	{
+		if (!models[i])
+		{
+			models[i] = std::move(model);
+			modelBounds[i] = bounds;
+			return i;
+		}
+	}
+
+	modelBounds.push_back(bounds);
+	models.push_back(std::move(model));
+	modelInstanceCounts.push_back(0);
+	return static_cast<uint32_t>(models.size() - 1);
+}
+
+void Scene::releaseModel(uint32_t modelId)
+{
+	if (modelId < models.size() && modelInstanceCounts[modelId] == 0)
+	{
+		models[modelId].reset();
+	}
+}
+
+EntityHandle Scene::create(uint32_t modelId, std::string_view name, const Transform& transform)
+{
+	uint32_t slot;
+	if (!freeSlots.empty())
+	{
+		slot = freeSlots.back();
+		freeSlots.pop_back();
+	}
+	else
+	{
+		slot = static_cast<uint32_t>(sparseToDense.size());
+		sparseToDense.push_back(0);
+		generations.push_back(0);
+	}
+
+	const uint32_t dense = static_cast<uint32_t>(size());
+	sparseToDense[slot] = dense;
+	denseToSparse.push_back(slot);
+
+	const glm::mat4 world = transform.toMatrix();
+	const AABB bounds = modelBounds[modelId].transformed(world);
+
+	transforms.push_back(transform);
+	worldMatrices.push_back(world);
+	previousWorldMatrices.push_back(world);
+	modelIds.push_back(modelId);
+	visible.push_back(1);
+	nameIds.push_back(internName(name));
+	worldBounds.push_back(bounds);
+	dirty.push_back(0);
+	bvhLeaves.push_back(bvh.insert(slot, bounds));
+
+	++modelInstanceCounts[modelId];
+	return { slot, generations[slot] };
+}
+
+void Scene::destroy(EntityHandle handle)
+{
+	if (!isValid(handle))
+	{
+		return;
+	}
+
+	const uint32_t dense = sparseToDense[handle.index];
+	const uint32_t last = static_cast<uint32_t>(size() - 1);
+	--modelInstanceCounts[modelIds[dense]];
+	bvh.remove(bvhLeaves[dense]);
+
+	// Move the last entity into the hole, then drop the tail
+	if (dense != last)
+	{
+		transforms[dense] = transforms[last];
+		worldMatrices[dense] = worldMatrices[last];
+		previousWorldMatrices[dense] = previousWorldMatrices[last];
+		modelIds[dense] = modelIds[last];
+		visible[dense] = visible[last];
+		nameIds[dense] = nameIds[last];
+		worldBounds[dense] = worldBounds[last];
+		dirty[dense] = dirty[last];
+		bvhLeaves[dense] = bvhLeaves[last];
+		denseToSparse[dense] = denseToSparse[last];
+		sparseToDense[denseToSparse[dense]] = dense;
+	}
+
+	transforms.pop_back();
+	worldMatrices.pop_back();
+	previousWorldMatrices.pop_back();
+	modelIds.pop_back();
+	visible.pop_back();
+	nameIds.pop_back();
+	worldBounds.pop_back();
+	dirty.pop_back();
+	bvhLeaves.pop_back();
+	denseToSparse.pop_back();
+
+	++generations[handle.index];
+	freeSlots.push_back(handle.index);
+}
+
+void Scene::clear()
+{
+	// Bump every live generation so outstanding handles are invalidated
+	for (uint32_t slot : denseToSparse)
+	{
+		++generations[slot];
+		freeSlots.push_back(slot);
+	}
+
+	transforms.clear();
+	worldMatrices.clear();
+	previousWorldMatrices.clear();
+	moved.clear();
+	modelIds.clear();
+	visible.clear();
+	nameIds.clear();
+	worldBounds.clear();
+	dirty.clear();
+	bvhLeaves.clear();
+	bvh.clear();
+	denseToSparse.clear();
+	std::fill(modelInstanceCounts.begin(), modelInstanceCounts.end(), 0);
+}
+
+bool Scene::isValid(EntityHandle handle) const
+{
+	return handle.index < generations.size() && generations[handle.index] == handle.generation &&
+		sparseToDense[handle.index] < size() && denseToSparse[sparseToDense[handle.index]] == handle.index;
+}
+
+void Scene::updateWorldMatrices()
+{
+	// Removals may have swapped other entities into these slots, which only costs them a frame of motion
+	const size_t count = size();
+	for (uint32_t i : moved)
+	{
+		if (i < count)
+		{
+			previousWorldMatrices[i] = worldMatrices[i];
+		}
+	}
+	moved.clear();
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		if (dirty[i])
+		{
+			moved.push_back(static_cast<uint32_t>(i));
+		}
+	}
+
+	jobSystem.parallelFor(0, moved.size(), 256, [this](size_t begin, size_t end)
+	{
+		for (size_t m = begin; m < end; ++m)
+		{
+			const uint32_t i = moved[m];
+			previousWorldMatrices[i] = worldMatrices[i];
+			worldMatrices[i] = transforms[i].toMatrix();
+			worldBounds[i] = modelBounds[modelIds[i]].transformed(worldMatrices[i]);
+		}
+	});
+
+	for (uint32_t i : moved)
+	{
+		bvh.move(bvhLeaves[i], worldBounds[i]);
+		dirty[i] = 0;
+	}
+}
+
+void Scene::buildRenderLists(std::vector<std::vector<InstanceData>>& instancesPerModel, RenderListBuckets& buckets, const Frustum* frustum) const
+{
+	// Chunks are BVH subtrees overlapping the frustum, or runs of the dense arrays without one
+	constexpr size_t CHUNK_SIZE = 4096;
+	size_t chunkCount;
+	if (frustum)
+	{
+		bvh.splitFrustum(*frustum, static_cast<size_t>(jobSystem.threadCount()) * 4, buckets.subtrees);
+		chunkCount = buckets.subtrees.size();
+	}
+	else
+	{
+		chunkCount = (size() + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	}
+
+	const size_t modelCount = models.size();
+	if (buckets.entities.size() < chunkCount)
+	{
+		buckets.entities.resize(chunkCount);
+	}
+	buckets.offsets.assign(chunkCount * modelCount, 0);
+
+	// Each chunk collects its visible entities into its own bucket and counts them per model
+	jobSystem.parallelFor(0, chunkCount, 1, [&](size_t begin, size_t end)
+	{
+		for (size_t chunk = begin; chunk < end; ++chunk)
+		{
+			std::vector<uint32_t>& entities = buckets.entities[chunk];
+			entities.clear();
+			if (frustum)
+			{
+				bvh.queryFrustum(*frustum, buckets.subtrees[chunk], entities);
+				for (uint32_t& entity : entities)
+				{
+					entity = sparseToDense[entity];
+				}
+				std::erase_if(entities, [this](uint32_t dense) { return !visible[dense]; });
+			}
+			else
+			{
+				const uint32_t last = static_cast<uint32_t>(std::min((chunk + 1) * CHUNK_SIZE, size()));
+				for (uint32_t dense = static_cast<uint32_t>(chunk * CHUNK_SIZE); dense < last; ++dense)
+				{
+					if (visible[dense])
+					{
+						entities.push_back(dense);
+					}
+				}
+			}
+
+			uint32_t* counts = &buckets.offsets[chunk * modelCount];
+			for (uint32_t dense : entities)
+			{
+				++counts[modelIds[dense]];
+			}
+		}
+	});
+
+	// Counts become each chunk's write position in each model's list, model by model then chunk by chunk,
+	// so the merge needs no locks and the lists come out in the same order on every run
+	instancesPerModel.resize(modelCount);
+	for (size_t modelId = 0; modelId < modelCount; ++modelId)
+	{
+		uint32_t total = 0;
+		for (size_t chunk = 0; chunk < chunkCount; ++chunk)
+		{
+			uint32_t& offset = buckets.offsets[chunk * modelCount + modelId];
+			const uint32_t count = offset;
+			offset = total;
+			total += count;
+		}
+		// Existing elements are overwritten below, only growth pays for initialisation
+		instancesPerModel[modelId].resize(total);
+	}
+
+	jobSystem.parallelFor(0, chunkCount, 1, [&](size_t begin, size_t end)
+	{
+		for (size_t chunk = begin; chunk < end; ++chunk)
+		{
+			uint32_t* offsets = &buckets.offsets[chunk * modelCount];
+			for (uint32_t dense : buckets.entities[chunk])
+			{
+				const uint32_t modelId = modelIds[dense];
+				instancesPerModel[modelId][offsets[modelId]++] = { worldMatrices[dense], previousWorldMatrices[dense] };
+			}
+		}
+	});
+}
+
+EntityHandle Scene::raycast(const Ray& ray, float maxDistance, float& hitDistance) const
+{
+	const uint32_t slot = bvh.raycast(ray, maxDistance, hitDistance);
+	if (slot == BVH::NULL_NODE)
+	{
+		return {};
+	}
+	return { slot, generations[slot] };
+}
+
+uint32_t Scene::internName(std::string_view name)
+{
+	std::string key(name);
+	auto it = nameLookup.find(key);
+	if (it != nameLookup.end())
+	{
+		return it->second;
+	}
+
+	const uint32_t id = static_cast<uint32_t>(names.size());
+	names.push_back(key);
+	nameLookup.emplace(std::move(key), id);
+	return id;
+}
@@ -1,4 +1,5 @@
 #include "shader.hpp"
+#include "renderStats.hpp"
 #include <glad/glad.h>
 
 #include <fstream>
@@ -39,28 +40,85 @@ Shader::Shader(const char* vertexPath, const char* fragmentPath)
 	glDeleteShader(fragment);
 }
 
+Shader::Shader(const char* computePath)
+{
+	std::string computeCode;
+
+	try
+	{
+		computeCode = readShaderFile(computePath);
+	}
+	catch (const std::runtime_error& e)
+	{
+		std::cerr << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ\n" << e.what() << std::endl;
+		return;
+	}
+
+	uint32_t compute = compileShader(GL_COMPUTE_SHADER, computeCode.c_str());
+
+	ID = glCreateProgram();
+	glAttachShader(ID, compute);
+	glLinkProgram(ID);
+	checkCompilationErrors(ID, "PROGRAM");
+
+	glDeleteShader(compute);
+}
+
 Shader::~Shader() 
 {
-	glDeleteProgram(ID);
+	glState.deleteProgram(ID);
 }
 
 void Shader::use() const
 {
-	glUseProgram(ID);
+	countedUseProgram(ID);
 }
 
 void Shader::setBool(const std::string_view name, bool value) const
 {
+	countUniformUpdate();
 	glUniform1i(glGetUniformLocation(ID, name.data()), (int)value);
 }
 void Shader::setInt(const std::string_view name, int value) const
 {
+	countUniformUpdate();
 	glUniform1i(glGetUniformLocation(ID, name.data()), value);
 }
 void Shader::setFloat(const std::string_view name, float value) const
 {
+	countUniformUpdate();
 	glUniform1f(glGetUniformLocation(ID, name.data()), value);
 }
+void Shader::setVec2(const std::string_view name, const glm::vec2& value) const
+{
+	countUniformUpdate();
+	glUniform2fv(glGetUniformLocation(ID, name.data()), 1, &value[0]);
+}
+void Shader::setIVec2(const std::string_view name, const glm::ivec2& value) const
+{
+	countUniformUpdate();
+	glUniform2iv(glGetUniformLocation(ID, name.data()), 1, &value[0]);
+}
+void Shader::setVec3(const std::string_view name, const glm::vec3& value) const
+{
+	countUniformUpdate();
+	glUniform3fv(glGetUniformLocation(ID, name.data()), 1, &value[0]);
+}
+void Shader::setVec3Array(const std::string_view name, const glm::vec3* values, int count) const
+{
+	countUniformUpdate();
+	glUniform3fv(glGetUniformLocation(ID, name.data()), count, &values[0][0]);
+}
+void Shader::setVec4(const std::string_view name, const glm::vec4& value) const
+{
+	countUniformUpdate();
+	glUniform4fv(glGetUniformLocation(ID, name.data()), 1, &value[0]);
+}
+void Shader::setMat4(const std::string_view name, const glm::mat4& value) const
+{
+	countUniformUpdate();
+	glUniformMatrix4fv(glGetUniformLocation(ID, name.data()), 1, GL_FALSE, &value[0][0]);
+}
 
 std::string Shader::readShaderFile(const std::string& path) 
 {
@@ -80,7 +138,16 @@ uint32_t Shader::compileShader(uint32_t shaderType, const char* shaderCode)
 	uint32_t shader = glCreateShader(shaderType);
 	glShaderSource(shader, 1, &shaderCode, nullptr);
 	glCompileShader(shader);
-	checkCompilationErrors(shader, (shaderType == GL_VERTEX_SHADER) ? "VERTEX" : "FRAGMENT");
+	const char* type = "FRAGMENT";
+	if (shaderType == GL_VERTEX_SHADER)
+	{
+		type = "VERTEX";
+	}
+	else if (shaderType == GL_COMPUTE_SHADER)
+	{
+		type = "COMPUTE";
+	}
+	checkCompilationErrors(shader, type);
 	return shader;
 }
 
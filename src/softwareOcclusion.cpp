@@ -0,0 +1,391 @@
+#include "softwareOcclusion.hpp"
+#include "jobSystem.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SOFTWARE_OCCLUSION_X86
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+namespace
+{
+	// Clips against the near plane (z >= -w), then projects and emits the polygon as a triangle fan
+	void clipAndProject(const glm::vec4 (&clip)[3], float width, float height, std::vector<ScreenTriangle>& out)
+	{
+		glm::vec4 polygon[4];
+		int count = 0;
+		for (int i = 0; i < 3; ++i)
+		{
+			const glm::vec4& a = clip[i];
+			const glm::vec4& b = clip[(i + 1) % 3];
+			const float distanceA = a.z + a.w;
+			const float distanceB = b.z + b.w;
+
+			if (distanceA >= 0.0f)
+			{
+				polygon[count++] = a;
+			}
+			if ((distanceA >= 0.0f) != (distanceB >= 0.0f))
+			{
+				polygon[count++] = a + (b - a) * (distanceA / (distanceA - distanceB));
+			}
+		}
+		if (count < 3)
+		{
+			return;
+		}
+
+		float x[4], y[4], z[4];
+		float minX = FLT_MAX, maxX = -FLT_MAX, minY = FLT_MAX, maxY = -FLT_MAX;
+		for (int i = 0; i < count; ++i)
+		{
+			const float inverseW = 1.0f / polygon[i].w;
+			x[i] = (polygon[i].x * inverseW * 0.5f + 0.5f) * width;
+			y[i] = (polygon[i].y * inverseW * 0.5f + 0.5f) * height;
+			z[i] = polygon[i].z * inverseW * 0.5f + 0.5f;
+			minX = std::min(minX, x[i]);
+			maxX = std::max(maxX, x[i]);
+			minY = std::min(minY, y[i]);
+			maxY = std::max(maxY, y[i]);
+		}
+
+		// Off screen, or back facing (counter-clockwise is front facing, as in GL)
+		if (maxX < 0.0f || minX > width || maxY < 0.0f || minY > height)
+		{
+			return;
+		}
+		if ((x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]) <= 0.0f)
+		{
+			return;
+		}
+
+		for (int i = 1; i + 1 < count; ++i)
+		{
+			out.push_back({ { x[0], x[i], x[i + 1] }, { y[0], y[i], y[i + 1] }, { z[0], z[i], z[i + 1] } });
+		}
+	}
+
+	// Runs body(thread) for threadCount slices as jobs, the calling thread takes slice 0
+	template<typename Body>
+	void runParallel(int threadCount, Body&& body)
+	{
+		jobSystem.parallelFor(0, static_cast<size_t>(threadCount), 1, [&body](size_t begin, size_t end)
+		{
+			for (size_t thread = begin; thread < end; ++thread)
+			{
+				body(static_cast<int>(thread));
+			}
+		});
+	}
+}
+
+bool setupTriangle(const ScreenTriangle& triangle, int width, int rowBegin, int rowEnd, TriangleSetup& setup)
+{
+	const float* x = triangle.x;
+	const float* y = triangle.y;
+
+	// Pixel centers sit at +0.5, a pixel is covered when its center is inside all three edges
+	setup.minX = std::max(static_cast<int>(std::floor(std::min({ x[0], x[1], x[2] }) - 0.5f)), 0);
+	setup.maxX = std::min(static_cast<int>(std::ceil(std::max({ x[0], x[1], x[2] }) - 0.5f)), width - 1);
+	setup.minY = std::max(static_cast<int>(std::floor(std::min({ y[0], y[1], y[2] }) - 0.5f)), rowBegin);
+	setup.maxY = std::min(static_cast<int>(std::ceil(std::max({ y[0], y[1], y[2] }) - 0.5f)), rowEnd - 1);
+	if (setup.minX > setup.maxX || setup.minY > setup.maxY)
+	{
+		return false;
+	}
+
+	// Edge i runs from vertex i to vertex i + 1 and is positive on the inside
+	for (int i = 0; i < 3; ++i)
+	{
+		const int j = (i + 1) % 3;
+		setup.edgeA[i] = y[i] - y[j];
+		setup.edgeB[i] = x[j] - x[i];
+		setup.edgeC[i] = -(setup.edgeA[i] * x[i] + setup.edgeB[i] * y[i]);
+	}
+
+	// Barycentric weight of vertex k is the edge opposite to it over the area
+	const float area = setup.edgeC[0] + setup.edgeA[0] * x[2] + setup.edgeB[0] * y[2];
+	if (area <= 0.0f)
+	{
+		return false;
+	}
+	const float inverseArea = 1.0f / area;
+	const float* z = triangle.z;
+	setup.depthA = (setup.edgeA[1] * z[0] + setup.edgeA[2] * z[1] + setup.edgeA[0] * z[2]) * inverseArea;
+	setup.depthB = (setup.edgeB[1] * z[0] + setup.edgeB[2] * z[1] + setup.edgeB[0] * z[2]) * inverseArea;
+	setup.depthC = (setup.edgeC[1] * z[0] + setup.edgeC[2] * z[1] + setup.edgeC[0] * z[2]) * inverseArea;
+	return true;
+}
+
+void rasterizeScalar(const ScreenTriangle* triangles, size_t count, float* depth, int width, int rowBegin, int rowEnd)
+{
+	TriangleSetup setup;
+	for (size_t t = 0; t < count; ++t)
+	{
+		if (!setupTriangle(triangles[t], width, rowBegin, rowEnd, setup))
+		{
+			continue;
+		}
+
+		for (int y = setup.minY; y <= setup.maxY; ++y)
+		{
+			// Row terms first, so every kernel evaluates A * x + (B * y + C) in the same order
+			const float py = static_cast<float>(y) + 0.5f;
+			const float row0 = setup.edgeB[0] * py + setup.edgeC[0];
+			const float row1 = setup.edgeB[1] * py + setup.edgeC[1];
+			const float row2 = setup.edgeB[2] * py + setup.edgeC[2];
+			const float rowDepth = setup.depthB * py + setup.depthC;
+			float* depthRow = depth + static_cast<size_t>(y) * width;
+
+			for (int x = setup.minX; x <= setup.maxX; ++x)
+			{
+				const float px = static_cast<float>(x) + 0.5f;
+				if (setup.edgeA[0] * px + row0 >= 0.0f && setup.edgeA[1] * px + row1 >= 0.0f && setup.edgeA[2] * px + row2 >= 0.0f)
+				{
+					depthRow[x] = std::min(depthRow[x], setup.depthA * px + rowDepth);
+				}
+			}
+		}
+	}
+}
+
+SoftwareOcclusion::Isa SoftwareOcclusion::bestIsa()
+{
+	if (isSupported(Isa::AVX2))
+	{
+		return Isa::AVX2;
+	}
+	if (isSupported(Isa::SSE4))
+	{
+		return Isa::SSE4;
+	}
+	return Isa::Scalar;
+}
+
+bool SoftwareOcclusion::isSupported(Isa isa)
+{
+	if (isa == Isa::Scalar)
+	{
+		return true;
+	}
+
+#if defined(SOFTWARE_OCCLUSION_SIMD) && defined(SOFTWARE_OCCLUSION_X86)
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	const bool sse41 = (info[2] & (1 << 19)) != 0;
+	if (isa == Isa::SSE4)
+	{
+		return sse41;
+	}
+
+	// AVX2 also needs the OS to save the YMM registers
+	const bool osAvx = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 0x6) == 0x6;
+	__cpuidex(info, 7, 0);
+	return sse41 && osAvx && (info[1] & (1 << 5)) != 0;
+#else
+	return isa == Isa::SSE4 ? __builtin_cpu_supports("sse4.1") : __builtin_cpu_supports("avx2");
+#endif
+#else
+	return false;
+#endif
+}
+
+const char* SoftwareOcclusion::isaName(Isa isa)
+{
+	switch (isa)
+	{
+	case Isa::SSE4: return "SSE4.1";
+	case Isa::AVX2: return "AVX2";
+	default: return "Scalar";
+	}
+}
+
+SoftwareOcclusion::SoftwareOcclusion(int width, int height, Isa isa, int threadCount)
+	: width((std::max(width, TILE_WIDTH) + TILE_WIDTH - 1) / TILE_WIDTH * TILE_WIDTH),
+	  height((std::max(height, TILE_HEIGHT) + TILE_HEIGHT - 1) / TILE_HEIGHT * TILE_HEIGHT),
+	  isa(isSupported(isa) ? isa : Isa::Scalar),
+	  threadCount(threadCount > 0 ? threadCount : std::max(static_cast<int>(std::thread::hardware_concurrency()), 1))
+{
+	tilesX = this->width / TILE_WIDTH;
+	tilesY = this->height / TILE_HEIGHT;
+	this->threadCount = std::min(this->threadCount, tilesY);
+
+	depth.assign(static_cast<size_t>(this->width) * this->height, 1.0f);
+	tileMaxDepth.assign(static_cast<size_t>(tilesX) * tilesY, 1.0f);
+}
+
+void SoftwareOcclusion::transformOccluders(const OccluderMesh* occluders, size_t count, const glm::mat4& viewProjection, std::vector<ScreenTriangle>& out) const
+{
+	std::vector<glm::vec4> clipPositions;
+	for (size_t o = 0; o < count; ++o)
+	{
+		const OccluderMesh& occluder = occluders[o];
+		const glm::mat4 clipFromObject = viewProjection * occluder.world;
+
+		// Transform each referenced vertex once
+		uint32_t vertexCount = 0;
+		for (size_t i = 0; i < occluder.indexCount; ++i)
+		{
+			vertexCount = std::max(vertexCount, occluder.indices[i] + 1);
+		}
+		clipPositions.resize(vertexCount);
+
+		const uint8_t* bytes = static_cast<const uint8_t*>(occluder.positions);
+		for (uint32_t v = 0; v < vertexCount; ++v)
+		{
+			const float* position = reinterpret_cast<const float*>(bytes + v * occluder.stride);
+			clipPositions[v] = clipFromObject * glm::vec4(position[0], position[1], position[2], 1.0f);
+		}
+
+		for (size_t i = 0; i + 2 < occluder.indexCount; i += 3)
+		{
+			const glm::vec4 clip[3] = {
+				clipPositions[occluder.indices[i]],
+				clipPositions[occluder.indices[i + 1]],
+				clipPositions[occluder.indices[i + 2]]
+			};
+			clipAndProject(clip, static_cast<float>(width), static_cast<float>(height), out);
+		}
+	}
+}
+
+void SoftwareOcclusion::render(const std::vector<OccluderMesh>& occluders, const glm::mat4& viewProjection)
+{
+	// Transform: occluders are split between threads, then the triangle lists are joined in order
+	threadTriangles.resize(threadCount);
+	const int transformThreads = static_cast<int>(std::min<size_t>(threadCount, std::max<size_t>(occluders.size(), 1)));
+	runParallel(transformThreads, [&](int thread)
+	{
+		const size_t begin = occluders.size() * thread / transformThreads;
+		const size_t end = occluders.size() * (thread + 1) / transformThreads;
+		threadTriangles[thread].clear();
+		transformOccluders(occluders.data() + begin, end - begin, viewProjection, threadTriangles[thread]);
+	});
+
+	triangles.clear();
+	for (int thread = 0; thread < transformThreads; ++thread)
+	{
+		triangles.insert(triangles.end(), threadTriangles[thread].begin(), threadTriangles[thread].end());
+	}
+
+	// Rasterize: every thread owns a band of whole tile rows, so no two threads write the same pixel
+	runParallel(threadCount, [&](int thread)
+	{
+		const int firstTileRow = tilesY * thread / threadCount;
+		const int endTileRow = tilesY * (thread + 1) / threadCount;
+		rasterizeBand(firstTileRow * TILE_HEIGHT, endTileRow * TILE_HEIGHT);
+	});
+}
+
+void SoftwareOcclusion::rasterizeBand(int rowBegin, int rowEnd)
+{
+	if (rowBegin >= rowEnd)
+	{
+		return;
+	}
+
+	std::fill(depth.begin() + static_cast<size_t>(rowBegin) * width, depth.begin() + static_cast<size_t>(rowEnd) * width, 1.0f);
+
+	switch (isa)
+	{
+	case Isa::AVX2:
+		rasterizeAVX2(triangles.data(), triangles.size(), depth.data(), width, rowBegin, rowEnd);
+		break;
+	case Isa::SSE4:
+		rasterizeSSE4(triangles.data(), triangles.size(), depth.data(), width, rowBegin, rowEnd);
+		break;
+	default:
+		rasterizeScalar(triangles.data(), triangles.size(), depth.data(), width, rowBegin, rowEnd);
+		break;
+	}
+
+	for (int tileY = rowBegin / TILE_HEIGHT; tileY < rowEnd / TILE_HEIGHT; ++tileY)
+	{
+		for (int tileX = 0; tileX < tilesX; ++tileX)
+		{
+			float farthest = 0.0f;
+			for (int y = tileY * TILE_HEIGHT; y < (tileY + 1) * TILE_HEIGHT; ++y)
+			{
+				const float* row = depth.data() + static_cast<size_t>(y) * width + tileX * TILE_WIDTH;
+				for (int x = 0; x < TILE_WIDTH; ++x)
+				{
+					farthest = std::max(farthest, row[x]);
+				}
+			}
+			tileMaxDepth[static_cast<size_t>(tileY) * tilesX + tileX] = farthest;
+		}
+	}
+}
+
+bool SoftwareOcclusion::isVisible(const glm::mat4& clipFromObject, const AABB& bounds) const
+{
+	float minX = FLT_MAX, maxX = -FLT_MAX, minY = FLT_MAX, maxY = -FLT_MAX;
+	float nearestDepth = 1.0f;
+	for (int i = 0; i < 8; ++i)
+	{
+		const glm::vec3 corner((i & 1) ? bounds.max.x : bounds.min.x, (i & 2) ? bounds.max.y : bounds.min.y, (i & 4) ? bounds.max.z : bounds.min.z);
+		const glm::vec4 clip = clipFromObject * glm::vec4(corner, 1.0f);
+
+		// Crossing the near plane, no screen rectangle to test
+		if (clip.z < -clip.w || clip.w <= 0.0f)
+		{
+			return true;
+		}
+
+		const float inverseW = 1.0f / clip.w;
+		const float x = (clip.x * inverseW * 0.5f + 0.5f) * width;
+		const float y = (clip.y * inverseW * 0.5f + 0.5f) * height;
+		minX = std::min(minX, x);
+		maxX = std::max(maxX, x);
+		minY = std::min(minY, y);
+		maxY = std::max(maxY, y);
+		nearestDepth = std::min(nearestDepth, clip.z * inverseW * 0.5f + 0.5f);
+	}
+
+	// Off screen is the frustum test's business, do not claim it is occluded
+	if (maxX < 0.0f || minX > width || maxY < 0.0f || minY > height)
+	{
+		return true;
+	}
+
+	// Every pixel the rectangle touches, not just those whose centers it covers
+	const int x0 = std::clamp(static_cast<int>(std::floor(minX)), 0, width - 1);
+	const int x1 = std::clamp(static_cast<int>(std::floor(maxX)), 0, width - 1);
+	const int y0 = std::clamp(static_cast<int>(std::floor(minY)), 0, height - 1);
+	const int y1 = std::clamp(static_cast<int>(std::floor(maxY)), 0, height - 1);
+
+	for (int tileY = y0 / TILE_HEIGHT; tileY <= y1 / TILE_HEIGHT; ++tileY)
+	{
+		for (int tileX = x0 / TILE_WIDTH; tileX <= x1 / TILE_WIDTH; ++tileX)
+		{
+			// Everything in this tile is nearer than the box
+			if (tileMaxDepth[static_cast<size_t>(tileY) * tilesX + tileX] < nearestDepth)
+			{
+				continue;
+			}
+
+			const int rowBegin = std::max(y0, tileY * TILE_HEIGHT);
+			const int rowEnd = std::min(y1, (tileY + 1) * TILE_HEIGHT - 1);
+			const int columnBegin = std::max(x0, tileX * TILE_WIDTH);
+			const int columnEnd = std::min(x1, (tileX + 1) * TILE_WIDTH - 1);
+			for (int y = rowBegin; y <= rowEnd; ++y)
+			{
+				const float* row = depth.data() + static_cast<size_t>(y) * width;
+				for (int x = columnBegin; x <= columnEnd; ++x)
+				{
+					if (row[x] >= nearestDepth)
+					{
+						return true;
+					}
+				}
+			}
+		}
+	}
+	return false;
+}
@@ -0,0 +1,60 @@
+#include "softwareOcclusion.hpp"
+
+#if defined(SOFTWARE_OCCLUSION_SIMD)
+#include <immintrin.h>
+
+// Compiled with AVX2 enabled, only called after SoftwareOcclusion::isSupported(Isa::AVX2).
+// Multiplies and adds stay separate (no FMA) so results match the scalar kernel bit for bit.
+void rasterizeAVX2(const ScreenTriangle* triangles, size_t count, float* depth, int width, int rowBegin, int rowEnd)
+{
+	const __m256 laneOffsets = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+	const __m256 zero = _mm256_setzero_ps();
+
+	TriangleSetup setup;
+	for (size_t t = 0; t < count; ++t)
+	{
+		if (!setupTriangle(triangles[t], width, rowBegin, rowEnd, setup))
+		{
+			continue;
+		}
+
+		const __m256 edgeA0 = _mm256_set1_ps(setup.edgeA[0]);
+		const __m256 edgeA1 = _mm256_set1_ps(setup.edgeA[1]);
+		const __m256 edgeA2 = _mm256_set1_ps(setup.edgeA[2]);
+		const __m256 depthA = _mm256_set1_ps(setup.depthA);
+		const int firstX = setup.minX & ~7;
+
+		for (int y = setup.minY; y <= setup.maxY; ++y)
+		{
+			const float py = static_cast<float>(y) + 0.5f;
+			const __m256 row0 = _mm256_set1_ps(setup.edgeB[0] * py + setup.edgeC[0]);
+			const __m256 row1 = _mm256_set1_ps(setup.edgeB[1] * py + setup.edgeC[1]);
+			const __m256 row2 = _mm256_set1_ps(setup.edgeB[2] * py + setup.edgeC[2]);
+			const __m256 rowDepth = _mm256_set1_ps(setup.depthB * py + setup.depthC);
+			float* depthRow = depth + static_cast<size_t>(y) * width;
+
+			for (int x = firstX; x <= setup.maxX; x += 8)
+			{
+				const __m256 px = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(x)), laneOffsets);
+				const __m256 e0 = _mm256_add_ps(_mm256_mul_ps(edgeA0, px), row0);
+				const __m256 e1 = _mm256_add_ps(_mm256_mul_ps(edgeA1, px), row1);
+				const __m256 e2 = _mm256_add_ps(_mm256_mul_ps(edgeA2, px), row2);
+				const __m256 inside = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(e0, zero, _CMP_GE_OQ), _mm256_cmp_ps(e1, zero, _CMP_GE_OQ)), _mm256_cmp_ps(e2, zero, _CMP_GE_OQ));
+				if (_mm256_movemask_ps(inside) == 0)
+				{
+					continue;
+				}
+
+				const __m256 current = _mm256_loadu_ps(depthRow + x);
+				const __m256 fragment = _mm256_add_ps(_mm256_mul_ps(depthA, px), rowDepth);
+				_mm256_storeu_ps(depthRow + x, _mm256_blendv_ps(current, _mm256_min_ps(current, fragment), inside));
+			}
+		}
+	}
+}
+#else
+void rasterizeAVX2(const ScreenTriangle* triangles, size_t count, float* depth, int width, int rowBegin, int rowEnd)
+{
+	rasterizeScalar(triangles, count, depth, width, rowBegin, rowEnd);
+}
+#endif
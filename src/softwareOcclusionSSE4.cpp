@@ -0,0 +1,59 @@
+#include "softwareOcclusion.hpp"
+
+#if defined(SOFTWARE_OCCLUSION_SIMD)
+#include <smmintrin.h>
+
+// Compiled with SSE4.1 enabled, only called after SoftwareOcclusion::isSupported(Isa::SSE4)
+void rasterizeSSE4(const ScreenTriangle* triangles, size_t count, float* depth, int width, int rowBegin, int rowEnd)
+{
+	const __m128 laneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+	const __m128 zero = _mm_setzero_ps();
+
+	TriangleSetup setup;
+	for (size_t t = 0; t < count; ++t)
+	{
+		if (!setupTriangle(triangles[t], width, rowBegin, rowEnd, setup))
+		{
+			continue;
+		}
+
+		const __m128 edgeA0 = _mm_set1_ps(setup.edgeA[0]);
+		const __m128 edgeA1 = _mm_set1_ps(setup.edgeA[1]);
+		const __m128 edgeA2 = _mm_set1_ps(setup.edgeA[2]);
+		const __m128 depthA = _mm_set1_ps(setup.depthA);
+		const int firstX = setup.minX & ~3;
+
+		for (int y = setup.minY; y <= setup.maxY; ++y)
+		{
+			const float py = static_cast<float>(y) + 0.5f;
+			const __m128 row0 = _mm_set1_ps(setup.edgeB[0] * py + setup.edgeC[0]);
+			const __m128 row1 = _mm_set1_ps(setup.edgeB[1] * py + setup.edgeC[1]);
+			const __m128 row2 = _mm_set1_ps(setup.edgeB[2] * py + setup.edgeC[2]);
+			const __m128 rowDepth = _mm_set1_ps(setup.depthB * py + setup.depthC);
+			float* depthRow = depth + static_cast<size_t>(y) * width;
+
+			for (int x = firstX; x <= setup.maxX; x += 4)
+			{
+				const __m128 px = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), laneOffsets);
+				const __m128 e0 = _mm_add_ps(_mm_mul_ps(edgeA0, px), row0);
+				const __m128 e1 = _mm_add_ps(_mm_mul_ps(edgeA1, px), row1);
+				const __m128 e2 = _mm_add_ps(_mm_mul_ps(edgeA2, px), row2);
+				const __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)), _mm_cmpge_ps(e2, zero));
+				if (_mm_movemask_ps(inside) == 0)
+				{
+					continue;
+				}
+
+				const __m128 current = _mm_loadu_ps(depthRow + x);
+				const __m128 fragment = _mm_add_ps(_mm_mul_ps(depthA, px), rowDepth);
+				_mm_storeu_ps(depthRow + x, _mm_blendv_ps(current, _mm_min_ps(current, fragment), inside));
+			}
+		}
+	}
+}
+#else
+void rasterizeSSE4(const ScreenTriangle* triangles, size_t count, float* depth, int width, int rowBegin, int rowEnd)
+{
+	rasterizeScalar(triangles, count, depth, width, rowBegin, rowEnd);
+}
+#endif
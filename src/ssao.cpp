@@ -0,0 +1,138 @@
+#include "ssao.hpp"
+#include "profiler.hpp"
+#include "renderStats.hpp"
+
+#include <algorithm>
+#include <random>
+
+namespace
+{
+	GLuint groupCount(int size)
+	{
+		return static_cast<GLuint>((size + 7) / 8);
+	}
+
+	GLuint createTarget(GLenum format, int width, int height)
+	{
+		GLuint texture;
+		glCreateTextures(GL_TEXTURE_2D, 1, &texture);
+		glTextureStorage2D(texture, 1, format, width, height);
+		glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTextureParameteri(texture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTextureParameteri(texture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		return texture;
+	}
+}
+
+SSAO::SSAO()
+	: depthShader("shaders/ssaoDepth.comp"),
+	  aoShader("shaders/ssao.comp"),
+	  blurShader("shaders/ssaoBlur.comp"),
+	  upsampleShader("shaders/ssaoUpsample.comp")
+{
+	// Fixed seed so the pattern, and benchmark images, are the same every run
+	std::mt19937 generator(1234);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	for (int i = 0; i < KERNEL_SIZE; ++i)
+	{
+		glm::vec3 sample(unit(generator) * 2.0f - 1.0f, unit(generator) * 2.0f - 1.0f, unit(generator));
+		sample = glm::normalize(sample) * unit(generator);
+
+		// More samples close to the origin, where occluders matter most
+		const float scale = static_cast<float>(i) / KERNEL_SIZE;
+		kernel[i] = sample * glm::mix(0.1f, 1.0f, scale * scale);
+	}
+}
+
+SSAO::~SSAO()
+{
+	const GLuint textures[4] = { halfDepthTexture, halfAOTexture, blurTexture, aoTexture };
+	glState.deleteTextures(4, textures);
+}
+
+void SSAO::allocate(int width, int height)
+{
+	const GLuint textures[4] = { halfDepthTexture, halfAOTexture, blurTexture, aoTexture };
+	glState.deleteTextures(4, textures);
+
+	targetWidth = width;
+	targetHeight = height;
+	const int halfWidth = std::max((width + 1) / 2, 1);
+	const int halfHeight = std::max((height + 1) / 2, 1);
+	halfDepthTexture = createTarget(GL_R32F, halfWidth, halfHeight);
+	halfAOTexture = createTarget(GL_R8, halfWidth, halfHeight);
+	blurTexture = createTarget(GL_R8, halfWidth, halfHeight);
+	aoTexture = createTarget(GL_R8, width, height);
+}
+
+void SSAO::compute(GLuint depthTexture, int width, int height, const glm::mat4& projection)
+{
+	if (width != targetWidth || height != targetHeight)
+	{
+		allocate(width, height);
+	}
+
+	const int halfWidth = std::max((width + 1) / 2, 1);
+	const int halfHeight = std::max((height + 1) / 2, 1);
+	const glm::vec4 projectionParams(projection[0][0], projection[1][1], projection[2][2], projection[3][2]);
+
+	profiler.beginGpuZone("SSAO Depth");
+	depthShader.use();
+	depthShader.setInt("depthTexture", 0);
+	depthShader.setIVec2("depthSize", glm::ivec2(width, height));
+	depthShader.setVec4("projectionParams", projectionParams);
+	countedBindTextureUnit(0, depthTexture);
+	glBindImageTexture(0, halfDepthTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+	glDispatchCompute(groupCount(halfWidth), groupCount(halfHeight), 1);
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+	profiler.endGpuZone();
+
+	profiler.beginGpuZone("SSAO");
+	aoShader.use();
+	aoShader.setInt("halfDepth", 0);
+	aoShader.setVec4("projectionParams", projectionParams);
+	aoShader.setVec3Array("kernel", kernel.data(), KERNEL_SIZE);
+	aoShader.setFloat("radius", radius);
+	aoShader.setFloat("bias", bias);
+	aoShader.setFloat("power", power);
+	countedBindTextureUnit(0, halfDepthTexture);
+	glBindImageTexture(0, halfAOTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R8);
+	glDispatchCompute(groupCount(halfWidth), groupCount(halfHeight), 1);
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+	profiler.endGpuZone();
+
+	// Horizontal into the blur target, vertical back into the AO target
+	profiler.beginGpuZone("SSAO Blur");
+	blurShader.use();
+	blurShader.setInt("aoSource", 0);
+	blurShader.setInt("halfDepth", 1);
+	blurShader.setFloat("depthSharpness", depthSharpness);
+	countedBindTextureUnit(1, halfDepthTexture);
+	const GLuint sources[2] = { halfAOTexture, blurTexture };
+	const glm::ivec2 directions[2] = { { 1, 0 }, { 0, 1 } };
+	for (int pass = 0; pass < 2; ++pass)
+	{
+		blurShader.setIVec2("direction", directions[pass]);
+		countedBindTextureUnit(0, sources[pass]);
+		glBindImageTexture(0, sources[1 - pass], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R8);
+		glDispatchCompute(groupCount(halfWidth), groupCount(halfHeight), 1);
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+	}
+	profiler.endGpuZone();
+
+	profiler.beginGpuZone("SSAO Upsample");
+	upsampleShader.use();
+	upsampleShader.setInt("aoSource", 0);
+	upsampleShader.setInt("halfDepth", 1);
+	upsampleShader.setInt("depthTexture", 2);
+	upsampleShader.setVec4("projectionParams", projectionParams);
+	countedBindTextureUnit(0, halfAOTexture);
+	countedBindTextureUnit(2, depthTexture);
+	glBindImageTexture(0, aoTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R8);
+	glDispatchCompute(groupCount(width), groupCount(height), 1);
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+	profiler.endGpuZone();
+
+	glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_READ_ONLY, GL_R8);
+}
@@ -0,0 +1,116 @@
+#include "temporalAA.hpp"
+#include "renderStats.hpp"
+
+namespace
+{
+	float halton(uint32_t index, uint32_t base)
+	{
+		float result = 0.0f;
+		float fraction = 1.0f;
+		while (index > 0)
+		{
+			fraction /= static_cast<float>(base);
+			result += fraction * static_cast<float>(index % base);
+			index /= base;
+		}
+		return result;
+	}
+}
+
+TemporalAA::TemporalAA()
+	: resolveShader("shaders/postprocess.vert", "shaders/taaResolve.frag")
+{
+}
+
+TemporalAA::~TemporalAA()
+{
+	glState.deleteTextures(2, history);
+}
+
+void TemporalAA::allocate(int targetWidth, int targetHeight, RenderGraph& graph)
+{
+	graph.forget(history[0]);
+	graph.forget(history[1]);
+	glState.deleteTextures(2, history);
+
+	width = targetWidth;
+	height = targetHeight;
+	glCreateTextures(GL_TEXTURE_2D, 2, history);
+	for (GLuint texture : history)
+	{
+		glTextureStorage2D(texture, 1, GL_RGBA16F, width, height);
+		glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTextureParameteri(texture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTextureParameteri(texture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	}
+	historyValid = false;
+}
+
+void TemporalAA::beginFrame(const glm::mat4& currentViewProjection, int newRenderWidth, int newRenderHeight, int targetWidth, int targetHeight, RenderGraph& graph)
+{
+	if (targetWidth != width || targetHeight != height)
+	{
+		allocate(targetWidth, targetHeight, graph);
+	}
+
+	// History rendered at another scale covers a different part of its texture
+	if (!enabled || newRenderWidth != renderWidth || newRenderHeight != renderHeight)
+	{
+		historyValid = false;
+	}
+	renderWidth = newRenderWidth;
+	renderHeight = newRenderHeight;
+
+	previousViewProjection = historyValid ? viewProjection : currentViewProjection;
+	viewProjection = currentViewProjection;
+
+	resolving = enabled;
+	if (enabled)
+	{
+		frameIndex = (frameIndex + 1) % JITTER_PHASES;
+		jitter = glm::vec2(halton(frameIndex + 1, 2), halton(frameIndex + 1, 3)) - 0.5f;
+	}
+	else
+	{
+		jitter = glm::vec2(0.0f);
+	}
+}
+
+void TemporalAA::endFrame()
+{
+	if (!resolving)
+	{
+		return;
+	}
+
+	current = 1 - current;
+	historyValid = true;
+}
+
+glm::mat4 TemporalAA::jitterProjection(const glm::mat4& projection) const
+{
+	glm::mat4 jittered = projection;
+	jittered[2][0] += jitter.x * 2.0f / static_cast<float>(renderWidth);
+	jittered[2][1] += jitter.y * 2.0f / static_cast<float>(renderHeight);
+	return jittered;
+}
+
+void TemporalAA::bindResolve(GLuint color, GLuint velocity, GLuint depth, const glm::vec2& renderScale)
+{
+	resolveShader.use();
+	resolveShader.setInt("currentColor", 0);
+	resolveShader.setInt("velocityTexture", 1);
+	resolveShader.setInt("depthTexture", 2);
+	resolveShader.setInt("historyTexture", 3);
+	resolveShader.setVec2("renderScale", renderScale);
+	resolveShader.setMat4("reprojection", previousViewProjection * glm::inverse(viewProjection));
+	resolveShader.setFloat("feedback", feedback);
+	resolveShader.setBool("historyValid", historyValid);
+
+	const GLuint textures[4] = { color, velocity, depth, historyTexture() };
+	for (GLuint i = 0; i < 4; ++i)
+	{
+		countedBindTextureUnit(i, textures[i]);
+	}
+}
@@ -0,0 +1,421 @@
+#include "textureStreaming.hpp"
+#include "glState.hpp"
+#include "jobSystem.hpp"
+#include "model.hpp"
+#include "stb_image.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+TextureStreamer textureStreamer;
+
+namespace
+{
+	// 2x2 box filter, the last row and column repeat on odd sizes
+	std::vector<uint8_t> downsample(const uint8_t* source, int width, int height, int channels)
+	{
+		const int targetWidth = std::max(width / 2, 1);
+		const int targetHeight = std::max(height / 2, 1);
+		std::vector<uint8_t> target(static_cast<size_t>(targetWidth) * targetHeight * channels);
+
+		for (int y = 0; y < targetHeight; ++y)
+		{
+			const int y0 = std::min(y * 2, height - 1);
+			const int y1 = std::min(y * 2 + 1, height - 1);
+			for (int x = 0; x < targetWidth; ++x)
+			{
+				const int x0 = std::min(x * 2, width - 1);
+				const int x1 = std::min(x * 2 + 1, width - 1);
+				for (int c = 0; c < channels; ++c)
+				{
+					const int sum = source[(static_cast<size_t>(y0) * width + x0) * channels + c]
+						+ source[(static_cast<size_t>(y0) * width + x1) * channels + c]
+						+ source[(static_cast<size_t>(y1) * width + x0) * channels + c]
+						+ source[(static_cast<size_t>(y1) * width + x1) * channels + c];
+					target[(static_cast<size_t>(y) * targetWidth + x) * channels + c] = static_cast<uint8_t>((sum + 2) / 4);
+				}
+			}
+		}
+		return target;
+	}
+
+	int levelSize(int size, int level)
+	{
+		return std::max(size >> level, 1);
+	}
+}
+
+MipChain BuildMipChain(const DecodedTexture& decoded, int firstLevel, int lastLevel)
+{
+	MipChain chain;
+	chain.firstLevel = firstLevel;
+	chain.channels = decoded.channels;
+	if (!decoded.data)
+	{
+		return chain;
+	}
+
+	const uint8_t* source = decoded.data;
+	std::vector<uint8_t> previous;
+	int width = decoded.width;
+	int height = decoded.height;
+	for (int level = 0; level <= lastLevel; ++level)
+	{
+		if (level > 0)
+		{
+			std::vector<uint8_t> next = downsample(source, width, height, decoded.channels);
+			width = std::max(width / 2, 1);
+			height = std::max(height / 2, 1);
+			previous = std::move(next);
+			source = previous.data();
+		}
+		if (level >= firstLevel)
+		{
+			chain.sizes.push_back({ width, height });
+			chain.levels.emplace_back(source, source + static_cast<size_t>(width) * height * decoded.channels);
+		}
+	}
+	return chain;
+}
+
+uint32_t TextureStreamer::upload(DecodedTexture& decoded, TextureType type, const std::string& path, const std::string& directory)
+{
+	uint32_t id;
+	glCreateTextures(GL_TEXTURE_2D, 1, &id);
+	if (!decoded.data)
+	{
+		std::cerr << "Failed to load texture" << std::endl;
+		return id;
+	}
+
+	StreamedTexture texture;
+	texture.path = path;
+	texture.directory = directory;
+	texture.channels = decoded.channels;
+	texture.width = decoded.width;
+	texture.height = decoded.height;
+	ChooseTextureFormat(type, decoded.channels, texture.format, texture.internalFormat);
+	texture.levelCount = static_cast<int>(std::floor(std::log2(std::max(decoded.width, decoded.height)))) + 1;
+	texture.initialLevel = 0;
+	while (texture.initialLevel < texture.levelCount - 1 &&
+		std::max(levelSize(texture.width, texture.initialLevel), levelSize(texture.height, texture.initialLevel)) > initialSize)
+	{
+		++texture.initialLevel;
+	}
+	texture.residentLevel = texture.initialLevel;
+	texture.wantedLevel = texture.levelCount - 1;
+	texture.lastWantedFrame = frame;
+
+	const MipChain chain = BuildMipChain(decoded, texture.initialLevel, texture.levelCount - 1);
+	stbi_image_free(decoded.data);
+	decoded.data = nullptr;
+
+	glTextureParameteri(id, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTextureParameteri(id, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTextureParameteri(id, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTextureParameteri(id, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTextureParameteri(id, GL_TEXTURE_MAX_LEVEL, texture.levelCount - 1);
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	for (size_t i = 0; i < chain.levels.size(); ++i)
+	{
+		defineLevel(id, texture, chain.firstLevel + static_cast<int>(i), chain.sizes[i].x, chain.sizes[i].y, chain.levels[i].data());
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	setResidentLevel(id, texture, texture.initialLevel);
+
+	textures.emplace(id, std::move(texture));
+	return id;
+}
+
+void TextureStreamer::release(uint32_t texture)
+{
+	auto found = textures.find(texture);
+	if (found == textures.end())
+	{
+		return;
+	}
+
+	if (found->second.pending.valid())
+	{
+		found->second.pending.wait();
+	}
+	totalBytes -= found->second.bytes;
+	textures.erase(found);
+}
+
+void TextureStreamer::update(const std::vector<std::shared_ptr<Model>>& models, const std::vector<std::vector<InstanceData>>& instancesPerModel,
+	const glm::vec3& eye, float focalLength)
+{
+	++frame;
+	if (textures.empty())
+	{
+		return;
+	}
+
+	finishLoads();
+	computeWantedLevels(models, instancesPerModel, eye, focalLength);
+	freeLevels();
+	startLoads();
+}
+
+int TextureStreamer::pendingLoads() const
+{
+	int count = 0;
+	for (const auto& [id, texture] : textures)
+	{
+		count += texture.pending.valid() ? 1 : 0;
+	}
+	return count;
+}
+
+size_t TextureStreamer::levelBytes(const StreamedTexture& texture, int level) const
+{
+	// Drivers pad three channel texels to four bytes
+	const size_t texelBytes = texture.channels == 3 ? 4 : static_cast<size_t>(texture.channels);
+	return static_cast<size_t>(levelSize(texture.width, level)) * levelSize(texture.height, level) * texelBytes;
+}
+
+void TextureStreamer::defineLevel(uint32_t id, const StreamedTexture& texture, int level, int width, int height, const void* pixels)
+{
+	// Core GL has no direct state access call that (re)defines a mutable level, so it goes through unit 0.
+	// Nothing changes the active texture unit since textures are bound by unit, see GLStateCache.
+	glState.bindTexture(0, id);
+	glTexImage2D(GL_TEXTURE_2D, level, texture.internalFormat, width, height, 0, texture.format, GL_UNSIGNED_BYTE, pixels);
+}
+
+void TextureStreamer::setResidentLevel(uint32_t id, StreamedTexture& texture, int level)
+{
+	// A zero sized image releases the level's storage
+	for (int freed = texture.residentLevel; freed < level; ++freed)
+	{
+		defineLevel(id, texture, freed, 0, 0, nullptr);
+	}
+	texture.residentLevel = level;
+	glTextureParameteri(id, GL_TEXTURE_BASE_LEVEL, level);
+
+	size_t bytes = 0;
+	for (int resident = level; resident < texture.levelCount; ++resident)
+	{
+		bytes += levelBytes(texture, resident);
+	}
+	totalBytes += bytes - texture.bytes;
+	texture.bytes = bytes;
+}
+
+void TextureStreamer::finishLoads()
+{
+	for (auto& [id, texture] : textures)
+	{
+		if (!texture.pending.valid() || texture.pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+		{
+			continue;
+		}
+
+		// The chain ends just above the resident level, nothing frees levels of a texture while it loads
+		const MipChain chain = texture.pending.get();
+		texture.pendingBytes = 0;
+		if (chain.levels.empty())
+		{
+			std::cout << "Failed to stream texture: " << texture.path << std::endl;
+			continue;
+		}
+
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		for (size_t i = 0; i < chain.levels.size(); ++i)
+		{
+			defineLevel(id, texture, chain.firstLevel + static_cast<int>(i), chain.sizes[i].x, chain.sizes[i].y, chain.levels[i].data());
+		}
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		setResidentLevel(id, texture, chain.firstLevel);
+	}
+}
+
+void TextureStreamer::computeWantedLevels(const std::vector<std::shared_ptr<Model>>& models, const std::vector<std::vector<InstanceData>>& instancesPerModel,
+	const glm::vec3& eye, float focalLength)
+{
+	// Distance to the nearest point of each instance's bounding sphere, in the model's own units
+	const size_t modelCount = std::min(models.size(), instancesPerModel.size());
+	nearestPerModel.assign(modelCount, FLT_MAX);
+	jobSystem.parallelFor(0, modelCount, 1, [&](size_t begin, size_t end)
+		{
+			for (size_t modelId = begin; modelId < end; ++modelId)
+			{
+				const Model* model = models[modelId].get();
+				if (!model || !model->bounds.valid())
+				{
+					continue;
+				}
+
+				const float radius = glm::length(model->bounds.extents());
+				float nearest = FLT_MAX;
+				for (const InstanceData& instance : instancesPerModel[modelId])
+				{
+					const float scale = std::max(glm::length(glm::vec3(instance.world[0])), 1e-6f);
+					const glm::vec3 center = glm::vec3(instance.world * glm::vec4(model->bounds.center(), 1.0f));
+					const float distance = std::max(glm::length(center - eye) - radius * scale, 0.1f);
+					nearest = std::min(nearest, distance / scale);
+				}
+				nearestPerModel[modelId] = nearest;
+			}
+		});
+
+	for (auto& [id, texture] : textures)
+	{
+		texture.wantedLevel = texture.levelCount - 1;
+	}
+
+	for (size_t modelId = 0; modelId < modelCount; ++modelId)
+	{
+		if (nearestPerModel[modelId] == FLT_MAX)
+		{
+			continue;
+		}
+
+		for (const Mesh& mesh : models[modelId]->meshes)
+		{
+			if (mesh.uvDensity <= 0.0f)
+			{
+				continue;
+			}
+
+			for (const Texture& meshTexture : mesh.textures)
+			{
+				auto found = textures.find(meshTexture.id);
+				if (found == textures.end())
+				{
+					continue;
+				}
+
+				// Level 0 texels covered by one pixel at the nearest instance, each level halves it
+				StreamedTexture& texture = found->second;
+				const float texelsPerPixel = mesh.uvDensity * std::max(texture.width, texture.height) * nearestPerModel[modelId] / focalLength;
+				const int level = std::clamp(static_cast<int>(std::floor(std::log2(std::max(texelsPerPixel, 1e-6f)))), 0, texture.levelCount - 1);
+				texture.wantedLevel = std::min(texture.wantedLevel, level);
+			}
+		}
+	}
+
+	for (auto& [id, texture] : textures)
+	{
+		if (texture.wantedLevel <= texture.residentLevel)
+		{
+			texture.lastWantedFrame = frame;
+		}
+	}
+}
+
+void TextureStreamer::freeLevels()
+{
+	// Detail nothing has needed for a while, down to the initial levels at most
+	for (auto& [id, texture] : textures)
+	{
+		if (!texture.pending.valid() && texture.residentLevel < std::min(texture.wantedLevel, texture.initialLevel) &&
+			frame - texture.lastWantedFrame > releaseDelayFrames)
+		{
+			setResidentLevel(id, texture, std::min(texture.wantedLevel, texture.initialLevel));
+		}
+	}
+
+	// Only over budget when it was lowered: drop a level at a time from the texture with the most unneeded
+	// detail, then the largest
+	while (totalBytes > budgetBytes)
+	{
+		auto victim = textures.end();
+		for (auto it = textures.begin(); it != textures.end(); ++it)
+		{
+			const StreamedTexture& texture = it->second;
+			if (texture.pending.valid() || texture.residentLevel >= texture.initialLevel)
+			{
+				continue;
+			}
+			if (victim == textures.end())
+			{
+				victim = it;
+				continue;
+			}
+
+			const int excess = texture.wantedLevel - texture.residentLevel;
+			const int victimExcess = victim->second.wantedLevel - victim->second.residentLevel;
+			if (excess > victimExcess || (excess == victimExcess && texture.bytes > victim->second.bytes))
+			{
+				victim = it;
+			}
+		}
+
+		if (victim == textures.end())
+		{
+			break;
+		}
+		setResidentLevel(victim->first, victim->second, victim->second.residentLevel + 1);
+	}
+}
+
+void TextureStreamer::startLoads()
+{
+	int pending = pendingLoads();
+	if (pending >= maxPendingLoads)
+	{
+		return;
+	}
+
+	// Most under-resolved first
+	std::vector<uint32_t> candidates;
+	size_t reservedBytes = 0;
+	for (const auto& [id, texture] : textures)
+	{
+		if (texture.pending.valid())
+		{
+			reservedBytes += texture.pendingBytes;
+		}
+		else if (texture.wantedLevel < texture.residentLevel)
+		{
+			candidates.push_back(id);
+		}
+	}
+	std::sort(candidates.begin(), candidates.end(), [this](uint32_t a, uint32_t b)
+		{
+			const StreamedTexture& first = textures.at(a);
+			const StreamedTexture& second = textures.at(b);
+			return first.residentLevel - first.wantedLevel > second.residentLevel - second.wantedLevel;
+		});
+
+	for (uint32_t id : candidates)
+	{
+		if (pending >= maxPendingLoads)
+		{
+			break;
+		}
+
+		// As fine as the budget allows, one level short of what is wanted is better than nothing
+		StreamedTexture& texture = textures.at(id);
+		int target = texture.residentLevel;
+		size_t extraBytes = 0;
+		while (target > texture.wantedLevel && totalBytes + reservedBytes + extraBytes + levelBytes(texture, target - 1) <= budgetBytes)
+		{
+			--target;
+			extraBytes += levelBytes(texture, target);
+		}
+		if (target == texture.residentLevel)
+		{
+			continue;
+		}
+
+		reservedBytes += extraBytes;
+		texture.pendingBytes = extraBytes;
+		++pending;
+		texture.pending = std::async(std::launch::async, [path = texture.path, directory = texture.directory, target, last = texture.residentLevel - 1]()
+			{
+				DecodedTexture decoded = DecodeTextureFile(path, directory);
+				MipChain chain = BuildMipChain(decoded, target, last);
+				if (decoded.data)
+				{
+					stbi_image_free(decoded.data);
+				}
+				return chain;
+			});
+	}
+}
@@ -0,0 +1,595 @@
+#include "virtualTexture.hpp"
+#include "glState.hpp"
+#include "model.hpp"
+#include "renderStats.hpp"
+#include "shader.hpp"
+#include "stb_image.h"
+
+#include <bit>
+#include <chrono>
+#include <iostream>
+
+VirtualTextureSystem virtualTextures;
+
+void VirtualPageCache::init(int slotsX, int slotsY)
+{
+	this->slotsX = slotsX;
+	this->slotsY = slotsY;
+	textures.clear();
+	slots.assign(static_cast<size_t>(slotsX) * slotsY, Slot{});
+	frame = 0;
+}
+
+int VirtualPageCache::addTexture(int width, int height)
+{
+	const int pagesX = static_cast<int>(std::bit_ceil(static_cast<uint32_t>((width + PAGE_SIZE - 1) / PAGE_SIZE)));
+	const int pagesY = static_cast<int>(std::bit_ceil(static_cast<uint32_t>((height + PAGE_SIZE - 1) / PAGE_SIZE)));
+	if (width <= 0 || height <= 0 || pagesX > MAX_PAGES || pagesY > MAX_PAGES)
+	{
+		return -1;
+	}
+
+	int id = 0;
+	while (id < static_cast<int>(textures.size()) && textures[id].live)
+	{
+		++id;
+	}
+	if (id == MAX_TEXTURES)
+	{
+		return -1;
+	}
+	if (id == static_cast<int>(textures.size()))
+	{
+		textures.emplace_back();
+	}
+
+	Texture& texture = textures[id];
+	texture = Texture{};
+	texture.live = true;
+	texture.width = width;
+	texture.height = height;
+	texture.pagesX = pagesX;
+	texture.pagesY = pagesY;
+	while (std::max(levelSize(width, texture.levelCount), levelSize(height, texture.levelCount)) > PAGE_SIZE)
+	{
+		++texture.levelCount;
+	}
+	++texture.levelCount;
+
+	for (int level = 0; level < texture.levelCount; ++level)
+	{
+		const size_t pages = static_cast<size_t>(gridSize(pagesX, level)) * gridSize(pagesY, level);
+		texture.pageSlots.emplace_back(pages, -1);
+		texture.table.emplace_back(pages, 0u);
+	}
+	texture.dirty = true;
+	return id;
+}
+
+void VirtualPageCache::removeTexture(int texture)
+{
+	for (int slot = 0; slot < static_cast<int>(slots.size()); ++slot)
+	{
+		if (slots[slot].texture == texture)
+		{
+			release(slot);
+		}
+	}
+	textures[texture] = Texture{};
+}
+
+uint32_t VirtualPageCache::tailRequest(int texture) const
+{
+	return packRequest(texture, textures[texture].levelCount - 1, 0, 0);
+}
+
+int32_t& VirtualPageCache::pageSlot(uint32_t request)
+{
+	Texture& texture = textures[requestTexture(request)];
+	const int level = requestLevel(request);
+	const size_t page = static_cast<size_t>(requestPageY(request)) * gridSize(texture.pagesX, level) + requestPageX(request);
+	return texture.pageSlots[level][page];
+}
+
+void VirtualPageCache::analyse(const uint32_t* feedback, size_t count, std::vector<uint32_t>& requests)
+{
+	requests.clear();
+
+	// Most of the screen asks for the same few pages
+	sorted.assign(feedback, feedback + count);
+	std::sort(sorted.begin(), sorted.end());
+	sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+
+	for (uint32_t request : sorted)
+	{
+		if (request == NO_REQUEST)
+		{
+			break;
+		}
+
+		const uint32_t id = requestTexture(request);
+		const uint32_t level = requestLevel(request);
+		const uint32_t pageX = requestPageX(request);
+		const uint32_t pageY = requestPageY(request);
+		if (id >= textures.size() || !textures[id].live || level >= static_cast<uint32_t>(textures[id].levelCount) ||
+			pageX >= static_cast<uint32_t>(gridSize(textures[id].pagesX, level)) || pageY >= static_cast<uint32_t>(gridSize(textures[id].pagesY, level)))
+		{
+			continue;
+		}
+
+		// The page and every coarser one covering it, the shader samples the finest resident of them
+		for (uint32_t coarser = level; coarser < static_cast<uint32_t>(textures[id].levelCount); ++coarser)
+		{
+			const int32_t slot = pageSlot(packRequest(id, coarser, pageX >> (coarser - level), pageY >> (coarser - level)));
+			if (slot >= 0 && slots[slot].loaded)
+			{
+				slots[slot].lastUsed = frame;
+			}
+		}
+
+		if (pageSlot(request) < 0)
+		{
+			requests.push_back(request);
+		}
+		// Only missing when the cache was full as the texture was added
+		if (pageSlot(tailRequest(id)) < 0)
+		{
+			requests.push_back(tailRequest(id));
+		}
+	}
+
+	// Coarse pages first, each covers more of what is missing
+	std::sort(requests.begin(), requests.end(), [](uint32_t a, uint32_t b)
+	{
+		return requestLevel(a) != requestLevel(b) ? requestLevel(a) > requestLevel(b) : a < b;
+	});
+	requests.erase(std::unique(requests.begin(), requests.end()), requests.end());
+}
+
+int VirtualPageCache::allocate(uint32_t request, bool pinned)
+{
+	int chosen = -1;
+	for (int slot = 0; slot < static_cast<int>(slots.size()); ++slot)
+	{
+		if (slots[slot].texture < 0)
+		{
+			chosen = slot;
+			break;
+		}
+	}
+
+	if (chosen < 0)
+	{
+		for (int slot = 0; slot < static_cast<int>(slots.size()); ++slot)
+		{
+			const Slot& candidate = slots[slot];
+			if (!candidate.loaded || candidate.pinned || candidate.lastUsed >= frame)
+			{
+				continue;
+			}
+			if (chosen < 0 || candidate.lastUsed < slots[chosen].lastUsed)
+			{
+				chosen = slot;
+			}
+		}
+		if (chosen < 0)
+		{
+			return -1;
+		}
+		release(chosen);
+	}
+
+	Slot& slot = slots[chosen];
+	slot.texture = static_cast<int32_t>(requestTexture(request));
+	slot.request = request;
+	++slot.generation;
+	slot.lastUsed = frame;
+	slot.loaded = false;
+	slot.pinned = pinned;
+	pageSlot(request) = chosen;
+	return chosen;
+}
+
+bool VirtualPageCache::commit(int slot, uint32_t generation)
+{
+	Slot& target = slots[slot];
+	if (target.texture < 0 || target.generation != generation || target.loaded)
+	{
+		return false;
+	}
+	target.loaded = true;
+	textures[target.texture].dirty = true;
+	return true;
+}
+
+void VirtualPageCache::release(int slot)
+{
+	Slot& target = slots[slot];
+	pageSlot(target.request) = -1;
+	if (target.loaded)
+	{
+		textures[target.texture].dirty = true;
+	}
+	target.texture = -1;
+	target.loaded = false;
+	target.pinned = false;
+}
+
+bool VirtualPageCache::buildTable(int id)
+{
+	Texture& texture = textures[id];
+	if (!texture.dirty)
+	{
+		return false;
+	}
+
+	// Coarsest first, pages that are not resident take the entry of the page above them
+	for (int level = texture.levelCount - 1; level >= 0; --level)
+	{
+		const int gridX = gridSize(texture.pagesX, level);
+		const int gridY = gridSize(texture.pagesY, level);
+		const int parentGridX = gridSize(texture.pagesX, level + 1);
+		for (int y = 0; y < gridY; ++y)
+		{
+			for (int x = 0; x < gridX; ++x)
+			{
+				const size_t page = static_cast<size_t>(y) * gridX + x;
+				const int32_t slot = texture.pageSlots[level][page];
+				if (slot >= 0 && slots[slot].loaded)
+				{
+					texture.table[level][page] = packEntry(slot % slotsX, slot / slotsX, level);
+				}
+				else if (level + 1 < texture.levelCount)
+				{
+					texture.table[level][page] = texture.table[level + 1][static_cast<size_t>(y >> 1) * parentGridX + (x >> 1)];
+				}
+				else
+				{
+					texture.table[level][page] = 0;
+				}
+			}
+		}
+	}
+	texture.dirty = false;
+	return true;
+}
+
+void CutVirtualPage(const MipChain& chain, uint32_t request, uint8_t* rgba)
+{
+	const int level = static_cast<int>(VirtualPageCache::requestLevel(request)) - chain.firstLevel;
+	const int width = chain.sizes[level].x;
+	const int height = chain.sizes[level].y;
+	const int channels = chain.channels;
+	const uint8_t* pixels = chain.levels[level].data();
+	const int originX = static_cast<int>(VirtualPageCache::requestPageX(request)) * VirtualPageCache::PAGE_SIZE;
+	const int originY = static_cast<int>(VirtualPageCache::requestPageY(request)) * VirtualPageCache::PAGE_SIZE;
+
+	for (int y = 0; y < VirtualPageCache::PAGE_SIZE; ++y)
+	{
+		const int sourceY = std::min(originY + y, height - 1);
+		for (int x = 0; x < VirtualPageCache::PAGE_SIZE; ++x)
+		{
+			const int sourceX = std::min(originX + x, width - 1);
+			const uint8_t* source = pixels + (static_cast<size_t>(sourceY) * width + sourceX) * channels;
+			uint8_t* target = rgba + (static_cast<size_t>(y) * VirtualPageCache::PAGE_SIZE + x) * 4;
+
+			// Grey and grey-alpha images spread over the colour channels
+			target[0] = source[0];
+			target[1] = channels >= 3 ? source[1] : source[0];
+			target[2] = channels >= 3 ? source[2] : source[0];
+			target[3] = channels == 4 ? source[3] : channels == 2 ? source[1] : 255;
+		}
+	}
+}
+
+void VirtualTextureSystem::init(int slotsX, int slotsY)
+{
+	cache.init(slotsX, slotsY);
+
+	glCreateTextures(GL_TEXTURE_2D, 1, &physical);
+	glTextureStorage2D(physical, 1, GL_SRGB8_ALPHA8, slotsX * VirtualPageCache::PAGE_SIZE, slotsY * VirtualPageCache::PAGE_SIZE);
+	glTextureParameteri(physical, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTextureParameteri(physical, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTextureParameteri(physical, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTextureParameteri(physical, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+}
+
+void VirtualTextureSystem::shutdown()
+{
+	if (pending.valid())
+	{
+		pending.wait();
+	}
+
+	for (Readback& readback : readbacks)
+	{
+		if (readback.fence)
+		{
+			glDeleteSync(readback.fence);
+		}
+		if (readback.buffer)
+		{
+			glDeleteBuffers(1, &readback.buffer);
+		}
+		readback = Readback{};
+	}
+	glState.deleteTextures(1, &feedback);
+	glState.deleteTextures(1, &physical);
+	feedback = 0;
+	physical = 0;
+}
+
+uint32_t VirtualTextureSystem::upload(DecodedTexture& decoded, int& virtualId)
+{
+	virtualId = -1;
+	if (!physical || !decoded.data)
+	{
+		return 0;
+	}
+
+	virtualId = cache.addTexture(decoded.width, decoded.height);
+	if (virtualId < 0)
+	{
+		std::cout << "Virtual texture cache cannot page a " << decoded.width << "x" << decoded.height << " image, uploading it whole" << std::endl;
+		return 0;
+	}
+
+	const VirtualPageCache::Texture& texture = cache.textures[virtualId];
+	auto chain = std::make_shared<const MipChain>(BuildMipChain(decoded, 0, texture.levelCount - 1));
+	stbi_image_free(decoded.data);
+	decoded.data = nullptr;
+
+	// One texel per page, integer textures only filter with GL_NEAREST
+	uint32_t indirection;
+	glCreateTextures(GL_TEXTURE_2D, 1, &indirection);
+	glTextureStorage2D(indirection, texture.levelCount, GL_RGBA8UI, texture.pagesX, texture.pagesY);
+	glTextureParameteri(indirection, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTextureParameteri(indirection, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	if (static_cast<size_t>(virtualId) >= chains.size())
+	{
+		chains.resize(virtualId + 1);
+		indirections.resize(virtualId + 1, 0);
+	}
+	chains[virtualId] = chain;
+	indirections[virtualId] = indirection;
+
+	// The tail is drawn until the feedback asks for more
+	const uint32_t tail = cache.tailRequest(virtualId);
+	const int slot = cache.allocate(tail, true);
+	if (slot >= 0)
+	{
+		std::vector<uint8_t> rgba(VirtualPageCache::PAGE_SIZE * VirtualPageCache::PAGE_SIZE * 4);
+		CutVirtualPage(*chain, tail, rgba.data());
+		uploadPage(slot, rgba.data());
+		cache.commit(slot, cache.slots[slot].generation);
+	}
+	cache.buildTable(virtualId);
+	uploadTable(virtualId);
+	return indirection;
+}
+
+void VirtualTextureSystem::release(int virtualId)
+{
+	cache.removeTexture(virtualId);
+	chains[virtualId].reset();
+	indirections[virtualId] = 0;
+}
+
+void VirtualTextureSystem::update()
+{
+	if (!physical)
+	{
+		return;
+	}
+
+	++frame;
+	cache.beginFrame();
+	finishLoads();
+	readFeedback();
+	startLoads();
+	requests.clear();
+	updateTables();
+}
+
+void VirtualTextureSystem::beginFeedback(Shader& shader, int renderWidth, int renderHeight)
+{
+	if (!physical)
+	{
+		shader.setInt("vtFeedbackScale", 0);
+		return;
+	}
+
+	const int width = (renderWidth + FEEDBACK_SCALE - 1) / FEEDBACK_SCALE;
+	const int height = (renderHeight + FEEDBACK_SCALE - 1) / FEEDBACK_SCALE;
+	if (width != feedbackWidth || height != feedbackHeight)
+	{
+		glState.deleteTextures(1, &feedback);
+		glCreateTextures(GL_TEXTURE_2D, 1, &feedback);
+		glTextureStorage2D(feedback, 1, GL_R32UI, width, height);
+		feedbackWidth = width;
+		feedbackHeight = height;
+
+		// Readbacks of the old size are dropped
+		for (Readback& readback : readbacks)
+		{
+			if (readback.fence)
+			{
+				glDeleteSync(readback.fence);
+				readback.fence = nullptr;
+			}
+			if (!readback.buffer)
+			{
+				glCreateBuffers(1, &readback.buffer);
+			}
+			glNamedBufferData(readback.buffer, static_cast<GLsizeiptr>(width) * height * sizeof(uint32_t), nullptr, GL_STREAM_READ);
+		}
+	}
+
+	const uint32_t noRequest = VirtualPageCache::NO_REQUEST;
+	glClearTexImage(feedback, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, &noRequest);
+	glBindImageTexture(FEEDBACK_IMAGE_UNIT, feedback, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32UI);
+	countedBindTextureUnit(PHYSICAL_UNIT, physical);
+
+	// A different pixel of every block each frame, 7 is coprime to the block size so all of them come round
+	const int jitter = static_cast<int>((frame * 7) % (FEEDBACK_SCALE * FEEDBACK_SCALE));
+	shader.setInt("vtFeedbackScale", FEEDBACK_SCALE);
+	shader.setIVec2("vtFeedbackOffset", glm::ivec2(jitter % FEEDBACK_SCALE, jitter / FEEDBACK_SCALE));
+	shader.setVec2("vtPhysicalSize", glm::vec2(cache.slotsX, cache.slotsY) * static_cast<float>(VirtualPageCache::PAGE_SIZE));
+	feedbackActive = true;
+}
+
+void VirtualTextureSystem::endFeedback()
+{
+	if (!feedbackActive)
+	{
+		return;
+	}
+	feedbackActive = false;
+
+	// Copied into the oldest buffer of the ring, mapped READBACK_FRAMES frames later so nothing stalls
+	glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT | GL_PIXEL_BUFFER_BARRIER_BIT);
+	Readback& readback = readbacks[readbackIndex];
+	if (readback.fence)
+	{
+		glDeleteSync(readback.fence);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+	glGetTextureImage(feedback, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, static_cast<GLsizei>(feedbackWidth * feedbackHeight * sizeof(uint32_t)), nullptr);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	readbackIndex = (readbackIndex + 1) % READBACK_FRAMES;
+}
+
+void VirtualTextureSystem::bindTexture(Shader& shader, uint32_t indirection, int virtualId) const
+{
+	const VirtualPageCache::Texture& texture = cache.textures[virtualId];
+	countedBindTextureUnit(INDIRECTION_UNIT, indirection);
+	shader.setInt("vtTexture", virtualId);
+	shader.setVec2("vtSize", glm::vec2(texture.width, texture.height));
+	shader.setInt("vtLevels", texture.levelCount);
+}
+
+int VirtualTextureSystem::residentPages() const
+{
+	int resident = 0;
+	for (const VirtualPageCache::Slot& slot : cache.slots)
+	{
+		resident += slot.loaded ? 1 : 0;
+	}
+	return resident;
+}
+
+void VirtualTextureSystem::uploadPage(int slot, const uint8_t* rgba)
+{
+	glTextureSubImage2D(physical, 0, (slot % cache.slotsX) * VirtualPageCache::PAGE_SIZE, (slot / cache.slotsX) * VirtualPageCache::PAGE_SIZE,
+		VirtualPageCache::PAGE_SIZE, VirtualPageCache::PAGE_SIZE, GL_RGBA, GL_UNSIGNED_BYTE, rgba);
+}
+
+void VirtualTextureSystem::uploadTable(int virtualId)
+{
+	const VirtualPageCache::Texture& texture = cache.textures[virtualId];
+	for (int level = 0; level < texture.levelCount; ++level)
+	{
+		glTextureSubImage2D(indirections[virtualId], level, 0, 0,
+			VirtualPageCache::gridSize(texture.pagesX, level), VirtualPageCache::gridSize(texture.pagesY, level),
+			GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, texture.table[level].data());
+	}
+}
+
+void VirtualTextureSystem::finishLoads()
+{
+	if (!pending.valid() || pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+	{
+		return;
+	}
+
+	for (const LoadedPage& page : pending.get())
+	{
+		// Dropped when its texture was released while it loaded
+		if (cache.commit(page.slot, page.generation))
+		{
+			uploadPage(page.slot, page.rgba.data());
+		}
+	}
+}
+
+void VirtualTextureSystem::readFeedback()
+{
+	Readback& oldest = readbacks[readbackIndex];
+	if (!oldest.fence)
+	{
+		return;
+	}
+	const GLenum status = glClientWaitSync(oldest.fence, 0, 0);
+	if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+	{
+		return;
+	}
+	glDeleteSync(oldest.fence);
+	oldest.fence = nullptr;
+
+	feedbackWords.resize(static_cast<size_t>(feedbackWidth) * feedbackHeight);
+	glGetNamedBufferSubData(oldest.buffer, 0, static_cast<GLsizeiptr>(feedbackWords.size() * sizeof(uint32_t)), feedbackWords.data());
+	cache.analyse(feedbackWords.data(), feedbackWords.size(), requests);
+	requestCount = requests.size();
+}
+
+void VirtualTextureSystem::startLoads()
+{
+	if (pending.valid() || requests.empty())
+	{
+		return;
+	}
+
+	struct PageLoad
+	{
+		int slot;
+		uint32_t generation;
+		uint32_t request;
+		std::shared_ptr<const MipChain> chain;
+	};
+
+	std::vector<PageLoad> loads;
+	for (uint32_t request : requests)
+	{
+		if (static_cast<int>(loads.size()) == maxUploadsPerFrame)
+		{
+			break;
+		}
+		const int slot = cache.allocate(request);
+		if (slot < 0)
+		{
+			break;
+		}
+		loads.push_back({ slot, cache.slots[slot].generation, request, chains[VirtualPageCache::requestTexture(request)] });
+	}
+	if (loads.empty())
+	{
+		return;
+	}
+
+	pending = std::async(std::launch::async, [loads = std::move(loads)]()
+	{
+		std::vector<LoadedPage> pages;
+		pages.reserve(loads.size());
+		for (const PageLoad& load : loads)
+		{
+			LoadedPage page{ load.slot, load.generation, std::vector<uint8_t>(VirtualPageCache::PAGE_SIZE * VirtualPageCache::PAGE_SIZE * 4) };
+			CutVirtualPage(*load.chain, load.request, page.rgba.data());
+			pages.push_back(std::move(page));
+		}
+		return pages;
+	});
+}
+
+void VirtualTextureSystem::updateTables()
+{
+	for (size_t id = 0; id < indirections.size(); ++id)
+	{
+		if (indirections[id] && cache.buildTable(static_cast<int>(id)))
+		{
+			uploadTable(static_cast<int>(id));
+		}
+	}
+}
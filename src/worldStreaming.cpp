@@ -0,0 +1,235 @@
+#include <glad/glad.h>
+
+#include "worldStreaming.hpp"
+#include "model.hpp"
+#include "modelLibrary.hpp"
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+namespace
+{
+	uint64_t PackCoord(glm::ivec2 coord)
+	{
+		return (static_cast<uint64_t>(static_cast<uint32_t>(coord.x)) << 32) | static_cast<uint32_t>(coord.y);
+	}
+}
+
+void WorldStreamer::addObject(const std::string& folder, const std::string& path, const Transform& transform)
+{
+	auto [source, newSource] = sourceLookup.try_emplace(folder, static_cast<uint32_t>(sources.size()));
+	if (newSource)
+	{
+		Source& added = sources.emplace_back();
+		added.folder = folder;
+		added.path = path;
+	}
+
+	const glm::ivec2 coord(static_cast<int>(std::floor(transform.position.x / cellSize)), static_cast<int>(std::floor(transform.position.z / cellSize)));
+	auto [cellIndex, newCell] = cellLookup.try_emplace(PackCoord(coord), static_cast<uint32_t>(cells.size()));
+	if (newCell)
+	{
+		cells.emplace_back().coord = coord;
+	}
+
+	Cell& cell = cells[cellIndex->second];
+	cell.objects.push_back({ source->second, transform });
+	if (std::find(cell.sources.begin(), cell.sources.end(), source->second) == cell.sources.end())
+	{
+		cell.sources.push_back(source->second);
+	}
+	++objects;
+}
+
+void WorldStreamer::clear(Scene& scene, ModelLibrary& library)
+{
+	for (Cell& cell : cells)
+	{
+		unload(cell, scene, library);
+	}
+
+	// Models that never reached the library still hold decoded pixels and possibly some GL objects
+	for (Source& source : sources)
+	{
+		if (source.import.valid())
+		{
+			source.uploading = source.import.get();
+		}
+		if (source.uploading)
+		{
+			source.uploading->release();
+		}
+	}
+
+	cells.clear();
+	cellLookup.clear();
+	sources.clear();
+	sourceLookup.clear();
+	objects = 0;
+}
+
+void WorldStreamer::update(Scene& scene, ModelLibrary& library, const glm::vec3& eye)
+{
+	if (!enabled)
+	{
+		return;
+	}
+
+	PROFILE_ZONE("World Streaming");
+	finishImports(scene, library);
+
+	loading.clear();
+	for (uint32_t i = 0; i < cells.size(); ++i)
+	{
+		Cell& cell = cells[i];
+		const float cellDistance = distance(cell, eye);
+		if (cell.state == CellState::UNLOADED && cellDistance <= loadRadius)
+		{
+			cell.state = CellState::LOADING;
+		}
+		else if (cell.state != CellState::UNLOADED && cellDistance > loadRadius + hysteresis)
+		{
+			unload(cell, scene, library);
+		}
+
+		if (cell.state == CellState::LOADING)
+		{
+			loading.push_back({ cellDistance, i });
+		}
+	}
+
+	// Nearest cells claim the import slots first
+	std::sort(loading.begin(), loading.end());
+	for (const auto& [cellDistance, index] : loading)
+	{
+		Cell& cell = cells[index];
+		if (requestSources(cell, library))
+		{
+			instantiate(cell, scene, library);
+		}
+	}
+}
+
+size_t WorldStreamer::cellsIn(CellState state) const
+{
+	return static_cast<size_t>(std::count_if(cells.begin(), cells.end(), [state](const Cell& cell) { return cell.state == state; }));
+}
+
+int WorldStreamer::pendingImports() const
+{
+	return static_cast<int>(std::count_if(sources.begin(), sources.end(), [](const Source& source) { return source.import.valid(); }));
+}
+
+float WorldStreamer::distance(const Cell& cell, const glm::vec3& eye) const
+{
+	// To the nearest point of the cell's square, height is ignored
+	const glm::vec2 minCorner = glm::vec2(cell.coord) * cellSize;
+	const glm::vec2 nearest = glm::clamp(glm::vec2(eye.x, eye.z), minCorner, minCorner + cellSize);
+	return glm::length(glm::vec2(eye.x, eye.z) - nearest);
+}
+
+void WorldStreamer::finishImports(Scene& scene, ModelLibrary& library)
+{
+	for (Source& source : sources)
+	{
+		if (source.import.valid() && source.import.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+		{
+			source.uploading = source.import.get();
+		}
+	}
+
+	size_t budget = uploadBudgetBytes;
+	for (Source& source : sources)
+	{
+		if (!source.uploading || budget == 0)
+		{
+			continue;
+		}
+
+		// Loaded through the library in the meantime, e.g. added from the UI
+		if (library.find(source.folder) != ModelLibrary::NOT_RESIDENT)
+		{
+			source.uploading->release();
+			source.uploading.reset();
+			continue;
+		}
+
+		if (source.uploading->uploadStep(budget))
+		{
+			library.adopt(scene, source.folder, std::move(source.uploading));
+			source.uploading.reset();
+		}
+	}
+}
+
+bool WorldStreamer::requestSources(Cell& cell, ModelLibrary& library)
+{
+	bool resident = true;
+	for (uint32_t index : cell.sources)
+	{
+		Source& source = sources[index];
+		if (library.find(source.folder) != ModelLibrary::NOT_RESIDENT)
+		{
+			if (std::find(cell.pinned.begin(), cell.pinned.end(), index) == cell.pinned.end())
+			{
+				library.pin(source.folder);
+				cell.pinned.push_back(index);
+			}
+			continue;
+		}
+
+		resident = false;
+		if (source.import.valid() || source.uploading || pendingImports() >= maxPendingImports)
+		{
+			continue;
+		}
+
+		// Import and texture decode only, uploadStep does the GL side over the next frames
+		std::cout << "Streaming in model: " << source.folder << std::endl;
+		source.import = std::async(std::launch::async, [path = source.path, folder = source.folder]()
+		{
+			return std::make_shared<Model>(path, false, folder, false);
+		});
+	}
+	return resident;
+}
+
+void WorldStreamer::instantiate(Cell& cell, Scene& scene, ModelLibrary& library)
+{
+	cell.entities.reserve(cell.objects.size());
+	for (const Object& object : cell.objects)
+	{
+		const Source& source = sources[object.source];
+		cell.entities.push_back(scene.create(library.find(source.folder), source.folder, object.transform));
+	}
+	// The entities keep the models resident from here on
+	releasePins(cell, library);
+	cell.state = CellState::LOADED;
+}
+
+void WorldStreamer::unload(Cell& cell, Scene& scene, ModelLibrary& library)
+{
+	// The UI can remove entities of a loaded cell
+	for (EntityHandle handle : cell.entities)
+	{
+		if (scene.isValid(handle))
+		{
+			scene.destroy(handle);
+		}
+	}
+	cell.entities.clear();
+	releasePins(cell, library);
+	cell.state = CellState::UNLOADED;
+}
+
+void WorldStreamer::releasePins(Cell& cell, ModelLibrary& library)
+{
+	for (uint32_t index : cell.pinned)
+	{
+		library.unpin(sources[index].folder);
+	}
+	cell.pinned.clear();
+}